@@ -34,7 +34,8 @@ void LineInfo::Clear()
 {
   if (m_pcLine != nullptr)
     {
-      delete[] m_pcLine;
+      if (!IsShared())
+        delete[] m_pcLine;
       m_pcLine = nullptr;
       m_nLength = 0;
       m_nMax = 0;
@@ -52,7 +53,8 @@ void LineInfo::FreeBuffer()
 {
   if (m_pcLine != nullptr)
     {
-      delete[] m_pcLine;
+      if (!IsShared())
+        delete[] m_pcLine;
       m_pcLine = nullptr;
       m_nLength = 0;
       m_nMax = 0;
@@ -74,12 +76,12 @@ void LineInfo::Create(LPCTSTR pszLine, size_t nLength)
     }
 
   ASSERT (nLength <= INT_MAX);		// assert "positive int"
+  if (m_pcLine != nullptr && !IsShared())
+    delete[] m_pcLine;
   m_nLength = nLength;
   m_nMax = ALIGN_BUF_SIZE (m_nLength + 1);
   ASSERT (m_nMax < INT_MAX);
   ASSERT (m_nMax >= m_nLength + 1);
-  if (m_pcLine != nullptr)
-    delete[] m_pcLine;
   m_pcLine = new TCHAR[m_nMax];
   ZeroMemory(m_pcLine, m_nMax * sizeof(TCHAR));
   const size_t dwLen = sizeof (TCHAR) * m_nLength;
@@ -96,16 +98,41 @@ void LineInfo::Create(LPCTSTR pszLine, size_t nLength)
   m_nEolChars = nEols;
 }
 
+/**
+ * @brief Create a line on data in a buffer shared with other lines.
+ * The data is not copied until the line grows, so the buffer must
+ * stay until the line is cleared.
+ * @param [in] pcLine Line data, followed by a zero.
+ * @param [in] nLength Line length.
+ */
+void LineInfo::CreateShared(TCHAR *pcLine, size_t nLength)
+{
+  ASSERT (nLength <= INT_MAX);		// assert "positive int"
+  ASSERT (pcLine[nLength] == '\0');
+  if (m_pcLine != nullptr && !IsShared())
+    delete[] m_pcLine;
+  m_pcLine = pcLine;
+  m_nMax = 0;
+
+  int nEols = 0;
+  if (nLength > 1 && IsDosEol(&pcLine[nLength - 2]))
+    nEols = 2;
+  else if (nLength && IsEol(pcLine[nLength - 1]))
+    nEols = 1;
+  m_nLength = nLength - nEols;
+  m_nEolChars = nEols;
+}
+
 /**
  * @brief Create an empty line.
  */
 void LineInfo::CreateEmpty()
 {
+  if (m_pcLine != nullptr && !IsShared())
+    delete [] m_pcLine;
   m_nLength = 0;
   m_nEolChars = 0;
   m_nMax = ALIGN_BUF_SIZE (m_nLength + 1);
-  if (m_pcLine != nullptr)
-    delete [] m_pcLine;
   m_pcLine = new TCHAR[m_nMax];
   ZeroMemory(m_pcLine, m_nMax * sizeof(TCHAR));
 }
@@ -121,13 +148,15 @@ void LineInfo::Append(LPCTSTR pszChars, size_t nLength)
   size_t nBufNeeded = m_nLength + nLength + 1;
   if (nBufNeeded > m_nMax)
     {
+      const bool bShared = IsShared();
       m_nMax = ALIGN_BUF_SIZE (nBufNeeded);
 	  ASSERT (m_nMax < INT_MAX);
       ASSERT (m_nMax >= m_nLength + nLength);
       TCHAR *pcNewBuf = new TCHAR[m_nMax];
       if (FullLength() > 0)
         memcpy (pcNewBuf, m_pcLine, sizeof (TCHAR) * (FullLength() + 1));
-      delete[] m_pcLine;
+      if (!bShared)
+        delete[] m_pcLine;
       m_pcLine = pcNewBuf;
     }
 
@@ -191,12 +220,14 @@ bool LineInfo::ChangeEol(LPCTSTR lpEOL)
   ASSERT (nBufNeeded < INT_MAX);
   if (nBufNeeded > m_nMax)
     {
+      const bool bShared = IsShared();
       m_nMax = ALIGN_BUF_SIZE (nBufNeeded);
       ASSERT (m_nMax >= nBufNeeded);
       TCHAR *pcNewBuf = new TCHAR[m_nMax];
       if (FullLength() > 0)
         memcpy (pcNewBuf, m_pcLine, sizeof (TCHAR) * (FullLength() + 1));
-      delete[] m_pcLine;
+      if (!bShared)
+        delete[] m_pcLine;
       m_pcLine = pcNewBuf;
     }
   
@@ -255,10 +286,12 @@ void LineInfo::DeleteEnd(size_t nStartChar)
  */
 void LineInfo::CopyFrom(const LineInfo &li)
 {
-  if (m_pcLine != nullptr)
+  if (m_pcLine != nullptr && !IsShared())
     delete [] m_pcLine;
-  m_pcLine = new TCHAR[li.m_nMax];
-  memcpy(m_pcLine, li.m_pcLine, li.m_nMax * sizeof(TCHAR));
+  const size_t nMax = li.IsShared() ? li.FullLength() + 1 : li.m_nMax;
+  m_pcLine = new TCHAR[nMax];
+  m_nMax = nMax;
+  memcpy(m_pcLine, li.m_pcLine, nMax * sizeof(TCHAR));
 }
 
 /**
@@ -27,6 +27,7 @@ public:
     void Clear();
     void FreeBuffer();
     void Create(LPCTSTR pszLine, size_t nLength);
+    void CreateShared(TCHAR *pcLine, size_t nLength);
     void CreateEmpty();
     void Append(LPCTSTR pszChars, size_t nLength);
     void Delete(size_t nStartChar, size_t nEndChar);
@@ -56,8 +57,11 @@ public:
     };
 
 private:
+    /** @brief Is the line data in a buffer shared with other lines? */
+    bool IsShared() const { return m_pcLine != nullptr && m_nMax == 0; }
+
     TCHAR *m_pcLine; /**< Line data. */
-    size_t m_nMax; /**< Allocated space for line data. */
+    size_t m_nMax; /**< Allocated space for line data, 0 if data is shared. */
     size_t m_nLength; /**< Line length (without EOL bytes). */
     int m_nEolChars; /**< # of EOL bytes. */
   };
@@ -0,0 +1,331 @@
+/**
+ * @file  LineTree.cpp
+ *
+ * @brief Implementation of LineTree class.
+ */
+
+#include "stdafx.h"
+#include "LineTree.h"
+#include <algorithm>
+#include <iterator>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+/**
+ * @brief Node of the tree: a leaf holding lines, or a node holding nodes.
+ */
+struct LineTree::Node
+  {
+    Node() : nLines(0) {}
+
+    /** @brief Does the node hold lines? */
+    bool IsLeaf() const { return aChildren.empty(); }
+    /** @brief Return number of lines or of children held. */
+    size_t Count() const { return IsLeaf() ? aLines.size() : aChildren.size(); }
+    /** @brief Has the node too few lines or children to stand alone? */
+    bool IsSmall() const { return Count() < (IsLeaf() ? MaxLeafLines : MaxChildren) / 4; }
+
+    size_t nLines; /**< Lines in the subtree. */
+    std::vector<LineInfo> aLines; /**< Lines of a leaf. */
+    NodeList aChildren; /**< Children of a node, empty for a leaf. */
+  };
+
+/**
+ * @brief Constructor.
+ */
+LineTree::LineTree()
+: m_pRoot(new Node)
+{
+  ForgetLeaves();
+}
+
+LineTree::~LineTree()
+{
+}
+
+/**
+ * @brief Return number of lines.
+ */
+size_t LineTree::size() const
+{
+  return m_pRoot->nLines;
+}
+
+/**
+ * @brief Are there no lines?
+ */
+bool LineTree::empty() const
+{
+  return m_pRoot->nLines == 0;
+}
+
+/**
+ * @brief Find the leaf holding a line.
+ * The leaf is remembered, with the index of its first line: though const,
+ * this changes the tree, which is why one thread at a time may read it.
+ */
+const LineTree::CachedLeaf & LineTree::FindLeaf(size_t nLine) const
+{
+  ASSERT (nLine < size());
+  for (int i = 0; i < 2; i++)
+    {
+      const CachedLeaf & cached = m_aCachedLeaves[i];
+      if (cached.pLeaf != nullptr && nLine >= cached.nFirst &&
+          nLine - cached.nFirst < cached.pLeaf->nLines)
+        {
+          if (i > 0)
+            std::swap(m_aCachedLeaves[0], m_aCachedLeaves[1]);
+          return m_aCachedLeaves[0];
+        }
+    }
+
+  Node * pNode = m_pRoot.get();
+  size_t nFirst = 0;
+  while (!pNode->IsLeaf())
+    {
+      size_t k = 0;
+      while (nLine - nFirst >= pNode->aChildren[k]->nLines)
+        nFirst += pNode->aChildren[k++]->nLines;
+      pNode = pNode->aChildren[k].get();
+    }
+  m_aCachedLeaves[1] = m_aCachedLeaves[0];
+  m_aCachedLeaves[0].pLeaf = pNode;
+  m_aCachedLeaves[0].nFirst = nFirst;
+  return m_aCachedLeaves[0];
+}
+
+/**
+ * @brief Forget the leaves found, before the tree changes.
+ */
+void LineTree::ForgetLeaves()
+{
+  for (CachedLeaf & cached : m_aCachedLeaves)
+    {
+      cached.pLeaf = nullptr;
+      cached.nFirst = 0;
+    }
+}
+
+/**
+ * @brief Return a line.
+ */
+LineInfo & LineTree::operator[] (size_t nLine)
+{
+  const CachedLeaf & cached = FindLeaf(nLine);
+  return cached.pLeaf->aLines[nLine - cached.nFirst];
+}
+
+/**
+ * @brief Return a line.
+ */
+const LineInfo & LineTree::operator[] (size_t nLine) const
+{
+  const CachedLeaf & cached = FindLeaf(nLine);
+  return cached.pLeaf->aLines[nLine - cached.nFirst];
+}
+
+/**
+ * @brief Split a node holding too many lines or children.
+ * The node keeps the first part, the others are added to @p aSplit.
+ */
+void LineTree::Split(Node * pNode, NodeList & aSplit)
+{
+  const size_t nMax = pNode->IsLeaf() ? MaxLeafLines : MaxChildren;
+  const size_t nCount = pNode->Count();
+  if (nCount <= nMax)
+    return;
+
+  const size_t nParts = (nCount + nMax - 1) / nMax;
+  for (size_t p = 1; p < nParts; p++)
+    {
+      const size_t nBegin = nCount * p / nParts;
+      const size_t nEnd = nCount * (p + 1) / nParts;
+      std::unique_ptr<Node> pPart(new Node);
+      if (pNode->IsLeaf())
+        {
+          pPart->aLines.assign(pNode->aLines.begin() + nBegin, pNode->aLines.begin() + nEnd);
+          pPart->nLines = nEnd - nBegin;
+        }
+      else
+        {
+          for (size_t k = nBegin; k < nEnd; k++)
+            {
+              pPart->nLines += pNode->aChildren[k]->nLines;
+              pPart->aChildren.push_back(std::move(pNode->aChildren[k]));
+            }
+        }
+      pNode->nLines -= pPart->nLines;
+      aSplit.push_back(std::move(pPart));
+    }
+  if (pNode->IsLeaf())
+    pNode->aLines.resize(nCount / nParts);
+  else
+    pNode->aChildren.resize(nCount / nParts);
+}
+
+/**
+ * @brief Merge a small child of a node with its neighbour.
+ * The merged node is split again if it got too big.
+ */
+void LineTree::Merge(Node * pNode, size_t nChild)
+{
+  if (pNode->aChildren.size() < 2 || !pNode->aChildren[nChild]->IsSmall())
+    return;
+
+  const size_t nLeft = nChild > 0 ? nChild - 1 : nChild;
+  Node * pLeft = pNode->aChildren[nLeft].get();
+  Node * pRight = pNode->aChildren[nLeft + 1].get();
+  pLeft->nLines += pRight->nLines;
+  if (pLeft->IsLeaf())
+    pLeft->aLines.insert(pLeft->aLines.end(), pRight->aLines.begin(), pRight->aLines.end());
+  else
+    std::move(pRight->aChildren.begin(), pRight->aChildren.end(), std::back_inserter(pLeft->aChildren));
+  pNode->aChildren.erase(pNode->aChildren.begin() + nLeft + 1);
+
+  NodeList aSplit;
+  Split(pLeft, aSplit);
+  pNode->aChildren.insert(pNode->aChildren.begin() + nLeft + 1,
+      std::make_move_iterator(aSplit.begin()), std::make_move_iterator(aSplit.end()));
+}
+
+/**
+ * @brief Insert copies of a line in a subtree.
+ * @param [out] aSplit Nodes split from @p pNode, to add after it.
+ */
+void LineTree::Insert(Node * pNode, size_t nPosition, size_t nCount, const LineInfo & li, NodeList & aSplit)
+{
+  pNode->nLines += nCount;
+  if (pNode->IsLeaf())
+    {
+      pNode->aLines.insert(pNode->aLines.begin() + nPosition, nCount, li);
+    }
+  else
+    {
+      size_t k = 0;
+      while (k + 1 < pNode->aChildren.size() && nPosition > pNode->aChildren[k]->nLines)
+        nPosition -= pNode->aChildren[k++]->nLines;
+      NodeList aChildSplit;
+      Insert(pNode->aChildren[k].get(), nPosition, nCount, li, aChildSplit);
+      pNode->aChildren.insert(pNode->aChildren.begin() + k + 1,
+          std::make_move_iterator(aChildSplit.begin()), std::make_move_iterator(aChildSplit.end()));
+    }
+  Split(pNode, aSplit);
+}
+
+/**
+ * @brief Insert copies of a line.
+ * @param [in] nPosition Index of the first inserted line.
+ * @param [in] nCount Number of lines to insert.
+ * @param [in] li Line to copy: its text is not copied, only the pointer to it.
+ */
+void LineTree::insert(size_t nPosition, size_t nCount, const LineInfo & li)
+{
+  ASSERT (nPosition <= size());
+  if (nCount == 0)
+    return;
+
+  ForgetLeaves();
+  NodeList aSplit;
+  Insert(m_pRoot.get(), nPosition, nCount, li, aSplit);
+  //  The tree grows from the root, so all leaves stay at the same depth
+  while (!aSplit.empty())
+    {
+      std::unique_ptr<Node> pRoot(new Node);
+      pRoot->nLines = m_pRoot->nLines;
+      pRoot->aChildren.push_back(std::move(m_pRoot));
+      for (auto & pNode : aSplit)
+        {
+          pRoot->nLines += pNode->nLines;
+          pRoot->aChildren.push_back(std::move(pNode));
+        }
+      aSplit.clear();
+      m_pRoot = std::move(pRoot);
+      Split(m_pRoot.get(), aSplit);
+    }
+}
+
+/**
+ * @brief Erase a range of lines from a subtree.
+ */
+void LineTree::Erase(Node * pNode, size_t nFirst, size_t nLast)
+{
+  pNode->nLines -= nLast - nFirst;
+  if (pNode->IsLeaf())
+    {
+      pNode->aLines.erase(pNode->aLines.begin() + nFirst, pNode->aLines.begin() + nLast);
+      return;
+    }
+
+  //  Children wholly in the range are dropped, at most two are left
+  //  with some of their lines: merge them if they got small
+  size_t nStart = 0;
+  size_t k = 0;
+  size_t nTouched = SIZE_MAX;
+  while (k < pNode->aChildren.size() && nStart < nLast)
+    {
+      Node * pChild = pNode->aChildren[k].get();
+      const size_t nEnd = nStart + pChild->nLines;
+      if (nEnd > nFirst)
+        {
+          if (nTouched == SIZE_MAX)
+            nTouched = k;
+          const size_t nFrom = (std::max)(nFirst, nStart) - nStart;
+          const size_t nTo = (std::min)(nLast, nEnd) - nStart;
+          if (nFrom == 0 && nTo == pChild->nLines)
+            {
+              pNode->aChildren.erase(pNode->aChildren.begin() + k);
+              nStart = nEnd;
+              continue;
+            }
+          Erase(pChild, nFrom, nTo);
+        }
+      nStart = nEnd;
+      k++;
+    }
+  if (nTouched + 1 < pNode->aChildren.size())
+    Merge(pNode, nTouched + 1);
+  if (nTouched < pNode->aChildren.size())
+    Merge(pNode, nTouched);
+}
+
+/**
+ * @brief Erase a range of lines.
+ * @param [in] nFirst Index of the first line to erase.
+ * @param [in] nLast Index after the last line to erase.
+ */
+void LineTree::erase(size_t nFirst, size_t nLast)
+{
+  ASSERT (nFirst <= nLast && nLast <= size());
+  if (nFirst == nLast)
+    return;
+
+  ForgetLeaves();
+  Erase(m_pRoot.get(), nFirst, nLast);
+  while (m_pRoot->aChildren.size() == 1)
+    {
+      std::unique_ptr<Node> pChild = std::move(m_pRoot->aChildren[0]);
+      m_pRoot = std::move(pChild);
+    }
+}
+
+/**
+ * @brief Add empty lines or erase lines at the end.
+ */
+void LineTree::resize(size_t nSize)
+{
+  if (nSize > size())
+    insert(size(), nSize - size(), LineInfo());
+  else
+    erase(nSize, size());
+}
+
+/**
+ * @brief Erase all lines.
+ */
+void LineTree::clear()
+{
+  m_pRoot.reset(new Node);
+  ForgetLeaves();
+}
@@ -0,0 +1,79 @@
+/**
+ * @file LineTree.h
+ *
+ * @brief Declaration for LineTree class.
+ *
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "LineInfo.h"
+
+/**
+ * @brief Lines of a text buffer, in a balanced tree.
+ *
+ * Lines are kept in leaves of up to MaxLeafLines lines, under nodes of up
+ * to MaxChildren children which know how many lines they hold, all leaves
+ * at the same depth (a B+ tree counted by lines). Finding a line, and
+ * inserting or erasing a range of lines, take O(log n) steps plus the
+ * lines moved in one leaf, instead of moving all the lines after them.
+ * The leaves of the last two lines found are remembered, so going through
+ * the lines one by one, or copying lines down as when compacting them,
+ * costs no more than with an array.
+ *
+ * As with an array of LineInfo, erasing or overwriting a line does not
+ * free its text: call LineInfo::Clear() first.
+ *
+ * A tree must be used by one thread at a time, also when only reading it:
+ * finding a line, even through the const operator[], updates the leaves
+ * remembered. Different trees can be used by different threads.
+ */
+class LineTree
+  {
+public:
+    enum
+      {
+        MaxLeafLines = 256, /**< Most lines in a leaf */
+        MaxChildren = 32 /**< Most children of a node */
+      };
+
+    LineTree();
+    ~LineTree();
+
+    size_t size() const;
+    bool empty() const;
+
+    LineInfo & operator[] (size_t nLine);
+    const LineInfo & operator[] (size_t nLine) const;
+
+    void insert(size_t nPosition, size_t nCount, const LineInfo & li);
+    void erase(size_t nFirst, size_t nLast);
+    void resize(size_t nSize);
+    void clear();
+
+private:
+    struct Node;
+    typedef std::vector<std::unique_ptr<Node>> NodeList;
+
+    /** @brief A leaf found, with the index of its first line. */
+    struct CachedLeaf
+      {
+        Node * pLeaf;
+        size_t nFirst;
+      };
+
+    LineTree(const LineTree &) = delete;
+    LineTree & operator= (const LineTree &) = delete;
+
+    const CachedLeaf & FindLeaf(size_t nLine) const;
+    void ForgetLeaves();
+    static void Insert(Node * pNode, size_t nPosition, size_t nCount, const LineInfo & li, NodeList & aSplit);
+    static void Erase(Node * pNode, size_t nFirst, size_t nLast);
+    static void Split(Node * pNode, NodeList & aSplit);
+    static void Merge(Node * pNode, size_t nChild);
+
+    std::unique_ptr<Node> m_pRoot; /**< Root node, a leaf while there are few lines. */
+    mutable CachedLeaf m_aCachedLeaves[2]; /**< Leaves of the last lines found, the latest first; not thread safe. */
+  };
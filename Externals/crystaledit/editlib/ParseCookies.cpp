@@ -0,0 +1,112 @@
+/**
+ * @file  ParseCookies.cpp
+ *
+ * @brief Implementation of ParseCookies class.
+ */
+
+#include "stdafx.h"
+#include "ParseCookies.h"
+#include <algorithm>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+/**
+ * @brief Constructor.
+ */
+ParseCookies::ParseCookies()
+: m_nValidLines(0)
+{
+}
+
+/**
+ * @brief Forget all cookies, for a text of @p nLines lines.
+ */
+void ParseCookies::Reset(size_t nLines)
+{
+  m_aCookies.assign(nLines, Invalid);
+  m_nValidLines = 0;
+}
+
+/**
+ * @brief Forget all cookies and lines.
+ */
+void ParseCookies::clear()
+{
+  m_aCookies.clear();
+  m_nValidLines = 0;
+}
+
+/**
+ * @brief Store the cookie of the first line whose cookie was not known.
+ * If it is the cookie the line had before, the following lines are valid
+ * again up to the next changed line.
+ */
+void ParseCookies::SetNext(DWORD dwCookie)
+{
+  ASSERT (m_nValidLines < m_aCookies.size());
+  ASSERT (dwCookie != Invalid);
+  DWORD & dwOld = m_aCookies[m_nValidLines];
+  if (dwOld == dwCookie)
+    m_nValidLines = std::find(m_aCookies.begin() + m_nValidLines + 1, m_aCookies.end(), Invalid) - m_aCookies.begin();
+  else
+    {
+      dwOld = dwCookie;
+      m_nValidLines++;
+    }
+}
+
+/**
+ * @brief Make the cookies from a line on not valid.
+ * The cookie of the first line which was valid is not kept, as it may not
+ * follow from the cookie of the line before it.
+ */
+void ParseCookies::Truncate(size_t nLine)
+{
+  if (nLine >= m_nValidLines)
+    return;
+  if (m_nValidLines < m_aCookies.size())
+    m_aCookies[m_nValidLines] = Invalid;
+  m_nValidLines = nLine;
+}
+
+/**
+ * @brief The text of a line changed.
+ */
+void ParseCookies::LineChanged(size_t nLine)
+{
+  ASSERT (nLine < m_aCookies.size());
+  Truncate(nLine);
+  m_aCookies[nLine] = Invalid;
+}
+
+/**
+ * @brief The text of a line changed, and lines were inserted or deleted after it.
+ * @param [in] nLine Changed line.
+ * @param [in] nDelta Number of lines inserted after @p nLine if positive,
+ *  of lines deleted after it if negative.
+ */
+void ParseCookies::LinesChanged(size_t nLine, ptrdiff_t nDelta)
+{
+  Truncate(nLine);
+  if (nDelta > 0)
+    m_aCookies.insert(m_aCookies.begin() + nLine + 1, nDelta, Invalid);
+  else
+    {
+      ASSERT (nLine + 1 - nDelta <= m_aCookies.size());
+      m_aCookies.erase(m_aCookies.begin() + nLine + 1, m_aCookies.begin() + nLine + 1 - nDelta);
+    }
+  ASSERT (nLine < m_aCookies.size());
+  m_aCookies[nLine] = Invalid;
+}
+
+/**
+ * @brief The text of any line from @p nLine on may have changed.
+ */
+void ParseCookies::TextChanged(size_t nLine)
+{
+  ASSERT (nLine < m_aCookies.size());
+  Truncate(nLine);
+  std::fill(m_aCookies.begin() + nLine, m_aCookies.end(), Invalid);
+}
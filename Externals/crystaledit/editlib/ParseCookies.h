@@ -0,0 +1,58 @@
+/**
+ * @file ParseCookies.h
+ *
+ * @brief Declaration for ParseCookies class.
+ *
+ */
+
+#pragma once
+
+#include <vector>
+
+/**
+ * @brief Parse cookies of the lines of a view: the parser state at the end
+ * of each line, which the parsing of the next line starts from.
+ *
+ * The first GetValidLines() cookies are known. The cookies below them are
+ * the ones computed before the text was edited, or Invalid where a line was
+ * changed, inserted or not parsed yet. When parsing goes on and a line gets
+ * the cookie it had before the edit, the lines after it parse as before too,
+ * up to the next changed line: they are valid again without being parsed.
+ * So typing in a line only re-parses the lines whose cookie really changes,
+ * most often none, instead of all the lines below it.
+ *
+ * The cookies kept below the valid lines must each follow from the cookie
+ * of the line before, unless it is Invalid: this is what SetNext(),
+ * LineChanged(), LinesChanged() and TextChanged() preserve.
+ */
+class ParseCookies
+  {
+public:
+    enum : DWORD
+      {
+        Invalid = static_cast<DWORD>(-1) /**< Cookie not computed */
+      };
+
+    ParseCookies();
+
+    size_t size() const { return m_aCookies.size(); }
+    bool empty() const { return m_aCookies.empty(); }
+    void Reset(size_t nLines);
+    void clear();
+
+    /** @brief Return number of lines, from the first, whose cookie is known. */
+    size_t GetValidLines() const { return m_nValidLines; }
+    /** @brief Return cookie of a line among the valid lines. */
+    DWORD operator[] (size_t nLine) const { ASSERT (nLine < m_nValidLines); return m_aCookies[nLine]; }
+
+    void SetNext(DWORD dwCookie);
+    void LineChanged(size_t nLine);
+    void LinesChanged(size_t nLine, ptrdiff_t nDelta);
+    void TextChanged(size_t nLine);
+
+private:
+    void Truncate(size_t nLine);
+
+    std::vector<DWORD> m_aCookies; /**< Cookie of each line, or Invalid. */
+    size_t m_nValidLines; /**< Lines whose cookie is known. */
+  };
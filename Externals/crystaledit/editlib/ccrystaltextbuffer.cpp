@@ -196,8 +196,7 @@ void CCrystalTextBuffer::InsertLine (LPCTSTR pszLine, size_t nLength,
     nPosition = (int) m_aLines.size();
 
   // insert all lines in one pass
-  std::vector<LineInfo>::iterator iter = m_aLines.begin() + nPosition;
-  m_aLines.insert(iter, nCount, line);
+  m_aLines.insert(nPosition, nCount, line);
 
   // create text data for lines after the first one
   for (int ic = 1; ic < nCount; ic++) 
@@ -230,6 +229,27 @@ AppendLine (int nLineIndex, LPCTSTR pszChars, size_t nLength )
   li.Append(pszChars, nLength);
 }
 
+/**
+ * @brief Add lines at the end, on a buffer they share.
+ * The lines keep their text in the buffer until they change, so loading
+ * a file takes no allocation per line.
+ * @param [in] pcText Lines, each with its EOL and followed by a zero.
+ *  The buffer is freed with the lines.
+ * @param [in] aLineStarts Index of the first char of each line in
+ *  @p pcText, and the size of @p pcText.
+ */
+void CCrystalTextBuffer::
+AppendLines (std::unique_ptr<TCHAR[]> pcText, const std::vector<size_t> & aLineStarts)
+{
+  ASSERT (aLineStarts.size() > 0);
+  const size_t nFirst = m_aLines.size();
+  const size_t nCount = aLineStarts.size() - 1;
+  m_aLines.resize(nFirst + nCount);
+  for (size_t i = 0; i < nCount; i++)
+    m_aLines[nFirst + i].CreateShared(&pcText[aLineStarts[i]], aLineStarts[i + 1] - aLineStarts[i] - 1);
+  m_aSharedText.push_back(std::move(pcText));
+}
+
 /**
  * @brief Copy line range [line1;line2] to range starting at newline1
  *
@@ -282,14 +302,11 @@ void CCrystalTextBuffer::
 FreeAll ()
 {
   //  Free text
-  std::vector<LineInfo>::iterator iter = m_aLines.begin();
-  std::vector<LineInfo>::iterator end = m_aLines.end();
-  while (iter != end)
-    {
-      (*iter).Clear();
-      ++iter;
-    }
+  const size_t nSize = m_aLines.size();
+  for (size_t i = 0; i < nSize; i++)
+    m_aLines[i].Clear();
   m_aLines.clear();
+  m_aSharedText.clear();
 
   // Undo buffer will be cleared by its destructor
 
@@ -423,8 +440,6 @@ LoadFromFile (LPCTSTR pszFileName, CRLFSTYLE nCrlfStyle /*= CRLF_STYLE_AUTOMATIC
       ASSERT (nCrlfStyle >= 0 && nCrlfStyle <= 2);
       m_nCRLFMode = nCrlfStyle;
 
-      m_aLines.reserve(4096);
-
       DWORD dwBufPtr = 0;
       while (dwBufPtr < dwCurSize)
         {
@@ -1041,9 +1056,7 @@ InternalDeleteText (CCrystalTextView * pSource, int nStartLine, int nStartChar,
       const int nDelCount = nEndLine - nStartLine;
       for (int L = nStartLine + 1; L <= nEndLine; L++)
         m_aLines[L].Clear();
-      std::vector<LineInfo>::iterator iterBegin = m_aLines.begin() + nStartLine + 1;
-      std::vector<LineInfo>::iterator iterEnd = iterBegin + nDelCount;
-      m_aLines.erase(iterBegin, iterEnd);
+      m_aLines.erase(nStartLine + 1, nStartLine + 1 + nDelCount);
 
       //  nEndLine is no more valid
       m_aLines[nStartLine].DeleteEnd(nStartChar);
@@ -1956,9 +1969,7 @@ void CCrystalTextBuffer::DeleteLine(int line, int nCount /*=1*/)
 {
   for (int ic = 0; ic < nCount; ic++)
     m_aLines[line + ic].Clear();
-  std::vector<LineInfo>::iterator iterBegin = m_aLines.begin() + line;
-  std::vector<LineInfo>::iterator iterEnd = iterBegin + nCount;
-  m_aLines.erase(iterBegin, iterEnd);
+  m_aLines.erase(line, line + nCount);
 }
 
 int CCrystalTextBuffer::GetTabSize() const
@@ -34,7 +34,9 @@
 #pragma once
 
 #include <vector>
+#include <memory>
 #include "LineInfo.h"
+#include "LineTree.h"
 #include "UndoRecord.h"
 #include "ccrystaltextview.h"
 
@@ -150,7 +152,8 @@ public :
       };
 
     //  Lines of text
-    std::vector<LineInfo> m_aLines; /**< Text lines. */
+    LineTree m_aLines; /**< Text lines. */
+    std::vector<std::unique_ptr<TCHAR[]>> m_aSharedText; /**< Buffers of lines added by AppendLines() */
 
     //  Undo
     std::vector<UndoRecord> m_aUndoBuf; /**< Undo records. */
@@ -169,6 +172,7 @@ public :
     //  Helper methods
     void InsertLine (LPCTSTR pszLine, size_t nLength, int nPosition = -1, int nCount = 1);
     void AppendLine (int nLineIndex, LPCTSTR pszChars, size_t nLength);
+    void AppendLines (std::unique_ptr<TCHAR[]> pcText, const std::vector<size_t> & aLineStarts);
     void MoveLine(int line1, int line2, int newline1);
     void SetEmptyLine(int nPosition, int nCount = 1);
 
@@ -107,6 +107,7 @@
 #include "ccrystaltextmarkers.h"
 #include "string_util.h"
 #include "wcwidth.h"
+#include "ParseCookies.h"
 
 using std::vector;
 using CrystalLineParser::TEXTBLOCK;
@@ -544,7 +545,7 @@ CCrystalTextView::CCrystalTextView ()
   m_pstrIncrementalSearchStringOld = new CString;
   ASSERT( m_pstrIncrementalSearchStringOld != nullptr );
   //END SW
-  m_ParseCookies = new vector<DWORD>;
+  m_ParseCookies = new ParseCookies;
   m_pnActualLineLength = new vector<int>;
   ResetView ();
   SetTextType (SRC_PLAIN);
@@ -874,6 +875,7 @@ void CCrystalTextView::ScrollToSubLine( int nNewTopSubLine,
         }
       int nDummy;
       GetLineBySubLine( m_nTopSubLine, m_nTopLine, nDummy );
+      StartParseAhead ();
     }
 }
 
@@ -1269,36 +1271,32 @@ GetLineColors (int nLineIndex, COLORREF & crBkgnd,
 DWORD CCrystalTextView::
 GetParseCookie (int nLineIndex)
 {
-  const int nLineCount = GetLineCount ();
-  if (m_ParseCookies->size() == 0)
+  if (m_ParseCookies->empty())
     {
-      // must be initialized to invalid value (DWORD) -1
-      m_ParseCookies->assign(nLineCount, static_cast<DWORD>(-1));
+      m_ParseCookies->Reset(GetLineCount ());
+      StartParseAhead ();
     }
 
   if (nLineIndex < 0)
     return 0;
-  if ((*m_ParseCookies)[nLineIndex] != - 1)
-    return (*m_ParseCookies)[nLineIndex];
+  while (m_ParseCookies->GetValidLines() <= static_cast<size_t>(nLineIndex))
+    ParseNextLine ();
 
-  int L = nLineIndex;
-  while (L >= 0 && (*m_ParseCookies)[L] == - 1)
-    L--;
-  L++;
+  return (*m_ParseCookies)[nLineIndex];
+}
 
+/**
+ * @brief Parse the first line whose parse cookie is not known.
+ */
+void CCrystalTextView::
+ParseNextLine ()
+{
+  const int L = static_cast<int>(m_ParseCookies->GetValidLines());
+  DWORD dwCookie = 0;
+  if (L > 0)
+    dwCookie = (*m_ParseCookies)[L - 1];
   int nBlocks;
-  while (L <= nLineIndex)
-    {
-      DWORD dwCookie = 0;
-      if (L > 0)
-        dwCookie = (*m_ParseCookies)[L - 1];
-      ASSERT (dwCookie != - 1);
-      (*m_ParseCookies)[L] = ParseLine (dwCookie, GetLineChars(L), GetLineLength(L), nullptr, nBlocks);
-      ASSERT ((*m_ParseCookies)[L] != - 1);
-      L++;
-    }
-
-  return (*m_ParseCookies)[nLineIndex];
+  m_ParseCookies->SetNext(ParseLine (dwCookie, GetLineChars(L), GetLineLength(L), nullptr, nBlocks));
 }
 
 std::vector<TEXTBLOCK> CCrystalTextView::
@@ -1710,8 +1708,10 @@ CCrystalTextView::GetTextBlocks(int nLineIndex)
   blocks[0].m_nColorIndex = COLORINDEX_NORMALTEXT;
   blocks[0].m_nBgColorIndex = COLORINDEX_BKGND;
   nBlocks++;
-  (*m_ParseCookies)[nLineIndex] = ParseLine(dwCookie, GetLineChars(nLineIndex), GetLineLength(nLineIndex), blocks.data(), nBlocks);
-  ASSERT((*m_ParseCookies)[nLineIndex] != -1);
+  dwCookie = ParseLine(dwCookie, GetLineChars(nLineIndex), GetLineLength(nLineIndex), blocks.data(), nBlocks);
+  if (m_ParseCookies->GetValidLines() == static_cast<size_t>(nLineIndex))
+    m_ParseCookies->SetNext(dwCookie);
+  ASSERT(dwCookie == (*m_ParseCookies)[nLineIndex]);
   blocks.resize(nBlocks);
   
   return MergeTextBlocks(blocks, 
@@ -4325,14 +4325,13 @@ UpdateView (CCrystalTextView * pSource, CUpdateContext * pContext,
   if ((dwFlags & UPDATE_SINGLELINE) != 0)
     {
       ASSERT (nLineIndex != -1);
-      //  All text below this line should be reparsed
-      const int cookiesSize = (int) m_ParseCookies->size();
-      if (cookiesSize > 0)
+      //  This line should be reparsed, and the text below it if its
+      //  parse cookie changes
+      if (!m_ParseCookies->empty())
         {
-          ASSERT (cookiesSize == nLineCount);
-          // must be reinitialized to invalid value (DWORD) - 1
-          for (int i = nLineIndex; i < cookiesSize; ++i)
-            (*m_ParseCookies)[i] = static_cast<DWORD>(-1);
+          ASSERT (m_ParseCookies->size() == static_cast<size_t>(nLineCount));
+          m_ParseCookies->LineChanged(nLineIndex);
+          StartParseAhead ();
         }
       //  This line'th actual length must be recalculated
       if (m_pnActualLineLength->size())
@@ -4349,6 +4348,21 @@ UpdateView (CCrystalTextView * pSource, CUpdateContext * pContext,
     }
   else
     {
+      //  This line should be reparsed, and the text below it if its
+      //  parse cookie changes: the lines below the lines inserted or
+      //  deleted after it are the same as before
+      if (!m_ParseCookies->empty())
+        {
+          const ptrdiff_t nDelta = nLineCount - static_cast<ptrdiff_t>(m_ParseCookies->size());
+          if (nLineIndex == -1)
+            m_ParseCookies->clear();
+          else if (nDelta == 0)
+            m_ParseCookies->TextChanged(nLineIndex);
+          else
+            m_ParseCookies->LinesChanged(nLineIndex, nDelta);
+          StartParseAhead ();
+        }
+
       if (m_bViewLineNumbers)
         // if enabling linenumber, we must invalidate all line-cache in visible area because selection margin width changes dynamically.
         nLineIndex = m_nTopLine < nLineIndex ? m_nTopLine : nLineIndex;
@@ -4356,23 +4370,6 @@ UpdateView (CCrystalTextView * pSource, CUpdateContext * pContext,
       if (nLineIndex == -1)
         nLineIndex = 0;         //  Refresh all text
 
-      //  All text below this line should be reparsed
-      if (m_ParseCookies->size())
-        {
-          size_t arrSize = m_ParseCookies->size();
-          if (arrSize != static_cast<size_t>(nLineCount))
-            {
-              size_t oldsize = arrSize; 
-              m_ParseCookies->resize(nLineCount);
-              arrSize = nLineCount;
-              // must be initialized to invalid value (DWORD) - 1
-              for (size_t i = oldsize; i < arrSize; ++i)
-                (*m_ParseCookies)[i] = static_cast<DWORD>(-1);
-            }
-          for (size_t i = nLineIndex; i < arrSize; ++i)
-            (*m_ParseCookies)[i] = static_cast<DWORD>(-1);
-        }
-
       //  Recalculate actual length for all lines below this
       if (m_pnActualLineLength->size())
         {
@@ -48,6 +48,7 @@ class SyntaxColors;
 class CFindTextDlg;
 struct LastSearchInfos;
 class CCrystalTextMarkers;
+class ParseCookies;
 
 ////////////////////////////////////////////////////////////////////////////
 // CCrystalTextView class declaration
@@ -147,19 +148,22 @@ private:
     //  Parsing stuff
 
     /**  
-    This array must be initialized to (DWORD) - 1, code for invalid values (not yet computed).
-    We prefer to limit the recomputing delay to the moment when we need to read
-    a parseCookie value for drawing.
+    Parse cookies of the lines, computed only when we need to read a
+    parseCookie value for drawing, or in the background (see ParseAhead).
     GetParseCookie must always be used to read the m_ParseCookies value of a line.
-    If the actual value is invalid code, GetParseCookie computes the value, 
-    stores it in m_ParseCookies, and returns the new valid value.
+    If the value is not yet known, GetParseCookie parses the lines from the
+    last known one, stores their values in m_ParseCookies, and returns the value.
     When we edit the text, the parse cookies value may change for the modified line
     and all the lines below (As m_ParseCookies[line i] depends on m_ParseCookies[line (i-1)])
-    It would be a loss of time to recompute all these values after each action.
-    So we just set all these values to invalid code (DWORD) - 1.
+    The values of the lines below are kept, and parsing stops recomputing them
+    at the first line whose value did not change.
     */
-    std::vector<DWORD> *m_ParseCookies;
+    ParseCookies *m_ParseCookies;
     DWORD GetParseCookie (int nLineIndex);
+    void ParseNextLine ();
+    size_t GetParseAheadEnd ();
+    void StartParseAhead ();
+    void ParseAhead ();
 
     /**
     Pre-calculated line lengths (in characters)
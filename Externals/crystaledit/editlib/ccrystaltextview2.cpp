@@ -51,7 +51,9 @@
 #include "SyntaxColors.h"
 #include "ccrystaltextmarkers.h"
 #include <malloc.h>
+#include <algorithm>
 #include "string_util.h"
+#include "ParseCookies.h"
 
 #ifndef __AFXPRIV_H__
 #pragma message("Include <afxpriv.h> in your stdafx.h to avoid this message")
@@ -63,6 +65,10 @@
 #endif
 
 static const UINT_PTR CRYSTAL_TIMER_DRAGSEL = 1001;
+static const UINT_PTR CRYSTAL_TIMER_PARSE = 1002;
+static const UINT CRYSTAL_PARSE_INTERVAL = 50; // ms between slices of parsing ahead
+static const DWORD CRYSTAL_PARSE_SLICE = 15; // ms of parsing ahead per slice
+static const size_t CRYSTAL_PARSE_AHEAD_SCREENS = 4; // screens parsed ahead below the visible lines
 
 static LPTSTR NTAPI EnsureCharNext(LPCTSTR current)
 {
@@ -1010,6 +1016,62 @@ OnTimer (UINT_PTR nIDEvent)
           SetSelection (m_ptAnchor, m_ptCursorPos);
         }
     }
+  else if (nIDEvent == CRYSTAL_TIMER_PARSE)
+    {
+      ParseAhead ();
+    }
+}
+
+/**
+ * @brief Return the line before which parsing ahead stops.
+ * Only a few screens below the visible lines are parsed ahead, not the
+ * whole file: lines further down are parsed when they are drawn.
+ */
+size_t CCrystalTextView::
+GetParseAheadEnd ()
+{
+  const size_t nTopLine = static_cast<size_t>((std::max) (m_nTopLine, 0));
+  const size_t nScreenLines = static_cast<size_t>((std::max) (GetScreenLines (), 1));
+  return (std::min) (nTopLine + (1 + CRYSTAL_PARSE_AHEAD_SCREENS) * nScreenLines, m_ParseCookies->size());
+}
+
+/**
+ * @brief Start parsing the lines whose parse cookie is not known, in the background.
+ * Lines are parsed by slices while the view is idle, up to a few screens
+ * below the visible lines, so that scrolling down, or the parsing stopped
+ * by an edit, takes less time. Parsing stays in this thread, as it reads
+ * lines that editing changes.
+ */
+void CCrystalTextView::
+StartParseAhead ()
+{
+  if (m_hWnd != nullptr && !m_ParseCookies->empty() && m_ParseCookies->GetValidLines() < GetParseAheadEnd ())
+    SetTimer (CRYSTAL_TIMER_PARSE, CRYSTAL_PARSE_INTERVAL, nullptr);
+}
+
+/**
+ * @brief Parse a slice of the lines whose parse cookie is not known.
+ * The timer is stopped when all lines to parse ahead are known.
+ */
+void CCrystalTextView::
+ParseAhead ()
+{
+  const size_t nLineCount = m_ParseCookies->size();
+  const size_t nParseEnd = GetParseAheadEnd ();
+  if (m_ParseCookies->GetValidLines() < nParseEnd && nLineCount == static_cast<size_t>(GetLineCount ()))
+    {
+      const DWORD dwStart = ::GetTickCount ();
+      do
+        {
+          const size_t nEnd = (std::min) (m_ParseCookies->GetValidLines() + 256, nParseEnd);
+          while (m_ParseCookies->GetValidLines() < nEnd)
+            ParseNextLine ();
+        }
+      while (m_ParseCookies->GetValidLines() < nParseEnd && ::GetTickCount () - dwStart < CRYSTAL_PARSE_SLICE);
+      if (m_ParseCookies->GetValidLines() < nParseEnd)
+        return;
+    }
+  KillTimer (CRYSTAL_TIMER_PARSE);
 }
 
 /** 
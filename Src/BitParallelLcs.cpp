@@ -0,0 +1,330 @@
+/**
+ * @file  BitParallelLcs.cpp
+ *
+ * @brief Longest common subsequence computed on bit vectors.
+ */
+
+#include "pch.h"
+#include "BitParallelLcs.h"
+#include <algorithm>
+
+namespace strdiff
+{
+
+const int64_t BitParallelLcs::MaxWork = static_cast<int64_t>(1) << 28;
+const int64_t BitParallelLcs::MaxTraceWords = static_cast<int64_t>(1) << 22;
+
+namespace
+{
+
+typedef uint64_t Bits;
+const int WordBits = 64;
+
+inline int Words(int bits)
+{
+	return (bits + WordBits - 1) / WordBits;
+}
+
+inline bool TestBit(const Bits *v, int i)
+{
+	return ((v[i / WordBits] >> (i % WordBits)) & 1) != 0;
+}
+
+inline int BitCount(Bits x)
+{
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return static_cast<int>((x * 0x0101010101010101ULL) >> 56);
+}
+
+/**
+ * @brief Number of clear bits among the first @p i bits: the LCS length of
+ * the first i elements of the first range.
+ */
+inline int ZeroCount(const Bits *v, int i)
+{
+	int count = 0;
+	for (int w = 0; w < i / WordBits; ++w)
+		count += WordBits - BitCount(v[w]);
+	if (i % WordBits != 0)
+		count += i % WordBits - BitCount(v[i / WordBits] & ((static_cast<Bits>(1) << (i % WordBits)) - 1));
+	return count;
+}
+
+/**
+ * @brief Compares ranges of two sequences.
+ *
+ * Bit i of the vector after the first j elements of the second range is
+ * clear when the LCS of the first i + 1 elements of the first range and
+ * of these j elements is longer than with only i elements.
+ */
+class LcsEngine
+{
+public:
+	LcsEngine(const std::vector<unsigned> &seq1, const std::vector<unsigned> &seq2, unsigned nSymbols)
+		: m_seq1(seq1.data()), m_seq2(seq2.data())
+		, m_count(nSymbols, 0), m_head(nSymbols, -1), m_dense(nSymbols, -1), m_next(seq1.size())
+	{
+	}
+
+	void Script(int b1, int e1, int b2, int e2, std::vector<char> &edscript);
+	void Pass(int b1, int e1, int b2, int e2, bool reverse, std::vector<Bits> &v, std::vector<Bits> *trace);
+
+private:
+	void BuildMasks(int b1, int e1, bool reverse);
+	void ClearMasks(int b1, int e1);
+	static void Step(Bits *v, const Bits *mask, int words);
+
+	const unsigned *m_seq1;
+	const unsigned *m_seq2;
+	std::vector<int> m_count; /**< Elements of the first range per symbol */
+	std::vector<int> m_head; /**< Last element of the first range per symbol, -1 if none */
+	std::vector<int> m_dense; /**< Mask of a frequent symbol, -1 for the others */
+	std::vector<int> m_next; /**< Previous element with the same symbol, -1 if none */
+	std::vector<Bits> m_masks; /**< Match masks of the frequent symbols */
+	std::vector<Bits> m_scratch; /**< Match mask of a rare symbol */
+};
+
+/**
+ * @brief Compute match masks of the symbols of a range of the first sequence.
+ * Symbols found in many elements get their own mask. Masks of the others
+ * are set from their elements when needed, which costs less than keeping
+ * a mask for each of them.
+ */
+void LcsEngine::BuildMasks(int b1, int e1, bool reverse)
+{
+	const int words = Words(e1 - b1);
+	const int denseMin = (std::max)(1, words / 4);
+	int nDense = 0;
+	for (int p = b1; p < e1; ++p)
+	{
+		const unsigned s = m_seq1[p];
+		m_next[p] = m_head[s];
+		m_head[s] = p;
+		if (++m_count[s] == denseMin)
+			m_dense[s] = nDense++;
+	}
+	m_masks.assign(static_cast<size_t>(nDense) * words, 0);
+	m_scratch.assign(words, 0);
+	for (int p = b1; p < e1; ++p)
+	{
+		const int dense = m_dense[m_seq1[p]];
+		if (dense >= 0)
+		{
+			const int bit = reverse ? e1 - 1 - p : p - b1;
+			m_masks[static_cast<size_t>(dense) * words + bit / WordBits] |= static_cast<Bits>(1) << (bit % WordBits);
+		}
+	}
+}
+
+/**
+ * @brief Forget the masks of a range of the first sequence.
+ */
+void LcsEngine::ClearMasks(int b1, int e1)
+{
+	for (int p = b1; p < e1; ++p)
+	{
+		const unsigned s = m_seq1[p];
+		m_count[s] = 0;
+		m_head[s] = -1;
+		m_dense[s] = -1;
+	}
+	m_masks.clear();
+}
+
+/**
+ * @brief Update the bit vector for the next element of the second sequence.
+ * V' = (V + (V & M)) | (V & ~M), where M is the match mask of the element.
+ */
+void LcsEngine::Step(Bits *v, const Bits *mask, int words)
+{
+	Bits carry = 0;
+	for (int w = 0; w < words; ++w)
+	{
+		const Bits x = v[w];
+		Bits sum = x + (x & mask[w]);
+		Bits overflow = sum < x;
+		sum += carry;
+		overflow |= sum < carry;
+		carry = overflow;
+		v[w] = sum | (x & ~mask[w]);
+	}
+}
+
+/**
+ * @brief Compute the bit vector of a range of the first sequence after
+ * the elements of a range of the second sequence.
+ * @param [in] reverse Compare the ranges from their ends.
+ * @param [out] v Bit vector after all the elements.
+ * @param [out] trace If not null, the bit vectors after each element.
+ */
+void LcsEngine::Pass(int b1, int e1, int b2, int e2, bool reverse, std::vector<Bits> &v, std::vector<Bits> *trace)
+{
+	const int words = Words(e1 - b1);
+	const int n = e2 - b2;
+	v.assign(words, ~static_cast<Bits>(0));
+	if (trace != nullptr)
+		trace->resize(static_cast<size_t>(n) * words);
+	BuildMasks(b1, e1, reverse);
+	for (int k = 0; k < n; ++k)
+	{
+		const unsigned s = m_seq2[reverse ? e2 - 1 - k : b2 + k];
+		if (s < m_head.size() && m_head[s] >= 0)
+		{
+			if (m_dense[s] >= 0)
+			{
+				Step(v.data(), &m_masks[static_cast<size_t>(m_dense[s]) * words], words);
+			}
+			else
+			{
+				for (int p = m_head[s]; p >= 0; p = m_next[p])
+				{
+					const int bit = reverse ? e1 - 1 - p : p - b1;
+					m_scratch[bit / WordBits] |= static_cast<Bits>(1) << (bit % WordBits);
+				}
+				Step(v.data(), m_scratch.data(), words);
+				for (int p = m_head[s]; p >= 0; p = m_next[p])
+					m_scratch[(reverse ? e1 - 1 - p : p - b1) / WordBits] = 0;
+			}
+		}
+		if (trace != nullptr)
+			std::copy(v.begin(), v.end(), trace->begin() + static_cast<size_t>(k) * words);
+	}
+	ClearMasks(b1, e1);
+}
+
+/**
+ * @brief Append the edit script of ranges of the sequences.
+ */
+void LcsEngine::Script(int b1, int e1, int b2, int e2, std::vector<char> &edscript)
+{
+	// Common ends are part of a longest common subsequence
+	int prefix = 0;
+	while (b1 + prefix < e1 && b2 + prefix < e2 && m_seq1[b1 + prefix] == m_seq2[b2 + prefix])
+		++prefix;
+	edscript.insert(edscript.end(), prefix, '=');
+	b1 += prefix;
+	b2 += prefix;
+	int suffix = 0;
+	while (b1 < e1 - suffix && b2 < e2 - suffix && m_seq1[e1 - 1 - suffix] == m_seq2[e2 - 1 - suffix])
+		++suffix;
+	e1 -= suffix;
+	e2 -= suffix;
+
+	const int m = e1 - b1;
+	const int n = e2 - b2;
+	const int words = Words(m);
+	if (m == 0 || n == 0)
+	{
+		edscript.insert(edscript.end(), m, '-');
+		edscript.insert(edscript.end(), n, '+');
+	}
+	else if (static_cast<int64_t>(n) * words <= BitParallelLcs::MaxTraceWords || n == 1)
+	{
+		std::vector<Bits> v, trace;
+		Pass(b1, e1, b2, e2, false, v, &trace);
+
+		// Trace back from the ends: the last element of the first range is
+		// deleted if not needed, else the last element of the second range
+		// is inserted if not needed, else they match.
+		const size_t start = edscript.size();
+		int i = m, j = n;
+		while (i > 0 && j > 0)
+		{
+			const Bits *v = &trace[static_cast<size_t>(j - 1) * words];
+			if (TestBit(v, i - 1))
+			{
+				edscript.push_back('-');
+				--i;
+			}
+			else if (j > 1 && ZeroCount(v - words, i) == ZeroCount(v, i))
+			{
+				edscript.push_back('+');
+				--j;
+			}
+			else
+			{
+				edscript.push_back('=');
+				--i;
+				--j;
+			}
+		}
+		edscript.insert(edscript.end(), i, '-');
+		edscript.insert(edscript.end(), j, '+');
+		std::reverse(edscript.begin() + start, edscript.end());
+	}
+	else
+	{
+		// Split the first range where the LCS of the first half of the
+		// second range and of the second half add up to the longest
+		const int mid = b2 + n / 2;
+		std::vector<Bits> forward, backward;
+		Pass(b1, e1, b2, mid, false, forward, nullptr);
+		Pass(b1, e1, mid, e2, true, backward, nullptr);
+		std::vector<int> suffixLength(m + 1, 0);
+		for (int k = 0; k < m; ++k)
+			suffixLength[k + 1] = suffixLength[k] + !TestBit(backward.data(), k);
+		int best = -1, split = 0, prefixLength = 0;
+		for (int i = 0; i <= m; ++i)
+		{
+			if (prefixLength + suffixLength[m - i] > best)
+			{
+				best = prefixLength + suffixLength[m - i];
+				split = i;
+			}
+			if (i < m)
+				prefixLength += !TestBit(forward.data(), i);
+		}
+		Script(b1, b1 + split, b2, mid, edscript);
+		Script(b1 + split, e1, mid, e2, edscript);
+	}
+
+	edscript.insert(edscript.end(), suffix, '=');
+}
+
+}
+
+/**
+ * @brief Is comparing sequences of these lengths fast enough?
+ */
+bool BitParallelLcs::CanCompare(size_t length1, size_t length2)
+{
+	const int64_t words = static_cast<int64_t>((length1 + WordBits - 1) / WordBits);
+	return words * static_cast<int64_t>(length2) <= MaxWork;
+}
+
+/**
+ * @brief Compute the edit script of a longest common subsequence.
+ * @param [in] seq1, seq2 Sequences of symbols less than @p nSymbols.
+ * @param [out] edscript '=' for elements in both sequences, '-' for elements
+ *  only in @p seq1 and '+' for elements only in @p seq2, in sequence order.
+ * @return Length of the longest common subsequence.
+ */
+int BitParallelLcs::EditScript(const std::vector<unsigned> &seq1, const std::vector<unsigned> &seq2,
+	unsigned nSymbols, std::vector<char> &edscript)
+{
+	edscript.clear();
+	edscript.reserve(seq1.size() + seq2.size());
+	LcsEngine engine(seq1, seq2, nSymbols);
+	engine.Script(0, static_cast<int>(seq1.size()), 0, static_cast<int>(seq2.size()), edscript);
+	return static_cast<int>(std::count(edscript.begin(), edscript.end(), '='));
+}
+
+/**
+ * @brief Compute the length of a longest common subsequence.
+ * @param [in] seq1, seq2 Sequences of symbols less than @p nSymbols.
+ */
+int BitParallelLcs::Length(const std::vector<unsigned> &seq1, const std::vector<unsigned> &seq2,
+	unsigned nSymbols)
+{
+	const int m = static_cast<int>(seq1.size());
+	if (m == 0 || seq2.empty())
+		return 0;
+	LcsEngine engine(seq1, seq2, nSymbols);
+	std::vector<Bits> v;
+	engine.Pass(0, m, 0, static_cast<int>(seq2.size()), false, v, nullptr);
+	return ZeroCount(v.data(), m);
+}
+
+}
@@ -0,0 +1,42 @@
+/**
+ * @file  BitParallelLcs.h
+ *
+ * @brief Declaration of BitParallelLcs class.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace strdiff
+{
+
+/**
+ * @brief Longest common subsequence of two sequences, computed on bit vectors.
+ *
+ * Elements of the sequences are symbols, equal elements having equal
+ * symbols. Each element of the second sequence updates a bit vector over
+ * the first sequence, 64 elements in a machine word (Hyyro's bit-parallel
+ * LCS), so comparing sequences of m and n elements takes m * n / 64 steps
+ * whatever the differences are.
+ *
+ * The edit script is traced back from the bit vectors of all the elements
+ * of the second sequence. When these would take too much memory, the
+ * sequences are split where an optimal alignment crosses the middle of the
+ * second sequence (Hirschberg), and each half is compared on its own.
+ */
+class BitParallelLcs
+{
+public:
+	static const int64_t MaxWork; /**< Most bit vector words computed for one comparison */
+	static const int64_t MaxTraceWords; /**< Most bit vector words kept to trace back an edit script */
+
+	static bool CanCompare(size_t length1, size_t length2);
+	static int EditScript(const std::vector<unsigned> &seq1, const std::vector<unsigned> &seq2,
+		unsigned nSymbols, std::vector<char> &edscript);
+	static int Length(const std::vector<unsigned> &seq1, const std::vector<unsigned> &seq2,
+		unsigned nSymbols);
+};
+
+}
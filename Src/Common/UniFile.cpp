@@ -33,6 +33,7 @@ THE SOFTWARE.
 #include <cstdio>
 #include <cassert>
 #include <memory>
+#include <algorithm>
 #include <Poco/SharedMemory.h>
 #include <Poco/Exception.h>
 #include "UnicodeString.h"
@@ -41,6 +42,11 @@ THE SOFTWARE.
 #include "TFile.h"
 #include <windows.h>
 
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#define UNIFILE_SIMD
+#endif
+
 using Poco::SharedMemory;
 using Poco::Exception;
 
@@ -688,6 +694,355 @@ bool UniMemFile::ReadString(String & line, String & eol, bool * lossy)
 	return true;
 }
 
+/**
+ * @brief Count the bits set in a mask.
+ */
+static inline int CountBits(unsigned mask)
+{
+	int n = 0;
+	for (; mask != 0; mask &= mask - 1)
+		++n;
+	return n;
+}
+
+/**
+ * @brief Find where lines begin in text of one or two byte code units.
+ * EOLs are counted to the stats like ReadString() counts them, and so
+ * are zeros.
+ * @param [in] data Text.
+ * @param [in] count Number of code units in text.
+ * @param [in] bigEndian Two byte units are big endian.
+ * @param [in,out] stats Stats the EOLs and zeros are added to.
+ * @param [out] lineStarts Index of the first unit of each line but the first.
+ */
+template <typename Unit>
+static void ScanLines(const unsigned char *data, size_t count, bool bigEndian,
+		UniFile::txtstats & stats, std::vector<size_t> & lineStarts)
+{
+	const Unit *units = reinterpret_cast<const Unit *>(data);
+	const int shift = bigEndian ? 8 : 0;
+	const Unit cr = static_cast<Unit>('\r' << shift);
+	const Unit lf = static_cast<Unit>('\n' << shift);
+	size_t next = 0; // units before this belong to EOLs already found
+
+	auto eolAt = [&](size_t i)
+	{
+		if (i < next)
+			return;
+		if (units[i] == cr && i + 1 < count && units[i + 1] == lf)
+		{
+			++stats.ncrlfs;
+			next = i + 2;
+		}
+		else
+		{
+			if (units[i] == cr)
+				++stats.ncrs;
+			else
+				++stats.nlfs;
+			next = i + 1;
+		}
+		lineStarts.push_back(next);
+	};
+
+	size_t i = 0;
+#ifdef UNIFILE_SIMD
+	// Look at 16 bytes at a time, most of them hold no EOL or zero
+	const int unitsPerVec = 16 / sizeof(Unit);
+	const unsigned unitBits = sizeof(Unit) == 1 ? 0xFFFF : 0x5555;
+	const __m128i vcr = sizeof(Unit) == 1 ? _mm_set1_epi8(static_cast<char>(cr)) : _mm_set1_epi16(static_cast<short>(cr));
+	const __m128i vlf = sizeof(Unit) == 1 ? _mm_set1_epi8(static_cast<char>(lf)) : _mm_set1_epi16(static_cast<short>(lf));
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + unitsPerVec <= count; i += unitsPerVec)
+	{
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(units + i));
+		unsigned zeros, eols;
+		if (sizeof(Unit) == 1)
+		{
+			zeros = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+			eols = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, vcr), _mm_cmpeq_epi8(v, vlf)));
+		}
+		else
+		{
+			zeros = _mm_movemask_epi8(_mm_cmpeq_epi16(v, zero));
+			eols = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi16(v, vcr), _mm_cmpeq_epi16(v, vlf)));
+		}
+		if (zeros != 0)
+			stats.nzeros += CountBits(zeros & unitBits);
+		for (eols &= unitBits; eols != 0; eols &= eols - 1)
+		{
+			unsigned long bit;
+			_BitScanForward(&bit, eols);
+			eolAt(i + bit / sizeof(Unit));
+		}
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		if (units[i] == cr || units[i] == lf)
+			eolAt(i);
+		else if (units[i] == 0)
+			++stats.nzeros;
+	}
+}
+
+/**
+ * @brief Decode UTF-8 text into lines like ReadString() decodes it.
+ * Lines end at decoded CR and LF characters: EOL and zero bytes taken
+ * as trail bytes of a bad sequence belong to its character. Bad lead
+ * bytes become '?', as do characters outside of UTF-16, which are
+ * counted as losses. A sequence cut by the end of the text is dropped.
+ * @param [in] data Text.
+ * @param [in] count Number of bytes in text.
+ * @param [out] text Gets the lines, each followed by a zero. Must have
+ *  room for @p count chars, plus one per CR or LF byte, plus one.
+ * @param [in,out] stats Stats the EOLs and zeros are added to.
+ * @param [out] lineStarts Index of the first char of each line but the first.
+ * @return End of decoded lines.
+ */
+static TCHAR *DecodeUtf8Lines(const unsigned char *data, size_t count, TCHAR *text,
+		UniFile::txtstats & stats, std::vector<size_t> & lineStarts)
+{
+	TCHAR *out = text;
+	size_t pos = 0;
+#ifdef UNIFILE_SIMD
+	const __m128i vcr = _mm_set1_epi8('\r');
+	const __m128i vlf = _mm_set1_epi8('\n');
+	const __m128i zero = _mm_setzero_si128();
+#endif
+	while (pos < count)
+	{
+#ifdef UNIFILE_SIMD
+		// Runs of ASCII but EOLs and zeros need no decoding
+		while (count - pos >= 16)
+		{
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+			const unsigned special = _mm_movemask_epi8(v) | _mm_movemask_epi8(_mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(v, vcr), _mm_cmpeq_epi8(v, vlf)), _mm_cmpeq_epi8(v, zero)));
+			unsigned long n = 16;
+			if (special != 0)
+				_BitScanForward(&n, special);
+			for (unsigned long k = 0; k < n; ++k)
+				out[k] = data[pos + k];
+			pos += n;
+			out += n;
+			if (n < 16)
+				break;
+		}
+		if (pos == count)
+			break;
+#endif
+		const unsigned char *p = data + pos;
+		int len = ucr::Utf8len_fromLeadByte(*p);
+		if (len > 0 && static_cast<size_t>(len) > count - pos)
+			break;
+		unsigned ch = '?';
+		if (len < 1 || len > 4)
+			len = 1;
+		else
+			ch = ucr::GetUtf8Char(const_cast<unsigned char *>(p));
+		pos += len;
+		if (ch == '\r' || ch == '\n')
+		{
+			*out++ = static_cast<TCHAR>(ch);
+			// Like ReadString(), look for LF in the byte after the lead byte
+			if (ch == '\n')
+				++stats.nlfs;
+			else if (static_cast<size_t>(p + 1 - data) < count && p[1] == '\n')
+			{
+				*out++ = '\n';
+				++stats.ncrlfs;
+				++pos;
+			}
+			else
+				++stats.ncrs;
+			*out++ = 0;
+			lineStarts.push_back(out - text);
+		}
+		else if (ch < 0x10000)
+		{
+			if (ch == 0)
+				++stats.nzeros;
+			*out++ = static_cast<TCHAR>(ch);
+		}
+		else if (ch < 0x110000)
+		{
+			*out++ = static_cast<TCHAR>((ch - 0x10000) / 0x400 + 0xd800);
+			*out++ = static_cast<TCHAR>((ch % 0x400) + 0xdc00);
+		}
+		else
+		{
+			*out++ = '?';
+			++stats.nlosses;
+		}
+	}
+	*out++ = 0;
+	return out;
+}
+
+/**
+ * @brief Read all the remaining lines at once.
+ * The file is scanned for EOLs, then all its lines are decoded one after
+ * the other into one buffer; UTF-8 is decoded and split into lines in one
+ * pass. This saves allocating a string for every line and EOL, which is
+ * what limits ReadString() with big files. Lines and stats are the same as
+ * from ReadString(), also for bad UTF-8.
+ * @param [out] text Lines, each with its EOL and followed by a zero.
+ * @param [out] lineStarts Index of the first char of each line in @p text,
+ *  and the size of @p text. There is always at least one line, the last
+ *  line being empty if the file ends with an EOL.
+ * @return false if the encoding of the file is not read this way, then
+ *  nothing is read and the lines must be read with ReadString().
+ */
+bool UniMemFile::ReadAllLines(std::unique_ptr<TCHAR[]> & text, std::vector<size_t> & lineStarts)
+{
+#ifdef _UNICODE
+	if (m_unicoding != ucr::NONE && m_unicoding != ucr::UCS2LE && m_unicoding != ucr::UCS2BE && m_unicoding != ucr::UTF8)
+		return false;
+	int codepage = m_codepage;
+	if (m_unicoding == ucr::NONE)
+	{
+		// Codepages Windows does not know are converted by ReadString()
+		if (codepage == -1)
+			codepage = ucr::getDefaultCodepage();
+		if (codepage != CP_ACP && !IsValidCodePage(codepage))
+			return false;
+	}
+
+	const int charsize = (m_unicoding == ucr::UCS2LE || m_unicoding == ucr::UCS2BE) ? 2 : 1;
+	const unsigned char *data = m_current;
+	const size_t count = m_current ? static_cast<size_t>(m_filesize - (m_current - m_base)) / charsize : 0;
+	if (count > INT_MAX && m_unicoding == ucr::NONE)
+		return false;
+
+	txtstats stats;
+	try
+	{
+		lineStarts.clear();
+		lineStarts.push_back(0);
+		size_t capacity;
+		TCHAR *out;
+		if (m_unicoding == ucr::UTF8)
+		{
+			// Lines are known only when decoding, as bad sequences may
+			// hide EOL bytes. Only single byte EOLs make more chars, with
+			// the zero after them, than bytes.
+			const size_t eolBytes = std::count(data, data + count, '\r') + std::count(data, data + count, '\n');
+			capacity = count + eolBytes + 1;
+			text.reset(new TCHAR[capacity]);
+			out = DecodeUtf8Lines(data, count, text.get(), stats, lineStarts);
+			lineStarts.push_back(out - text.get());
+		}
+		else
+		{
+			if (charsize == 2)
+				ScanLines<uint16_t>(data, count, m_unicoding == ucr::UCS2BE, stats, lineStarts);
+			else
+				ScanLines<unsigned char>(data, count, false, stats, lineStarts);
+			lineStarts.push_back(count);
+
+			// No encoding read here has more chars than code units, and each
+			// line gets a zero
+			const size_t nLines = lineStarts.size() - 1;
+			capacity = count + nLines;
+			text.reset(new TCHAR[capacity]);
+			out = text.get();
+			DWORD flags = MB_ERR_INVALID_CHARS;
+			auto unitAt = [&](size_t k) -> unsigned
+			{
+				if (charsize == 1)
+					return data[k];
+				const unsigned char *u = data + 2 * k;
+				return m_unicoding == ucr::UCS2LE ? u[0] | (u[1] << 8) : (u[0] << 8) | u[1];
+			};
+			for (size_t i = 0; i < nLines; ++i)
+			{
+				const size_t begin = lineStarts[i];
+				const size_t end = lineStarts[i + 1];
+				lineStarts[i] = out - text.get();
+
+				// All lines but the last end with an EOL
+				size_t eolEnd = end;
+				if (i + 1 < nLines)
+				{
+					--eolEnd;
+					if (eolEnd > begin && unitAt(eolEnd) == '\n' && unitAt(eolEnd - 1) == '\r')
+						--eolEnd;
+				}
+				const unsigned char *src = data + begin * charsize;
+				const size_t len = eolEnd - begin;
+				switch (m_unicoding)
+				{
+				case ucr::UCS2LE:
+					memcpy(out, src, len * sizeof(TCHAR));
+					out += len;
+					break;
+				case ucr::UCS2BE:
+					for (size_t k = 0; k < len; ++k)
+						*out++ = static_cast<TCHAR>((src[2 * k] << 8) | src[2 * k + 1]);
+					break;
+				default:
+					if (len > 0)
+					{
+						const int cch = static_cast<int>((std::min<size_t>)(capacity - (out - text.get()), INT_MAX));
+						const char *lpd = reinterpret_cast<const char *>(src);
+						int n = MultiByteToWideChar(codepage, flags, lpd, static_cast<int>(len), out, cch);
+						if (n == 0 && GetLastError() == ERROR_INVALID_FLAGS)
+						{
+							flags = 0;
+							n = MultiByteToWideChar(codepage, flags, lpd, static_cast<int>(len), out, cch);
+						}
+						if (n == 0 && GetLastError() == ERROR_NO_UNICODE_TRANSLATION)
+						{
+							++stats.nlosses;
+							n = MultiByteToWideChar(codepage, 0, lpd, static_cast<int>(len), out, cch);
+						}
+						if (n == 0)
+						{
+							if (GetLastError() == ERROR_INSUFFICIENT_BUFFER)
+								return false;
+							out[n++] = '?';
+						}
+						out += n;
+					}
+					break;
+				}
+				for (size_t k = eolEnd; k < end; ++k)
+					*out++ = static_cast<TCHAR>(unitAt(k));
+				*out++ = 0;
+			}
+			lineStarts[nLines] = out - text.get();
+		}
+		const size_t size = out - text.get();
+
+		// Text of multibyte encodings may take much less room than the file
+		if (size + size / 4 < capacity)
+		{
+			std::unique_ptr<TCHAR[]> fit(new TCHAR[size]);
+			memcpy(fit.get(), text.get(), size * sizeof(TCHAR));
+			text.swap(fit);
+		}
+	}
+	catch (std::bad_alloc &)
+	{
+		text.reset();
+		lineStarts.clear();
+		return false;
+	}
+
+	m_current += count * charsize;
+	m_lineno += static_cast<int>(lineStarts.size() - 2);
+	m_txtstats.ncrs += stats.ncrs;
+	m_txtstats.nlfs += stats.nlfs;
+	m_txtstats.ncrlfs += stats.ncrlfs;
+	m_txtstats.nzeros += stats.nzeros;
+	m_txtstats.nlosses += stats.nlosses;
+	return true;
+#else
+	return false;
+#endif
+}
+
 /**
  * @brief Write one line (doing any needed conversions)
  */
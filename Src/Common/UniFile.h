@@ -8,6 +8,8 @@
  */
 #pragma once
 
+#include <memory>
+#include <vector>
 #include "unicoder.h"
 
 namespace Poco { class SharedMemory; }
@@ -166,6 +168,7 @@ public:
 public:
 	virtual bool ReadString(String & line, bool * lossy);
 	virtual bool ReadString(String & line, String & eol, bool * lossy);
+	virtual bool ReadAllLines(std::unique_ptr<TCHAR[]> & text, std::vector<size_t> & lineStarts);
 	virtual int64_t GetPosition() const { return m_current - m_base; }
 	virtual bool WriteString(const String & line);
 
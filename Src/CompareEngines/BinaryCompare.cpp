@@ -8,9 +8,10 @@
 #include "BinaryCompare.h"
 #include "DiffItem.h"
 #include "PathContext.h"
-#include "TFile.h"
-#include <io.h>
-#include <fcntl.h>
+#include "FileReader.h"
+#include <algorithm>
+#include <cstring>
+#include <windows.h>
 
 namespace CompareEngines
 {
@@ -23,47 +24,57 @@ BinaryCompare::~BinaryCompare()
 {
 }
 
-static int compare_files(const String& file1, const String& file2)
+/**
+ * @brief Compare blocks of mapped files.
+ * Read errors of memory-mapped files show up as in-page exceptions, which
+ * are turned into a failure here.
+ * @return false if reading the files failed.
+ */
+static bool compare_blocks(const char *data1, const char *data2, size_t len, bool &equal)
 {
-	const size_t bufsize = 1024 * 256;
-	int code;
-	int fd1 = -1, fd2 = -1;
-	
-	_tsopen_s(&fd1, TFile(file1).wpath().c_str(), O_BINARY | O_RDONLY, _SH_DENYWR, _S_IREAD);
-	_tsopen_s(&fd2, TFile(file2).wpath().c_str(), O_BINARY | O_RDONLY, _SH_DENYWR, _S_IREAD);
-	if (fd1 != -1 && fd2 != -1)
+	__try
 	{
-		for (;;)
-		{
-			char buf1[bufsize];
-			char buf2[bufsize];
-			int size1 = _read(fd1, buf1, sizeof(buf1));
-			int size2 = _read(fd2, buf2, sizeof(buf2));
-			if (size1 <= 0 || size2 <= 0)
-			{
-				if (size1 < 0 || size2 < 0)
-					code = DIFFCODE::CMPERR;
-				else
-					code = DIFFCODE::SAME;
-				break;
-			}
-			if (size1 != size2 || memcmp(buf1, buf2, size1) != 0)
-			{
-				code = DIFFCODE::DIFF;
-				break;
-			}
-		}
+		equal = memcmp(data1, data2, len) == 0;
 	}
-	else
+	__except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ?
+		EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
 	{
-		code = DIFFCODE::CMPERR;
+		return false;
 	}
-	if (fd1 != -1)
-		_close(fd1);
-	if (fd2 != -1)
-		_close(fd2);
+	return true;
+}
+
+static int compare_files(const String& file1, const String& file2)
+{
+	std::unique_ptr<FileReader> reader1 = FileReader::Open(file1);
+	std::unique_ptr<FileReader> reader2 = FileReader::Open(file2);
+	if (!reader1 || !reader2)
+		return DIFFCODE::CMPERR;
 
-	return code;
+	// Blocks of the two files need not be of same size, compare the
+	// overlapping part and get next block for the side used up
+	const char *data1 = nullptr, *data2 = nullptr;
+	size_t len1 = 0, len2 = 0;
+	for (;;)
+	{
+		if (len1 == 0 && !reader1->IsEof() && !reader1->Read(data1, len1))
+			return DIFFCODE::CMPERR;
+		if (len2 == 0 && !reader2->IsEof() && !reader2->Read(data2, len2))
+			return DIFFCODE::CMPERR;
+		// no more data means end of file
+		if (len1 == 0 || len2 == 0)
+			return (len1 == len2) ? DIFFCODE::SAME : DIFFCODE::DIFF;
+		const size_t len = (std::min)(len1, len2);
+		bool equal;
+		if (!compare_blocks(data1, data2, len, equal))
+			return DIFFCODE::CMPERR;
+		if (!equal)
+			return DIFFCODE::DIFF;
+		data1 += len;
+		data2 += len;
+		len1 -= len;
+		len2 -= len;
+	}
 }
 
 /**
@@ -7,10 +7,16 @@
 #include "pch.h"
 #include "ByteComparator.h"
 #include <cassert>
+#include <algorithm>
 #include "UnicodeString.h"
 #include "FileTextStats.h"
 #include "CompareOptions.h"
 
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#define BYTECOMPARATOR_SIMD
+#endif
+
 /**
  * @brief Returns if given char is EOL byte.
  * @param [in] ch Char to test.
@@ -32,6 +38,216 @@ static inline bool iswsch(TCHAR ch)
 	return ch == ' ' || ch == '\t';
 }
 
+/**
+ * @brief Skip over equal bytes, one byte at a time.
+ * @param [in] ptr0 Pointer to first buffer.
+ * @param [in] ptr1 Pointer to second buffer.
+ * @param [in] len Number of bytes available in both buffers.
+ * @param [in] stopAtWs Stop at whitespace bytes?
+ * @param [in] stopAtEol Stop at EOL bytes?
+ * @return Number of equal bytes skipped.
+ */
+static size_t SkipEqualScalar(const char *ptr0, const char *ptr1, size_t len,
+		bool stopAtWs, bool stopAtEol)
+{
+	size_t done = 0;
+	for (; done < len; ++done)
+	{
+		char ch = ptr0[done];
+		if (ch != ptr1[done] || (stopAtWs && iswsch(ch)) || (stopAtEol && iseolch(ch)))
+			break;
+	}
+	return done;
+}
+
+/**
+ * @brief Leave the whole buffer to the byte per byte scan of TextScan().
+ */
+static const char *TextScanScalar(FileTextStats & stats, const char *ptr, const char *end)
+{
+	return ptr;
+}
+
+#ifdef BYTECOMPARATOR_SIMD
+
+/**
+ * @brief Count number of set bits without the POPCNT instruction.
+ */
+static inline int PopCountBits(unsigned mask)
+{
+	mask = mask - ((mask >> 1) & 0x55555555);
+	mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+	return static_cast<int>((((mask + (mask >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+}
+
+/**
+ * @brief Return index of lowest set bit of non-zero @p mask.
+ */
+static inline unsigned LowestBit(unsigned mask)
+{
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+}
+
+/**
+ * @brief 16-byte vector operations using SSE2.
+ */
+struct VectorSse2
+{
+	typedef __m128i Vec;
+	static const size_t Width = 16;
+	static const unsigned FullMask = 0xFFFF;
+	static Vec Load(const char *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+	static Vec Set1(char ch) { return _mm_set1_epi8(ch); }
+	static unsigned MaskEq(Vec a, Vec b) { return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b))); }
+	static int PopCount(unsigned mask) { return PopCountBits(mask); }
+};
+
+/**
+ * @brief 32-byte vector operations using AVX2 (and POPCNT).
+ */
+struct VectorAvx2
+{
+	typedef __m256i Vec;
+	static const size_t Width = 32;
+	static const unsigned FullMask = 0xFFFFFFFF;
+	static Vec Load(const char *p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); }
+	static Vec Set1(char ch) { return _mm256_set1_epi8(ch); }
+	static unsigned MaskEq(Vec a, Vec b) { return static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b))); }
+	static int PopCount(unsigned mask) { return static_cast<int>(_mm_popcnt_u32(mask)); }
+};
+
+/**
+ * @brief Skip over equal bytes a vector at a time.
+ * Stops at first differing byte, and at whitespace and EOL bytes if asked,
+ * so the compare state machine gets to decide about them. Trailing bytes
+ * not filling a whole vector are left to the state machine too.
+ * @param [in] ptr0 Pointer to first buffer.
+ * @param [in] ptr1 Pointer to second buffer.
+ * @param [in] len Number of bytes available in both buffers.
+ * @param [in] stopAtWs Stop at whitespace bytes?
+ * @param [in] stopAtEol Stop at EOL bytes?
+ * @return Number of equal bytes skipped.
+ */
+template <class V>
+static size_t SkipEqualWide(const char *ptr0, const char *ptr1, size_t len,
+		bool stopAtWs, bool stopAtEol)
+{
+	const typename V::Vec space = V::Set1(' ');
+	const typename V::Vec tab = V::Set1('\t');
+	const typename V::Vec cr = V::Set1('\r');
+	const typename V::Vec lf = V::Set1('\n');
+	size_t done = 0;
+	for (; len - done >= V::Width; done += V::Width)
+	{
+		const typename V::Vec v0 = V::Load(ptr0 + done);
+		unsigned stop = ~V::MaskEq(v0, V::Load(ptr1 + done)) & V::FullMask;
+		if (stopAtWs)
+			stop |= V::MaskEq(v0, space) | V::MaskEq(v0, tab);
+		if (stopAtEol)
+			stop |= V::MaskEq(v0, cr) | V::MaskEq(v0, lf);
+		if (stop != 0)
+			return done + LowestBit(stop);
+	}
+	return done;
+}
+
+/**
+ * @brief Calculate EOL and zero-byte statistics a vector at a time.
+ * A vector is scanned only when a byte follows it in the buffer, so a CR/LF
+ * pair starting at its last byte is seen complete. The byte per byte scan
+ * continues from the returned position, which is never the last byte of
+ * the buffer; a CR there still needs the eof handling of TextScan().
+ * @param [in,out] stats Structure holding statistics.
+ * @param [in] ptr Pointer to begin of the buffer.
+ * @param [in] end Pointer to end of buffer.
+ * @return Pointer to first byte not scanned.
+ */
+template <class V>
+static const char *TextScanWide(FileTextStats & stats, const char *ptr, const char *end)
+{
+	const typename V::Vec zero = V::Set1('\0');
+	const typename V::Vec cr = V::Set1('\r');
+	const typename V::Vec lf = V::Set1('\n');
+	__int64 nzeros = 0, ncrs = 0, nlfs = 0, npairs = 0;
+	unsigned crossing = 0; // last vector ended with CR of a CR/LF pair
+	for (; end - ptr > static_cast<ptrdiff_t>(V::Width); ptr += V::Width)
+	{
+		const typename V::Vec v = V::Load(ptr);
+		const unsigned z = V::MaskEq(v, zero);
+		const unsigned c = V::MaskEq(v, cr);
+		const unsigned l = V::MaskEq(v, lf);
+		if ((z | c | l) == 0)
+		{
+			crossing = 0;
+			continue;
+		}
+		const unsigned next = ptr[V::Width] == '\n' ? 1 : 0;
+		const unsigned pairs = c & ((l >> 1) | (next << (V::Width - 1)));
+		crossing = pairs >> (V::Width - 1);
+		nzeros += V::PopCount(z);
+		ncrs += V::PopCount(c);
+		nlfs += V::PopCount(l);
+		npairs += V::PopCount(pairs);
+	}
+	// LF of a pair crossing the last vector was not counted, skip it
+	stats.nzeros += nzeros;
+	stats.ncrlfs += npairs;
+	stats.ncrs += ncrs - npairs;
+	stats.nlfs += nlfs - (npairs - crossing);
+	return ptr + crossing;
+}
+
+#endif // BYTECOMPARATOR_SIMD
+
+/**
+ * @brief Implementations of the inner loops for the CPU we are running on.
+ */
+struct ByteScanners
+{
+	const char *(*TextScan)(FileTextStats & stats, const char *ptr, const char *end);
+	size_t (*SkipEqual)(const char *ptr0, const char *ptr1, size_t len, bool stopAtWs, bool stopAtEol);
+};
+
+/**
+ * @brief Select widest vector implementation the CPU and OS support.
+ */
+static ByteScanners SelectScanners()
+{
+	ByteScanners scanners = { TextScanScalar, SkipEqualScalar };
+#ifdef BYTECOMPARATOR_SIMD
+	int info[4];
+	__cpuid(info, 0);
+	const int maxLeaf = info[0];
+	__cpuid(info, 1);
+	const bool sse2 = (info[3] & (1 << 26)) != 0;
+	const bool popcnt = (info[2] & (1 << 23)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	bool avx2 = false;
+	// AVX2 also needs the OS to save the YMM registers
+	if (maxLeaf >= 7 && popcnt && osxsave && avx && (_xgetbv(0) & 6) == 6)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+	if (avx2)
+	{
+		scanners.TextScan = TextScanWide<VectorAvx2>;
+		scanners.SkipEqual = SkipEqualWide<VectorAvx2>;
+	}
+	else if (sse2)
+	{
+		scanners.TextScan = TextScanWide<VectorSse2>;
+		scanners.SkipEqual = SkipEqualWide<VectorSse2>;
+	}
+#endif
+	return scanners;
+}
+
+static const ByteScanners Scanners = SelectScanners();
+
 /**
  * @brief Calculates statistics from given buffer.
  * This function calculates EOL byte and zero-byte statistics from given
@@ -59,6 +275,7 @@ static void TextScan(FileTextStats & stats, const char *ptr, const char *end, bo
 			++stats.ncrs;
 		}
 	}
+	ptr = Scanners.TextScan(stats, ptr, end);
 	for (; ptr < end; ++ptr)
 	{
 		char ch = *ptr;
@@ -165,6 +382,10 @@ ByteComparator::COMP_RESULT ByteComparator::CompareBuffers(
 	const char *orig0 = ptr0;
 	const char *orig1 = ptr1;
 
+	// Bytes the state machine below may treat specially
+	const bool stopAtWs = m_ignore_all_space || m_ignore_space_change;
+	const bool stopAtEol = m_ignore_eol_diff || m_ignore_blank_lines;
+
 	// cycle through buffer data performing actual comparison
 	while (true)
 	{
@@ -406,6 +627,20 @@ ByteComparator::COMP_RESULT ByteComparator::CompareBuffers(
 			m_bol1 = iseolch(c1);
 			++ptr0;
 			++ptr1;
+
+			// Skip over a run of equal bytes which need no decisions
+			// about whitespace, EOLs or case; the state machine would
+			// just step over them one by one
+			size_t skipped = Scanners.SkipEqual(ptr0, ptr1,
+				static_cast<size_t>((std::min)(end0 - ptr0, end1 - ptr1)), stopAtWs, stopAtEol);
+			if (skipped > 0)
+			{
+				ptr0 += skipped;
+				ptr1 += skipped;
+				m_bol0 = m_bol1 = iseolch(ptr0[-1]);
+				if (m_ignore_eol_diff)
+					m_eol0 = m_eol1 = false;
+			}
 			continue;
 		}
 		goto need_more;
@@ -21,6 +21,10 @@ namespace CompareEngines
  * options for whitespace ignore etc. Which makes it more complex than just
  * simple byte per byte compare. Also counts EOL / 0-byte statistics from
  * buffers so we can detect binary files and EOL types.
+ *
+ * Runs of equal bytes and the statistics are handled with SSE2 or AVX2
+ * vectors when the CPU supports them; the byte per byte state machine only
+ * runs near bytes the compare options need decisions about.
  */
 class ByteComparator
 {
@@ -7,7 +7,7 @@
 #include "pch.h"
 #include "ByteCompare.h"
 #include <cassert>
-#include <io.h>
+#include <windows.h>
 #include "FileLocation.h"
 #include "UnicodeString.h"
 #include "IAbortable.h"
@@ -15,15 +15,11 @@
 #include "DiffContext.h"
 #include "diff.h"
 #include "ByteComparator.h"
+#include "FileReader.h"
 
 namespace CompareEngines
 {
 
-static const int KILO = 1024; // Kilo(byte)
-
-/** @brief Quick contents compare's file buffer size. */
-static const int WMCMPBUFF = 32 * KILO;
-
 static void CopyTextStats(const FileTextStats * stats, FileTextStats * myTextStats);
 
 /**
@@ -88,10 +84,34 @@ void ByteCompare::SetFileData(int items, file_data *data)
 }
 
 
+/**
+ * @brief Call ByteComparator::CompareBuffers() for blocks of mapped files.
+ * Read errors of memory-mapped files show up as in-page exceptions, which
+ * are turned into a failure here.
+ * @return false if reading the files failed.
+ */
+static bool CompareBlocks(ByteComparator &comparator, ByteComparator::COMP_RESULT &result,
+	FileTextStats & stats0, FileTextStats & stats1, const char* &ptr0, const char* &ptr1,
+	const char* end0, const char* end1, bool eof0, bool eof1, int64_t offset0, int64_t offset1)
+{
+	__try
+	{
+		result = comparator.CompareBuffers(stats0, stats1, ptr0, ptr1, end0, end1,
+			eof0, eof1, offset0, offset1);
+	}
+	__except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ?
+		EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+	{
+		return false;
+	}
+	return true;
+}
+
 /**
  * @brief Compare two specified files, byte-by-byte
- * @param [in] bStopAfterFirstDiff Stop compare after we find first difference?
- * @param [in] piAbortable Interface allowing to abort compare
+ * Files are compared straight from the blocks FileReader gives out,
+ * without copying them into buffers of our own.
+ * @param [in,out] location Locations of the files.
  * @return DIFFCODE
  */
 int ByteCompare::CompareFiles(FileLocation *location)
@@ -100,82 +120,67 @@ int ByteCompare::CompareFiles(FileLocation *location)
 	// Right now, we assume files are in 8-bit encoding
 	// because transform code converted any UCS-2 files to UTF-8
 	// We could compare directly in UCS-2LE here, as an optimization, in that case
-	char buff[2][WMCMPBUFF]; // buffered access to files
 	int i;
 	unsigned diffcode = 0;
 
-	// area of buffer currently holding data
-	int64_t bfstart[2]; // offset into buff[i] where current data resides
-	int64_t bfend[2]; // past-the-end pointer into buff[i], giving end of current data
-	// buff[0] has bytes to process from buff[0][bfstart[0]] to buff[0][bfend[0]-1]
-
+	std::unique_ptr<FileReader> readers[2];
+	const char* begin[2]; // begin of current block
+	const char* ptr[2]; // where comparing continues in current block
+	const char* end[2]; // past-the-end pointer of current block
+	int64_t offset[2]; // offset of current block in file
+	bool needMore[2]; // side has been compared to the end of its block
 	bool eof[2]; // if we've finished file
 
-	// initialize our buffer pointers and end of file flags
+	// initialize our block pointers and end of file flags
 	for (i = 0; i < 2; ++i)
 	{
-		bfstart[i] = bfend[i] = 0;
+		// Same file on both sides gets two readers sharing the descriptor,
+		// readers read at offsets of their own
+		readers[i] = FileReader::Create(m_inf[i].desc);
+		if (!readers[i])
+			return DIFFCODE::CMPERR;
+		begin[i] = ptr[i] = end[i] = nullptr;
+		offset[i] = 0;
+		needMore[i] = true;
 		eof[i] = false;
 	}
+	if (m_inf[0].desc == m_inf[1].desc)
+		location[1] = location[0];
 
 	ByteComparator comparator(m_pOptions.get());
 
 	// Begin loop
-	// we handle the files in WMCMPBUFF sized buffers (variable buff[][])
-	// That is, we do one buffer full at a time
-	// or even less, as we process until one side buffer is empty, then reload that one
-	// and continue
-	while (!eof[0] || !eof[1])
+	// we compare until one side's block is used up, then get next block
+	// for that side and continue
+	for (;;)
 	{
 		if (m_piAbortable != nullptr && m_piAbortable->ShouldAbort())
 			return DIFFCODE::CMPABORT;
 
-		// load or update buffers as appropriate
+		// get next blocks as appropriate
 		for (i = 0; i < 2; ++i)
 		{
-			if (!eof[i] && bfstart[i] == sizeof(buff[i])/sizeof(buff[i][0]))
-			{
-				bfstart[i] = bfend[i] = 0;
-			}
-			if (!eof[i] && bfend[i] < sizeof(buff[i])/sizeof(buff[i][0]) - 1)
-			{
-				// Assume our blocks are in range of int
-				int space = sizeof(buff[i])/sizeof(buff[i][0]) - (int) bfend[i];
-				int rtn = _read(m_inf[i].desc, &buff[i][bfend[i]], (unsigned)space);
-				if (rtn == -1)
-					return DIFFCODE::CMPERR;
-				if (rtn < space)
-					eof[i] = true;
-				bfend[i] += rtn;
-				if (m_inf[0].desc == m_inf[1].desc)
-				{
-					bfstart[1] = bfstart[0];
-					bfend[1] = bfend[0];
-					eof[1] = eof[0];
-					location[1] = location[0];
-					memcpy(&buff[1][bfend[1] - rtn], &buff[0][bfend[0] - rtn], rtn);
-					break;
-				}
-			}
+			if (!needMore[i] || eof[i])
+				continue;
+			// comparator asks for more only after using up the block
+			assert(ptr[i] == end[i]);
+			const char* data;
+			size_t len;
+			if (!readers[i]->Read(data, len))
+				return DIFFCODE::CMPERR;
+			offset[i] += end[i] - begin[i];
+			begin[i] = ptr[i] = data;
+			end[i] = data + len;
+			eof[i] = readers[i]->IsEof();
+			needMore[i] = false;
 		}
-		// where to start comparing right now
-		const char* ptr0 = &buff[0][bfstart[0]];
-		const char* ptr1 = &buff[1][bfstart[1]];
-
-		// remember where we started
-		const char* orig0 = ptr0;
-		const char* orig1 = ptr1;
-
-		// how far can we go right now?
-		const char* end0 = &buff[0][bfend[0]];
-		const char* end1 = &buff[1][bfend[1]];
 
-		int64_t offset0 = (ptr0 - &buff[0][0]);
-		int64_t offset1 = (ptr1 - &buff[1][0]);
-
-		// are these two buffers the same?
-		int result = comparator.CompareBuffers(m_textStats[0], m_textStats[1],
-				ptr0, ptr1, end0, end1, eof[0], eof[1], offset0, offset1);
+		// are these two blocks the same?
+		ByteComparator::COMP_RESULT result;
+		if (!CompareBlocks(comparator, result, m_textStats[0], m_textStats[1],
+				ptr[0], ptr[1], end[0], end[1], eof[0], eof[1],
+				offset[0] + (ptr[0] - begin[0]), offset[1] + (ptr[1] - begin[1])))
+			return DIFFCODE::CMPERR;
 		if (result == ByteComparator::RESULT_DIFF)
 		{
 			if (m_pOptions->m_bStopAfterFirstDiff)
@@ -187,69 +192,31 @@ int ByteCompare::CompareFiles(FileLocation *location)
 			else
 			{
 				diffcode |= DIFFCODE::DIFF;
-				ptr0 = end0;
-				ptr1 = end1;
-				// move our current pointers over what we just compared
-				assert(ptr0 >= orig0);
-				assert(ptr1 >= orig1);
-				bfstart[0] += ptr0 - orig0;
-				bfstart[1] += ptr1 - orig1;
+				// skip over what we just compared
+				for (i = 0; i < 2; ++i)
+				{
+					ptr[i] = end[i];
+					needMore[i] = true;
+				}
 			}
 		}
 		else if (result == ByteComparator::NEED_MORE_0)
 		{
-			const int m = (int)(ptr0 - &buff[0][0]);
-			const int l = (int)(end0 - ptr0);
-			//move uncompared data to begin of buff0
-			memcpy(&buff[0][0], &buff[0][m], l);
-			bfstart[0] = 0;
-			bfstart[1] += ptr1 - orig1;
-			bfend[0] = l;
+			needMore[0] = true;
 		}
 		else if (result == ByteComparator::NEED_MORE_1)
 		{
-			const int m = (int)(ptr1 - &buff[1][0]);
-			const int l = (int)(end1 - ptr1);
-			//move uncompared data to begin of buff1
-			memcpy(&buff[1][0], &buff[1][m], l);
-			bfstart[1] = 0;
-			bfstart[0] += ptr0 - orig0;
-			bfend[1] = l;
+			needMore[1] = true;
 		}
 		else if (result == ByteComparator::NEED_MORE_BOTH)
 		{
-			if ((end0 == ptr0) && (end1 == ptr1))
-			{
-				bfstart[0] += ptr0 - orig0;
-				bfend[0] = 0;
-				bfstart[1] += ptr1 - orig1;
-				bfend[1] = 0;
-			}
-			else
-			{
-				if (ptr0 < end0)
-				{
-					const int m = (int)(ptr0 - orig0);
-					const int l = (int)(end0 - ptr0);
-					//move uncompared data to begin of buff0
-					memcpy(&buff[0][0], &buff[0][m], l);
-					bfstart[0] = 0;
-					bfend[0] += l;
-				}
-				if (ptr1 < end1)
-				{
-					const int m = (int)(ptr1 - orig1);
-					const int l = (int)(end1 - ptr1);
-					//move uncompared data to begin of buff1
-					memcpy(&buff[1][0], &buff[1][ m], l);
-					bfstart[1] = 0;
-					bfend[1] += l;
-				}
-			}
+			needMore[0] = needMore[1] = true;
 		}
 		else
 		{
 			assert(result == ByteComparator::RESULT_SAME);
+			for (i = 0; i < 2; ++i)
+				needMore[i] = (ptr[i] == end[i]);
 		}
 
 		// Did we finish both files?
@@ -270,7 +237,7 @@ int ByteCompare::CompareFiles(FileLocation *location)
 				diffcode |= DIFFCODE::TEXT;
 
 			// If either unfinished, they differ
-			if (ptr0 != end0 || ptr1 != end1)
+			if (ptr[0] != end[0] || ptr[1] != end[1])
 				diffcode = (diffcode & DIFFCODE::DIFF);
 			if (diffcode & DIFFCODE::DIFF)
 				return diffcode | DIFFCODE::DIFF;
@@ -278,7 +245,6 @@ int ByteCompare::CompareFiles(FileLocation *location)
 				return diffcode | DIFFCODE::SAME;
 		}
 	}
-	return diffcode;
 }
 
 /**
@@ -19,8 +19,8 @@ namespace CompareEngines
 
 /**
  * @brief A quick compare -compare method implementation class.
- * This compare method compares files in small blocks. Code assumes block size
- * is in range of 32-bit int-type.
+ * This compare method compares files block by block, as FileReader gives
+ * them out.
  */
 class ByteCompare
 {
@@ -0,0 +1,398 @@
+/**
+ * @file  FileReader.cpp
+ *
+ * @brief Implementation file for FileReader classes.
+ */
+
+#include "pch.h"
+#include "FileReader.h"
+#include <algorithm>
+#include <cstdlib>
+#include <io.h>
+#include <malloc.h>
+#include <windows.h>
+#include "TFile.h"
+
+namespace CompareEngines
+{
+
+namespace
+{
+
+/** @brief Files smaller than this are read into one buffer. */
+const uint64_t MappedMinSize = 1024 * 1024;
+/** @brief Files larger than this are read with read-ahead. */
+const uint64_t ReadAheadMinSize = 256 * 1024 * 1024;
+/** @brief Size of file views mapped at once, multiple of allocation granularity. */
+const uint64_t ViewSize = 16 * 1024 * 1024;
+/** @brief Size of read buffers. */
+const size_t BufferSize = 1024 * 1024;
+/** @brief Alignment of read buffers. */
+const size_t BufferAlignment = 4096;
+
+/** @brief Same layout as WIN32_MEMORY_RANGE_ENTRY. */
+struct MemoryRange
+{
+	void *VirtualAddress;
+	SIZE_T NumberOfBytes;
+};
+
+typedef BOOL (WINAPI *PrefetchVirtualMemoryFunc)(HANDLE, ULONG_PTR, MemoryRange *, ULONG);
+
+/**
+ * @brief Return PrefetchVirtualMemory(), or nullptr before Windows 8.
+ */
+PrefetchVirtualMemoryFunc GetPrefetchVirtualMemory()
+{
+	static const PrefetchVirtualMemoryFunc func = reinterpret_cast<PrefetchVirtualMemoryFunc>(
+		GetProcAddress(GetModuleHandle(_T("kernel32.dll")), "PrefetchVirtualMemory"));
+	return func;
+}
+
+/**
+ * @brief Read from given offset of a synchronous file handle.
+ * @return false if reading failed, reading past end of file is not a failure.
+ */
+bool ReadAt(HANDLE hFile, uint64_t offset, char *buffer, size_t size, size_t &read)
+{
+	OVERLAPPED ov = {};
+	ov.Offset = static_cast<DWORD>(offset);
+	ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+	DWORD n = 0;
+	if (!ReadFile(hFile, buffer, static_cast<DWORD>(size), &n, &ov) && GetLastError() != ERROR_HANDLE_EOF)
+		return false;
+	read = n;
+	return true;
+}
+
+/**
+ * @brief Common part of readers: the handle and the read position.
+ */
+class HandleFileReader : public FileReader
+{
+public:
+	HandleFileReader(HANDLE hFile, uint64_t offset, uint64_t size)
+		: m_hFile(hFile), m_bOwnHandle(false), m_offset(offset), m_size(size) {}
+	virtual ~HandleFileReader()
+	{
+		if (m_bOwnHandle)
+			CloseHandle(m_hFile);
+	}
+	virtual bool Init() = 0;
+	void SetOwnHandle() { m_bOwnHandle = true; }
+
+protected:
+	HANDLE m_hFile;
+	bool m_bOwnHandle; /**< Close m_hFile when done? */
+	uint64_t m_offset; /**< Offset of next block */
+	uint64_t m_size; /**< Size of file */
+};
+
+/**
+ * @brief Reader mapping views of the file into memory.
+ */
+class MappedFileReader : public HandleFileReader
+{
+public:
+	MappedFileReader(HANDLE hFile, uint64_t offset, uint64_t size)
+		: HandleFileReader(hFile, offset, size), m_hMapping(nullptr), m_pView(nullptr) {}
+
+	virtual ~MappedFileReader()
+	{
+		if (m_pView != nullptr)
+			UnmapViewOfFile(m_pView);
+		if (m_hMapping != nullptr)
+			CloseHandle(m_hMapping);
+	}
+
+	virtual bool Init()
+	{
+		// Empty files cannot be mapped, but they need no reading either
+		if (m_offset >= m_size)
+			return true;
+		m_hMapping = CreateFileMapping(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		return m_hMapping != nullptr;
+	}
+
+	virtual bool Read(const char *&data, size_t &len)
+	{
+		if (m_pView != nullptr)
+		{
+			UnmapViewOfFile(m_pView);
+			m_pView = nullptr;
+		}
+		if (m_offset >= m_size)
+		{
+			data = "";
+			len = 0;
+			m_bEof = true;
+			return true;
+		}
+		const uint64_t base = m_offset & ~(ViewSize - 1);
+		const size_t viewLen = static_cast<size_t>((std::min)(ViewSize, m_size - base));
+		m_pView = static_cast<const char *>(MapViewOfFile(m_hMapping, FILE_MAP_READ,
+			static_cast<DWORD>(base >> 32), static_cast<DWORD>(base), viewLen));
+		if (m_pView == nullptr)
+			return false;
+		data = m_pView + (m_offset - base);
+		len = viewLen - static_cast<size_t>(m_offset - base);
+
+		// Tell the memory manager the whole view is going to be read,
+		// so it is paged in with large reads instead of fault by fault
+		if (PrefetchVirtualMemoryFunc prefetch = GetPrefetchVirtualMemory())
+		{
+			MemoryRange range = { const_cast<char *>(data), len };
+			prefetch(GetCurrentProcess(), 1, &range, 0);
+		}
+
+		m_offset += len;
+		m_bEof = m_offset >= m_size;
+		return true;
+	}
+
+private:
+	HANDLE m_hMapping;
+	const char *m_pView; /**< Currently mapped view */
+};
+
+/**
+ * @brief Reader reading the file into one large aligned buffer.
+ */
+class BufferedFileReader : public HandleFileReader
+{
+public:
+	BufferedFileReader(HANDLE hFile, uint64_t offset, uint64_t size)
+		: HandleFileReader(hFile, offset, size), m_pBuffer(nullptr), m_bufSize(0) {}
+
+	virtual ~BufferedFileReader()
+	{
+		_aligned_free(m_pBuffer);
+	}
+
+	virtual bool Init()
+	{
+		// Small files get a buffer with room for a byte more than they have,
+		// the short read then tells end of file without another read
+		const uint64_t remaining = m_size > m_offset ? m_size - m_offset : 0;
+		m_bufSize = static_cast<size_t>((std::min)(static_cast<uint64_t>(BufferSize),
+			(remaining + BufferAlignment) & ~static_cast<uint64_t>(BufferAlignment - 1)));
+		m_pBuffer = static_cast<char *>(_aligned_malloc(m_bufSize, BufferAlignment));
+		return m_pBuffer != nullptr;
+	}
+
+	virtual bool Read(const char *&data, size_t &len)
+	{
+		len = 0;
+		data = m_pBuffer;
+		if (m_bEof)
+			return true;
+		if (!ReadAt(m_hFile, m_offset, m_pBuffer, m_bufSize, len))
+			return false;
+		m_offset += len;
+		m_bEof = len < m_bufSize;
+		return true;
+	}
+
+private:
+	char *m_pBuffer;
+	size_t m_bufSize;
+};
+
+/**
+ * @brief Reader reading next block with overlapped I/O while the current
+ * block is compared.
+ */
+class ReadAheadFileReader : public HandleFileReader
+{
+public:
+	ReadAheadFileReader(HANDLE hFile, uint64_t offset, uint64_t size)
+		: HandleFileReader(hFile, offset, size), m_hAsync(INVALID_HANDLE_VALUE), m_cur(0)
+	{
+		for (int i = 0; i < 2; ++i)
+		{
+			m_pBuffer[i] = nullptr;
+			m_ov[i] = OVERLAPPED();
+			m_bPending[i] = false;
+			m_bFailed[i] = false;
+		}
+	}
+
+	virtual ~ReadAheadFileReader()
+	{
+		for (int i = 0; i < 2; ++i)
+		{
+			if (m_bPending[i])
+			{
+				DWORD n;
+				CancelIoEx(m_hAsync, &m_ov[i]);
+				GetOverlappedResult(m_hAsync, &m_ov[i], &n, TRUE);
+			}
+			if (m_ov[i].hEvent != nullptr)
+				CloseHandle(m_ov[i].hEvent);
+			_aligned_free(m_pBuffer[i]);
+		}
+		if (m_hAsync != INVALID_HANDLE_VALUE)
+			CloseHandle(m_hAsync);
+	}
+
+	virtual bool Init()
+	{
+		// Overlapped reads need a handle of their own opened for them
+		m_hAsync = ReOpenFile(m_hFile, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+			FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN);
+		if (m_hAsync == INVALID_HANDLE_VALUE)
+			return false;
+		for (int i = 0; i < 2; ++i)
+		{
+			m_pBuffer[i] = static_cast<char *>(_aligned_malloc(BufferSize, BufferAlignment));
+			m_ov[i].hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+			if (m_pBuffer[i] == nullptr || m_ov[i].hEvent == nullptr)
+				return false;
+		}
+		Issue(0);
+		return true;
+	}
+
+	virtual bool Read(const char *&data, size_t &len)
+	{
+		const int i = m_cur;
+		len = 0;
+		data = m_pBuffer[i];
+		if (m_bEof)
+			return true;
+		if (m_bFailed[i])
+			return false;
+		if (m_bPending[i])
+		{
+			DWORD n = 0;
+			m_bPending[i] = false;
+			if (!GetOverlappedResult(m_hAsync, &m_ov[i], &n, TRUE) && GetLastError() != ERROR_HANDLE_EOF)
+				return false;
+			len = n;
+		}
+		m_bEof = len < BufferSize;
+		if (!m_bEof)
+		{
+			// Buffer of previous block is free again, read ahead into it
+			m_cur = 1 - i;
+			Issue(m_cur);
+		}
+		return true;
+	}
+
+private:
+	/** @brief Start reading next block into buffer @p i. */
+	void Issue(int i)
+	{
+		OVERLAPPED &ov = m_ov[i];
+		ov.Internal = ov.InternalHigh = 0;
+		ov.Offset = static_cast<DWORD>(m_offset);
+		ov.OffsetHigh = static_cast<DWORD>(m_offset >> 32);
+		ResetEvent(ov.hEvent);
+		m_offset += BufferSize;
+		if (ReadFile(m_hAsync, m_pBuffer[i], static_cast<DWORD>(BufferSize), nullptr, &ov) ||
+			GetLastError() == ERROR_IO_PENDING)
+			m_bPending[i] = true;
+		else if (GetLastError() != ERROR_HANDLE_EOF)
+			m_bFailed[i] = true;
+		// else reading at end of file, the block is empty
+	}
+
+	HANDLE m_hAsync; /**< Handle opened for overlapped reads */
+	char *m_pBuffer[2];
+	OVERLAPPED m_ov[2];
+	bool m_bPending[2]; /**< Read into the buffer not completed yet */
+	bool m_bFailed[2]; /**< Starting the read into the buffer failed */
+	int m_cur; /**< Buffer of the next block */
+};
+
+/**
+ * @brief Create reader for @p hFile, falling back to buffered reads.
+ * @param [in] hFile Handle of file to read.
+ * @param [in] bOwnHandle Reader closes @p hFile, also when failing.
+ * @param [in] offset Offset to start reading from.
+ * @param [in] strategy How to read the file.
+ */
+std::unique_ptr<FileReader> CreateReader(HANDLE hFile, bool bOwnHandle, uint64_t offset, FileReader::Strategy strategy)
+{
+	std::unique_ptr<HandleFileReader> reader;
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(hFile, &size))
+	{
+		const uint64_t fileSize = static_cast<uint64_t>(size.QuadPart);
+		if (strategy == FileReader::AUTO)
+			strategy = FileReader::ChooseStrategy(fileSize > offset ? fileSize - offset : 0);
+		if (strategy == FileReader::MAPPED)
+			reader.reset(new MappedFileReader(hFile, offset, fileSize));
+		else if (strategy == FileReader::READ_AHEAD)
+			reader.reset(new ReadAheadFileReader(hFile, offset, fileSize));
+		if (reader && !reader->Init())
+			reader.reset();
+		if (!reader)
+		{
+			reader.reset(new BufferedFileReader(hFile, offset, fileSize));
+			if (!reader->Init())
+				reader.reset();
+		}
+	}
+	if (reader && bOwnHandle)
+		reader->SetOwnHandle();
+	else if (bOwnHandle)
+		CloseHandle(hFile);
+	return std::unique_ptr<FileReader>(reader.release());
+}
+
+}
+
+/**
+ * @brief Create reader for a file opened with CRT functions.
+ * Reading starts from the current position of the descriptor; the position
+ * itself is not changed. The descriptor must stay open as long as the
+ * reader is used.
+ * @param [in] fd File descriptor.
+ * @param [in] strategy How to read the file.
+ * @return Reader, or empty pointer if the file cannot be read.
+ */
+std::unique_ptr<FileReader> FileReader::Create(int fd, Strategy strategy /*= AUTO*/)
+{
+	HANDLE hFile = reinterpret_cast<HANDLE>(_get_osfhandle(fd));
+	__int64 pos = _lseeki64(fd, 0, SEEK_CUR);
+	if (hFile == INVALID_HANDLE_VALUE || pos < 0)
+		return nullptr;
+	return CreateReader(hFile, false, static_cast<uint64_t>(pos), strategy);
+}
+
+/**
+ * @brief Open file for reading.
+ * The file is shared for reading only while it is read.
+ * @param [in] path Full path to file.
+ * @param [in] strategy How to read the file.
+ * @return Reader, or empty pointer if the file cannot be opened.
+ */
+std::unique_ptr<FileReader> FileReader::Open(const String& path, Strategy strategy /*= AUTO*/)
+{
+	HANDLE hFile = CreateFileW(TFile(path).wpath().c_str(), GENERIC_READ, FILE_SHARE_READ,
+		nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return nullptr;
+	return CreateReader(hFile, true, 0, strategy);
+}
+
+/**
+ * @brief Choose how to read a file having @p size bytes left to read.
+ * Small files are read with one read call, which is cheaper than setting up
+ * a mapping. Mid-sized files are mapped and compared straight from the file
+ * cache. Mapped views are paged in on demand, so the largest files are read
+ * with overlapped reads instead, which keeps the next read in flight while
+ * the current block is compared.
+ */
+FileReader::Strategy FileReader::ChooseStrategy(uint64_t size)
+{
+	if (size < MappedMinSize)
+		return BUFFERED;
+	if (size < ReadAheadMinSize)
+		return MAPPED;
+	return READ_AHEAD;
+}
+
+} // namespace CompareEngines
@@ -0,0 +1,64 @@
+/**
+ * @file  FileReader.h
+ *
+ * @brief Declaration file for FileReader classes used by compare engines.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include "UnicodeString.h"
+
+namespace CompareEngines
+{
+
+/**
+ * @brief Sequential block reader for compare engines.
+ *
+ * A reader hands out the file contents as a sequence of blocks. Blocks
+ * point straight into mapped file pages or into the reader's own buffers,
+ * so compare engines compare them in place without copying. A block stays
+ * valid until the next Read() call or until the reader is destroyed.
+ *
+ * Readers read at explicit offsets, so several readers can share one file
+ * descriptor. Data of mapped files is accessed as memory; read errors then
+ * show up as EXCEPTION_IN_PAGE_ERROR structured exceptions which callers
+ * must handle around their use of the blocks.
+ */
+class FileReader
+{
+public:
+	/** @brief How the file is read. */
+	enum Strategy
+	{
+		AUTO, /**< Choose by file size */
+		MAPPED, /**< Map views of the file into memory */
+		BUFFERED, /**< Read into one large aligned buffer */
+		READ_AHEAD, /**< Double-buffered overlapped reads, next block is read while current is compared */
+	};
+
+	virtual ~FileReader() {}
+
+	/**
+	 * @brief Get next block of file.
+	 * @param [out] data Pointer to block.
+	 * @param [out] len Length of block, 0 only at end of file.
+	 * @return false if reading failed.
+	 */
+	virtual bool Read(const char *&data, size_t &len) = 0;
+
+	/** @brief Is the last block returned the end of the file? */
+	bool IsEof() const { return m_bEof; }
+
+	static std::unique_ptr<FileReader> Create(int fd, Strategy strategy = AUTO);
+	static std::unique_ptr<FileReader> Open(const String& path, Strategy strategy = AUTO);
+	static Strategy ChooseStrategy(uint64_t size);
+
+protected:
+	FileReader() : m_bEof(false) {}
+
+	bool m_bEof; /**< Last block returned ends the file */
+};
+
+} // namespace CompareEngines
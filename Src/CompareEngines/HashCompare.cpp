@@ -0,0 +1,281 @@
+/**
+ * @file  HashCompare.cpp
+ *
+ * @brief Implementation file for HashCompare
+ */
+
+#include "pch.h"
+#include "HashCompare.h"
+#include <cstring>
+#include <windows.h>
+#include "DiffItem.h"
+#include "PathContext.h"
+#include "IAbortable.h"
+#include "FileReader.h"
+
+namespace CompareEngines
+{
+
+namespace
+{
+
+const uint64_t Prime1 = 0x9E3779B185EBCA87ULL;
+const uint64_t Prime2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t Prime3 = 0x165667B19E3779F9ULL;
+const uint64_t Prime4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t Prime5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t Rotl(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t Read64(const unsigned char *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+inline uint32_t Read32(const unsigned char *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+inline uint64_t Round(uint64_t acc, uint64_t input)
+{
+	acc += input * Prime2;
+	acc = Rotl(acc, 31);
+	return acc * Prime1;
+}
+
+inline uint64_t MergeRound(uint64_t acc, uint64_t val)
+{
+	acc ^= Round(0, val);
+	return acc * Prime1 + Prime4;
+}
+
+/** @brief Hash full 32-byte stripes of @p p, return bytes consumed. */
+inline size_t HashStripes(uint64_t acc[4], const unsigned char *p, size_t len)
+{
+	uint64_t v1 = acc[0], v2 = acc[1], v3 = acc[2], v4 = acc[3];
+	const unsigned char *q = p;
+	for (; len >= 32; len -= 32, q += 32)
+	{
+		v1 = Round(v1, Read64(q));
+		v2 = Round(v2, Read64(q + 8));
+		v3 = Round(v3, Read64(q + 16));
+		v4 = Round(v4, Read64(q + 24));
+	}
+	acc[0] = v1; acc[1] = v2; acc[2] = v3; acc[3] = v4;
+	return q - p;
+}
+
+/**
+ * @brief Hash one block of file.
+ * Read errors of memory-mapped files show up as in-page exceptions, which
+ * are turned into a failure here.
+ */
+bool HashBlock(ContentHasher &hasher, const void *data, size_t len)
+{
+	__try
+	{
+		hasher.Update(data, len);
+	}
+	__except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ?
+		EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+	{
+		return false;
+	}
+	return true;
+}
+
+}
+
+ContentHasher::ContentHasher(uint64_t seed /*= 0*/)
+: m_seed(seed)
+, m_totalLen(0)
+, m_bufLen(0)
+{
+	m_acc[0] = seed + Prime1 + Prime2;
+	m_acc[1] = seed + Prime2;
+	m_acc[2] = seed;
+	m_acc[3] = seed - Prime1;
+}
+
+/**
+ * @brief Add @p len bytes at @p data to the digest.
+ */
+void ContentHasher::Update(const void *data, size_t len)
+{
+	const unsigned char *p = static_cast<const unsigned char *>(data);
+	m_totalLen += len;
+	if (m_bufLen > 0)
+	{
+		size_t n = (std::min)(len, sizeof(m_buf) - m_bufLen);
+		memcpy(m_buf + m_bufLen, p, n);
+		m_bufLen += n;
+		p += n;
+		len -= n;
+		if (m_bufLen < sizeof(m_buf))
+			return;
+		HashStripes(m_acc, m_buf, sizeof(m_buf));
+		m_bufLen = 0;
+	}
+	size_t n = HashStripes(m_acc, p, len);
+	memcpy(m_buf, p + n, len - n);
+	m_bufLen = len - n;
+}
+
+/**
+ * @brief Return digest of the data added so far.
+ */
+uint64_t ContentHasher::Digest() const
+{
+	uint64_t h;
+	if (m_totalLen >= 32)
+	{
+		h = Rotl(m_acc[0], 1) + Rotl(m_acc[1], 7) + Rotl(m_acc[2], 12) + Rotl(m_acc[3], 18);
+		for (int i = 0; i < 4; ++i)
+			h = MergeRound(h, m_acc[i]);
+	}
+	else
+		h = m_seed + Prime5;
+	h += m_totalLen;
+
+	const unsigned char *p = m_buf;
+	size_t len = m_bufLen;
+	for (; len >= 8; len -= 8, p += 8)
+	{
+		h ^= Round(0, Read64(p));
+		h = Rotl(h, 27) * Prime1 + Prime4;
+	}
+	if (len >= 4)
+	{
+		h ^= static_cast<uint64_t>(Read32(p)) * Prime1;
+		h = Rotl(h, 23) * Prime2 + Prime3;
+		p += 4;
+		len -= 4;
+	}
+	for (; len > 0; --len, ++p)
+	{
+		h ^= *p * Prime5;
+		h = Rotl(h, 11) * Prime1;
+	}
+
+	h ^= h >> 33;
+	h *= Prime2;
+	h ^= h >> 29;
+	h *= Prime3;
+	h ^= h >> 32;
+	return h;
+}
+
+HashCompare::HashCompare()
+: m_piAbortable(nullptr)
+{
+}
+
+HashCompare::~HashCompare()
+{
+}
+
+/**
+ * @brief Set Abortable-interface.
+ * @param [in] piAbortable Pointer to abortable interface.
+ */
+void HashCompare::SetAbortable(const IAbortable * piAbortable)
+{
+	m_piAbortable = piAbortable;
+}
+
+/**
+ * @brief Compute digest of file contents.
+ * The data is hashed straight from the blocks FileReader gives out, for
+ * mapped files without copying them into read buffers.
+ * @param [in] path Full path to file.
+ * @param [out] hash Digest of file contents.
+ * @param [in] piAbortable Interface telling when to give up, or nullptr.
+ * @return true if file was read completely, false on error or abort.
+ */
+bool HashCompare::HashFile(const String& path, uint64_t &hash, const IAbortable * piAbortable /*= nullptr*/)
+{
+	std::unique_ptr<FileReader> reader = FileReader::Open(path);
+	if (!reader)
+		return false;
+
+	ContentHasher hasher;
+	while (!reader->IsEof())
+	{
+		if (piAbortable != nullptr && piAbortable->ShouldAbort())
+			return false;
+		const char *data;
+		size_t len;
+		if (!reader->Read(data, len) || !HashBlock(hasher, data, len))
+			return false;
+	}
+	hash = hasher.Digest();
+	return true;
+}
+
+/**
+ * @brief Compare two or three files by digests of their contents.
+ * Digests of all existing files are stored into @p di, also when sizes
+ * already tell the files differ.
+ * @param [in] files Files to compare.
+ * @param [in,out] di Diffitem info, gets the digests.
+ * @return DIFFCODE
+ */
+int HashCompare::CompareFiles(const PathContext& files, DIFFITEM &di) const
+{
+	const int nFiles = files.GetSize();
+	bool bError = false;
+	for (int i = 0; i < nFiles; ++i)
+	{
+		DiffFileInfo &dfi = di.diffFileInfo[i];
+		dfi.m_bContentHashValid = false;
+		if (!di.diffcode.exists(i))
+			continue;
+		dfi.m_bContentHashValid = HashFile(files[i], dfi.m_contentHash, m_piAbortable);
+		if (!dfi.m_bContentHashValid)
+		{
+			// HashFile() gives up also when aborted, which is no error
+			if (m_piAbortable != nullptr && m_piAbortable->ShouldAbort())
+				return DIFFCODE::CMPABORT;
+			bError = true;
+		}
+	}
+	if (bError)
+		return DIFFCODE::CMPERR;
+
+	auto same = [&di](int i, int j)
+	{
+		const DiffFileInfo &a = di.diffFileInfo[i];
+		const DiffFileInfo &b = di.diffFileInfo[j];
+		return a.m_bContentHashValid && b.m_bContentHashValid &&
+			a.size == b.size && a.m_contentHash == b.m_contentHash;
+	};
+
+	switch (nFiles)
+	{
+	case 2:
+		return same(0, 1) ? DIFFCODE::SAME : DIFFCODE::DIFF;
+	case 3:
+		bool same10 = same(1, 0);
+		bool same12 = same(1, 2);
+		if (same10 && same12)
+			return DIFFCODE::SAME;
+		else if (same10)
+			return DIFFCODE::DIFF | DIFFCODE::DIFF3RDONLY;
+		else if (same12)
+			return DIFFCODE::DIFF | DIFFCODE::DIFF1STONLY;
+		else if (same(0, 2))
+			return DIFFCODE::DIFF | DIFFCODE::DIFF2NDONLY;
+		return DIFFCODE::DIFF;
+	}
+	return DIFFCODE::CMPERR;
+}
+
+} // namespace CompareEngines
@@ -0,0 +1,59 @@
+/**
+ * @file  HashCompare.h
+ *
+ * @brief Declaration file for HashCompare compare engine.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "UnicodeString.h"
+
+class DIFFITEM;
+class PathContext;
+class IAbortable;
+
+namespace CompareEngines
+{
+
+/**
+ * @brief Streaming 64-bit content digest (XXH64).
+ * Data is hashed in 32-byte stripes over four independent lanes, so the
+ * multiplications of one stripe do not wait for each other. Digests are
+ * identical to the reference XXH64 implementation.
+ */
+class ContentHasher
+{
+public:
+	explicit ContentHasher(uint64_t seed = 0);
+	void Update(const void *data, size_t len);
+	uint64_t Digest() const;
+
+private:
+	uint64_t m_acc[4]; /**< Lane accumulators */
+	uint64_t m_seed;
+	uint64_t m_totalLen; /**< Bytes hashed so far */
+	unsigned char m_buf[32]; /**< Bytes not yet forming a full stripe */
+	size_t m_bufLen;
+};
+
+/**
+ * @brief A content hash compare class.
+ * This compare method computes a digest of every file and compares the
+ * digests. Every file is read once, also in three-way compare, and the
+ * digests are stored into DIFFITEM for showing and reusing them.
+ */
+class HashCompare
+{
+public:
+	HashCompare();
+	~HashCompare();
+	void SetAbortable(const IAbortable * piAbortable);
+	int CompareFiles(const PathContext& files, DIFFITEM &di) const;
+	static bool HashFile(const String& path, uint64_t &hash, const IAbortable * piAbortable = nullptr);
+
+private:
+	const IAbortable * m_piAbortable;
+};
+
+} // namespace CompareEngines
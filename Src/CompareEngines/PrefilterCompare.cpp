@@ -0,0 +1,228 @@
+/**
+ * @file  PrefilterCompare.cpp
+ *
+ * @brief Implementation file for PrefilterCompare
+ */
+
+#include "pch.h"
+#include "PrefilterCompare.h"
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstring>
+#include "DiffItem.h"
+#include "PathContext.h"
+#include "TFile.h"
+
+namespace CompareEngines
+{
+
+namespace
+{
+
+/** @brief Result of comparing samples of two files. */
+enum
+{
+	UNDECIDED,
+	SAME,
+	DIFFERENT,
+};
+
+/** @brief Read exactly @p len bytes from @p offset of file @p fd. */
+bool ReadAt(int fd, int64_t offset, std::vector<char> &buf, size_t len)
+{
+	buf.resize(len);
+	if (len == 0)
+		return true;
+	if (_lseeki64(fd, offset, SEEK_SET) != offset)
+		return false;
+	size_t pos = 0;
+	while (pos < len)
+	{
+		int n = _read(fd, &buf[pos], static_cast<unsigned>(len - pos));
+		if (n <= 0)
+			return false;
+		pos += n;
+	}
+	return true;
+}
+
+/**
+ * @brief Does data start with a Unicode signature (BOM)?
+ * These are the signatures diffutils recognizes, in get_unicode_signature().
+ */
+bool StartsWithSignature(const char *data, size_t len)
+{
+	static const char *const signatures[] = {
+		"\xFF\xFE\0\0", "\0\0\xFE\xFF", "\xEF\xBB\xBF", "\xFF\xFE", "\xFE\xFF" };
+	static const size_t lengths[] = { 4, 4, 3, 2, 2 };
+	for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i)
+	{
+		if (len >= lengths[i] && memcmp(data, signatures[i], lengths[i]) == 0)
+			return true;
+	}
+	return false;
+}
+
+}
+
+PrefilterCompare::PrefilterCompare()
+{
+}
+
+PrefilterCompare::~PrefilterCompare()
+{
+}
+
+/**
+ * @brief Read samples of a file.
+ * The head sample is the first SampleSize bytes of the file, the tail
+ * sample the last SampleSize bytes not already in the head sample.
+ * @param [in] path Full path to file.
+ * @param [in] size Size of file.
+ * @param [out] sample Gets the samples.
+ * @return true if samples were read.
+ */
+bool PrefilterCompare::ReadSample(const String& path, uint64_t size, Sample &sample)
+{
+	sample.bRead = true;
+	int fd = -1;
+	_tsopen_s(&fd, TFile(path).wpath().c_str(), O_RDONLY | O_BINARY, _SH_DENYWR, _S_IREAD);
+	if (fd < 0)
+		return false;
+	const size_t headLen = static_cast<size_t>((std::min)(static_cast<uint64_t>(SampleSize), size));
+	const size_t tailLen = static_cast<size_t>((std::min)(static_cast<uint64_t>(SampleSize), size - headLen));
+	sample.bOk = _filelengthi64(fd) == static_cast<int64_t>(size) &&
+		ReadAt(fd, 0, sample.head, headLen) &&
+		ReadAt(fd, size - tailLen, sample.tail, tailLen);
+	_close(fd);
+	return sample.bOk;
+}
+
+/**
+ * @brief Check if a file starts with a Unicode signature (BOM).
+ * Only the first bytes are read, unless the samples of the file are read.
+ * @param [in] path Full path to file.
+ * @param [in] size Size of file.
+ * @param [in,out] sample Samples of file, gets the result.
+ * @return true if file has a signature or could not be read.
+ */
+bool PrefilterCompare::HasSignature(const String& path, uint64_t size, Sample &sample)
+{
+	if (sample.nSignature < 0)
+	{
+		if (sample.bOk)
+			sample.nSignature = StartsWithSignature(sample.head.data(), sample.head.size());
+		else
+		{
+			int fd = -1;
+			_tsopen_s(&fd, TFile(path).wpath().c_str(), O_RDONLY | O_BINARY, _SH_DENYWR, _S_IREAD);
+			if (fd < 0)
+				return true;
+			std::vector<char> start;
+			if (ReadAt(fd, 0, start, static_cast<size_t>((std::min)(static_cast<uint64_t>(4), size))))
+				sample.nSignature = StartsWithSignature(start.data(), start.size());
+			_close(fd);
+			if (sample.nSignature < 0)
+				return true;
+		}
+	}
+	return sample.nSignature != 0;
+}
+
+/**
+ * @brief Compare two files by their sizes and samples.
+ * Samples are read only when needed and reused for further pairs.
+ * @param [in] bSignatures Are files with a Unicode signature left for the
+ * full compare, because it skips or converts the signature?
+ * @return UNDECIDED, SAME or DIFFERENT.
+ */
+int PrefilterCompare::ComparePair(const PathContext& files, const DIFFITEM &di, Sample samples[], int i, int j, bool bSignatures)
+{
+	const DiffFileInfo &a = di.diffFileInfo[i];
+	const DiffFileInfo &b = di.diffFileInfo[j];
+	if (a.size == DirItem::FILE_SIZE_NONE || b.size == DirItem::FILE_SIZE_NONE)
+		return UNDECIDED;
+	if (bSignatures && (HasSignature(files[i], a.size, samples[i]) || HasSignature(files[j], b.size, samples[j])))
+		return UNDECIDED;
+	if (a.size != b.size)
+		return DIFFERENT;
+	for (int k : { i, j })
+	{
+		if (!samples[k].bRead)
+			ReadSample(files[k], di.diffFileInfo[k].size, samples[k]);
+		if (!samples[k].bOk)
+			return UNDECIDED;
+	}
+	if (samples[i].head != samples[j].head || samples[i].tail != samples[j].tail)
+		return DIFFERENT;
+	return (a.size <= 2 * SampleSize) ? SAME : UNDECIDED;
+}
+
+/**
+ * @brief Try to settle compare of two or three files without full compare.
+ * Must only be used when any byte difference between files is a difference
+ * in compare result, except for Unicode signatures if @p bSignatures is
+ * true. Text/binary status is given only for files read completely as
+ * samples, diff counts are never known.
+ * @param [in] files Files to compare.
+ * @param [in] di Diffitem info, all files must exist.
+ * @param [in] bSignatures Does the full compare skip Unicode signatures
+ * (BOMs), like diffutils compare? Files having one are then left for it.
+ * @return DIFFCODE, or 0 if full compare is needed.
+ */
+int PrefilterCompare::CompareFiles(const PathContext& files, const DIFFITEM &di, bool bSignatures /*= false*/) const
+{
+	const int nFiles = files.GetSize();
+	Sample samples[3];
+	unsigned code = DIFFCODE::FILE;
+
+	if (nFiles == 2)
+	{
+		switch (ComparePair(files, di, samples, 0, 1, bSignatures))
+		{
+		case SAME: code |= DIFFCODE::SAME; break;
+		case DIFFERENT: code |= DIFFCODE::DIFF; break;
+		default: return 0;
+		}
+	}
+	else
+	{
+		const int result10 = ComparePair(files, di, samples, 1, 0, bSignatures);
+		const int result12 = ComparePair(files, di, samples, 1, 2, bSignatures);
+		if (result10 == UNDECIDED || result12 == UNDECIDED)
+			return 0;
+		if (result10 == SAME && result12 == SAME)
+			code |= DIFFCODE::SAME;
+		else if (result10 == SAME)
+			code |= DIFFCODE::DIFF | DIFFCODE::DIFF3RDONLY;
+		else if (result12 == SAME)
+			code |= DIFFCODE::DIFF | DIFFCODE::DIFF1STONLY;
+		else
+		{
+			const int result02 = ComparePair(files, di, samples, 0, 2, bSignatures);
+			if (result02 == UNDECIDED)
+				return 0;
+			code |= DIFFCODE::DIFF;
+			if (result02 == SAME)
+				code |= DIFFCODE::DIFF2NDONLY;
+		}
+	}
+
+	// Text/binary status is known only when every file was read completely
+	static const unsigned binSide[3] = { DIFFCODE::BINSIDE1, DIFFCODE::BINSIDE2, DIFFCODE::BINSIDE3 };
+	unsigned textflags = 0;
+	for (int i = 0; i < nFiles; ++i)
+	{
+		const Sample &sample = samples[i];
+		if (!sample.bOk || di.diffFileInfo[i].size > 2 * SampleSize)
+			return code;
+		if (std::find(sample.head.begin(), sample.head.end(), '\0') != sample.head.end() ||
+			std::find(sample.tail.begin(), sample.tail.end(), '\0') != sample.tail.end())
+			textflags |= DIFFCODE::BIN | binSide[i];
+	}
+	return code | (textflags != 0 ? textflags : DIFFCODE::TEXT);
+}
+
+} // namespace CompareEngines
@@ -0,0 +1,57 @@
+/**
+ * @file  PrefilterCompare.h
+ *
+ * @brief Declaration file for PrefilterCompare compare engine.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "UnicodeString.h"
+
+class DIFFITEM;
+class PathContext;
+
+namespace CompareEngines
+{
+
+/**
+ * @brief Cheap checks settling file compare before full compare.
+ * Used in front of content compares when compare options are byte-exact,
+ * so that any difference in file bytes is a difference in compare result.
+ * Files of different sizes are then different without reading them. Files
+ * of same size are compared by samples from their beginning and end; files
+ * small enough for the samples to cover them completely get their result
+ * from the samples too. Other files are left for the full compare.
+ * Diffutils compare skips Unicode signatures (BOMs), so in front of it
+ * files having one are left for the full compare too.
+ */
+class PrefilterCompare
+{
+public:
+	/** @brief Size of samples taken from beginning and end of file. */
+	static const size_t SampleSize = 64 * 1024;
+
+	PrefilterCompare();
+	~PrefilterCompare();
+	int CompareFiles(const PathContext& files, const DIFFITEM &di, bool bSignatures = false) const;
+
+private:
+	/** @brief Samples of one file. */
+	struct Sample
+	{
+		Sample() : bRead(false), bOk(false), nSignature(-1) {}
+		bool bRead; /**< Reading samples tried? */
+		bool bOk; /**< Samples read? */
+		int nSignature; /**< Has Unicode signature: 1, none: 0, not known: -1 */
+		std::vector<char> head; /**< Data from beginning of file */
+		std::vector<char> tail; /**< Data from end of file, not overlapping head */
+	};
+
+	static bool ReadSample(const String& path, uint64_t size, Sample &sample);
+	static bool HasSignature(const String& path, uint64_t size, Sample &sample);
+	static int ComparePair(const PathContext& files, const DIFFITEM &di, Sample samples[], int i, int j, bool bSignatures);
+};
+
+} // namespace CompareEngines
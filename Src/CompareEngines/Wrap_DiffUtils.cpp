@@ -178,6 +178,7 @@ int DiffUtils::diffutils_compare_files()
 						options.bFilterCommentsLines = m_pOptions->m_filterCommentsLines;
 						options.bIgnoreCase = m_pOptions->m_bIgnoreCase;
 						options.bIgnoreEol = m_pOptions->m_bIgnoreEOLDifference;
+						options.nDiffAlgorithm = m_pOptions->m_diffAlgorithm;
 						m_pDiffWrapper->SetOptions(&options);
   						m_pDiffWrapper->PostFilter(thisob->line0, QtyLinesLeft+1, thisob->line1, QtyLinesRight+1, op, asLwrCaseExt);
 						if(op == OP_TRIVIAL)
@@ -329,6 +330,34 @@ bool DiffUtils::Diff2Files(struct change ** diffs, int depth,
 	return bRet;
 }
 
+/**
+ * @brief Compare two files using diffutils, from any thread.
+ *
+ * Diffutils options are per thread, so they are set for the calling thread
+ * first. Unlike the other overload this does not use the file data set with
+ * SetFileData(), so several threads can compare files at the same time.
+ * @param [in,out] inf Files to compare.
+ * @param [out] diffs Pointer to list of change structs where diffdata is stored.
+ * @param [out] bin_status used to return binary status from compare.
+ * @return `true` when compare succeeds, `false` if error happened during compare.
+ */
+bool DiffUtils::Diff2Files(file_data *inf, struct change ** diffs, int * bin_status) const
+{
+	bool bRet = true;
+	m_pOptions->SetToDiffUtils();
+	SE_Handler seh;
+	try
+	{
+		*diffs = diff_2_files(inf, 0, bin_status, false, nullptr);
+	}
+	catch (SE_Exception&)
+	{
+		*diffs = nullptr;
+		bRet = false;
+	}
+	return bRet;
+}
+
 /**
  * @brief Copy text stat results from diffutils back into the FileTextStats structure
  */
@@ -42,6 +42,7 @@ public:
 	void GetTextStats(int side, FileTextStats *stats) const;
 	bool Diff2Files(struct change ** diffs, int depth,
 			int * bin_status, bool bMovedBlocks, int * bin_file) const;
+	bool Diff2Files(file_data *inf, struct change ** diffs, int * bin_status) const;
 	void SetCodepage(int codepage) { m_codepage = codepage; }
 
 private:
@@ -48,6 +48,7 @@ DiffutilsOptions::DiffutilsOptions(const DiffutilsOptions& options)
 	m_ignoreWhitespace = options.m_ignoreWhitespace;
 	m_outputStyle = options.m_outputStyle;
 	m_bIgnoreEOLDifference = options.m_bIgnoreEOLDifference;
+	m_diffAlgorithm = options.m_diffAlgorithm;
 }
 
 /**
@@ -92,6 +93,7 @@ DiffutilsOptions::DiffutilsOptions()
 : m_outputStyle(DIFF_OUTPUT_NORMAL)
 , m_contextLines(0)
 , m_filterCommentsLines(false)
+, m_diffAlgorithm(DIFF_ALGORITHM_DEFAULT)
 {
 }
 
@@ -104,6 +106,7 @@ DiffutilsOptions::DiffutilsOptions(const CompareOptions& options)
 , m_outputStyle(DIFF_OUTPUT_NORMAL)
 , m_contextLines(0)
 , m_filterCommentsLines(false)
+, m_diffAlgorithm(DIFF_ALGORITHM_DEFAULT)
 {
 }
 
@@ -115,6 +118,18 @@ void DiffutilsOptions::SetFromDiffOptions(const DIFFOPTIONS & options)
 {
 	CompareOptions::SetFromDiffOptions(options);
 	m_filterCommentsLines = options.bFilterCommentsLines;
+	switch (options.nDiffAlgorithm)
+	{
+	case DIFF_ALGORITHM_DEFAULT:
+	case DIFF_ALGORITHM_MINIMAL:
+	case DIFF_ALGORITHM_PATIENCE:
+	case DIFF_ALGORITHM_HISTOGRAM:
+		m_diffAlgorithm = static_cast<DiffAlgorithm>(options.nDiffAlgorithm);
+		break;
+	default:
+		throw "Unknown diff algorithm value!";
+		break;
+	}
 }
 
 /**
@@ -183,6 +198,8 @@ void DiffutilsOptions::SetToDiffUtils()
 	else
 		length_varies = 0;
 
+	diff_algorithm = m_diffAlgorithm;
+
 	// We have no interest changing these values, hard-code them.
 	always_text_flag = 0; // diffutils needs to detect binary files
 	horizon_lines = 0;
@@ -200,6 +217,7 @@ void DiffutilsOptions::GetAsDiffOptions(DIFFOPTIONS &options) const
 	options.bIgnoreBlankLines = m_bIgnoreBlankLines;
 	options.bIgnoreCase = m_bIgnoreCase;
 	options.bIgnoreEol = m_bIgnoreEOLDifference;
+	options.nDiffAlgorithm = m_diffAlgorithm;
 	
 	switch (m_ignoreWhitespace)
 	{
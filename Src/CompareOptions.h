@@ -64,6 +64,23 @@ enum DiffOutputType
 	DIFF_OUTPUT_HTML = OUTPUT_HTML,
 };
 
+/**
+ * @brief Algorithms for aligning lines of compared files.
+ *
+ * Myers' algorithm (the default) finds a short edit script, but may align
+ * unrelated lines like braces and blank lines when a block of code is
+ * rewritten. Patience and histogram diff first align lines that are rare
+ * in both files, which usually gives more readable differences for code.
+ */
+enum DiffAlgorithm
+{
+	// NOTE: these values are stored in the user's Registry - don't change their value !!
+	DIFF_ALGORITHM_DEFAULT = DIFF_ALG_MYERS,       /**< Myers' algorithm with speedup heuristics */
+	DIFF_ALGORITHM_MINIMAL = DIFF_ALG_MINIMAL,     /**< Myers' algorithm, smallest edit script */
+	DIFF_ALGORITHM_PATIENCE = DIFF_ALG_PATIENCE,   /**< Patience diff */
+	DIFF_ALGORITHM_HISTOGRAM = DIFF_ALG_HISTOGRAM, /**< Histogram diff */
+};
+
 /**
  * @brief Diffutils options.
  */
@@ -74,6 +91,7 @@ struct DIFFOPTIONS
 	bool bIgnoreBlankLines; /**< Ignore blank lines -option. */
 	bool bIgnoreEol; /**< Ignore EOL differences -option. */
 	bool bFilterCommentsLines; /**< Ignore Multiline comments differences -option. */
+	int nDiffAlgorithm; /**< Diff algorithm -option. */
 };
 
 /**
@@ -113,6 +131,7 @@ public:
 	enum DiffOutputType m_outputStyle; /**< Output style (for patch files) */
 	int m_contextLines; /**< Number of context lines (for patch files) */
 	bool m_filterCommentsLines;/**< Ignore Multiline comments differences.*/
+	enum DiffAlgorithm m_diffAlgorithm; /**< Algorithm for aligning lines */
 };
 
 /**
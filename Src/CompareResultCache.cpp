@@ -0,0 +1,327 @@
+/**
+ * @file  CompareResultCache.cpp
+ *
+ * @brief Implementation of CompareResultCache class.
+ */
+
+#include "pch.h"
+#include "CompareResultCache.h"
+#include <cstring>
+#include <iterator>
+#include <Poco/FileStream.h>
+#include <Poco/ScopedLock.h>
+#include "DiffItem.h"
+#include "DiffContext.h"
+#include "CompareOptions.h"
+#include "Environment.h"
+#include "paths.h"
+#include "unicoder.h"
+#include "TFile.h"
+#include "DebugNew.h"
+
+using Poco::FastMutex;
+
+namespace
+{
+
+const char CacheMagic[4] = { 'W', 'M', 'R', 'C' };
+const uint32_t CacheVersion = 2;
+
+/** @brief Compare result flags worth caching. */
+const unsigned CachedFlags = DIFFCODE::TEXTFLAGS | DIFFCODE::COMPAREFLAGS | DIFFCODE::COMPAREFLAGS3WAY;
+
+/** @brief 64-bit FNV-1a hash. */
+uint64_t Fnv1a(const void *data, size_t len, uint64_t hash = 14695981039346656037ULL)
+{
+	const unsigned char *p = static_cast<const unsigned char *>(data);
+	for (size_t i = 0; i < len; ++i)
+	{
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+template <class T>
+void Put(std::string &buf, T value)
+{
+	buf.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <class T>
+bool Get(const std::string &buf, size_t &pos, T &value)
+{
+	if (buf.size() - pos < sizeof(value))
+		return false;
+	memcpy(&value, buf.data() + pos, sizeof(value));
+	pos += sizeof(value);
+	return true;
+}
+
+}
+
+/**
+ * @brief Constructor.
+ * @param [in] sFilePath Full path to cache file.
+ * @param [in] optionsHash Hash of compare options, see HashOptions().
+ */
+CompareResultCache::CompareResultCache(const String& sFilePath, uint64_t optionsHash)
+: m_sFilePath(sFilePath)
+, m_optionsHash(optionsHash)
+, m_bModified(false)
+{
+}
+
+CompareResultCache::~CompareResultCache()
+{
+}
+
+/**
+ * @brief Read cached results from the cache file.
+ * A missing, damaged or outdated cache file leaves the cache empty.
+ * @return true if results were read.
+ */
+bool CompareResultCache::Load()
+{
+	FastMutex::ScopedLock lock(m_mutex);
+	m_entries.clear();
+	m_bModified = false;
+
+	std::string buf;
+	try
+	{
+		if (!TFile(m_sFilePath).exists())
+			return false;
+		Poco::FileInputStream fin(ucr::toUTF8(m_sFilePath), std::ios::in | std::ios::binary);
+		buf.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+	}
+	catch (...)
+	{
+		return false;
+	}
+
+	size_t pos = 0;
+	char magic[sizeof(CacheMagic)];
+	uint32_t version, count;
+	uint64_t optionsHash;
+	if (!Get(buf, pos, magic) || memcmp(magic, CacheMagic, sizeof(magic)) != 0 ||
+		!Get(buf, pos, version) || version != CacheVersion ||
+		!Get(buf, pos, optionsHash) || optionsHash != m_optionsHash ||
+		!Get(buf, pos, count))
+		return false;
+
+	m_entries.reserve(count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint32_t keylen;
+		if (!Get(buf, pos, keylen) || buf.size() - pos < keylen)
+			break;
+		String key = ucr::toTString(buf.substr(pos, keylen));
+		pos += keylen;
+
+		Entry entry;
+		bool ok = Get(buf, pos, entry.code) && Get(buf, pos, entry.nsdiffs) && Get(buf, pos, entry.nidiffs);
+		for (int j = 0; ok && j < 3; ++j)
+		{
+			int32_t unicoding;
+			uint8_t bom, hashValid;
+			ok = Get(buf, pos, entry.textStats[j].ncrs) && Get(buf, pos, entry.textStats[j].nlfs) &&
+				Get(buf, pos, entry.textStats[j].ncrlfs) && Get(buf, pos, entry.textStats[j].nzeros) &&
+				Get(buf, pos, entry.encoding[j].m_codepage) && Get(buf, pos, unicoding) && Get(buf, pos, bom) &&
+				Get(buf, pos, hashValid) && Get(buf, pos, entry.contentHash[j]);
+			entry.encoding[j].m_unicoding = static_cast<ucr::UNICODESET>(unicoding);
+			entry.encoding[j].m_bom = bom != 0;
+			entry.bContentHashValid[j] = hashValid != 0;
+		}
+		if (!ok)
+			break;
+		entry.bUsed = false;
+		m_entries.emplace(std::move(key), entry);
+	}
+	return true;
+}
+
+/**
+ * @brief Write cached results to the cache file.
+ * The file is written under a temporary name first, so that an interrupted
+ * write never leaves a truncated cache behind.
+ * @param [in] bPrune Drop results not used during this compare; only valid
+ *  after a full compare of the tree.
+ * @return true if nothing needed saving or saving succeeded.
+ */
+bool CompareResultCache::Save(bool bPrune)
+{
+	FastMutex::ScopedLock lock(m_mutex);
+	if (!m_bModified && !bPrune)
+		return true;
+
+	std::string buf;
+	buf.append(CacheMagic, sizeof(CacheMagic));
+	Put(buf, CacheVersion);
+	Put(buf, m_optionsHash);
+	size_t countPos = buf.size();
+	Put(buf, static_cast<uint32_t>(0));
+	uint32_t count = 0;
+	for (const auto& kv : m_entries)
+	{
+		const Entry &entry = kv.second;
+		if (bPrune && !entry.bUsed)
+			continue;
+		std::string key = ucr::toUTF8(kv.first);
+		Put(buf, static_cast<uint32_t>(key.length()));
+		buf.append(key);
+		Put(buf, entry.code);
+		Put(buf, entry.nsdiffs);
+		Put(buf, entry.nidiffs);
+		for (int j = 0; j < 3; ++j)
+		{
+			Put(buf, entry.textStats[j].ncrs);
+			Put(buf, entry.textStats[j].nlfs);
+			Put(buf, entry.textStats[j].ncrlfs);
+			Put(buf, entry.textStats[j].nzeros);
+			Put(buf, entry.encoding[j].m_codepage);
+			Put(buf, static_cast<int32_t>(entry.encoding[j].m_unicoding));
+			Put(buf, static_cast<uint8_t>(entry.encoding[j].m_bom));
+			Put(buf, static_cast<uint8_t>(entry.bContentHashValid[j]));
+			Put(buf, entry.contentHash[j]);
+		}
+		++count;
+	}
+	memcpy(&buf[countPos], &count, sizeof(count));
+
+	String sTempPath = m_sFilePath + _T(".tmp");
+	try
+	{
+		if (paths::EnsurePathExist(paths::GetParentPath(m_sFilePath)).empty())
+			return false;
+		{
+			Poco::FileOutputStream fout(ucr::toUTF8(sTempPath), std::ios::out | std::ios::binary | std::ios::trunc);
+			fout.write(buf.data(), buf.size());
+			fout.close();
+			if (!fout.good())
+				return false;
+		}
+		TFile(sTempPath).renameTo(m_sFilePath);
+	}
+	catch (...)
+	{
+		return false;
+	}
+	m_bModified = false;
+	return true;
+}
+
+/**
+ * @brief Set compare result of @p di from cache.
+ * @param [in,out] di Item to compare, gets result flags, difference counts,
+ *  text statistics, encodings and content digests when found.
+ * @param [in] nDirs Number of compared folders.
+ * @return true if a result for unchanged files was found.
+ */
+bool CompareResultCache::Lookup(DIFFITEM &di, int nDirs)
+{
+	String key = MakeKey(di, nDirs);
+	FastMutex::ScopedLock lock(m_mutex);
+	auto it = m_entries.find(key);
+	if (it == m_entries.end())
+		return false;
+	Entry &entry = it->second;
+	entry.bUsed = true;
+	di.diffcode.diffcode |= entry.code;
+	di.nsdiffs = entry.nsdiffs;
+	di.nidiffs = entry.nidiffs;
+	for (int i = 0; i < nDirs; ++i)
+	{
+		if (di.diffcode.exists(i))
+		{
+			di.diffFileInfo[i].m_textStats = entry.textStats[i];
+			di.diffFileInfo[i].encoding = entry.encoding[i];
+			di.diffFileInfo[i].m_contentHash = entry.contentHash[i];
+			di.diffFileInfo[i].m_bContentHashValid = entry.bContentHashValid[i];
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Remember compare result of @p di.
+ * Failed compares are not cached, they are tried again next time.
+ * @param [in] di Compared item.
+ * @param [in] nDirs Number of compared folders.
+ */
+void CompareResultCache::Store(const DIFFITEM &di, int nDirs)
+{
+	if (di.diffcode.isResultError() || di.diffcode.isResultAbort())
+		return;
+	Entry entry = Entry();
+	entry.code = di.diffcode.diffcode & CachedFlags;
+	entry.nsdiffs = di.nsdiffs;
+	entry.nidiffs = di.nidiffs;
+	for (int i = 0; i < nDirs; ++i)
+	{
+		entry.textStats[i] = di.diffFileInfo[i].m_textStats;
+		entry.encoding[i] = di.diffFileInfo[i].encoding;
+		entry.contentHash[i] = di.diffFileInfo[i].m_contentHash;
+		entry.bContentHashValid[i] = di.diffFileInfo[i].m_bContentHashValid;
+	}
+	entry.bUsed = true;
+	String key = MakeKey(di, nDirs);
+	FastMutex::ScopedLock lock(m_mutex);
+	m_entries[key] = entry;
+	m_bModified = true;
+}
+
+/**
+ * @brief Return key of @p di: path, size and modification time of each side.
+ */
+String CompareResultCache::MakeKey(const DIFFITEM &di, int nDirs)
+{
+	String key;
+	for (int i = 0; i < nDirs; ++i)
+	{
+		if (i > 0)
+			key += _T('|');
+		if (!di.diffcode.exists(i))
+			continue;
+		key += di.diffFileInfo[i].GetFile();
+		key += strutils::format(_T("*%I64u*%I64d"),
+			static_cast<unsigned __int64>(di.diffFileInfo[i].size),
+			static_cast<__int64>(di.diffFileInfo[i].mtime.epochMicroseconds()));
+	}
+	return key;
+}
+
+/**
+ * @brief Return path of the cache file for folders compared in @p ctxt.
+ * Every combination of compared root folders gets a cache file of its own
+ * in the user's local application data folder.
+ */
+String CompareResultCache::GetCacheFilePath(const CDiffContext &ctxt)
+{
+	uint64_t hash = Fnv1a(nullptr, 0);
+	for (int i = 0; i < ctxt.GetCompareDirs(); ++i)
+	{
+		String path = strutils::makelower(ctxt.GetNormalizedPath(i)) + _T("|");
+		hash = Fnv1a(path.c_str(), path.length() * sizeof(TCHAR), hash);
+	}
+	return paths::ConcatPath(env::GetLocalAppDataPath(),
+		strutils::format(_T("WinMerge\\CompareCache\\%016I64x.cache"), static_cast<unsigned __int64>(hash)));
+}
+
+/**
+ * @brief Return hash of everything affecting file compare results.
+ * @param [in] ctxt Compare context with compare method and options set.
+ * @param [in] options Compare options.
+ * @param [in] lineFilters Line filters in use, empty if none.
+ */
+uint64_t CompareResultCache::HashOptions(const CDiffContext &ctxt, const DIFFOPTIONS &options, const String &lineFilters)
+{
+	String desc = strutils::format(_T("%d|%d|%d|%d|%d|%d|%d|%d|%d|%d|%d|%d|%d|%d|%d|"),
+		ctxt.GetCompareMethod(), ctxt.GetCompareDirs(),
+		options.nIgnoreWhitespace, options.bIgnoreCase, options.bIgnoreBlankLines,
+		options.bIgnoreEol, options.bFilterCommentsLines, options.nDiffAlgorithm,
+		ctxt.m_bStopAfterFirstDiff, ctxt.m_nQuickCompareLimit, ctxt.m_iGuessEncodingType,
+		ctxt.m_bIgnoreCodepage, ctxt.m_bPluginsEnabled, ctxt.m_bPrefilter, CacheVersion);
+	desc += lineFilters;
+	return Fnv1a(desc.c_str(), desc.length() * sizeof(TCHAR));
+}
@@ -0,0 +1,67 @@
+/**
+ *  @file CompareResultCache.h
+ *
+ *  @brief Declaration of class CompareResultCache
+ */
+#pragma once
+
+#define POCO_NO_UNWINDOWS 1
+#include <Poco/Mutex.h>
+#include <cstdint>
+#include <unordered_map>
+#include "UnicodeString.h"
+#include "FileTextEncoding.h"
+#include "FileTextStats.h"
+
+class DIFFITEM;
+class CDiffContext;
+struct DIFFOPTIONS;
+
+/**
+ * @brief On-disk cache of file compare results of folder compare.
+ *
+ * Results are keyed by path, size and modification time of the compared
+ * files on every side, so a file pair is compared again only when either
+ * file has changed since the previous compare. The cache file is tied to
+ * the compared root folders and to a hash of the compare options; a cache
+ * written with different options is ignored.
+ *
+ * Lookup() and Store() are called by the compare workers concurrently.
+ */
+class CompareResultCache
+{
+public:
+	CompareResultCache(const String& sFilePath, uint64_t optionsHash);
+	~CompareResultCache();
+
+	bool Load();
+	bool Save(bool bPrune);
+
+	bool Lookup(DIFFITEM &di, int nDirs);
+	void Store(const DIFFITEM &di, int nDirs);
+
+	static String GetCacheFilePath(const CDiffContext &ctxt);
+	static uint64_t HashOptions(const CDiffContext &ctxt, const DIFFOPTIONS &options, const String &lineFilters);
+
+private:
+	/** @brief Cached compare result of one file pair or triple. */
+	struct Entry
+	{
+		unsigned code; /**< Result flags (DIFFCODE::TEXTFLAGS and compare flags) */
+		int nsdiffs;
+		int nidiffs;
+		FileTextStats textStats[3];
+		FileTextEncoding encoding[3];
+		uint64_t contentHash[3];
+		bool bContentHashValid[3];
+		bool bUsed; /**< Used or stored during this compare? */
+	};
+
+	static String MakeKey(const DIFFITEM &di, int nDirs);
+
+	String m_sFilePath; /**< Full path to cache file */
+	uint64_t m_optionsHash;
+	std::unordered_map<String, Entry> m_entries;
+	bool m_bModified;
+	Poco::FastMutex m_mutex;
+};
@@ -34,6 +34,7 @@
 #include "DiffItemList.h"
 #include "IAbortable.h"
 #include "DiffWrapper.h"
+#include "CompareResultCache.h"
 #include "DebugNew.h"
 
 using Poco::FastMutex;
@@ -68,7 +69,9 @@ CDiffContext::CDiffContext(const PathContext & paths, int compareMethod)
 , m_bIgnoreCodepage(false)
 , m_iGuessEncodingType(0)
 , m_nQuickCompareLimit(0)
+, m_bPrefilter(false)
 , m_pFilterCommentsManager(nullptr)
+, m_pResultCache(nullptr)
 {
 	int index;
 	for (index = 0; index < paths.GetSize(); index++)
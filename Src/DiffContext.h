@@ -22,6 +22,7 @@ class CDiffWrapper;
 class CompareOptions;
 struct DIFFOPTIONS;
 class FilterCommentsManager;
+class CompareResultCache;
 
 /** Interface to a provider of plugin info */
 class IPluginInfos
@@ -173,6 +174,16 @@ public:
 	 */
 	int m_nQuickCompareLimit;
 
+	/**
+	 * Settle content compares by file sizes and samples when possible.
+	 * When compare options make any byte difference a difference, files
+	 * of different sizes are reported different without reading them, and
+	 * small files are compared by samples of their beginning and end. Such
+	 * results have no diff counts, and no text/binary status for files not
+	 * read completely.
+	 */
+	bool m_bPrefilter;
+
 	/**
 	 * Walk into unique folders and add contents.
 	 * This enables/disables walking into unique folders. If we don't walk into
@@ -190,6 +201,7 @@ public:
 	bool m_bPluginsEnabled; /**< Are plugins enabled? */
 	std::unique_ptr<FilterList> m_pFilterList; /**< Filter list for line filters */
 	FilterCommentsManager *m_pFilterCommentsManager;
+	std::unique_ptr<CompareResultCache> m_pResultCache; /**< Results of previous compares, or nullptr */
 
 private:
 	/**
@@ -50,6 +50,49 @@ bool DiffFileData::OpenFiles(const String& szFilepath1, const String& szFilepath
 	return b;
 }
 
+/**
+ * @brief Give texts in memory to diffutils instead of opening files.
+ * Texts are copied into buffers owned by diffutils, as diffutils modifies
+ * its buffers while comparing. Texts must be in the form diffutils reads
+ * from files, for example UTF-8 with BOM.
+ * @param [in] text1 First text to compare.
+ * @param [in] text2 Second text to compare.
+ * @return false if memory could not be allocated.
+ */
+bool DiffFileData::OpenBuffers(const std::string& text1, const std::string& text2)
+{
+	Reset();
+
+	const std::string *texts[2] = { &text1, &text2 };
+	for (int i = 0; i < 2; ++i)
+	{
+		m_inf[i].name = _strdup(ucr::toSystemCP(m_sDisplayFilepath[i]).c_str());
+		if (m_inf[i].name == nullptr)
+			break;
+
+		// Leave room for an appended newline and sentinel, like slurp() does
+		size_t len = texts[i]->length();
+		m_inf[i].bufsize = len + sizeof(unsigned) + 1;
+		m_inf[i].buffer = static_cast<char *>(malloc(m_inf[i].bufsize));
+		if (m_inf[i].buffer == nullptr)
+			break;
+		memcpy(m_inf[i].buffer, texts[i]->data(), len);
+		m_inf[i].buffered_chars = len;
+		m_inf[i].stat.st_mode = _S_IFREG;
+		m_inf[i].stat.st_size = len;
+		m_inf[i].in_memory = 1;
+	}
+
+	// diffutils frees the buffers in Reset()
+	m_used = true;
+	if (m_inf[0].buffer == nullptr || m_inf[1].buffer == nullptr)
+	{
+		Reset();
+		return false;
+	}
+	return true;
+}
+
 /** @brief stash away true names for display, before opening files */
 void DiffFileData::SetDisplayFilepaths(const String& szTrueFilepath1, const String& szTrueFilepath2)
 {
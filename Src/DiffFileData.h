@@ -7,6 +7,7 @@
  */
 #pragma once
 
+#include <string>
 #include "FileLocation.h"
 #include "FileTextStats.h"
 
@@ -29,6 +30,7 @@ struct DiffFileData
 	~DiffFileData();
 
 	bool OpenFiles(const String& szFilepath1, const String& szFilepath2);
+	bool OpenBuffers(const std::string& text1, const std::string& text2);
 	void Reset();
 	void Close() { Reset(); }
 	void SetDisplayFilepaths(const String& szTrueFilepath1, const String& szTrueFilepath2);
@@ -32,6 +32,7 @@ void DiffFileInfo::ClearPartial()
 	DirItem::ClearPartial();
 	encoding.Clear();
 	m_textStats.clear();
+	m_bContentHashValid = false;
 }
 
 /**
@@ -36,13 +36,15 @@ struct DiffFileInfo : public DirItem
 // data
 	FileTextEncoding encoding; /**< unicode or codepage info */
 	FileTextStats m_textStats; /**< EOL, zero-byte etc counts */
+	uint64_t m_contentHash; /**< Digest of file contents, see CMP_HASH_CONTENT */
+	bool m_bContentHashValid; /**< Has m_contentHash been computed? */
 
 	// We could stash a pointer here to the parent DIFFITEM
 	// but, I ran into trouble with, I think, the DIFFITEM copy constructor
 
 // methods
 
-	DiffFileInfo() { }
+	DiffFileInfo() : m_contentHash(0), m_bContentHashValid(false) { }
 	//void Clear();
 	void ClearPartial();
 	bool IsEditableEncoding() const;
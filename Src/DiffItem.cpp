@@ -11,10 +11,12 @@
 
 DIFFITEM DIFFITEM::emptyitem;
 
-/** @brief DIFFITEM's destructor */
+/**
+ * @brief DIFFITEM's destructor
+ * Children are destroyed by DiffItemList before their parent.
+ */
 DIFFITEM::~DIFFITEM()
 {
-	RemoveChildren();
 	assert(children == nullptr);
 }
 
@@ -52,20 +54,6 @@ bool DIFFITEM::IsAncestor(const DIFFITEM *pdi) const
 	return false;
 }
 
-/** @brief Remove and delete all children DIFFITEM entries */
-void DIFFITEM::RemoveChildren()
-{
-	DIFFITEM *pRem = children;
-	while (pRem != nullptr)
-	{
-		assert(pRem->parent == this);
-		DIFFITEM *pNext = pRem->Flink;
-		delete pRem;
-		pRem = pNext;
-	}
-	children = nullptr;
-}
-
 /** @brief Swap two items in `diffFileInfo[]`.  Used when swapping GUI panes. */
 void DIFFITEM::Swap(int idx1, int idx2)
 {
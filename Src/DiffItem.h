@@ -186,6 +186,9 @@ enum ViewCustomFlags
  * This class is for backend differences processing, representing physical
  * files and folders. This class is not for GUI data like selection or
  * visibility statuses. So do not include any GUI-dependent data here. 
+ *
+ * Items of a tree are allocated, linked and freed by the DiffItemList
+ * owning the tree, so never `new` or `delete` them directly.
  */
 
 // See http://web.eecs.utk.edu/~bvz/teaching/cs140Fa09/notes/Dllists for a discussion of
@@ -266,7 +269,6 @@ private:							// Don't allow direct external manipulation of link values
 public:
 	void DelinkFromSiblings();
 	void AddChildToParent(DIFFITEM *p);
-	void RemoveChildren();
 	int GetDepth() const;
 	bool IsAncestor(const DIFFITEM *pdi) const;
 	inline DIFFITEM *GetFwdSiblingLink() const { return Flink; }
@@ -294,4 +296,5 @@ public:
 					{}
 	~DIFFITEM();
 
+	friend class DiffItemList;
 };
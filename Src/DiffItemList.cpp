@@ -7,8 +7,76 @@
 #include "pch.h"
 #include "DiffItemList.h"
 #include <cassert>
+
+// Wrap placement new to avoid the need to temporarily #undef new
+static DIFFITEM *construct_item(void *p)
+{
+	return new(p) DIFFITEM;
+}
+
 #include "DebugNew.h"
 
+DiffItemPool::DiffItemPool() : m_nCarved(ChunkItems), m_pFree(nullptr)
+{
+}
+
+DiffItemPool::~DiffItemPool()
+{
+	Clear();
+}
+
+/**
+ * @brief Allocate and construct a new item.
+ * Freed items are reused first, then items are carved from the last chunk.
+ */
+DIFFITEM *DiffItemPool::New()
+{
+	Slot *pSlot;
+	{
+		Poco::FastMutex::ScopedLock lock(m_mutex);
+		if (m_pFree != nullptr)
+		{
+			pSlot = m_pFree;
+			m_pFree = pSlot->pNextFree;
+		}
+		else
+		{
+			if (m_nCarved == ChunkItems)
+			{
+				m_chunks.emplace_back(new Slot[ChunkItems]);
+				m_nCarved = 0;
+			}
+			pSlot = &m_chunks.back()[m_nCarved++];
+		}
+	}
+	return construct_item(pSlot);
+}
+
+/**
+ * @brief Destroy an item and keep its storage for new items.
+ * @param [in] p Item allocated from this pool, without children.
+ */
+void DiffItemPool::Delete(DIFFITEM *p)
+{
+	p->~DIFFITEM();
+	Slot *pSlot = reinterpret_cast<Slot *>(p);
+	Poco::FastMutex::ScopedLock lock(m_mutex);
+	pSlot->pNextFree = m_pFree;
+	m_pFree = pSlot;
+}
+
+/**
+ * @brief Release all chunks.
+ * All items must have been destroyed before.
+ */
+void DiffItemPool::Clear()
+{
+	Poco::FastMutex::ScopedLock lock(m_mutex);
+	m_chunks.clear();
+	m_nCarved = ChunkItems;
+	m_pFree = nullptr;
+}
+
 /**
  * @brief Constructor
  */
@@ -31,7 +99,7 @@ DiffItemList::~DiffItemList()
  */
 DIFFITEM *DiffItemList::AddNewDiff(DIFFITEM *par)
 {
-	DIFFITEM *p = new DIFFITEM;
+	DIFFITEM *p = m_pool.New();
 	if (par == nullptr)
 	{
 		// if there is no `parent`, this item becomes a child of `m_pRoot`
@@ -44,19 +112,72 @@ DIFFITEM *DiffItemList::AddNewDiff(DIFFITEM *par)
 	return p;
 }
 
+/**
+ * @brief Remove item from structured DIFFITEM tree.
+ * The item is delinked from its siblings and deleted with all its children.
+ * @param [in] diffpos Item to remove.
+ */
+void DiffItemList::RemoveDiff(DIFFITEM *diffpos)
+{
+	assert(diffpos != nullptr && diffpos != m_pRoot);
+	diffpos->DelinkFromSiblings();
+	DestroyChildren(diffpos, true);
+	m_pool.Delete(diffpos);
+}
+
+/**
+ * @brief Remove and delete all children of item.
+ * @param [in] diffpos Parent of items to remove.
+ */
+void DiffItemList::RemoveChildren(DIFFITEM *diffpos)
+{
+	assert(diffpos != nullptr);
+	DestroyChildren(diffpos, true);
+}
+
 /**
  * @brief Empty structured DIFFITEM tree
+ * Items are only destroyed, their storage is released at once with the
+ * chunks of the pool.
  */
 void DiffItemList::RemoveAll()
 {
-	delete m_pRoot;
-	m_pRoot = nullptr;
+	if (m_pRoot != nullptr)
+	{
+		DestroyChildren(m_pRoot, false);
+		m_pRoot->~DIFFITEM();
+		m_pRoot = nullptr;
+	}
+	m_pool.Clear();
 }
 
 void DiffItemList::InitDiffItemList()
 {
 	assert(m_pRoot == nullptr);
-	m_pRoot = new DIFFITEM;
+	m_pRoot = m_pool.New();
+}
+
+/**
+ * @brief Destroy all children of item, depth first.
+ * @param [in] par Parent of items to destroy.
+ * @param [in] bRecycle Return storage of items to the pool for reuse?
+ */
+void DiffItemList::DestroyChildren(DIFFITEM *par, bool bRecycle)
+{
+	DIFFITEM *p = par->children;
+	par->children = nullptr;
+	while (p != nullptr)
+	{
+		assert(p->parent == par);
+		DIFFITEM *pNext = p->Flink;
+		if (p->children != nullptr)
+			DestroyChildren(p, bRecycle);
+		if (bRecycle)
+			m_pool.Delete(p);
+		else
+			p->~DIFFITEM();
+		p = pNext;
+	}
 }
 
 /**
@@ -5,8 +5,45 @@
  */
 #pragma once
 
+#include <vector>
+#include <memory>
+#include <type_traits>
+#include <Poco/Mutex.h>
 #include "DiffItem.h"
 
+/**
+ * @brief Chunked arena for DIFFITEMs of one tree.
+ * Items are carved from large chunks instead of being allocated one by one,
+ * which saves the per-allocation overhead of millions of small heap blocks.
+ * Freed items are recycled for new items, and all chunks are released at
+ * once when the tree is removed.
+ */
+class DiffItemPool
+{
+public:
+	DiffItemPool();
+	~DiffItemPool();
+	DIFFITEM *New();
+	void Delete(DIFFITEM *p);
+	void Clear();
+	size_t GetChunkCount() const { return m_chunks.size(); }
+
+	static const size_t ChunkItems = 4096; /**< Items in one chunk */
+
+private:
+	/** @brief Storage of one item, or link to next free storage. */
+	union Slot
+	{
+		Slot *pNextFree;
+		std::aligned_storage<sizeof(DIFFITEM), alignof(DIFFITEM)>::type item;
+	};
+
+	std::vector<std::unique_ptr<Slot[]>> m_chunks; /**< Allocated chunks, last one is being carved */
+	size_t m_nCarved; /**< Slots of the last chunk handed out */
+	Slot *m_pFree; /**< Freed slots */
+	Poco::FastMutex m_mutex; /**< Items are added by several collect threads */
+};
+
 /**
  * @brief List of DIFFITEMs in folder compare.
  * This class holds a list of items we have in the folder compare. Basically
@@ -21,6 +58,8 @@ public:
 	~DiffItemList();
 	// add & remove differences
 	DIFFITEM *AddNewDiff(DIFFITEM *parent);
+	void RemoveDiff(DIFFITEM *diffpos);
+	void RemoveChildren(DIFFITEM *diffpos);
 	void RemoveAll();
 	void InitDiffItemList();
 
@@ -43,6 +82,11 @@ public:
 
 protected:
 	DIFFITEM* m_pRoot; /**< Root of list of diffitems; initially `nullptr`. */
+
+private:
+	void DestroyChildren(DIFFITEM *par, bool bRecycle);
+
+	DiffItemPool m_pool; /**< Storage of all items of the tree */
 };
 
 /**
@@ -30,6 +30,7 @@ using Poco::Exception;
 
 static bool IsTextFileStylePure(const UniMemFile::txtstats & stats);
 static CRLFSTYLE GetTextFileStyle(const UniMemFile::txtstats & stats);
+static void AppendTextForDiff(std::string & text, const TCHAR * chars, size_t len);
 
 /**
  * @brief Check if file has only one EOL type.
@@ -84,6 +85,9 @@ CDiffTextBuffer::CDiffTextBuffer(CMergeDoc * pDoc, int pane)
 , m_nThisPane(pane)
 , m_unpackerSubcode(0)
 , m_bMixedEOL(false)
+, m_nEditedBegin(0)
+, m_nEditedTail(0)
+, m_nRescanLineCount(0)
 {
 }
 
@@ -204,6 +208,52 @@ OnNotifyLineHasBeenEdited(int nLine)
 	CGhostTextBuffer::OnNotifyLineHasBeenEdited(nLine);
 }
 
+/**
+ * @brief Get number of real (non-ghost) lines in buffer.
+ */
+int CDiffTextBuffer::GetRealLineCount() const
+{
+	int nLastRealLine = ApparentLastRealLine();
+	return (nLastRealLine < 0) ? 0 : ComputeRealLine(nLastRealLine) + 1;
+}
+
+/**
+ * @brief Forget edits, the buffer has been rescanned.
+ */
+void CDiffTextBuffer::ResetEditedLines()
+{
+	m_nEditedBegin = INT_MAX;
+	m_nEditedTail = INT_MAX;
+	m_nRescanLineCount = GetRealLineCount();
+}
+
+/**
+ * @brief Consider whole buffer edited, so next rescan diffs all of it.
+ */
+void CDiffTextBuffer::MarkAllEdited()
+{
+	m_nEditedBegin = 0;
+	m_nEditedTail = 0;
+}
+
+/**
+ * @brief Record lines changed by an edit.
+ * The edited area is kept as one range: lines before it and lines after
+ * it are as they were in the last rescan. The end is counted from the end
+ * of the buffer so that later edits above it don't move it.
+ * @param [in] nStartLine First apparent line changed, after the edit.
+ * @param [in] nEndLine Last apparent line changed, after the edit.
+ */
+void CDiffTextBuffer::MarkEdited(int nStartLine, int nEndLine)
+{
+	int nRealLines = GetRealLineCount();
+	// Neighbour lines may have got or lost their EOL too
+	int nBegin = max(ComputeRealLine(nStartLine) - 1, 0);
+	int nEnd = min(ComputeRealLine(nEndLine) + 2, nRealLines);
+	m_nEditedBegin = min(m_nEditedBegin, nBegin);
+	m_nEditedTail = min(m_nEditedTail, max(nRealLines - nEnd, 0));
+}
+
 /**
  * @brief Set the folder for temp files.
  * @param [in] path Temp files folder.
@@ -245,6 +295,7 @@ int CDiffTextBuffer::LoadFromFile(LPCTSTR pszFileNameInit,
 {
 	ASSERT(!m_bInit);
 	ASSERT(m_aLines.size() == 0);
+	MarkAllEdited();
 
 	// Unpacking the file here, save the result in a temporary file
 	String sFileName(pszFileNameInit);
@@ -308,54 +359,66 @@ int CDiffTextBuffer::LoadFromFile(LPCTSTR pszFileNameInit,
 			if (encoding.m_unicoding == ucr::NONE  || !pufile->IsUnicode())
 				pufile->SetCodepage(encoding.m_codepage);
 		}
-		UINT lineno = 0;
-		String eol, preveol;
-		String sline;
-		bool done = false;
-		COleDateTime start = COleDateTime::GetCurrentTime(); // for trace messages
-
-		// Manually grow line array exponentially
-		UINT arraysize = 500;
-		m_aLines.resize(arraysize);
-		
-		// preveol must be initialized for empty files
-		preveol = _T("\n");
-		
-		do {
-			bool lossy = false;
-			done = !pufile->ReadString(sline, eol, &lossy);
-
-			// if last line had no eol, we can quit
-			if (done && preveol.empty())
-				break;
-			// but if last line had eol, we add an extra (empty) line to buffer
-
-			// Grow line array
-			if (lineno == arraysize)
-			{
-				// For smaller sizes use exponential growth, but for larger
-				// sizes grow by constant ratio. Unlimited exponential growth
-				// easily runs out of memory.
-				if (arraysize < 100 * 1024)
-					arraysize *= 2;
-				else
-					arraysize += 100 * 1024;
-				m_aLines.resize(arraysize);
-			}
-
-			sline += eol; // TODO: opportunity for optimization, as CString append is terrible
-			if (lossy)
-			{
-				// TODO: Should record lossy status of line
-			}
-			AppendLine(lineno, sline.c_str(), static_cast<int>(sline.length()));
-			++lineno;
-			preveol = eol;
-
-		} while (!done);
-
-		// fix array size (due to our manual exponential growth
-		m_aLines.resize(lineno);
+		// Decode a mapped file at once when its encoding allows it,
+		// the lines then share one buffer
+		UniMemFile *pmemfile = dynamic_cast<UniMemFile *>(pufile);
+		std::unique_ptr<TCHAR[]> text;
+		std::vector<size_t> lineStarts;
+		if (pmemfile != nullptr && pmemfile->ReadAllLines(text, lineStarts))
+		{
+			AppendLines(std::move(text), lineStarts);
+		}
+		else
+		{
+			UINT lineno = 0;
+			String eol, preveol;
+			String sline;
+			bool done = false;
+			COleDateTime start = COleDateTime::GetCurrentTime(); // for trace messages
+
+			// Manually grow line array exponentially
+			UINT arraysize = 500;
+			m_aLines.resize(arraysize);
+			
+			// preveol must be initialized for empty files
+			preveol = _T("\n");
+			
+			do {
+				bool lossy = false;
+				done = !pufile->ReadString(sline, eol, &lossy);
+
+				// if last line had no eol, we can quit
+				if (done && preveol.empty())
+					break;
+				// but if last line had eol, we add an extra (empty) line to buffer
+
+				// Grow line array
+				if (lineno == arraysize)
+				{
+					// For smaller sizes use exponential growth, but for larger
+					// sizes grow by constant ratio. Unlimited exponential growth
+					// easily runs out of memory.
+					if (arraysize < 100 * 1024)
+						arraysize *= 2;
+					else
+						arraysize += 100 * 1024;
+					m_aLines.resize(arraysize);
+				}
+
+				sline += eol; // TODO: opportunity for optimization, as CString append is terrible
+				if (lossy)
+				{
+					// TODO: Should record lossy status of line
+				}
+				AppendLine(lineno, sline.c_str(), static_cast<int>(sline.length()));
+				++lineno;
+				preveol = eol;
+
+			} while (!done);
+
+			// fix array size (due to our manual exponential growth
+			m_aLines.resize(lineno);
+		}
 	
 		
 		//Try to determine current CRLF mode (most frequent)
@@ -421,6 +484,94 @@ int CDiffTextBuffer::LoadFromFile(LPCTSTR pszFileNameInit,
 	return nRetVal;
 }
 
+/**
+ * @brief Append characters to text given to diffutils.
+ * Characters are encoded to UTF-8 one UTF-16 code unit at a time, and NUL is
+ * encoded as two bytes, exactly like diffutils transcodes the UCS-2 temp
+ * files. So diffutils sees the same bytes from memory as from temp files.
+ * @param [in,out] text Text to append to.
+ * @param [in] chars Characters to append.
+ * @param [in] len Number of characters.
+ */
+static void AppendTextForDiff(std::string & text, const TCHAR * chars, size_t len)
+{
+	for (size_t i = 0; i < len; ++i)
+	{
+		unsigned u = static_cast<unsigned short>(chars[i]);
+		if (u >= 0x800)
+		{
+			text += static_cast<char>(0xE0 + (u >> 12));
+			text += static_cast<char>(0x80 + ((u >> 6) & 0x3F));
+			text += static_cast<char>(0x80 + (u & 0x3F));
+		}
+		else if (u >= 0x80 || u == 0)
+		{
+			text += static_cast<char>(0xC0 + (u >> 6));
+			text += static_cast<char>(0x80 + (u & 0x3F));
+		}
+		else
+		{
+			text += static_cast<char>(u);
+		}
+	}
+}
+
+/**
+ * @brief Get buffer contents for diffutils without writing temp file.
+ * The text has the same lines and EOLs as the temp file SaveToFile()
+ * writes for diff-engine, in the UTF-8 form diffutils uses internally,
+ * prefixed with UTF-8 BOM.
+ * @param [out] text Text for diffutils.
+ * @param [in] nStartLine First line to get.
+ * @param [in] nLines Number of lines to get, -1 for rest of the buffer.
+ */
+void CDiffTextBuffer::GetTextForDiff(std::string & text, int nStartLine /*= 0*/, int nLines /*= -1*/)
+{
+	ASSERT (m_bInit);
+
+	if (nLines == -1)
+		nLines = static_cast<int>(m_aLines.size() - nStartLine);
+
+	CRLFSTYLE nCrlfStyle = CRLF_STYLE_AUTOMATIC;
+	if (!GetOptionsMgr()->GetBool(OPT_ALLOW_MIXED_EOL))
+		nCrlfStyle = GetCRLFMode();
+	LPCTSTR pszDefaultEol = GetStringEol(nCrlfStyle);
+
+	size_t nChars = 0;
+	for (int line = nStartLine; line < nStartLine + nLines; ++line)
+		nChars += GetFullLineLength(line);
+	text.assign("\xEF\xBB\xBF");
+	text.reserve(nChars + nChars / 8 + 3);
+
+	int lastRealLine = ApparentLastRealLine();
+	for (int line = nStartLine; line < nStartLine + nLines; ++line)
+	{
+		if (GetLineFlags(line) & LF_GHOST)
+			continue;
+
+		AppendTextForDiff(text, GetLineChars(line), GetLineLength(line));
+
+		// last real line ?
+		if (line == lastRealLine || lastRealLine == -1 )
+		{
+			// If original last line had no EOL, then we are done
+			if( !m_aLines[line].HasEol() )
+				break;
+		}
+
+		if (nCrlfStyle == CRLF_STYLE_AUTOMATIC || nCrlfStyle == CRLF_STYLE_MIXED)
+		{
+			LPCTSTR pszEol = GetLineEol(line);
+			AppendTextForDiff(text, pszEol, _tcslen(pszEol));
+		}
+		else
+			AppendTextForDiff(text, pszDefaultEol, _tcslen(pszDefaultEol));
+
+		if (line == lastRealLine || lastRealLine == -1)
+			break;
+	}
+}
+
 /**
  * @brief Saves file from buffer to disk
  *
@@ -667,5 +818,33 @@ DeleteText2(CCrystalTextView * pSource, int nStartLine, int nStartChar,
 			nLineSyncPoint < nEndLine)
 			m_pOwnerDoc->DeleteSyncPoint(m_nThisPane, nLineSyncPoint, false);
 	}
-	return CGhostTextBuffer::DeleteText2(pSource, nStartLine, nStartChar, nEndLine, nEndChar, nAction, bHistory);
+	if (!CGhostTextBuffer::DeleteText2(pSource, nStartLine, nStartChar, nEndLine, nEndChar, nAction, bHistory))
+		return false;
+	MarkEdited(nStartLine, nStartLine);
+	return true;
+}
+
+bool CDiffTextBuffer::			/* virtual override */
+InsertText(CCrystalTextView * pSource, int nLine, int nPos,
+	LPCTSTR pszText, size_t cchText, int &nEndLine, int &nEndChar,
+	int nAction /*= CE_ACTION_UNKNOWN*/, bool bHistory /*= true*/)
+{
+	if (!CGhostTextBuffer::InsertText(pSource, nLine, nPos, pszText, cchText,
+			nEndLine, nEndChar, nAction, bHistory))
+		return false;
+	MarkEdited(nLine, nEndLine);
+	return true;
+}
+
+/**
+ * @brief Apply default EOL style to all lines.
+ * EOLs are compared too, so whole buffer must be diffed again.
+ */
+bool CDiffTextBuffer::			/* virtual override */
+applyEOLMode()
+{
+	if (!CGhostTextBuffer::applyEOLMode())
+		return false;
+	MarkAllEdited();
+	return true;
 }
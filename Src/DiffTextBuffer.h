@@ -5,6 +5,8 @@
  */
 #pragma once
 
+#include <string>
+#include <climits>
 #include "GhostTextBuffer.h"
 #include "FileTextEncoding.h"
 
@@ -24,6 +26,9 @@ private :
 	String m_strTempPath; /**< Temporary files folder. */
 	int m_unpackerSubcode; /**< Plugin information. */
 	bool m_bMixedEOL; /**< EOL style of this buffer is mixed? */
+	int m_nEditedBegin; /**< First real line edited after last rescan, INT_MAX if none. */
+	int m_nEditedTail; /**< Real lines at end of buffer not edited after last rescan. */
+	int m_nRescanLineCount; /**< Real lines in buffer at last rescan. */
 
 	/** 
 	 * @brief Unicode encoding from ucr::UNICODESET.
@@ -37,6 +42,7 @@ private :
 	FileTextEncoding m_encoding;
 
 	bool FlagIsSet(UINT line, DWORD flag) const;
+	void MarkEdited(int nStartLine, int nEndLine);
 
 public :
 	CDiffTextBuffer(CMergeDoc * pDoc, int pane);
@@ -55,6 +61,7 @@ public :
 	int SaveToFile (const String& pszFileName, bool bTempFile, String & sError,
 		PackingInfo * infoUnpacker = nullptr, CRLFSTYLE nCrlfStyle = CRLF_STYLE_AUTOMATIC,
 		bool bClearModifiedFlag = true, int nStartLine = 0, int nLines = -1);
+	void GetTextForDiff(std::string & text, int nStartLine = 0, int nLines = -1);
 	ucr::UNICODESET getUnicoding() const { return m_encoding.m_unicoding; }
 	void setUnicoding(ucr::UNICODESET value) { m_encoding.m_unicoding = value; }
 	int getCodepage() const { return m_encoding.m_codepage; }
@@ -76,7 +83,21 @@ public :
 	void prepareForRescan();
 	virtual void OnNotifyLineHasBeenEdited(int nLine) override;
 	bool IsInitialized() const;
+	int GetRealLineCount() const;
+	void ResetEditedLines();
+	void MarkAllEdited();
+	bool HasEditedLines() const { return m_nEditedBegin != INT_MAX; }
+	/** @brief First real line edited after last rescan. */
+	int GetFirstEditedLine() const { return m_nEditedBegin; }
+	/** @brief Number of real lines at end of buffer not edited after last rescan. */
+	int GetUneditedTailLines() const { return m_nEditedTail; }
+	/** @brief Number of real lines in buffer at last rescan. */
+	int GetRescanLineCount() const { return m_nRescanLineCount; }
+	virtual bool InsertText (CCrystalTextView * pSource, int nLine, int nPos,
+		LPCTSTR pszText, size_t cchText, int &nEndLine, int &nEndChar,
+		int nAction = CE_ACTION_UNKNOWN, bool bHistory = true) override;
 	virtual bool DeleteText2 (CCrystalTextView * pSource, int nStartLine,
 		int nStartPos, int nEndLine, int nEndPos,
 		int nAction = CE_ACTION_UNKNOWN, bool bHistory = true) override;
+	virtual bool applyEOLMode() override;
 };
@@ -23,9 +23,7 @@
 #include "pch.h"
 #include "DiffThread.h"
 #include <cassert>
-#include <climits>
 #include <Poco/Thread.h>
-#include <Poco/Semaphore.h>
 #include "UnicodeString.h"
 #include "DiffContext.h"
 #include "DirScan.h"
@@ -33,10 +31,10 @@
 #include "PathContext.h"
 #include "CompareStats.h"
 #include "IAbortable.h"
+#include "CompareResultCache.h"
 #include "DebugNew.h"
 
 using Poco::Thread;
-using Poco::Semaphore;
 
 // Thread functions
 static void DiffThreadCollect(void *lpParam);
@@ -72,7 +70,7 @@ CDiffThread::CDiffThread()
  */
 CDiffThread::~CDiffThread()
 {
-	delete m_pDiffParm->pSemaphore;
+	delete m_pDiffParm->pCompareQueue;
 }
 
 /**
@@ -110,13 +108,16 @@ unsigned CDiffThread::CompareDirectories()
 
 	m_pDiffParm->nThreadState = THREAD_COMPARING;
 
-	delete m_pDiffParm->pSemaphore;
-	m_pDiffParm->pSemaphore = new Semaphore(0, LONG_MAX);
+	delete m_pDiffParm->pCompareQueue;
+	m_pDiffParm->pCompareQueue = nullptr;
 
 	m_pDiffParm->context->m_pCompareStats->SetCompareState(CompareStats::STATE_START);
 
 	if (!m_bOnlyRequested)
+	{
+		m_pDiffParm->pCompareQueue = new FolderCompareQueue(m_pDiffContext, nullptr);
 		m_threads[0].start(DiffThreadCollect, m_pDiffParm.get());
+	}
 	else
 	{
 		int nItems = DirScan_UpdateMarkedItems(m_pDiffParm.get(), nullptr);
@@ -173,11 +174,20 @@ static void DiffThreadCollect(void *pParam)
 	String subdir[3] = {_T(""), _T(""), _T("")}; // blank to start at roots specified in diff context
 
 	// Build results list (except delaying file comparisons until below)
-	DirScan_GetItems(paths, subdir, myStruct,
-			casesensitive, depth, nullptr, myStruct->context->m_bWalkUniques);
+	try
+	{
+		DirScan_GetItems(paths, subdir, myStruct,
+				casesensitive, depth, nullptr, myStruct->context->m_bWalkUniques);
+	}
+	catch (...)
+	{
+		// Don't leave the compare thread waiting for more folders
+		myStruct->pCompareQueue->CollectCompleted();
+		throw;
+	}
 
-	// Release Semaphore() once again to signal that collect phase is ready
-	myStruct->pSemaphore->set();
+	// Let compare queue know no more folders are coming
+	myStruct->pCompareQueue->CollectCompleted();
 
 	// Send message to UI to update
 	int event = CDiffThread::EVENT_COLLECT_COMPLETED;
@@ -201,11 +211,20 @@ static void DiffThreadCompare(void *pParam)
 
 	myStruct->context->m_pCompareStats->SetCompareState(CompareStats::STATE_COMPARE);
 
+	CompareResultCache *pCache = myStruct->context->m_pResultCache.get();
+	if (pCache != nullptr)
+		pCache->Load();
+
 	// Now do all pending file comparisons
+	int res;
 	if (myStruct->bOnlyRequested)
-		DirScan_CompareRequestedItems(myStruct, nullptr);
+		res = DirScan_CompareRequestedItems(myStruct, nullptr);
 	else
-		DirScan_CompareItems(myStruct, nullptr);
+		res = DirScan_CompareItems(myStruct, nullptr);
+
+	// Results of files gone or changed are dropped only after a full compare
+	if (pCache != nullptr)
+		pCache->Save(!myStruct->bOnlyRequested && res >= 0 && !myStruct->context->ShouldAbort());
 
 	myStruct->context->m_pCompareStats->SetCompareState(CompareStats::STATE_IDLE);
 
@@ -28,11 +28,8 @@
 #include <Poco/Delegate.h>
 #include "DiffContext.h"
 
-namespace Poco
-{
-class Semaphore;
-}
 class DiffThreadAbortable;
+class FolderCompareQueue;
 
 /**
  * @brief Structure used in sending data to the threads.
@@ -46,23 +43,24 @@ struct DiffFuncStruct
 	int nThreadState; /**< Thread state. */
 	DiffThreadAbortable * m_pAbortgate; /**< Interface for aborting compare. */
 	bool bOnlyRequested; /**< Compare only requested items? */
-	Poco::Semaphore *pSemaphore; /**< Semaphore for synchronizing threads. */
+	FolderCompareQueue *pCompareQueue; /**< Collected items waiting for compare. */
 
 	DiffFuncStruct()
 		: context(nullptr)
 		, nThreadState(0/*CDiffThread::THREAD_NOTSTARTED*/)
 		, m_pAbortgate(nullptr)
 		, bOnlyRequested(false)
-		, pSemaphore(nullptr)
+		, pCompareQueue(nullptr)
 		{}
 };
 
 /**
  * @brief Class for threaded folder compare.
- * This class implements folder compare in two phases and in two threads:
+ * This class implements folder compare as a pipeline of two threads:
  * - first thread collects items to compare to compare-time list
- *   (m_diffList).
- * - second threads compares items in the list.
+ *   (m_diffList), passing each listed folder on to the compare queue.
+ * - second thread runs the workers comparing items from the compare queue
+ *   while the collect is still going on.
  */
 class CDiffThread
 {
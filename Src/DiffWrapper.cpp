@@ -40,6 +40,7 @@
 #include <Poco/Debugger.h>
 #include <Poco/StringTokenizer.h>
 #include <Poco/Exception.h>
+#include <Poco/Environment.h>
 #include "DiffContext.h"
 #include "coretools.h"
 #include "DiffList.h"
@@ -58,6 +59,8 @@
 #include "UnicodeString.h"
 #include "unicoder.h"
 #include "TFile.h"
+#include "ParallelDiff.h"
+#include "StreamingDiff.h"
 #include "Exceptions.h"
 #include "MergeApp.h"
 
@@ -85,6 +88,7 @@ CDiffWrapper::CDiffWrapper()
 , m_infoPrediffer(nullptr)
 , m_pDiffList(nullptr)
 , m_bPathsAreTemp(false)
+, m_pTexts(nullptr)
 , m_pFilterList(nullptr)
 , m_bPluginsEnabled(false)
 , m_status()
@@ -659,6 +663,33 @@ void CDiffWrapper::SetPaths(const PathContext &tFiles,
 	m_bPathsAreTemp = tempPaths;
 }
 
+/**
+ * @brief Set texts to diff instead of reading files.
+ * Texts are given to diffutils from memory, which saves writing and reading
+ * temp files. Paths set with SetPaths() are still used to name the files.
+ * Prediffer plugins work on files only, so texts are not used when
+ * HasPrediffer() is true.
+ * @param [in] texts Texts in the UTF-8 form diffutils reads, one per file,
+ * or nullptr to read files again. Texts must remain valid until RunFileDiff()
+ * returns.
+ */
+void CDiffWrapper::SetTexts(const std::string *texts)
+{
+	m_pTexts = texts;
+}
+
+/**
+ * @brief Check if RunFileDiff() runs a prediffer plugin on the files.
+ * With automatic prediffer, the prediffer is searched during the first
+ * RunFileDiff(), so this is true until then.
+ */
+bool CDiffWrapper::HasPrediffer() const
+{
+	return m_bPluginsEnabled && m_infoPrediffer &&
+		(m_infoPrediffer->m_PluginOrPredifferMode != PLUGIN_MANUAL ||
+		 !m_infoPrediffer->m_PluginName.empty());
+}
+
 /**
  * @brief Set source paths for original (NON-TEMP) diffing two files.
  * Sets full paths to two (NON-TEMP) files we are diffing.
@@ -697,11 +728,16 @@ bool CDiffWrapper::RunFileDiff()
 	std::copy(m_files.begin(), m_files.end(), strFileTemp);
 	
 	m_options.SetToDiffUtils();
+	// Segments of large files are compared on all cores, unlike in
+	// folder compare where each thread compares files of its own
+	diff_threads = Poco::Environment::processorCount();
 
 	if (m_bUseDiffList)
 		m_nDiffs = m_pDiffList->GetSize();
 
-	for (file = 0; file < aFiles.GetSize(); file++)
+	const bool bUseTexts = m_pTexts != nullptr && !HasPrediffer();
+
+	for (file = 0; file < aFiles.GetSize() && !bUseTexts; file++)
 	{
 		if (m_bPluginsEnabled)
 		{
@@ -736,20 +772,41 @@ bool CDiffWrapper::RunFileDiff()
 	struct change *script12 = nullptr;
 	DiffFileData diffdata, diffdata10, diffdata12;
 	int bin_flag = 0, bin_flag10 = 0, bin_flag12 = 0;
+	std::unique_ptr<StreamingDiff> pStreamingDiff;
 
 	if (aFiles.GetSize() == 2)
 	{
 		diffdata.SetDisplayFilepaths(aFiles[0], aFiles[1]); // store true names for diff utils patch file
 		// This opens & fstats both files (if it succeeds)
-		if (!diffdata.OpenFiles(strFileTemp[0], strFileTemp[1]))
+		if (bUseTexts ? !diffdata.OpenBuffers(m_pTexts[0], m_pTexts[1]) :
+			!diffdata.OpenFiles(strFileTemp[0], strFileTemp[1]))
 		{
 			return false;
 		}
 
+		// Files too big for memory are streamed when only a patch is written
+		if (m_bCreatePatchFile && !m_bUseDiffList && StreamingDiff::IsSuitable(diffdata.m_inf))
+		{
+			pStreamingDiff.reset(new StreamingDiff(diffdata.m_inf));
+			switch (pStreamingDiff->Diff(&script))
+			{
+			case StreamingDiff::COMPARED:
+				CopyDiffutilTextStats(diffdata.m_inf, &diffdata);
+				break;
+			case StreamingDiff::FAILED:
+				bRet = false;
+				break;
+			default:
+				pStreamingDiff.reset();
+				break;
+			}
+		}
+
 		// Compare the files, if no error was found.
 		// Last param (bin_file) is `nullptr` since we don't
 		// (yet) need info about binary sides.
-		bRet = Diff2Files(&script, &diffdata, &bin_flag, nullptr);
+		if (pStreamingDiff == nullptr)
+			bRet = Diff2Files(&script, &diffdata, &bin_flag, nullptr);
 
 		// We don't anymore create diff-files for every rescan.
 		// User can create patch-file whenever one wants to.
@@ -774,19 +831,38 @@ bool CDiffWrapper::RunFileDiff()
 		diffdata10.SetDisplayFilepaths(aFiles[1], aFiles[0]); // store true names for diff utils patch file
 		diffdata12.SetDisplayFilepaths(aFiles[1], aFiles[2]); // store true names for diff utils patch file
 
-		if (!diffdata10.OpenFiles(strFileTemp[1], strFileTemp[0]))
+		if (bUseTexts ? !diffdata10.OpenBuffers(m_pTexts[1], m_pTexts[0]) :
+			!diffdata10.OpenFiles(strFileTemp[1], strFileTemp[0]))
 		{
 			return false;
 		}
 
-		bRet = Diff2Files(&script10, &diffdata10, &bin_flag10, nullptr);
-
-		if (!diffdata12.OpenFiles(strFileTemp[1], strFileTemp[2]))
+		if (bUseTexts ? !diffdata12.OpenBuffers(m_pTexts[1], m_pTexts[2]) :
+			!diffdata12.OpenFiles(strFileTemp[1], strFileTemp[2]))
 		{
 			return false;
 		}
 
-		bRet = Diff2Files(&script12, &diffdata12, &bin_flag12, nullptr);
+		// The two pairs are independent, so compare them at the same time,
+		// each with half of the cores for its segments.
+		// Diffutils options are per thread and must be set for the other one.
+		const int nThreads = diff_threads;
+		bool bRet10 = true, bRet12 = true;
+		std::vector<std::function<void()>> jobs;
+		jobs.push_back([&]()
+			{
+				m_options.SetToDiffUtils();
+				diff_threads = (nThreads + 1) / 2;
+				bRet10 = Diff2Files(&script10, &diffdata10, &bin_flag10, nullptr);
+			});
+		jobs.push_back([&]()
+			{
+				diff_threads = (nThreads + 1) / 2;
+				bRet12 = Diff2Files(&script12, &diffdata12, &bin_flag12, nullptr);
+			});
+		RunConcurrently(jobs);
+		diff_threads = nThreads;
+		bRet = bRet10 && bRet12;
 	}
 
 	// First determine what happened during comparison
@@ -852,9 +928,9 @@ bool CDiffWrapper::RunFileDiff()
 
 
 	// Create patch file
-	if (!m_status.bBinaries && m_bCreatePatchFile && aFiles.GetSize() == 2)
+	if (bRet && !m_status.bBinaries && m_bCreatePatchFile && aFiles.GetSize() == 2)
 	{
-		WritePatchFile(script, &inf[0]);
+		WritePatchFile(script, &inf[0], pStreamingDiff.get());
 	}
 	
 	// Go through diffs adding them to WinMerge's diff list
@@ -889,7 +965,7 @@ bool CDiffWrapper::RunFileDiff()
 		diffdata12.Close();
 	}
 
-	if (m_bPluginsEnabled)
+	if (m_bPluginsEnabled && !bUseTexts)
 	{
 		// Delete temp files transformation functions possibly created
 		for (file = 0; file < aFiles.GetSize(); file++)
@@ -1500,8 +1576,9 @@ void CDiffWrapper::WritePatchFileTerminator(enum output_style tOutput_style)
  * delimiters from \ to / since we want to keep compatibility with patch-tools.
  * @param [in] script list of changes.
  * @param [in] inf file_data table containing filenames
+ * @param [in] pStreamingDiff Streamed compare the script is from, or nullptr.
  */
-void CDiffWrapper::WritePatchFile(struct change * script, file_data * inf)
+void CDiffWrapper::WritePatchFile(struct change * script, file_data * inf, const StreamingDiff * pStreamingDiff)
 {
 	file_data inf_patch[2] = {0};
 	std::memcpy(&inf_patch, inf, sizeof(file_data) * 2);
@@ -1569,18 +1646,37 @@ void CDiffWrapper::WritePatchFile(struct change * script, file_data * inf)
 	}
 
 	// Output patchfile
+	// Lines of streamed files are read again from the files for printing
 	switch (output_style)
 	{
 	case OUTPUT_NORMAL:
-		print_normal_script(script);
+		if (pStreamingDiff != nullptr)
+		{
+			if (!pStreamingDiff->PrintScript(script))
+				m_status.bPatchFileFailed = true;
+		}
+		else
+			print_normal_script(script);
 		break;
 	case OUTPUT_CONTEXT:
 		print_context_header(inf_patch, 0);
-		print_context_script(script, 0);
+		if (pStreamingDiff != nullptr)
+		{
+			if (!pStreamingDiff->PrintScript(script))
+				m_status.bPatchFileFailed = true;
+		}
+		else
+			print_context_script(script, 0);
 		break;
 	case OUTPUT_UNIFIED:
 		print_context_header(inf_patch, 1);
-		print_context_script(script, 1);
+		if (pStreamingDiff != nullptr)
+		{
+			if (!pStreamingDiff->PrintScript(script))
+				m_status.bPatchFileFailed = true;
+		}
+		else
+			print_context_script(script, 1);
 		break;
 #if 0
 	case OUTPUT_ED:
@@ -24,6 +24,7 @@
 #pragma once
 
 #include <memory>
+#include <string>
 #include "diff.h"
 #include "FileLocation.h"
 #include "PathContext.h"
@@ -40,6 +41,7 @@ class FilterCommentsManager;
 struct FilterCommentsSet;
 class MovedLines;
 class FilterList;
+class StreamingDiff;
 
 /** @enum COMPARE_TYPE
  * @brief Different foldercompare methods.
@@ -68,6 +70,14 @@ class FilterList;
  * are not useful with that option.
  */
 
+/** @var CMP_HASH_CONTENT
+ * @brief Compare by digests of file contents.
+ * Every file is hashed once and files are judged identical when their sizes
+ * and digests match. Like binary compare this method doesn't know anything
+ * about text, but three-way compare reads every file only once and the
+ * digests are kept for showing them in folder compare.
+ */
+
 /** @var CMP_DATE
  * @brief Compare by modified date.
  * This compare type was added after requests and realization that in some
@@ -105,6 +115,7 @@ enum COMPARE_TYPE
 	CMP_DATE,
 	CMP_DATE_SIZE,
 	CMP_SIZE,
+	CMP_HASH_CONTENT,
 };
 
 /**
@@ -179,6 +190,8 @@ public:
 	bool GetDetectMovedBlocks() const { return (m_pMovedLines[0] != nullptr); }
 	void SetAppendFiles(bool bAppendFiles);
 	void SetPaths(const PathContext &files, bool tempPaths);
+	void SetTexts(const std::string *texts);
+	bool HasPrediffer() const;
 	void SetAlternativePaths(const PathContext &altPaths);
 	bool RunFileDiff();
 	void GetDiffStatus(DIFFSTATUS *status) const;
@@ -208,7 +221,7 @@ protected:
 	bool Diff2Files(struct change ** diffs, DiffFileData *diffData,
 		int * bin_status, int * bin_file) const;
 	void LoadWinMergeDiffsFromDiffUtilsScript(struct change * script, const file_data * inf);
-	void WritePatchFile(struct change * script, file_data * inf);
+	void WritePatchFile(struct change * script, file_data * inf, const StreamingDiff * pStreamingDiff);
 public:
 	void LoadWinMergeDiffsFromDiffUtilsScript3(
 		struct change * script10, struct change * script12,
@@ -221,6 +234,7 @@ private:
 	DIFFSTATUS m_status; /**< Status of last compare */
 	std::unique_ptr<FilterList> m_pFilterList; /**< List of linefilters. */
 	PathContext m_files; /**< Full path to diff'ed file. */
+	const std::string *m_pTexts; /**< Texts diff'ed instead of files, or nullptr. */
 	PathContext m_alternativePaths; /**< file's alternative path (may be relative). */
 	PathContext m_originalFile; /**< file's original (NON-TEMP) path. */
 
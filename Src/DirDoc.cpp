@@ -32,6 +32,7 @@
 #include "Merge.h"
 #include "IMergeDoc.h"
 #include "CompareOptions.h"
+#include "DiffWrapper.h"
 #include "UnicodeString.h"
 #include "CompareStats.h"
 #include "FilterList.h"
@@ -47,6 +48,7 @@
 #include "FileFilterHelper.h"
 #include "unicoder.h"
 #include "DirActions.h"
+#include "CompareResultCache.h"
 #include "MessageBoxDialog.h"
 
 #ifdef _DEBUG
@@ -253,12 +255,27 @@ void CDirDoc::Rescan()
 	m_pCtxt->m_bIgnoreSmallTimeDiff = GetOptionsMgr()->GetBool(OPT_IGNORE_SMALL_FILETIME);
 	m_pCtxt->m_bStopAfterFirstDiff = GetOptionsMgr()->GetBool(OPT_CMP_STOP_AFTER_FIRST);
 	m_pCtxt->m_nQuickCompareLimit = GetOptionsMgr()->GetInt(OPT_CMP_QUICK_LIMIT);
+	m_pCtxt->m_bPrefilter = GetOptionsMgr()->GetBool(OPT_CMP_PREFILTER);
 	m_pCtxt->m_bPluginsEnabled = GetOptionsMgr()->GetBool(OPT_PLUGINS_ENABLED);
 	m_pCtxt->m_bWalkUniques = GetOptionsMgr()->GetBool(OPT_CMP_WALK_UNIQUE_DIRS);
 	m_pCtxt->m_bIgnoreReparsePoints = GetOptionsMgr()->GetBool(OPT_CMP_IGNORE_REPARSE_POINTS);
 	m_pCtxt->m_bIgnoreCodepage = GetOptionsMgr()->GetBool(OPT_CMP_IGNORE_CODEPAGE);
 	m_pCtxt->m_pCompareStats = m_pCompareStats.get();
 
+	// Reuse results of unchanged files from previous compares
+	int nCompMethod = m_pCtxt->GetCompareMethod();
+	if (GetOptionsMgr()->GetBool(OPT_CMP_RESULT_CACHE) &&
+		(nCompMethod == CMP_CONTENT || nCompMethod == CMP_QUICK_CONTENT || nCompMethod == CMP_BINARY_CONTENT ||
+		 nCompMethod == CMP_HASH_CONTENT))
+	{
+		String lineFilters = m_pCtxt->m_pFilterList ? theApp.m_pLineFilters->GetAsString() : _T("");
+		m_pCtxt->m_pResultCache.reset(new CompareResultCache(
+			CompareResultCache::GetCacheFilePath(*m_pCtxt),
+			CompareResultCache::HashOptions(*m_pCtxt, options, lineFilters)));
+	}
+	else
+		m_pCtxt->m_pResultCache.reset();
+
 	// Set total items count since we don't collect items
 	if (m_bMarkedRescan)
 		m_pCompareStats->IncreaseTotalItems(m_pDirView->GetSelectedCount());
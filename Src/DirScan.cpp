@@ -7,17 +7,21 @@
 #include "pch.h"
 #include "DirScan.h"
 #include <cassert>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <memory>
 #define POCO_NO_UNWINDOWS 1
 #include <Poco/Semaphore.h>
-#include <Poco/Notification.h>
-#include <Poco/NotificationQueue.h>
 #include <Poco/Environment.h>
 #include <Poco/ThreadPool.h>
 #include <Poco/Thread.h>
 #include <Poco/Runnable.h>
 #include <Poco/Mutex.h>
-#include <Poco/AutoPtr.h>
+#include <Poco/AtomicCounter.h>
 #include <Poco/Stopwatch.h>
 #include <Poco/Format.h>
 #include "DiffThread.h"
@@ -25,6 +29,7 @@
 #include "DiffWrapper.h"
 #include "CompareStats.h"
 #include "FolderCmp.h"
+#include "CompareResultCache.h"
 #include "FileFilterHelper.h"
 #include "IAbortable.h"
 #include "FolderCmp.h"
@@ -37,9 +42,6 @@
 #include "OptionsMgr.h"
 #include "DebugNew.h"
 
-using Poco::NotificationQueue;
-using Poco::Notification;
-using Poco::AutoPtr;
 using Poco::Thread;
 using Poco::ThreadPool;
 using Poco::Runnable;
@@ -55,32 +57,208 @@ static DIFFITEM *AddToList(const String &sLeftDir, const String &sRightDir, cons
 static DIFFITEM *AddToList(const String &sDir1, const String &sDir2, const String &sDir3, const DirItem *ent1, const DirItem *ent2, const DirItem *ent3,
 	unsigned code, DiffFuncStruct *myStruct, DIFFITEM *parent, int nItems = 3);
 static void UpdateDiffItem(DIFFITEM &di, bool &bExists, CDiffContext *pCtxt);
-static int CompareItems(NotificationQueue &queue, DiffFuncStruct *myStruct, DIFFITEM *parentdiffpos);
+struct SubfolderScan;
+static String GetFolderPath(const PathContext &paths, const String subdir[], int nIndex);
+static int CollectFolderItems(const String subdir[], DirItemArray dirs[], DirItemArray aFiles[],
+	DiffFuncStruct *myStruct, bool casesensitive, int depth, DIFFITEM *parent,
+	bool bUniques, std::vector<SubfolderScan> &subfolders);
+static void UpdateFolderSize(DIFFITEM *parent, int nDirs);
 
-class WorkNotification: public Poco::Notification
+/**
+ * @brief Items of one folder given to a compare worker at once.
+ * A batch is closed when it is full or when its files add up to MAX_BYTES,
+ * so tiny files travel in big batches while big files still get spread
+ * over all workers.
+ */
+struct CompareBatch
+{
+	enum { MAX_ITEMS = 64 };
+	enum { MAX_BYTES = 1024 * 1024 };
+	CompareBatch() : count(0), bytes(0), urgent(false) {}
+	DIFFITEM *items[MAX_ITEMS];
+	int count;
+	uint64_t bytes; /**< Bytes to compare, largest side of each file */
+	bool urgent; /**< Items exist on all sides, compare before others */
+};
+
+/**
+ * @brief Bounded lock-free multi-producer multi-consumer queue.
+ * A ring of cells where each cell carries a sequence number telling whether
+ * it is free for the producer or ready for the consumer of the current lap
+ * (D. Vyukov's bounded MPMC queue). Producers and consumers only contend
+ * on one compare-and-swap of their own position. Capacity must be a power
+ * of two.
+ */
+template <class T>
+class BoundedMPMCQueue
 {
 public:
-	WorkNotification(DIFFITEM& di, NotificationQueue& queueResult): m_di(di), m_queueResult(queueResult) {}
-	DIFFITEM& data() const { return m_di; }
-	NotificationQueue& queueResult() const { return m_queueResult; }
+	explicit BoundedMPMCQueue(size_t capacity)
+		: m_cells(new Cell[capacity]), m_mask(capacity - 1), m_enqueuePos(0), m_dequeuePos(0)
+	{
+		assert((capacity & m_mask) == 0);
+		for (size_t i = 0; i < capacity; ++i)
+			m_cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	/** @return false if queue is full. */
+	bool TryPush(const T& value)
+	{
+		Cell *cell;
+		size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			cell = &m_cells[pos & m_mask];
+			size_t seq = cell->sequence.load(std::memory_order_acquire);
+			intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+			if (dif == 0)
+			{
+				if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (dif < 0)
+				return false;
+			else
+				pos = m_enqueuePos.load(std::memory_order_relaxed);
+		}
+		cell->value = value;
+		cell->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** @return false if queue is empty. */
+	bool TryPop(T& value)
+	{
+		Cell *cell;
+		size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			cell = &m_cells[pos & m_mask];
+			size_t seq = cell->sequence.load(std::memory_order_acquire);
+			intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+			if (dif == 0)
+			{
+				if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (dif < 0)
+				return false;
+			else
+				pos = m_dequeuePos.load(std::memory_order_relaxed);
+		}
+		value = cell->value;
+		cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+		return true;
+	}
+
 private:
-	DIFFITEM& m_di;
-	NotificationQueue& m_queueResult;
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		T value;
+	};
+	std::unique_ptr<Cell[]> m_cells;
+	size_t m_mask;
+	// Keep positions on cache lines of their own, they are hammered by different threads
+	alignas(64) std::atomic<size_t> m_enqueuePos;
+	alignas(64) std::atomic<size_t> m_dequeuePos;
 };
 
-class WorkCompletedNotification: public Poco::Notification
+/**
+ * @brief Batches waiting for a compare worker.
+ * Batches of items existing on all sides, which need actual comparing, are
+ * taken before the others. Idle workers sleep on a semaphore that is set
+ * once per queued batch, and once per worker when stopping. Producers of a
+ * full queue sleep on a semaphore counting its free cells.
+ *
+ * A batch is signaled once it is in its cell, but a producer that got an
+ * earlier cell may not have filled it yet, and the queues hand out cells
+ * in order. The batch then can't be taken before that producer signals its
+ * own batch, so a worker waits for that signal instead of polling, and
+ * gives back the signals it did not use. Filling a free cell waits the same
+ * way for a worker still emptying it.
+ */
+class CompareBatchQueue
 {
 public:
-	explicit WorkCompletedNotification(DIFFITEM& di): m_di(di) {}
-	DIFFITEM& data() const { return m_di; }
+	enum { CAPACITY = 4096 };
+
+	CompareBatchQueue()
+		: m_urgent(CAPACITY), m_normal(CAPACITY)
+		, m_freeUrgent(CAPACITY, LONG_MAX), m_freeNormal(CAPACITY, LONG_MAX)
+		, m_available(0, LONG_MAX), m_bStop(false) {}
+
+	/** @return false if queue is full. */
+	bool TryPush(CompareBatch *pBatch)
+	{
+		Poco::Semaphore &free = pBatch->urgent ? m_freeUrgent : m_freeNormal;
+		if (!free.tryWait(0))
+			return false;
+		if (!(pBatch->urgent ? m_urgent : m_normal).TryPush(pBatch))
+		{
+			free.set();
+			return false;
+		}
+		m_available.set();
+		return true;
+	}
+
+	/** @brief Queue batch, waiting for workers to make room if needed. */
+	void Push(CompareBatch *pBatch)
+	{
+		Poco::Semaphore &free = pBatch->urgent ? m_freeUrgent : m_freeNormal;
+		int nFree = 0;
+		do
+		{
+			free.wait();
+			++nFree;
+		} while (!(pBatch->urgent ? m_urgent : m_normal).TryPush(pBatch));
+		while (--nFree > 0)
+			free.set();
+		m_available.set();
+	}
+
+	/** @return next batch, or nullptr when workers are to quit. */
+	CompareBatch *WaitPop()
+	{
+		int nSignals = 0;
+		for (;;)
+		{
+			m_available.wait();
+			++nSignals;
+			CompareBatch *pBatch = nullptr;
+			if (m_urgent.TryPop(pBatch))
+				m_freeUrgent.set();
+			else if (m_normal.TryPop(pBatch))
+				m_freeNormal.set();
+			else if (!m_bStop)
+				continue;
+			while (--nSignals > 0)
+				m_available.set();
+			return pBatch;
+		}
+	}
+
+	void Stop(int nworkers)
+	{
+		m_bStop = true;
+		for (int i = 0; i < nworkers; ++i)
+			m_available.set();
+	}
+
 private:
-	DIFFITEM& m_di;
+	BoundedMPMCQueue<CompareBatch *> m_urgent;
+	BoundedMPMCQueue<CompareBatch *> m_normal;
+	Poco::Semaphore m_freeUrgent; /**< Free cells of m_urgent */
+	Poco::Semaphore m_freeNormal; /**< Free cells of m_normal */
+	Poco::Semaphore m_available; /**< Batches queued, and workers to quit */
+	std::atomic<bool> m_bStop;
 };
 
 class DiffWorker: public Runnable
 {
 public:
-	DiffWorker(NotificationQueue& queue, CDiffContext *pCtxt, int id):
+	DiffWorker(FolderCompareQueue& queue, CDiffContext *pCtxt, int id):
 	  m_queue(queue), m_pCtxt(pCtxt), m_id(id) {}
 
 	void run()
@@ -89,22 +267,31 @@ public:
 		// when we exit the thread, we delete this and release the scripts
 		CAssureScriptsForThread scriptsForRescan;
 
-		AutoPtr<Notification> pNf(m_queue.waitDequeueNotification());
-		while (pNf.get() != nullptr)
+		// Batches that did not fit into the full queue are compared here
+		std::vector<CompareBatch *> overflow;
+		for (;;)
 		{
-			WorkNotification* pWorkNf = dynamic_cast<WorkNotification*>(pNf.get());
-			if (pWorkNf != nullptr) {
-				m_pCtxt->m_pCompareStats->BeginCompare(&pWorkNf->data(), m_id);
+			CompareBatch *pBatch;
+			if (!overflow.empty())
+			{
+				pBatch = overflow.back();
+				overflow.pop_back();
+			}
+			else if ((pBatch = m_queue.WaitDequeue()) == nullptr)
+				break;
+			for (int i = 0; i < pBatch->count; ++i)
+			{
+				DIFFITEM &di = *pBatch->items[i];
+				m_pCtxt->m_pCompareStats->BeginCompare(&di, m_id);
 				if (!m_pCtxt->ShouldAbort())
-					CompareDiffItem(pWorkNf->data(), m_pCtxt);
-				pWorkNf->queueResult().enqueueNotification(new WorkCompletedNotification(pWorkNf->data()));
+					CompareDiffItem(di, m_pCtxt);
 			}
-			pNf = m_queue.waitDequeueNotification();
+			m_queue.BatchCompared(pBatch, overflow);
 		}
 	}
 
 private:
-	NotificationQueue& m_queue;
+	FolderCompareQueue& m_queue;
 	CDiffContext *m_pCtxt;
 	int m_id;
 };
@@ -112,54 +299,432 @@ private:
 typedef std::shared_ptr<DiffWorker> DiffWorkerPtr;
 
 /**
- * @brief Collect file- and folder-names to list.
- * This function walks given folders and adds found subfolders and files into
- * lists. There are two modes, determined by the @p depth:
- * - in non-recursive mode we walk only given folders, and add files
- *   contained. Subfolders are added as folder items, not walked into.
- * - in recursive mode we walk all subfolders and add the files they
- *   contain into list.
+ * @brief Subfolder found while collecting, still to be walked into.
+ */
+struct SubfolderScan
+{
+	DIFFITEM *parent; /**< Folder item the subfolder's items are added under */
+	String subdir[3]; /**< Subfolder paths under root paths */
+};
+
+/**
+ * @brief Small work-stealing scheduler for parallel folder collection.
  *
- * Items are tested against file filters in this function.
- * 
+ * Every worker owns a deque of jobs. Jobs spawned by a worker go to the back
+ * of its own deque and are taken back from there, so a worker keeps walking
+ * down the subtree it is in. Idle workers steal from the front of other
+ * workers' deques, which hands them the oldest and usually biggest subtrees.
+ *
+ * When a job throws, the workers quit and Run() rethrows the exception.
+ */
+class CollectScheduler
+{
+public:
+	typedef std::function<void (int)> Job; /**< Job body, gets id of the worker running it */
+
+	explicit CollectScheduler(int nworkers)
+		: m_nworkers(nworkers), m_queues(nworkers), m_mutexes(new Poco::FastMutex[nworkers])
+		, m_available(0, LONG_MAX), m_bStop(false) {}
+
+	/**
+	 * @brief Queue a job.
+	 * @param [in] id Id of the calling worker, or -1 if called from outside the workers.
+	 * @param [in] job Job to run.
+	 */
+	void Push(int id, Job job)
+	{
+		int iQueue = (id < 0) ? 0 : id;
+		++m_nUnfinished;
+		{
+			Poco::FastMutex::ScopedLock lock(m_mutexes[iQueue]);
+			m_queues[iQueue].push_back(std::move(job));
+		}
+		m_available.set();
+	}
+
+	/**
+	 * @brief Run queued jobs, and jobs they spawn, until there are no more jobs.
+	 * An exception thrown by a job is rethrown here, once all workers have quit.
+	 */
+	void Run()
+	{
+		if (m_nUnfinished == 0)
+			return;
+		std::vector<std::unique_ptr<Worker>> workers;
+		for (int i = 0; i < m_nworkers; ++i)
+			workers.emplace_back(new Worker(*this, i));
+		ThreadPool threadPool(m_nworkers, m_nworkers);
+		try
+		{
+			for (int i = 0; i < m_nworkers; ++i)
+				threadPool.start(*workers[i]);
+		}
+		catch (...)
+		{
+			// Workers already started use the scheduler, wait for them
+			Stop();
+			threadPool.joinAll();
+			throw;
+		}
+		threadPool.joinAll();
+		for (const auto& worker : workers)
+			worker->rethrow();
+	}
+
+private:
+	class Worker : public Runnable
+	{
+	public:
+		Worker(CollectScheduler &scheduler, int id) : m_scheduler(scheduler), m_id(id) {}
+		void run()
+		{
+			try
+			{
+				Job job;
+				while (m_scheduler.Take(m_id, job))
+				{
+					JobDone done(m_scheduler);
+					job(m_id);
+					job = nullptr;
+				}
+			}
+			catch (...)
+			{
+				// Poco would swallow the exception, keep it for Run()
+				m_exception = std::current_exception();
+				m_scheduler.Stop();
+			}
+		}
+		/** @brief Rethrow the exception thrown by a job, if any. */
+		void rethrow() const
+		{
+			if (m_exception)
+				std::rethrow_exception(m_exception);
+		}
+	private:
+		CollectScheduler &m_scheduler;
+		int m_id;
+		std::exception_ptr m_exception;
+	};
+
+	/** @brief Counts a job as finished when leaving a scope, also when the job throws. */
+	class JobDone
+	{
+	public:
+		explicit JobDone(CollectScheduler &scheduler) : m_scheduler(scheduler) {}
+		~JobDone()
+		{
+			if (--m_scheduler.m_nUnfinished == 0)
+			{
+				// Last job done, wake up everybody to quit
+				for (int i = 0; i < m_scheduler.m_nworkers; ++i)
+					m_scheduler.m_available.set();
+			}
+		}
+	private:
+		JobDone(const JobDone &) = delete;
+		JobDone & operator=(const JobDone &) = delete;
+		CollectScheduler &m_scheduler;
+	};
+
+	/** @brief Make the workers quit without running the jobs left. */
+	void Stop()
+	{
+		m_bStop = true;
+		for (int i = 0; i < m_nworkers; ++i)
+			m_available.set();
+	}
+
+	/**
+	 * @brief Get next job for worker @p id.
+	 * @return false when all jobs have been run, or the workers are to quit.
+	 */
+	bool Take(int id, Job &job)
+	{
+		m_available.wait();
+		if (m_bStop || m_nUnfinished == 0)
+			return false;
+		// Own queue first, newest job first
+		{
+			Poco::FastMutex::ScopedLock lock(m_mutexes[id]);
+			if (TakeFrom(id, id, job))
+				return true;
+		}
+		// Then steal oldest jobs from the others
+		for (int i = 1; i < m_nworkers; ++i)
+		{
+			int victim = (id + i) % m_nworkers;
+			Poco::FastMutex::ScopedLock lock(m_mutexes[victim]);
+			if (TakeFrom(victim, id, job))
+				return true;
+		}
+		// Other workers took the jobs we saw while the job we were signaled
+		// for went to a queue we had already passed. As there are at least
+		// as many jobs queued as signals handed out, looking at all queues
+		// at once finds it.
+		for (int i = 0; i < m_nworkers; ++i)
+			m_mutexes[i].lock();
+		bool bFound = false;
+		for (int i = 0; i < m_nworkers && !bFound; ++i)
+			bFound = TakeFrom((id + i) % m_nworkers, id, job);
+		for (int i = m_nworkers - 1; i >= 0; --i)
+			m_mutexes[i].unlock();
+		assert(bFound);
+		return bFound;
+	}
+
+	/**
+	 * @brief Take a job for worker @p id from queue @p iQueue, whose mutex the caller holds.
+	 * The owner of the queue takes its newest job, others steal the oldest one.
+	 */
+	bool TakeFrom(int iQueue, int id, Job &job)
+	{
+		std::deque<Job> &queue = m_queues[iQueue];
+		if (queue.empty())
+			return false;
+		if (iQueue == id)
+		{
+			job = std::move(queue.back());
+			queue.pop_back();
+		}
+		else
+		{
+			job = std::move(queue.front());
+			queue.pop_front();
+		}
+		return true;
+	}
+
+	int m_nworkers;
+	std::vector<std::deque<Job>> m_queues;
+	std::unique_ptr<Poco::FastMutex[]> m_mutexes;
+	Poco::Semaphore m_available; /**< Signaled once per queued job, and on quit */
+	Poco::AtomicCounter m_nUnfinished; /**< Jobs queued or running */
+	std::atomic<bool> m_bStop; /**< Set when a job threw */
+};
+
+/**
+ * @brief Walks the compared folders and adds found items to the list.
+ *
+ * With one thread folders are walked recursively on the calling thread. With
+ * more threads every folder to walk becomes a set of jobs in a
+ * CollectScheduler: one job per compare side lists and sorts that side's
+ * folder, and the job finishing last merge-joins the listings and spawns the
+ * jobs of the subfolders. Each folder only ever appends to its own children,
+ * so the resulting tree is the same as when walking with one thread.
+ */
+class FolderCollector
+{
+public:
+	FolderCollector(const PathContext &paths, DiffFuncStruct *myStruct,
+			bool casesensitive, bool bUniques, DIFFITEM *parent, int nthreads)
+		: m_paths(paths), m_myStruct(myStruct), m_pCtxt(myStruct->context)
+		, m_nDirs(paths.GetSize()), m_casesensitive(casesensitive), m_bUniques(bUniques)
+		, m_pParent(parent), m_nThreads(nthreads), m_pQueue(myStruct->pCompareQueue)
+		, m_pScheduler(nullptr), m_nTopResult(0)
+	{
+	}
+
+	int Collect(const String subdir[], int depth)
+	{
+		int result;
+		if (m_nThreads <= 1)
+		{
+			result = CollectSequential(subdir, depth, m_pParent);
+		}
+		else
+		{
+			CollectScheduler scheduler(m_nThreads);
+			m_pScheduler = &scheduler;
+			ScheduleFolder(-1, new FolderJob(subdir, m_pParent, depth, nullptr, m_nDirs));
+			scheduler.Run();
+			m_pScheduler = nullptr;
+			result = m_pCtxt->ShouldAbort() ? -1 : m_nTopResult;
+		}
+		return result;
+	}
+
+private:
+	/** @brief One folder to walk in parallel mode. */
+	struct FolderJob
+	{
+		FolderJob(const String subdir_[], DIFFITEM *parent_, int depth_, FolderJob *pParentJob_, int nDirs)
+			: parent(parent_), depth(depth_), pParentJob(pParentJob_)
+			, nPendingSides(nDirs), nPendingRefs(1), result(0)
+		{
+			std::copy(subdir_, subdir_ + nDirs, subdir);
+		}
+		String subdir[3];
+		DIFFITEM *parent;
+		int depth;
+		FolderJob *pParentJob;
+		DirItemArray dirs[3];
+		DirItemArray files[3];
+		Poco::AtomicCounter nPendingSides; /**< Sides not listed yet */
+		Poco::AtomicCounter nPendingRefs; /**< Own merge plus unfinished subfolders */
+		int result; /**< Result of CollectFolderItems() */
+	};
+
+	int CollectSequential(const String subdir[], int depth, DIFFITEM *parent)
+	{
+		std::vector<SubfolderScan> subfolders;
+		int result;
+		{
+			DirItemArray dirs[3], aFiles[3];
+			for (int nIndex = 0; nIndex < m_nDirs; nIndex++)
+				LoadAndSortFiles(GetFolderPath(m_paths, subdir, nIndex), &dirs[nIndex], &aFiles[nIndex], m_casesensitive);
+			result = CollectFolderItems(subdir, dirs, aFiles, m_myStruct,
+				m_casesensitive, depth, parent, m_bUniques, subfolders);
+		}
+		FolderListed(parent, result, subfolders);
+		if (result != 1)
+			return result;
+
+		for (const auto& sub : subfolders)
+		{
+			if (CollectSequential(sub.subdir, depth - 1, sub.parent) == -1)
+				return -1;
+		}
+		UpdateFolderSize(parent, m_nDirs);
+		return 1;
+	}
+
+	void ScheduleFolder(int id, FolderJob *job)
+	{
+		for (int nIndex = 0; nIndex < m_nDirs; ++nIndex)
+			m_pScheduler->Push(id, [this, job, nIndex](int worker) { ListFolderSide(worker, job, nIndex); });
+	}
+
+	void ListFolderSide(int id, FolderJob *job, int nIndex)
+	{
+		if (!m_pCtxt->ShouldAbort())
+			LoadAndSortFiles(GetFolderPath(m_paths, job->subdir, nIndex), &job->dirs[nIndex], &job->files[nIndex], m_casesensitive);
+		if (--job->nPendingSides == 0)
+			MergeFolder(id, job);
+	}
+
+	void MergeFolder(int id, FolderJob *job)
+	{
+		std::vector<SubfolderScan> subfolders;
+		job->result = CollectFolderItems(job->subdir, job->dirs, job->files, m_myStruct,
+			m_casesensitive, job->depth, job->parent, m_bUniques, subfolders);
+		for (int nIndex = 0; nIndex < m_nDirs; ++nIndex)
+		{
+			DirItemArray().swap(job->dirs[nIndex]);
+			DirItemArray().swap(job->files[nIndex]);
+		}
+		if (job->pParentJob == nullptr)
+			m_nTopResult = job->result;
+		FolderListed(job->parent, job->result, subfolders);
+		if (job->result == 1)
+		{
+			for (const auto& sub : subfolders)
+			{
+				++job->nPendingRefs;
+				ScheduleFolder(id, new FolderJob(sub.subdir, sub.parent, job->depth - 1, job, m_nDirs));
+			}
+		}
+		ReleaseFolder(job);
+	}
+
+	/**
+	 * @brief Pass items of a listed folder on to the compare queue.
+	 * Subfolders are walked only if the folder was collected completely.
+	 */
+	void FolderListed(DIFFITEM *parent, int result, const std::vector<SubfolderScan> &subfolders)
+	{
+		if (m_pQueue == nullptr)
+			return;
+		std::vector<DIFFITEM *> scheduled;
+		if (result == 1)
+		{
+			for (const auto& sub : subfolders)
+				scheduled.push_back(sub.parent);
+		}
+		m_pQueue->FolderListed(parent, scheduled);
+	}
+
+	/** @brief Drop one reference to @p job, finishing folders whose subfolders all are done. */
+	void ReleaseFolder(FolderJob *job)
+	{
+		while (job != nullptr && --job->nPendingRefs == 0)
+		{
+			if (job->result == 1)
+				UpdateFolderSize(job->parent, m_nDirs);
+			FolderJob *pParentJob = job->pParentJob;
+			delete job;
+			job = pParentJob;
+		}
+	}
+
+	const PathContext &m_paths;
+	DiffFuncStruct *m_myStruct;
+	CDiffContext *m_pCtxt;
+	int m_nDirs;
+	bool m_casesensitive;
+	bool m_bUniques;
+	DIFFITEM *m_pParent;
+	int m_nThreads;
+	FolderCompareQueue *m_pQueue; /**< Where listed folders go, nullptr if not comparing yet */
+	CollectScheduler *m_pScheduler;
+	int m_nTopResult;
+};
+
+/**
+ * @brief Return full path of the folder to list for one compare side.
  * @param [in] paths Root paths of compare
- * @param [in] leftsubdir Left side subdirectory under root path
- * @param [in] bLeftUniq Is left-side folder unique folder?
- * @param [in] rightsubdir Right side subdirectory under root path
- * @param [in] bRightUniq Is right-side folder unique folder?
+ * @param [in] subdir Subdirectories under root paths
+ * @param [in] nIndex Compare side
+ */
+static String GetFolderPath(const PathContext &paths, const String subdir[], int nIndex)
+{
+	if (subdir[0].empty())
+		return paths[nIndex];
+	return paths::ConcatPath(paths[nIndex], subdir[nIndex]);
+}
+
+/**
+ * @brief Add items of one listed folder to list.
+ * This function merge-joins the sorted listings of one folder (one listing
+ * per compare side) and adds found subfolders and files into the list as
+ * children of @p parent. Subfolders to walk into are not walked here, they
+ * are returned in @p subfolders so the caller decides when (and on which
+ * thread) they are listed. There are two modes, determined by the @p depth:
+ * - in non-recursive mode (@p depth is 0) subfolders are added as folder
+ *   items, not walked into.
+ * - in recursive mode subfolders are returned for walking.
+ *
+ * Items are tested against file filters in this function.
+ *
+ * @param [in] subdir Subdirectories under root paths
+ * @param [in] dirs Sorted subfolder listings, one per side
+ * @param [in] aFiles Sorted file listings, one per side
  * @param [in] myStruct Compare-related data, like context etc.
- * @param [in] casesensitive Is filename compare case sensitive?
+ * @param [in] casesensitive Is filename compare case sensitive? Names are
+ *  matched by the sort keys the listings were made with.
  * @param [in] depth Levels of subdirectories to scan, -1 scans all
  * @param [in] parent Folder diff item to be scanned
  * @param [in] bUniques If true, walk into unique folders.
- * @return 1 normally, -1 if compare was aborted
+ * @param [out] subfolders Subfolders to walk into, in list order.
+ * @return 1 normally, 0 if folder is empty, -1 if compare was aborted
  */
-int DirScan_GetItems(const PathContext &paths, const String subdir[],
+static int CollectFolderItems(const String subdir[],
+		DirItemArray dirs[], DirItemArray aFiles[],
 		DiffFuncStruct *myStruct,
 		bool casesensitive, int depth, DIFFITEM *parent,
-		bool bUniques)
+		bool bUniques, std::vector<SubfolderScan> &subfolders)
 {
 	static const TCHAR backslash[] = _T("\\");
-	int nDirs = paths.GetSize();
 	CDiffContext *pCtxt = myStruct->context;
-	String sDir[3];
+	int nDirs = pCtxt->GetCompareDirs();
 	String subprefix[3];
 
-	std::copy(paths.begin(), paths.end(), sDir);
-
 	if (!subdir[0].empty())
 	{
-		for (int nIndex = 0; nIndex < paths.GetSize(); nIndex++)
-		{
-			sDir[nIndex] = paths::ConcatPath(sDir[nIndex], subdir[nIndex]);
+		for (int nIndex = 0; nIndex < nDirs; nIndex++)
 			subprefix[nIndex] = subdir[nIndex] + backslash;
-		}
 	}
 
-	DirItemArray dirs[3], aFiles[3];
-	for (int nIndex = 0; nIndex < nDirs; nIndex++)
-		LoadAndSortFiles(sDir[nIndex], &dirs[nIndex], &aFiles[nIndex], casesensitive);
-
 	// Allow user to abort scanning
 	if (pCtxt->ShouldAbort())
 		return -1;
@@ -187,13 +752,13 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 
 		unsigned nDiffCode = DIFFCODE::DIR;
 		// Comparing directories leftDirs[i].name to rightDirs[j].name
-		if (i<dirs[0].size() && (j==dirs[1].size() || collstr(dirs[0][i].filename, dirs[1][j].filename, casesensitive)<0)
-			&& (nDirs < 3 ||      (k==dirs[2].size() || collstr(dirs[0][i].filename, dirs[2][k].filename, casesensitive)<0) ))
+		if (i<dirs[0].size() && (j==dirs[1].size() || collitem(dirs[0][i], dirs[1][j])<0)
+			&& (nDirs < 3 ||      (k==dirs[2].size() || collitem(dirs[0][i], dirs[2][k])<0) ))
 		{
 			nDiffCode |= DIFFCODE::FIRST;
 		}
-		else if (j<dirs[1].size() && (i==dirs[0].size() || collstr(dirs[1][j].filename, dirs[0][i].filename, casesensitive)<0)
-			&& (nDirs < 3 ||      (k==dirs[2].size() || collstr(dirs[1][j].filename, dirs[2][k].filename, casesensitive)<0) ))
+		else if (j<dirs[1].size() && (i==dirs[0].size() || collitem(dirs[1][j], dirs[0][i])<0)
+			&& (nDirs < 3 ||      (k==dirs[2].size() || collitem(dirs[1][j], dirs[2][k])<0) ))
 		{
 			nDiffCode |= DIFFCODE::SECOND;
 		}
@@ -203,23 +768,23 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 		}
 		else
 		{
-			if (k<dirs[2].size() && (i==dirs[0].size() || collstr(dirs[2][k].filename, dirs[0][i].filename, casesensitive)<0)
-				&&                     (j==dirs[1].size() || collstr(dirs[2][k].filename, dirs[1][j].filename, casesensitive)<0) )
+			if (k<dirs[2].size() && (i==dirs[0].size() || collitem(dirs[2][k], dirs[0][i])<0)
+				&&                     (j==dirs[1].size() || collitem(dirs[2][k], dirs[1][j])<0) )
 			{
 				nDiffCode |= DIFFCODE::THIRD;
 			}
-			else if ((i<dirs[0].size() && j<dirs[1].size() && collstr(dirs[0][i].filename, dirs[1][j].filename, casesensitive) == 0)
-				&& (k==dirs[2].size() || collstr(dirs[2][k].filename, dirs[0][i].filename, casesensitive) != 0))
+			else if ((i<dirs[0].size() && j<dirs[1].size() && collitem(dirs[0][i], dirs[1][j]) == 0)
+				&& (k==dirs[2].size() || collitem(dirs[2][k], dirs[0][i]) != 0))
 			{
 				nDiffCode |= DIFFCODE::FIRST | DIFFCODE::SECOND;
 			}
-			else if ((i<dirs[0].size() && k<dirs[2].size() && collstr(dirs[0][i].filename, dirs[2][k].filename, casesensitive) == 0)
-				&& (j==dirs[1].size() || collstr(dirs[1][j].filename, dirs[2][k].filename, casesensitive) != 0))
+			else if ((i<dirs[0].size() && k<dirs[2].size() && collitem(dirs[0][i], dirs[2][k]) == 0)
+				&& (j==dirs[1].size() || collitem(dirs[1][j], dirs[2][k]) != 0))
 			{
 				nDiffCode |= DIFFCODE::FIRST | DIFFCODE::THIRD;
 			}
-			else if ((j<dirs[1].size() && k<dirs[2].size() && collstr(dirs[1][j].filename, dirs[2][k].filename, casesensitive) == 0)
-				&& (i==dirs[0].size() || collstr(dirs[0][i].filename, dirs[1][j].filename, casesensitive) != 0))
+			else if ((j<dirs[1].size() && k<dirs[2].size() && collitem(dirs[1][j], dirs[2][k]) == 0)
+				&& (i==dirs[0].size() || collitem(dirs[0][i], dirs[1][j]) != 0))
 			{
 				nDiffCode |= DIFFCODE::SECOND | DIFFCODE::THIRD;
 			}
@@ -301,11 +866,8 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 				if ((nDiffCode & DIFFCODE::SKIPPED) == 0 && ((nDiffCode & DIFFCODE::SIDEFLAGS) == DIFFCODE::BOTH || bUniques))
 				{
 					// Scan recursively all subdirectories too, we are not adding folders
-					String newsubdir[3] = {leftnewsub, rightnewsub};
-					int result = DirScan_GetItems(paths, newsubdir, myStruct, casesensitive,
-							depth - 1, me, bUniques);
-					if (result == -1)
-						return -1;
+					SubfolderScan sub = { me, {leftnewsub, rightnewsub} };
+					subfolders.push_back(sub);
 				}
 			}
 			else
@@ -318,11 +880,8 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 				if ((nDiffCode & DIFFCODE::SKIPPED) == 0 && ((nDiffCode & DIFFCODE::SIDEFLAGS) == DIFFCODE::ALL || bUniques))
 				{
 					// Scan recursively all subdirectories too, we are not adding folders
-					String newsubdir[3] = {leftnewsub, middlenewsub, rightnewsub};
-					int result = DirScan_GetItems(paths, newsubdir, myStruct, casesensitive,
-							depth - 1, me, bUniques);
-					if (result == -1)
-						return -1;
+					SubfolderScan sub = { me, {leftnewsub, middlenewsub, rightnewsub} };
+					subfolders.push_back(sub);
 				}
 			}
 		}
@@ -345,9 +904,9 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 
 		// Comparing file aFiles[0][i].name to aFiles[1][j].name
 		if (i<aFiles[0].size() && (j==aFiles[1].size() ||
-				collstr(aFiles[0][i].filename, aFiles[1][j].filename, casesensitive) < 0)
+				collitem(aFiles[0][i], aFiles[1][j]) < 0)
 			&& (nDirs < 3 || 
-				(k==aFiles[2].size() || collstr(aFiles[0][i].filename, aFiles[2][k].filename, casesensitive)<0) ))
+				(k==aFiles[2].size() || collitem(aFiles[0][i], aFiles[2][k])<0) ))
 		{
 			if (nDirs < 3)
 			{
@@ -364,9 +923,9 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 			continue;
 		}
 		if (j<aFiles[1].size() && (i==aFiles[0].size() ||
-				collstr(aFiles[0][i].filename, aFiles[1][j].filename, casesensitive) > 0)
+				collitem(aFiles[0][i], aFiles[1][j]) > 0)
 			&& (nDirs < 3 ||
-				(k==aFiles[2].size() || collstr(aFiles[1][j].filename, aFiles[2][k].filename, casesensitive)<0) ))
+				(k==aFiles[2].size() || collitem(aFiles[1][j], aFiles[2][k])<0) ))
 		{
 			const unsigned nDiffCode = DIFFCODE::SECOND | DIFFCODE::FILE;
 			if (nDirs < 3)
@@ -380,8 +939,8 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 		if (nDirs == 3)
 		{
 			if (k<aFiles[2].size() && (i==aFiles[0].size() ||
-					collstr(aFiles[2][k].filename, aFiles[0][i].filename, casesensitive)<0)
-				&& (j==aFiles[1].size() || collstr(aFiles[2][k].filename, aFiles[1][j].filename, casesensitive)<0) )
+					collitem(aFiles[2][k], aFiles[0][i])<0)
+				&& (j==aFiles[1].size() || collitem(aFiles[2][k], aFiles[1][j])<0) )
 			{
 				const unsigned nDiffCode = DIFFCODE::THIRD | DIFFCODE::FILE;
 				AddToList(subdir[0], subdir[1], subdir[2], nullptr, nullptr, &aFiles[2][k], nDiffCode, myStruct, parent);
@@ -390,8 +949,8 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 				continue;
 			}
 
-			if ((i<aFiles[0].size() && j<aFiles[1].size() && collstr(aFiles[0][i].filename, aFiles[1][j].filename, casesensitive) == 0)
-			    && (k==aFiles[2].size() || collstr(aFiles[0][i].filename, aFiles[2][k].filename, casesensitive) != 0))
+			if ((i<aFiles[0].size() && j<aFiles[1].size() && collitem(aFiles[0][i], aFiles[1][j]) == 0)
+			    && (k==aFiles[2].size() || collitem(aFiles[0][i], aFiles[2][k]) != 0))
 			{
 				const unsigned nDiffCode = DIFFCODE::FIRST | DIFFCODE::SECOND | DIFFCODE::FILE;
 				AddToList(subdir[0], subdir[1], subdir[2], &aFiles[0][i], &aFiles[1][j], nullptr, nDiffCode, myStruct, parent);
@@ -399,8 +958,8 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 				++j;
 				continue;
 			}
-			else if ((i<aFiles[0].size() && k<aFiles[2].size() && collstr(aFiles[0][i].filename, aFiles[2][k].filename, casesensitive) == 0)
-			    && (j==aFiles[1].size() || collstr(aFiles[1][j].filename, aFiles[2][k].filename, casesensitive) != 0))
+			else if ((i<aFiles[0].size() && k<aFiles[2].size() && collitem(aFiles[0][i], aFiles[2][k]) == 0)
+			    && (j==aFiles[1].size() || collitem(aFiles[1][j], aFiles[2][k]) != 0))
 			{
 				const unsigned nDiffCode = DIFFCODE::FIRST | DIFFCODE::THIRD | DIFFCODE::FILE;
 				AddToList(subdir[0], subdir[1], subdir[2], &aFiles[0][i], nullptr, &aFiles[2][k], nDiffCode, myStruct, parent);
@@ -408,8 +967,8 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 				++k;
 				continue;
 			}
-			else if ((j<aFiles[1].size() && k<aFiles[2].size() && collstr(aFiles[1][j].filename, aFiles[2][k].filename, casesensitive) == 0)
-			    && (i==aFiles[0].size() || collstr(aFiles[0][i].filename, aFiles[1][j].filename, casesensitive) != 0))
+			else if ((j<aFiles[1].size() && k<aFiles[2].size() && collitem(aFiles[1][j], aFiles[2][k]) == 0)
+			    && (i==aFiles[0].size() || collitem(aFiles[0][i], aFiles[1][j]) != 0))
 			{
 				const unsigned nDiffCode = DIFFCODE::SECOND | DIFFCODE::THIRD | DIFFCODE::FILE;
 				AddToList(subdir[0], subdir[1], subdir[2], nullptr, &aFiles[1][j], &aFiles[2][k], nDiffCode, myStruct, parent);
@@ -444,32 +1003,86 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 		break;
 	}
 
-	if (parent != nullptr)
+	return 1;
+}
+
+/**
+ * @brief Sum sizes of folder's children into the folder item.
+ * Must be called only after all subfolders of @p parent have been walked.
+ * @param [in,out] parent Folder item, or nullptr for the root.
+ * @param [in] nDirs Number of compare sides.
+ */
+static void UpdateFolderSize(DIFFITEM *parent, int nDirs)
+{
+	if (parent == nullptr)
+		return;
+
+	for (int nIndex = 0; nIndex < nDirs; ++nIndex)
+		if (parent->diffcode.exists(nIndex) && parent->diffFileInfo[nIndex].size == DirItem::FILE_SIZE_NONE)
+			parent->diffFileInfo[nIndex].size = 0;
+
+	DIFFITEM *dic = parent->GetFirstChild();
+	while (dic)
 	{
 		for (int nIndex = 0; nIndex < nDirs; ++nIndex)
-			if (parent->diffcode.exists(nIndex) && parent->diffFileInfo[nIndex].size == DirItem::FILE_SIZE_NONE)
-				parent->diffFileInfo[nIndex].size = 0;
-	
-		DIFFITEM *dic = parent->GetFirstChild();
-		while (dic)
 		{
-			for (int nIndex = 0; nIndex < nDirs; ++nIndex)
-			{
-				if (dic->diffFileInfo[nIndex].size != DirItem::FILE_SIZE_NONE)
-					parent->diffFileInfo[nIndex].size += dic->diffFileInfo[nIndex].size;
-			}
-			dic = dic->GetFwdSiblingLink();
+			if (dic->diffFileInfo[nIndex].size != DirItem::FILE_SIZE_NONE)
+				parent->diffFileInfo[nIndex].size += dic->diffFileInfo[nIndex].size;
 		}
+		dic = dic->GetFwdSiblingLink();
 	}
+}
 
-	return 1;
+/**
+ * @brief Collect file- and folder-names to list.
+ * This function walks given folders and adds found subfolders and files into
+ * lists. There are two modes, determined by the @p depth:
+ * - in non-recursive mode we walk only given folders, and add files
+ *   contained. Subfolders are added as folder items, not walked into.
+ * - in recursive mode we walk all subfolders and add the files they
+ *   contain into list.
+ *
+ * Folders are walked by OPT_CMP_COLLECT_THREADS threads (see FolderCollector),
+ * zero or less meaning that many threads fewer than there are processors.
+ * Each listed folder is passed to DiffFuncStruct::pCompareQueue (if any), so
+ * its items can be compared while the collect is still running.
+ *
+ * @param [in] paths Root paths of compare
+ * @param [in] subdir Subdirectories under root paths
+ * @param [in] myStruct Compare-related data, like context etc.
+ * @param [in] casesensitive Is filename compare case sensitive?
+ * @param [in] depth Levels of subdirectories to scan, -1 scans all
+ * @param [in] parent Folder diff item to be scanned
+ * @param [in] bUniques If true, walk into unique folders.
+ * @return 1 normally, -1 if compare was aborted
+ */
+int DirScan_GetItems(const PathContext &paths, const String subdir[],
+		DiffFuncStruct *myStruct,
+		bool casesensitive, int depth, DIFFITEM *parent,
+		bool bUniques)
+{
+	int nthreads = GetOptionsMgr()->GetInt(OPT_CMP_COLLECT_THREADS);
+	if (nthreads <= 0)
+	{
+		nthreads += Environment::processorCount();
+		if (nthreads <= 0)
+			nthreads = 1;
+	}
+
+	FolderCollector collector(paths, myStruct, casesensitive, bUniques, parent, nthreads);
+	return collector.Collect(subdir, depth);
 }
 
 /**
  * @brief Compare DiffItems in list and add results to compare context.
  *
+ * Items are fed to the compare workers by DiffFuncStruct::pCompareQueue
+ * as the collect thread lists folders, this function runs the workers until
+ * everything below @p parentdiffpos has been compared.
+ *
  * @param myStruct [in] A structure containing compare-related data.
- * @param parentdiffpos [in] Position of parent diff item 
+ * @param parentdiffpos [in] Position of parent diff item, must be the top
+ *  item the compare queue was created for.
  * @return >= 0 number of diff items, -1 if compare was aborted
  */
 int DirScan_CompareItems(DiffFuncStruct *myStruct, DIFFITEM *parentdiffpos)
@@ -477,7 +1090,7 @@ int DirScan_CompareItems(DiffFuncStruct *myStruct, DIFFITEM *parentdiffpos)
 	const int compareMethod = myStruct->context->GetCompareMethod();
 	int nworkers = 1;
 
-	if (compareMethod == CMP_CONTENT || compareMethod == CMP_QUICK_CONTENT)
+	if (compareMethod == CMP_CONTENT || compareMethod == CMP_QUICK_CONTENT || compareMethod == CMP_HASH_CONTENT)
 	{
 		nworkers = GetOptionsMgr()->GetInt(OPT_CMP_COMPARE_THREADS);
 		if (nworkers <= 0)
@@ -488,114 +1101,297 @@ int DirScan_CompareItems(DiffFuncStruct *myStruct, DIFFITEM *parentdiffpos)
 		}
 	}
 
+	FolderCompareQueue *pQueue = myStruct->pCompareQueue;
+	assert(pQueue != nullptr);
 	ThreadPool threadPool(nworkers, nworkers);
 	std::vector<DiffWorkerPtr> workers;
-	NotificationQueue queue;
 	myStruct->context->m_pCompareStats->SetCompareThreadCount(nworkers);
 	for (int i = 0; i < nworkers; ++i)
 	{
-		workers.push_back(DiffWorkerPtr(new DiffWorker(queue, myStruct->context, i)));
+		workers.push_back(DiffWorkerPtr(new DiffWorker(*pQueue, myStruct->context, i)));
 		threadPool.start(*workers[i]);
 	}
 
-	int res = CompareItems(queue, myStruct, parentdiffpos);
-
-	Thread::sleep(100);
-	queue.wakeUpAll();
-	threadPool.joinAll();
-
-	return res;
-}
-
-static int CompareItems(NotificationQueue& queue, DiffFuncStruct *myStruct, DIFFITEM *parentdiffpos)
-{
-	NotificationQueue queueResult;
-	Stopwatch stopwatch;
-	CDiffContext *pCtxt = myStruct->context;
 	int res = 0;
-	int count = 0;
-	bool bCompareFailure = false;
-	if (parentdiffpos == nullptr)
-		myStruct->pSemaphore->wait();
+	Stopwatch stopwatch;
 	stopwatch.start();
-	DIFFITEM *pos = pCtxt->GetFirstChildDiffPosition(parentdiffpos);
-	while (pos != nullptr)
+	while (!pQueue->TryWaitCompleted(100, res))
 	{
-		if (pCtxt->ShouldAbort())
-			break;
-
 		if (stopwatch.elapsed() > 2000000)
 		{
 			int event = CDiffThread::EVENT_COMPARE_PROGRESSED;
 			myStruct->m_listeners.notify(myStruct, event);
 			stopwatch.restart();
 		}
-		myStruct->pSemaphore->wait();
-		DIFFITEM *curpos = pos;
-		DIFFITEM &di = pCtxt->GetNextSiblingDiffRefPosition(pos);
-		bool existsalldirs = di.diffcode.existAll();
-		if (di.diffcode.isDirectory() && pCtxt->m_bRecursive)
+	}
+
+	pQueue->StopWorkers(nworkers);
+	threadPool.joinAll();
+
+	return res;
+}
+
+/**
+ * @brief Constructor.
+ * @param [in] pCtxt Compare context.
+ * @param [in] top Folder item to be compared, nullptr for the whole tree.
+ */
+FolderCompareQueue::FolderCompareQueue(CDiffContext *pCtxt, DIFFITEM *top)
+: m_pCtxt(pCtxt)
+, m_pTop(top)
+, m_bRecursive(pCtxt->m_bRecursive)
+, m_pBatchQueue(new CompareBatchQueue)
+, m_nOutstanding(0)
+, m_bCollectCompleted(false)
+, m_nResult(0)
+, m_completed(false)
+{
+	m_folders[FolderKey(top)] = FolderState();
+}
+
+FolderCompareQueue::~FolderCompareQueue()
+{
+}
+
+/**
+ * @brief Return key of @p folder in m_folders.
+ * Children of the root point to the root item of the list, which is mapped
+ * to nullptr like the top passed for comparing the whole tree.
+ */
+const DIFFITEM *FolderCompareQueue::FolderKey(const DIFFITEM *folder) const
+{
+	return (folder == nullptr || !folder->HasParent()) ? nullptr : folder;
+}
+
+/**
+ * @brief Queue children of a listed folder for compare.
+ * @param [in] folder Folder whose children were all added to the list.
+ * @param [in] subfolders Children of @p folder that will be listed later,
+ *  in list order.
+ */
+void FolderCompareQueue::FolderListed(DIFFITEM *folder, const std::vector<DIFFITEM *> &subfolders)
+{
+	std::vector<CompareBatch *> batches;
+	{
+		Poco::FastMutex::ScopedLock lock(m_mutex);
+		FolderState &state = m_folders[FolderKey(folder)];
+		CompareBatch *pOpen[2] = { nullptr, nullptr };
+		std::vector<DIFFITEM *>::const_iterator it = subfolders.begin();
+		DIFFITEM *pos = m_pCtxt->GetFirstChildDiffPosition(folder);
+		while (pos != nullptr)
 		{
-			if ((di.diffcode.diffcode & DIFFCODE::CMPERR) != DIFFCODE::CMPERR)
-			{	// Only clear DIFF|SAME flags if not CMPERR (eg. both flags together)
-				di.diffcode.diffcode &= ~(DIFFCODE::DIFF | DIFFCODE::SAME);
-			}
-			int ndiff = CompareItems(queue, myStruct, curpos);
-			// Propogate sub-directory status to this directory
-			if (ndiff > 0)
-			{	// There were differences in the sub-directories
-				if (existsalldirs)
-					di.diffcode.diffcode |= DIFFCODE::DIFF;
-				res += ndiff;
+			DIFFITEM &di = m_pCtxt->GetNextSiblingDiffRefPosition(pos);
+			++state.nPending;
+			if (it != subfolders.end() && *it == &di)
+			{
+				// Compared when its own children are
+				m_folders[&di] = FolderState();
+				++it;
 			}
-			else 
-			if (ndiff == 0)
-			{	// Sub-directories were identical
-				if (existsalldirs)
-					di.diffcode.diffcode |= DIFFCODE::SAME;
+			else if (di.diffcode.isDirectory() && m_bRecursive)
+			{
+				// Not walked into, nothing to wait for
+				FinishFolder(di, m_pCtxt->ShouldAbort() ? -1 : 0, batches, pOpen);
 			}
 			else
-			if (ndiff == -1)
-			{	// There were file IO-errors during sub-directory comparison.
-				di.diffcode.diffcode |= DIFFCODE::CMPERR;
-				bCompareFailure = true;
+			{
+				AddToBatches(di, batches, pOpen);
 			}
 		}
-		if (existsalldirs)
-			queue.enqueueUrgentNotification(new WorkNotification(di, queueResult));
-		else
-			queue.enqueueNotification(new WorkNotification(di, queueResult));
-		++count;
-		pos = curpos;
-		pCtxt->GetNextSiblingDiffRefPosition(pos);
+		if (--state.nPending == 0)
+			FolderDone(folder, batches);
+	}
+	for (CompareBatch *pBatch : batches)
+		m_pBatchQueue->Push(pBatch);
+}
+
+/**
+ * @brief The collect has finished, or has been aborted.
+ */
+void FolderCompareQueue::CollectCompleted()
+{
+	Poco::FastMutex::ScopedLock lock(m_mutex);
+	m_bCollectCompleted = true;
+}
+
+/**
+ * @brief Return next batch to compare, waiting for one if needed.
+ * @return Batch, or nullptr when worker is to quit.
+ */
+CompareBatch *FolderCompareQueue::WaitDequeue()
+{
+	return m_pBatchQueue->WaitPop();
+}
+
+/**
+ * @brief Account results of compared batch to their folders.
+ * @param [in] pBatch Batch compare worker has finished with, deleted here.
+ * @param [in,out] overflow Batches the worker must compare itself since
+ *  they did not fit into the queue.
+ */
+void FolderCompareQueue::BatchCompared(CompareBatch *pBatch, std::vector<CompareBatch *> &overflow)
+{
+	std::vector<CompareBatch *> batches;
+	{
+		Poco::FastMutex::ScopedLock lock(m_mutex);
+		for (int i = 0; i < pBatch->count; ++i)
+			AccountItem(*pBatch->items[i], batches);
+		--m_nOutstanding;
+	}
+	delete pBatch;
+	// Never wait for room here, all workers might end up waiting
+	for (CompareBatch *pNext : batches)
+	{
+		if (!m_pBatchQueue->TryPush(pNext))
+			overflow.push_back(pNext);
 	}
+}
 
-	while (count > 0)
+/**
+ * @brief Account result of one compared item to its folder.
+ * @param [in] di Item compare worker has finished with.
+ * @param [in,out] batches Folder items to queue as their folders got done.
+ */
+void FolderCompareQueue::AccountItem(DIFFITEM &di, std::vector<CompareBatch *> &batches)
+{
+	DIFFITEM *diParent = di.GetParentLink();
+	assert(diParent != nullptr);
+	FolderState &state = m_folders[FolderKey(diParent)];
+	if (di.diffcode.isResultError())
 	{
-		AutoPtr<Notification> pNf(queueResult.waitDequeueNotification());
-		if (pNf.get() == nullptr)
-			break;
-		WorkCompletedNotification* pWorkCompletedNf = dynamic_cast<WorkCompletedNotification*>(pNf.get());
-		if (pWorkCompletedNf != nullptr) {
-			DIFFITEM &di = pWorkCompletedNf->data();
-			if (di.diffcode.isResultError()) { 
-				DIFFITEM *diParent = di.GetParentLink();
-				assert(diParent != nullptr);
-				if (diParent != nullptr)
-				{
-					diParent->diffcode.diffcode |= DIFFCODE::CMPERR;
-					bCompareFailure = true;
-				}
-			}
-				
-			if (di.diffcode.isResultDiff() ||
-				(!di.diffcode.existAll() && !di.diffcode.isResultFiltered()))
-				res++;
+		if (diParent != nullptr)
+		{
+			diParent->diffcode.diffcode |= DIFFCODE::CMPERR;
+			state.bFailure = true;
+		}
+	}
+	if (di.diffcode.isResultDiff() ||
+		(!di.diffcode.existAll() && !di.diffcode.isResultFiltered()))
+		state.nDiffs++;
+	if (--state.nPending == 0)
+		FolderDone(diParent, batches);
+}
+
+/**
+ * @brief Wait until all items have been compared.
+ * @param [in] milliseconds Maximum time to wait.
+ * @param [out] result Number of diff items, -1 if compare was aborted.
+ * @return true if compare has completed.
+ */
+bool FolderCompareQueue::TryWaitCompleted(long milliseconds, int &result)
+{
+	if (!m_completed.tryWait(milliseconds))
+	{
+		// Folders not listed due to abort never complete,
+		// wait only for the items already given to workers.
+		Poco::FastMutex::ScopedLock lock(m_mutex);
+		if (!m_bCollectCompleted || !m_pCtxt->ShouldAbort() || m_nOutstanding > 0)
+			return false;
+		m_nResult = -1;
+	}
+	result = m_nResult;
+	return true;
+}
+
+/**
+ * @brief Make compare workers quit once the queue is empty.
+ * @param [in] nworkers Number of workers running.
+ */
+void FolderCompareQueue::StopWorkers(int nworkers)
+{
+	m_pBatchQueue->Stop(nworkers);
+}
+
+/**
+ * @brief Add @p di to open batch of its kind, starting a new batch if needed.
+ * @param [in] di Item to compare.
+ * @param [in,out] batches Batches to queue.
+ * @param [in,out] pOpen Batches still taking items, urgent ones first.
+ */
+void FolderCompareQueue::AddToBatches(DIFFITEM &di, std::vector<CompareBatch *> &batches, CompareBatch *pOpen[2])
+{
+	bool urgent = di.diffcode.existAll();
+	CompareBatch *&pBatch = pOpen[urgent ? 0 : 1];
+	if (pBatch == nullptr)
+	{
+		pBatch = new CompareBatch;
+		pBatch->urgent = urgent;
+		batches.push_back(pBatch);
+		++m_nOutstanding;
+	}
+	pBatch->items[pBatch->count++] = &di;
+	if (urgent && !di.diffcode.isDirectory())
+	{
+		uint64_t size = 0;
+		for (int i = 0; i < m_pCtxt->GetCompareDirs(); ++i)
+		{
+			if (di.diffFileInfo[i].size != DirItem::FILE_SIZE_NONE)
+				size = (std::max)(size, static_cast<uint64_t>(di.diffFileInfo[i].size));
 		}
-		--count;
+		pBatch->bytes += size;
+	}
+	if (pBatch->count == CompareBatch::MAX_ITEMS || pBatch->bytes >= CompareBatch::MAX_BYTES)
+		pBatch = nullptr;
+}
+
+/**
+ * @brief Set result of folder item @p di from its children and queue it.
+ * @param [in] di Folder item.
+ * @param [in] ndiff Number of differences below folder, -1 on error.
+ * @param [in,out] batches Batches to queue.
+ * @param [in,out] pOpen Batches still taking items.
+ */
+void FolderCompareQueue::FinishFolder(DIFFITEM &di, int ndiff, std::vector<CompareBatch *> &batches, CompareBatch *pOpen[2])
+{
+	bool existsalldirs = di.diffcode.existAll();
+	FolderState &parentState = m_folders[FolderKey(di.GetParentLink())];
+	if ((di.diffcode.diffcode & DIFFCODE::CMPERR) != DIFFCODE::CMPERR)
+	{	// Only clear DIFF|SAME flags if not CMPERR (eg. both flags together)
+		di.diffcode.diffcode &= ~(DIFFCODE::DIFF | DIFFCODE::SAME);
+	}
+	// Propogate sub-directory status to this directory
+	if (ndiff > 0)
+	{	// There were differences in the sub-directories
+		if (existsalldirs)
+			di.diffcode.diffcode |= DIFFCODE::DIFF;
+		parentState.nDiffs += ndiff;
+	}
+	else 
+	if (ndiff == 0)
+	{	// Sub-directories were identical
+		if (existsalldirs)
+			di.diffcode.diffcode |= DIFFCODE::SAME;
+	}
+	else
+	if (ndiff == -1)
+	{	// There were file IO-errors during sub-directory comparison.
+		di.diffcode.diffcode |= DIFFCODE::CMPERR;
+		parentState.bFailure = true;
 	}
+	AddToBatches(di, batches, pOpen);
+}
 
-	return bCompareFailure || pCtxt->ShouldAbort() ? -1 : res;
+/**
+ * @brief All children of @p folder have been compared.
+ * @param [in] folder Folder item.
+ * @param [in,out] batches Batches to queue.
+ */
+void FolderCompareQueue::FolderDone(const DIFFITEM *folder, std::vector<CompareBatch *> &batches)
+{
+	const DIFFITEM *key = FolderKey(folder);
+	FolderState state = m_folders[key];
+	m_folders.erase(key);
+	int ndiff = (state.bFailure || m_pCtxt->ShouldAbort()) ? -1 : state.nDiffs;
+	if (key == FolderKey(m_pTop))
+	{
+		m_nResult = ndiff;
+		m_completed.set();
+	}
+	else
+	{
+		CompareBatch *pOpen[2] = { nullptr, nullptr };
+		FinishFolder(*const_cast<DIFFITEM *>(folder), ndiff, batches, pOpen);
+	}
 }
 
 /**
@@ -716,8 +1512,8 @@ int DirScan_UpdateMarkedItems(DiffFuncStruct *myStruct, DIFFITEM *parentdiffpos)
 			UpdateDiffItem(di, bItemsExist, pCtxt);
 			if (!bItemsExist)
 			{ 
-				di.DelinkFromSiblings();	// delink from list of Siblings
-				delete &di;					// Also delete all Children items
+				pCtxt->RemoveDiff(&di);		// delink from list of Siblings,
+											// also delete all Children items
 				continue;					// (... because `di` is now invalid)
 			}
 			if (!di.diffcode.isDirectory())
@@ -730,7 +1526,7 @@ int DirScan_UpdateMarkedItems(DiffFuncStruct *myStruct, DIFFITEM *parentdiffpos)
 					di.diffFileInfo[i].size = 0;
 			if (di.diffcode.isScanNeeded() && !di.diffcode.isResultFiltered())
 			{
-				di.RemoveChildren();
+				pCtxt->RemoveChildren(&di);
 				di.diffcode.diffcode &= ~DIFFCODE::NEEDSCAN;
 
 				bool casesensitive = false;
@@ -822,9 +1618,19 @@ void CompareDiffItem(DIFFITEM &di, CDiffContext * pCtxt)
 			)
 		{
 			di.diffcode.diffcode |= DIFFCODE::INCLUDED;
-			FolderCmp folderCmp;
-			di.diffcode.diffcode |= folderCmp.prepAndCompareFiles(pCtxt, di);
-			StoreDiffData(di, pCtxt, &folderCmp);
+			CompareResultCache *pCache = pCtxt->m_pResultCache.get();
+			if (pCache != nullptr && pCache->Lookup(di, nDirs))
+			{
+				StoreDiffData(di, pCtxt, nullptr);
+			}
+			else
+			{
+				FolderCmp folderCmp;
+				di.diffcode.diffcode |= folderCmp.prepAndCompareFiles(pCtxt, di);
+				StoreDiffData(di, pCtxt, &folderCmp);
+				if (pCache != nullptr && !pCtxt->ShouldAbort())
+					pCache->Store(di, nDirs);
+			}
 		}
 		else
 		{
@@ -952,6 +1758,5 @@ static DIFFITEM *AddToList(const String& sDir1, const String& sDir2, const Strin
 		di->diffcode.diffcode = code | DIFFCODE::THREEWAY;
 
 	myStruct->context->m_pCompareStats->IncreaseTotalItems();
-	myStruct->pSemaphore->set();
 	return di;
 }
@@ -5,6 +5,12 @@
  */ 
 #pragma once
 
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#define POCO_NO_UNWINDOWS 1
+#include <Poco/Mutex.h>
+#include <Poco/Event.h>
 #include "UnicodeString.h"
 
 class CDiffContext;
@@ -13,6 +19,67 @@ class PathContext;
 class IAbortable;
 class DIFFITEM;
 struct DiffFuncStruct;
+struct CompareBatch;
+class CompareBatchQueue;
+
+/**
+ * @brief Hands collected items over to the folder compare workers.
+ *
+ * The collect thread reports every folder it has listed. The items of that
+ * folder are queued for the compare workers right away, so comparing runs
+ * while the rest of the tree is still being walked. A folder item itself is
+ * queued only after everything below it has been compared, since its result
+ * is derived from its children.
+ *
+ * Items go to the workers in batches of one folder's items (see
+ * CompareBatch), so queueing and accounting results take one round trip
+ * per batch instead of one per item.
+ */
+class FolderCompareQueue
+{
+public:
+	FolderCompareQueue(CDiffContext *pCtxt, DIFFITEM *top);
+	~FolderCompareQueue();
+
+	// Called by collect thread(s)
+	void FolderListed(DIFFITEM *folder, const std::vector<DIFFITEM *> &subfolders);
+	void CollectCompleted();
+
+	// Called by compare workers
+	CompareBatch *WaitDequeue();
+	void BatchCompared(CompareBatch *pBatch, std::vector<CompareBatch *> &overflow);
+
+	// Called by compare thread
+	bool TryWaitCompleted(long milliseconds, int &result);
+	void StopWorkers(int nworkers);
+
+private:
+	/** @brief Compare status of one folder whose children are not all compared yet. */
+	struct FolderState
+	{
+		FolderState() : nPending(1), nDiffs(0), bFailure(false) {}
+		int nPending; /**< Children not compared yet, plus one until folder is listed */
+		int nDiffs; /**< Differences found so far */
+		bool bFailure; /**< Did compare of some child fail? */
+	};
+
+	const DIFFITEM *FolderKey(const DIFFITEM *folder) const;
+	void AccountItem(DIFFITEM &di, std::vector<CompareBatch *> &batches);
+	void FinishFolder(DIFFITEM &di, int ndiff, std::vector<CompareBatch *> &batches, CompareBatch *pOpen[2]);
+	void FolderDone(const DIFFITEM *folder, std::vector<CompareBatch *> &batches);
+	void AddToBatches(DIFFITEM &di, std::vector<CompareBatch *> &batches, CompareBatch *pOpen[2]);
+
+	CDiffContext *m_pCtxt;
+	DIFFITEM *m_pTop; /**< Folder item compared, nullptr for the root */
+	bool m_bRecursive;
+	std::unique_ptr<CompareBatchQueue> m_pBatchQueue; /**< Batches waiting for a compare worker */
+	std::unordered_map<const DIFFITEM *, FolderState> m_folders; /**< Folders in progress */
+	int m_nOutstanding; /**< Batches queued but not compared yet */
+	bool m_bCollectCompleted;
+	int m_nResult;
+	Poco::Event m_completed;
+	Poco::FastMutex m_mutex;
+};
 
 int DirScan_GetItems(const PathContext &paths, const String subdir[], DiffFuncStruct *myStruct,
 		bool casesensitive, int depth, DIFFITEM *parent, bool bUniques);
@@ -8,6 +8,7 @@
 #include "pch.h"
 #include "DirTravel.h"
 #include <algorithm>
+#include <climits>
 #include <Poco/DirectoryIterator.h>
 #include <Poco/Timestamp.h>
 #include <windows.h>
@@ -28,6 +29,7 @@ static void Sort(DirItemArray * dirs, bool casesensitive);
 
 /**
  * @brief Load arrays with all directories & files in specified dir
+ * The arrays are sorted by the sort keys of the names.
  */
 void LoadAndSortFiles(const String& sDir, DirItemArray * dirs, DirItemArray * files, bool casesensitive)
 {
@@ -61,7 +63,7 @@ static void LoadFiles(const String& sDir, DirItemArray * dirs, DirItemArray * fi
 		if (bIsDirectory)
 			continue;
 
-		DirItem ent;
+		DirEntry ent;
 		ent.ctime = it->created();
 		if (ent.ctime < 0)
 			ent.ctime = 0;
@@ -92,7 +94,7 @@ static void LoadFiles(const String& sDir, DirItemArray * dirs, DirItemArray * fi
 			if (bIsDirectory && _tcsstr(_T(".."), ff.cFileName))
 				continue;
 
-			DirItem ent;
+			DirEntry ent;
 
 			// Save filetimes as seconds since January 1, 1970
 			// Note that times can be < 0 if they are around that 1970..
@@ -134,25 +136,46 @@ static inline int collate_ignore_case(const String &str1, const String &str2)
 	return _tcsicoll(str1.c_str(), str2.c_str());
 }
 
-
-template<int (*compfunc)(const TCHAR *, const TCHAR *)>
-struct StringComparer
+/**
+ * @brief Compute sort keys of specified array and sort it by them
+ */
+static void Sort(DirItemArray * dirs, bool casesensitive)
 {
-	bool operator()(const DirItem &elem1, const DirItem &elem2)
-	{
-		return compfunc(elem1.filename.get().c_str(), elem2.filename.get().c_str()) < 0;
-	}
-};
+	for (DirEntry &ent : *dirs)
+		ent.collkey = MakeCollationKey(ent.filename, casesensitive);
+	std::sort(dirs->begin(), dirs->end(),
+		[](const DirEntry &elem1, const DirEntry &elem2) { return collitem(elem1, elem2) < 0; });
+}
 
 /**
- * @brief sort specified array
+ * @brief Make sort key of a name.
+ * Comparing keys of two names as plain strings gives the same order as
+ * collstr() gives for the names. Case-insensitive keys are made of case
+ * folded names.
+ *
+ * A name the locale can't transform, e.g. one with invalid UTF-16, gets a
+ * key of its own kind instead: the name after a character that no
+ * transformed key has, since wide keys hold one byte of the sort key per
+ * character. Such names sort after all others, by their characters, and
+ * still match the same name on other sides but never another name.
+ * @param [in] name Name to make key of.
+ * @param [in] casesensitive Is the key case sensitive?
  */
-static void Sort(DirItemArray * dirs, bool casesensitive)
+String MakeCollationKey(const String & name, bool casesensitive)
 {
-	if (casesensitive)
-        std::sort(dirs->begin(), dirs->end(), StringComparer<_tcscoll>());
-	else
-		std::sort(dirs->begin(), dirs->end(), StringComparer<_tcsicoll>());
+	String str = name;
+	if (!casesensitive)
+	{
+		for (TCHAR &c : str)
+			c = static_cast<TCHAR>(_totlower(c));
+	}
+	size_t len = _tcsxfrm(nullptr, str.c_str(), 0);
+	if (len == INT_MAX)
+		return String(1, static_cast<TCHAR>(-1)) + str;
+	String key(len + 1, 0);
+	_tcsxfrm(&key[0], str.c_str(), len + 1);
+	key.resize(len);
+	return key;
 }
 
 /**
@@ -8,10 +8,32 @@
 
 #include <vector>
 #include "UnicodeString.h"
+#include "DirItem.h"
 
-struct DirItem;
+/**
+ * @brief Listed file or folder with the sort key of its name.
+ * The key is computed once when the folder is listed, so sorting the
+ * listing and matching names between compare sides compare plain strings
+ * instead of doing locale aware comparisons again and again.
+ */
+struct DirEntry : public DirItem
+{
+	String collkey; /**< Sort key of filename, see MakeCollationKey() */
+};
 
-typedef std::vector<DirItem> DirItemArray;
+typedef std::vector<DirEntry> DirItemArray;
 
 void LoadAndSortFiles(const String& sDir, DirItemArray * dirs, DirItemArray * files, bool casesensitive);
+String MakeCollationKey(const String & name, bool casesensitive);
 int collstr(const String & s1, const String & s2, bool casesensitive);
+
+/**
+ * @brief Compare names of two listed items by their sort keys.
+ * The result has the sign of collstr() for the names, with the case
+ * sensitivity the items were listed with, except for names the locale
+ * can't transform (see MakeCollationKey()).
+ */
+inline int collitem(const DirEntry & e1, const DirEntry & e2)
+{
+	return e1.collkey.compare(e2.collkey);
+}
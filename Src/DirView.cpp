@@ -1621,12 +1621,7 @@ void CDirView::DeleteItem(int sel, bool removeDIFFITEM)
 	{
 		DIFFITEM *diffpos = GetItemKey(sel);
 		if (diffpos != (DIFFITEM *)SPECIAL_ITEM_POS)
-		{
-			if (diffpos->HasChildren())
-				diffpos->RemoveChildren();
-			diffpos->DelinkFromSiblings();
-			delete diffpos;
-		}
+			GetDiffContext().RemoveDiff(diffpos);
 	}
 	m_pList->DeleteItem(sel);
 }
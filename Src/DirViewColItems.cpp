@@ -61,6 +61,9 @@ const char *COLHDR_MENCODING    = N_("Middle Encoding");
 const char *COLHDR_NIDIFFS      = N_("Ignored Diff.");
 const char *COLHDR_NSDIFFS      = N_("Differences");
 const char *COLHDR_BINARY       = N_("Binary");
+const char *COLHDR_LHASH        = N_("Left Content Hash");
+const char *COLHDR_RHASH        = N_("Right Content Hash");
+const char *COLHDR_MHASH        = N_("Middle Content Hash");
 
 const char *COLDESC_FILENAME    = N_("Filename or folder name.");
 const char *COLDESC_DIR         = N_("Subfolder name when subfolders are included.");
@@ -95,6 +98,9 @@ const char *COLDESC_MENCODING   = N_("Middle side encoding.");
 const char *COLDESC_NIDIFFS     = N_("Number of ignored differences in file. These differences are ignored by WinMerge and cannot be merged.");
 const char *COLDESC_NSDIFFS     = N_("Number of differences in file. This number does not include ignored differences.");
 const char *COLDESC_BINARY      = N_("Shows an asterisk (*) if the file is binary.");
+const char *COLDESC_LHASH       = N_("Digest of left side file contents, only for Content Hash compare method.");
+const char *COLDESC_RHASH       = N_("Digest of right side file contents, only for Content Hash compare method.");
+const char *COLDESC_MHASH       = N_("Digest of middle side file contents, only for Content Hash compare method.");
 }
 
 /**
@@ -656,6 +662,19 @@ static String ColEncodingGet(const CDiffContext *, const void *p)
 	return r.encoding.GetName();
 }
 
+/**
+ * @brief Format Content Hash column data.
+ * @param [in] p Pointer to file information.
+ * @return String to show in the column.
+ */
+static String ColContentHashGet(const CDiffContext *, const void *p)
+{
+	const DiffFileInfo &r = *static_cast<const DiffFileInfo *>(p);
+	if (!r.m_bContentHashValid)
+		return String();
+	return strutils::format(_T("%016I64x"), static_cast<unsigned __int64>(r.m_contentHash));
+}
+
 /**
  * @brief Format EOL type to string.
  * @param [in] p Pointer to DIFFITEM.
@@ -947,6 +966,22 @@ static int ColEncodingSort(const CDiffContext *, const void *p, const void *q)
 	const DiffFileInfo &s = *static_cast<const DiffFileInfo *>(q);
 	return FileTextEncoding::Collate(r.encoding, s.encoding);
 }
+
+/**
+ * @brief Compare content digests.
+ * Files without digest are sorted before others.
+ * @param [in] p Pointer to first structure to compare.
+ * @param [in] q Pointer to second structure to compare.
+ * @return Compare result.
+ */
+static int ColContentHashSort(const CDiffContext *, const void *p, const void *q)
+{
+	const DiffFileInfo &r = *static_cast<const DiffFileInfo *>(p);
+	const DiffFileInfo &s = *static_cast<const DiffFileInfo *>(q);
+	if (r.m_bContentHashValid != s.m_bContentHashValid)
+		return r.m_bContentHashValid ? 1 : -1;
+	return cmpu64(r.m_contentHash, s.m_contentHash);
+}
 /* @} */
 
 #undef FIELD_OFFSET	// incorrect for Win32 as defined in WinNT.h
@@ -994,6 +1029,8 @@ static DirColInfo f_cols[] =
 	{ _T("Snidiffs"), COLHDR_NIDIFFS, COLDESC_NIDIFFS, ColDiffsGet, ColDiffsSort, FIELD_OFFSET(DIFFITEM, nidiffs), -1, false, DirColInfo::ALIGN_RIGHT },
 	{ _T("Leoltype"), COLHDR_LEOL_TYPE, COLDESC_LEOL_TYPE, &ColLEOLTypeGet, 0, 0, -1, true, DirColInfo::ALIGN_LEFT },
 	{ _T("Reoltype"), COLHDR_REOL_TYPE, COLDESC_REOL_TYPE, &ColREOLTypeGet, 0, 0, -1, true, DirColInfo::ALIGN_LEFT },
+	{ _T("Lhash"), COLHDR_LHASH, COLDESC_LHASH, &ColContentHashGet, &ColContentHashSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[0]), -1, true, DirColInfo::ALIGN_LEFT },
+	{ _T("Rhash"), COLHDR_RHASH, COLDESC_RHASH, &ColContentHashGet, &ColContentHashSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[1]), -1, true, DirColInfo::ALIGN_LEFT },
 };
 static DirColInfo f_cols3[] =
 {
@@ -1030,6 +1067,9 @@ static DirColInfo f_cols3[] =
 	{ _T("Leoltype"), COLHDR_LEOL_TYPE, COLDESC_LEOL_TYPE, &ColLEOLTypeGet, 0, 0, -1, true, DirColInfo::ALIGN_LEFT },
 	{ _T("Meoltype"), COLHDR_MEOL_TYPE, COLDESC_MEOL_TYPE, &ColMEOLTypeGet, 0, 0, -1, true, DirColInfo::ALIGN_LEFT },
 	{ _T("Reoltype"), COLHDR_REOL_TYPE, COLDESC_REOL_TYPE, &ColREOLTypeGet, 0, 0, -1, true, DirColInfo::ALIGN_LEFT },
+	{ _T("Lhash"), COLHDR_LHASH, COLDESC_LHASH, &ColContentHashGet, &ColContentHashSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[0]), -1, true, DirColInfo::ALIGN_LEFT },
+	{ _T("Mhash"), COLHDR_MHASH, COLDESC_MHASH, &ColContentHashGet, &ColContentHashSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[1]), -1, true, DirColInfo::ALIGN_LEFT },
+	{ _T("Rhash"), COLHDR_RHASH, COLDESC_RHASH, &ColContentHashGet, &ColContentHashSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[2]), -1, true, DirColInfo::ALIGN_LEFT },
 };
 
 /**
@@ -131,6 +131,20 @@ String GetMyDocuments()
 	return path;
 }
 
+/**
+ * @brief Return User's local application data folder.
+ * This function returns full path to per-user, non-roaming application data
+ * folder, for data that can be recreated, like caches.
+ * @return Full path to local application data folder.
+ */
+String GetLocalAppDataPath()
+{
+	TCHAR path[MAX_PATH];
+	path[0] = _T('\0');
+	SHGetFolderPath(nullptr, CSIDL_LOCAL_APPDATA, nullptr, 0, path);
+	return path;
+}
+
 /**
  * @brief Return unique string for the instance.
  * This function formats an unique string for WinMerge instance. The string
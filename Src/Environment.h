@@ -20,6 +20,7 @@ String GetProgPath();
 
 String GetWindowsDirectory();
 String GetMyDocuments();
+String GetLocalAppDataPath();
 String GetSystemTempPath();
 
 String GetPerInstanceString(const String& name);
@@ -18,21 +18,32 @@
 #include "FileTransform.h"
 #include "codepage_detect.h"
 #include "BinaryCompare.h"
+#include "HashCompare.h"
+#include "PrefilterCompare.h"
 #include "TimeSizeCompare.h"
 #include "TFile.h"
+#include "ParallelDiff.h"
 #include "DebugNew.h"
 
 using CompareEngines::ByteCompare;
 using CompareEngines::BinaryCompare;
+using CompareEngines::HashCompare;
+using CompareEngines::PrefilterCompare;
 using CompareEngines::TimeSizeCompare;
 
+/** @brief Three-way compares of files this big compare the pairs at the same time. */
+static const int64_t ConcurrentPairsSize = 4 * 1024 * 1024;
+
 static void GetComparePaths(CDiffContext * pCtxt, const DIFFITEM &di, PathContext & files);
+static bool IsByteExactCompare(CDiffContext * pCtxt, const DIFFITEM &di, int nCompMethod, bool &bSignatures);
 
 FolderCmp::FolderCmp()
 : m_pDiffUtilsEngine(nullptr)
 , m_pByteCompare(nullptr)
 , m_pBinaryCompare(nullptr)
+, m_pHashCompare(nullptr)
 , m_pTimeSizeCompare(nullptr)
+, m_pPrefilterCompare(nullptr)
 , m_ndiffs(CDiffContext::DIFFS_UNKNOWN)
 , m_ntrivialdiffs(CDiffContext::DIFFS_UNKNOWN)
 {
@@ -78,6 +89,28 @@ int FolderCmp::prepAndCompareFiles(CDiffContext * pCtxt, DIFFITEM &di)
 
 		PathContext tFiles;
 		GetComparePaths(pCtxt, di, tFiles);
+
+		// If options are binary equivalent, files of different size are
+		// clearly different, and small files can be compared by samples.
+		// This is optional, as then we don't always know if file is ascii
+		// or binary, and this affects behavior (also, we don't have an icon
+		// for unknown type)
+		bool bSignatures = false;
+		if (pCtxt->m_bPrefilter && di.diffcode.existAll() && IsByteExactCompare(pCtxt, di, nCompMethod, bSignatures))
+		{
+			if (m_pPrefilterCompare == nullptr)
+				m_pPrefilterCompare.reset(new PrefilterCompare());
+			int prefilterCode = m_pPrefilterCompare->CompareFiles(tFiles, di, bSignatures);
+			if (prefilterCode != 0)
+			{
+				// Like quick compare, the prefilter doesn't know about diff counts
+				bool bSame = (prefilterCode & DIFFCODE::COMPAREFLAGS) == DIFFCODE::SAME;
+				m_ndiffs = bSame ? 0 : CDiffContext::DIFFS_UNKNOWN_QUICKCOMPARE;
+				m_ntrivialdiffs = bSame ? 0 : CDiffContext::DIFFS_UNKNOWN_QUICKCOMPARE;
+				return prefilterCode;
+			}
+		}
+
 		struct change *script10 = nullptr;
 		struct change *script12 = nullptr;
 		struct change *script02 = nullptr;
@@ -139,11 +172,6 @@ int FolderCmp::prepAndCompareFiles(CDiffContext * pCtxt, DIFFITEM &di)
 				goto exitPrepAndCompare;
 		}
 
-		// If options are binary equivalent, we could check for filesize
-		// difference here, and bail out if files are clearly different
-		// But, then we don't know if file is ascii or binary, and this
-		// affects behavior (also, we don't have an icon for unknown type)
-
 		// Actually compare the files
 		// `diffutils_compare_files()` is a fairly thin front-end to GNU diffutils
 
@@ -228,21 +256,31 @@ int FolderCmp::prepAndCompareFiles(CDiffContext * pCtxt, DIFFITEM &di)
 						m_pDiffUtilsEngine->ClearFilterList();
 					m_pDiffUtilsEngine->SetFilterCommentsManager(pCtxt->m_pFilterCommentsManager);
 
-					bool bRet;
 					int bin_flag10 = 0, bin_flag12 = 0, bin_flag02 = 0;
 
+					// The pairs are independent, compare big files on more threads
+					const CompareEngines::DiffUtils *pEngine = m_pDiffUtilsEngine.get();
+					std::vector<std::function<void()>> jobs;
+					jobs.push_back([&]() { pEngine->Diff2Files(diffdata10.m_diffFileData.m_inf, &script10, &bin_flag10); });
+					jobs.push_back([&]() { pEngine->Diff2Files(diffdata12.m_diffFileData.m_inf, &script12, &bin_flag12); });
+					jobs.push_back([&]() { pEngine->Diff2Files(diffdata02.m_diffFileData.m_inf, &script02, &bin_flag02); });
+					if (di.diffFileInfo[0].size + di.diffFileInfo[1].size + di.diffFileInfo[2].size >= ConcurrentPairsSize)
+						RunConcurrently(jobs);
+					else
+					{
+						for (auto& job : jobs)
+							job();
+					}
+
 					m_pDiffUtilsEngine->SetFileData(2, diffdata10.m_diffFileData.m_inf);
-					bRet = m_pDiffUtilsEngine->Diff2Files(&script10, 0, &bin_flag10, false, nullptr);
 					m_pDiffUtilsEngine->GetTextStats(0, &m_diffFileData.m_textStats[1]);
 					m_pDiffUtilsEngine->GetTextStats(1, &m_diffFileData.m_textStats[0]);
 
 					m_pDiffUtilsEngine->SetFileData(2, diffdata12.m_diffFileData.m_inf);
-					bRet = m_pDiffUtilsEngine->Diff2Files(&script12, 0, &bin_flag12, false, nullptr);
 					m_pDiffUtilsEngine->GetTextStats(0, &m_diffFileData.m_textStats[1]);
 					m_pDiffUtilsEngine->GetTextStats(1, &m_diffFileData.m_textStats[2]);
 
 					m_pDiffUtilsEngine->SetFileData(2, diffdata02.m_diffFileData.m_inf);
-					bRet = m_pDiffUtilsEngine->Diff2Files(&script02, 0, &bin_flag02, false, nullptr);
 					m_pDiffUtilsEngine->GetTextStats(0, &m_diffFileData.m_textStats[0]);
 					m_pDiffUtilsEngine->GetTextStats(1, &m_diffFileData.m_textStats[2]);
 
@@ -449,6 +487,16 @@ exitPrepAndCompare:
 		GetComparePaths(pCtxt, di, tFiles);
 		code = m_pBinaryCompare->CompareFiles(tFiles, di);
 	}
+	else if (nCompMethod == CMP_HASH_CONTENT)
+	{
+		if (m_pHashCompare == nullptr)
+			m_pHashCompare.reset(new HashCompare());
+
+		PathContext tFiles;
+		GetComparePaths(pCtxt, di, tFiles);
+		m_pHashCompare->SetAbortable(pCtxt->GetAbortable());
+		code = m_pHashCompare->CompareFiles(tFiles, di);
+	}
 	else if (nCompMethod == CMP_DATE || nCompMethod == CMP_DATE_SIZE || nCompMethod == CMP_SIZE)
 	{
 		if (m_pTimeSizeCompare == nullptr)
@@ -493,3 +541,54 @@ void GetComparePaths(CDiffContext * pCtxt, const DIFFITEM &di, PathContext & tFi
 		}
 	}
 }
+
+/**
+ * @brief Is every byte difference between files a difference in result?
+ * Then files can be compared as byte sequences before the full compare.
+ * Diffutils compare skips or converts Unicode signatures (BOMs): files
+ * differing by them may compare same, so files having one are excluded.
+ * @param [in] pCtxt Pointer to compare context.
+ * @param [in] di Compared files.
+ * @param [in] nCompMethod Compare method, CMP_CONTENT or CMP_QUICK_CONTENT.
+ * @param [out] bSignatures Set true if files with a Unicode signature
+ * must be left for the full compare.
+ * @note Files bigger than the quick compare limit are compared with quick
+ * compare even if diffutils compare is selected.
+ */
+bool IsByteExactCompare(CDiffContext * pCtxt, const DIFFITEM &di, int nCompMethod, bool &bSignatures)
+{
+	if (pCtxt->m_bPluginsEnabled)
+		return false;
+
+	if (nCompMethod == CMP_CONTENT)
+	{
+		bool bQuick = false;
+		for (int nIndex = 0; nIndex < pCtxt->GetCompareDirs(); nIndex++)
+		{
+			if (di.diffFileInfo[nIndex].size > pCtxt->m_nQuickCompareLimit)
+				bQuick = true;
+		}
+		if (bQuick)
+			nCompMethod = CMP_QUICK_CONTENT;
+	}
+
+	const CompareOptions *pOptions = pCtxt->GetCompareOptions(nCompMethod);
+	if (pOptions == nullptr ||
+		pOptions->m_ignoreWhitespace != WHITESPACE_COMPARE_ALL ||
+		pOptions->m_bIgnoreBlankLines ||
+		pOptions->m_bIgnoreCase ||
+		pOptions->m_bIgnoreEOLDifference)
+		return false;
+
+	if (nCompMethod == CMP_CONTENT)
+	{
+		// Diffutils compare also applies line filters and comment filters,
+		// and with ignored codepages compares texts of different encodings
+		const DiffutilsOptions *pDiffutilsOptions = dynamic_cast<const DiffutilsOptions *>(pOptions);
+		if (pCtxt->m_pFilterList != nullptr || pCtxt->m_bIgnoreCodepage ||
+			pDiffutilsOptions == nullptr || pDiffutilsOptions->m_filterCommentsLines)
+			return false;
+		bSignatures = true;
+	}
+	return true;
+}
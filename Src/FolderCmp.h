@@ -10,6 +10,8 @@
 #include "Wrap_DiffUtils.h"
 #include "ByteCompare.h"
 #include "BinaryCompare.h"
+#include "HashCompare.h"
+#include "PrefilterCompare.h"
 #include "TimeSizeCompare.h"
 #include "PathContext.h"
 
@@ -53,5 +55,7 @@ private:
 	std::unique_ptr<CompareEngines::DiffUtils> m_pDiffUtilsEngine;
 	std::unique_ptr<CompareEngines::ByteCompare> m_pByteCompare;
 	std::unique_ptr<CompareEngines::BinaryCompare> m_pBinaryCompare;
+	std::unique_ptr<CompareEngines::HashCompare> m_pHashCompare;
 	std::unique_ptr<CompareEngines::TimeSizeCompare> m_pTimeSizeCompare;
+	std::unique_ptr<CompareEngines::PrefilterCompare> m_pPrefilterCompare;
 };
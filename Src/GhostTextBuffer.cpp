@@ -108,9 +108,7 @@ bool CGhostTextBuffer::InternalDeleteGhostLine (CCrystalTextView * pSource,
 		m_aLines[i].Clear();
 	}
 
-	vector<LineInfo>::iterator iterBegin = m_aLines.begin() + nLine;
-	vector<LineInfo>::iterator iterEnd = iterBegin + nCount;
-	m_aLines.erase(iterBegin, iterEnd);
+	m_aLines.erase(nLine, nLine + nCount);
 
 	if (pSource != nullptr)
 	{
@@ -256,6 +254,7 @@ InsertText (CCrystalTextView * pSource, int nLine,
 	bool bGroupFlag = false;
 	bool bFirstLineGhost = ((GetLineFlags(nLine) & LF_GHOST) != 0);
 	bool bSpecialLastLineHandling = bFirstLineGhost && (nLine == GetLineCount()-1);
+	int nFirstChangedLine = nLine;
 
 	if (bFirstLineGhost && cchText > 0)
 	{
@@ -271,7 +270,10 @@ InsertText (CCrystalTextView * pSource, int nLine,
 		};
 		int i = reverseFindRealLine(nLine);
 		if (i >= 0 && !m_aLines[i].HasEol())
+		{
 			CCrystalTextBuffer::InsertText(pSource, i, GetLineLength(i), text, text.GetLength(), nEndLine, nEndChar, 0, bHistory);
+			nFirstChangedLine = i;
+		}
 		else if (!LineInfo::IsEol(pszText[cchText - 1]))
 			CCrystalTextBuffer::InsertText(pSource, nLine, 0, text, text.GetLength(), nEndLine, nEndChar, 0, bHistory);
 	}
@@ -324,6 +326,9 @@ InsertText (CCrystalTextView * pSource, int nLine,
 		OnNotifyLineHasBeenEdited(i);
 	}
 
+	// lines after the inserted text are the lines which were after the insertion point
+	int nChangedEndLine = nEndLine + 1;
+
 	// when inserting into a ghost line block, we want to replace ghost lines
 	// with our text, so delete some ghost lines below the inserted text
 	if (bFirstLineGhost)
@@ -340,6 +345,7 @@ InsertText (CCrystalTextView * pSource, int nLine,
 			if ((GetLineFlags(nLineAfterInsertedBlock+i) & LF_GHOST) == 0)
 				break;
 		InternalDeleteGhostLine(pSource, nLineAfterInsertedBlock, i);
+		nChangedEndLine = max(nChangedEndLine, nLineAfterInsertedBlock);
 	}
 
 	for (i = nLine ; i < nEndLine ; i++)
@@ -359,14 +365,12 @@ InsertText (CCrystalTextView * pSource, int nLine,
 		int nLastLine = GetLineCount()-1;
 		ASSERT(m_aLines[nLastLine].FullLength() == 0);
 		m_aLines[nLastLine].Clear();
+		nChangedEndLine = GetLineCount();
 	}
 
-	// now we can recompute
+	// now we can update the mapping of the changed lines
 	if ((nEndLine > nLine) || bFirstLineGhost)
-	{
-		// TODO: Be smarter, and don't recompute if it is easy to see what changed
-		RecomputeRealityMapping();
-	}
+		UpdateRealityMapping(nFirstChangedLine, min(nChangedEndLine, GetLineCount()));
 
 	if (bGroupFlag)
 		FlushUndoGroup (pSource);
@@ -415,6 +419,8 @@ bool CGhostTextBuffer::			/* virtual override */
 DeleteText2 (CCrystalTextView * pSource, int nStartLine, int nStartChar,
             int nEndLine, int nEndChar, int nAction /*= CE_ACTION_UNKNOWN*/, bool bHistory /*= true*/)
 {
+	const int nLineCount = GetLineCount();
+	int nFirstChangedLine = nStartLine;
 	if ((GetLineFlags(nEndLine) & LF_GHOST) == 0)
 	{
 		if (!CCrystalTextBuffer::DeleteText2(pSource, nStartLine, nStartChar,
@@ -451,18 +457,17 @@ DeleteText2 (CCrystalTextView * pSource, int nStartLine, int nStartChar,
 			if (bHistory && m_nUndoPosition < static_cast<int>(m_aUndoBuf.size()))
 				m_aUndoBuf.resize(m_nUndoPosition);
 			InternalDeleteGhostLine(pSource, nEndLine2 + 1, nEndLine - (nEndLine2 + 1));
+			nFirstChangedLine = nEndLine2 + 1;
 		}
 	}
 
 	if (nStartChar != 0 || nEndChar != 0)
 		OnNotifyLineHasBeenEdited(nStartLine);
 
-	// now we can recompute
-	if (nStartLine != nEndLine)
-	{
-		// TODO: Be smarter, and don't recompute if it is easy to see what changed
-		RecomputeRealityMapping();
-	}
+	// now we can update the mapping of the changed lines: the lines after
+	// the start line are the lines which were after the deleted text
+	if (nStartLine != nEndLine || GetLineCount() != nLineCount)
+		UpdateRealityMapping(nFirstChangedLine, min(nStartLine + 1, GetLineCount()));
 		
 	return true;
 }
@@ -533,10 +538,10 @@ void CGhostTextBuffer::RemoveAllGhostLines()
  */
 int CGhostTextBuffer::ApparentLastRealLine() const
 {
-	if (m_RealityBlocks.size() == 0)
+	const int nRealLines = m_RealityMap.GetRealLineCount();
+	if (nRealLines == 0)
 		return -1;
-	const RealityBlock &block = m_RealityBlocks.back();
-	return block.nStartApparent + block.nCount - 1;
+	return m_RealityMap.GetApparentLine(nRealLines - 1);
 }
 
 /**
@@ -562,32 +567,19 @@ int CGhostTextBuffer::ComputeRealLine(int nApparentLine) const
  */
 int CGhostTextBuffer::ComputeApparentLine(int nRealLine) const
 {
-	const int size = static_cast<int>(m_RealityBlocks.size());
-	if (size == 0)
+	const int nRealLines = m_RealityMap.GetRealLineCount();
+	if (nRealLines == 0)
 		return 0;
 
-	// after last block ?
-	const RealityBlock & maxblock = m_RealityBlocks.back();
-	if (nRealLine >= maxblock.nStartReal + maxblock.nCount)
+	// after last real line ?
+	if (nRealLine >= nRealLines)
 		return GetLineCount();
 
-	// binary search to find correct (or nearest block)
-	int blo = 0;
-	int bhi = size - 1;
-	while (blo <= bhi)
-	{
-		int i = (blo + bhi) / 2;
-		const RealityBlock & block = m_RealityBlocks[i];
-		if (nRealLine < block.nStartReal)
-			bhi = i - 1;
-		else if (nRealLine >= block.nStartReal + block.nCount)
-			blo = i + 1;
-		else
-			return (nRealLine - block.nStartReal) + block.nStartApparent;
-	}
-	// Should have found it; all real lines should be in a block
-	ASSERT(false);
-	return -1;
+	// all real lines should be mapped
+	ASSERT(nRealLine >= 0);
+	if (nRealLine < 0)
+		return -1;
+	return m_RealityMap.GetApparentLine(nRealLine);
 }
 
 /**
@@ -603,8 +595,8 @@ int CGhostTextBuffer::ComputeApparentLine(int nRealLine) const
 int CGhostTextBuffer::ComputeRealLineAndGhostAdjustment(int nApparentLine,
 		int& decToReal) const
 {
-	const int size = static_cast<int>(m_RealityBlocks.size());
-	if (size == 0) 
+	const int nRealLines = m_RealityMap.GetRealLineCount();
+	if (nRealLines == 0) 
 	{
 		decToReal = 0;
 		return 0;
@@ -613,34 +605,18 @@ int CGhostTextBuffer::ComputeRealLineAndGhostAdjustment(int nApparentLine,
 	// after last apparent line ?
 	ASSERT(nApparentLine < GetLineCount());
 
-	// after last block ?
-	const RealityBlock & maxblock = m_RealityBlocks.back();
-	if (nApparentLine >= maxblock.nStartApparent + maxblock.nCount)
+	// the real line, or the real line after the ghost lines
+	const int nRealLine = m_RealityMap.GetRealLinesBefore(nApparentLine);
+
+	// after last real line ?
+	if (nRealLine == nRealLines)
 	{
 		decToReal = GetLineCount() - nApparentLine;
-		return maxblock.nStartReal + maxblock.nCount;
+		return nRealLines;
 	}
 
-	// binary search to find correct (or nearest block)
-	int blo = 0;
-	int bhi = size - 1;
-	while (blo <= bhi)
-	{
-		int i = (blo + bhi) / 2;
-		const RealityBlock & block = m_RealityBlocks[i];
-		if (nApparentLine < block.nStartApparent)
-			bhi = i - 1;
-		else if (nApparentLine >= block.nStartApparent + block.nCount)
-			blo = i + 1;
-		else // found it inside this block
-		{
-			decToReal = 0;
-			return (nApparentLine - block.nStartApparent) + block.nStartReal;
-		}
-	}
-	// it is a ghost line just before block blo
-	decToReal = m_RealityBlocks[blo].nStartApparent - nApparentLine;
-	return m_RealityBlocks[blo].nStartReal;
+	decToReal = m_RealityMap.GetApparentLine(nRealLine) - nApparentLine;
+	return nRealLine;
 }
 
 /**
@@ -652,59 +628,33 @@ int CGhostTextBuffer::ComputeRealLineAndGhostAdjustment(int nApparentLine,
  */
 int CGhostTextBuffer::ComputeApparentLine(int nRealLine, int decToReal) const
 {
-	int nPreviousBlock;
 	int nApparent;
+	int nPreviousRealLine;
 
-	const int size = (int) m_RealityBlocks.size();
-	int blo = 0;
-	int bhi = size - 1;
-	int i;
-	if (size == 0)
+	const int nRealLines = m_RealityMap.GetRealLineCount();
+	if (nRealLines == 0)
 		return 0;
 
-	// after last block ?
-	const RealityBlock & maxblock = m_RealityBlocks.back();
-	if (nRealLine >= maxblock.nStartReal + maxblock.nCount)
+	// after last real line ?
+	if (nRealLine >= nRealLines)
 	{
-		nPreviousBlock = size - 1;
 		nApparent = GetLineCount() - 1;
-		goto limitWithPreviousBlock;
+		nPreviousRealLine = nRealLines - 1;
 	}
-
-	// binary search to find correct (or nearest block)
-	while (blo <= bhi)
-	{
-		i = (blo + bhi) / 2;
-		const RealityBlock & block = m_RealityBlocks[i];
-		if (nRealLine < block.nStartReal)
-			bhi = i - 1;
-		else if (nRealLine >= block.nStartReal + block.nCount)
-			blo = i + 1;
-		else
-		{
-			if (nRealLine > block.nStartReal)
-				// limited by the previous line in this block
-				return (nRealLine - block.nStartReal) + block.nStartApparent;
-			nPreviousBlock = i - 1;
-			nApparent = (nRealLine - block.nStartReal) + block.nStartApparent;
-			goto limitWithPreviousBlock;
-		}
-	}
-	// Should have found it; all real lines should be in a block
-	ASSERT(false);
-	return -1;
-
-limitWithPreviousBlock:
-	// we must keep above the value lastApparentInPreviousBlock
-	int lastApparentInPreviousBlock;
-	if (nPreviousBlock == -1)
-		lastApparentInPreviousBlock = -1;
 	else
 	{
-		const RealityBlock & previousBlock = m_RealityBlocks[nPreviousBlock];
-		lastApparentInPreviousBlock = previousBlock.nStartApparent + previousBlock.nCount - 1;
+		// all real lines should be mapped
+		ASSERT(nRealLine >= 0);
+		if (nRealLine < 0)
+			return -1;
+		nApparent = m_RealityMap.GetApparentLine(nRealLine);
+		nPreviousRealLine = nRealLine - 1;
 	}
 
+	// we must keep above the apparent line of the previous real line
+	const int lastApparentInPreviousBlock = (nPreviousRealLine < 0) ? -1 :
+		m_RealityMap.GetApparentLine(nPreviousRealLine);
+
 	while (decToReal --) 
 	{
 		nApparent --;
@@ -721,70 +671,56 @@ void CGhostTextBuffer::FinishLoading()
 	RecomputeRealityMapping();
 }
 
-/** Recompute the reality mapping (this is fairly naive) */
+/** Recompute the reality mapping from the flags of all lines */
 void CGhostTextBuffer::RecomputeRealityMapping()
 {
-	m_RealityBlocks.clear();
-	int reality = -1; // last encountered real line
-	int i = 0; // current line
-	int nLineCount = GetLineCount();
-	RealityBlock block; // current block being traversed (in state 2)
-
-	// This is a state machine with 2 states
-
-	// state 1, i-1 not real line
-passingGhosts:
-	ASSERT( i <= nLineCount );
-	if (i == nLineCount)
+	m_RealityMap.Clear();
+	UpdateRealityMapping(0, GetLineCount());
+}
+
+/**
+ * @brief Update the reality mapping after some lines changed.
+ * Lines are inserted, erased or made ghost or real between @p nFirstLine and
+ * @p nEndLine, the lines after @p nEndLine being the lines which were after
+ * the changed lines: only the runs of the changed lines are updated.
+ * @param [in] nFirstLine First changed line.
+ * @param [in] nEndLine Line after the last changed line, after the change.
+ */
+void CGhostTextBuffer::UpdateRealityMapping(int nFirstLine, int nEndLine)
+{
+	const int nLineCount = GetLineCount();
+	const int nOldEndLine = nEndLine - (nLineCount - m_RealityMap.GetLineCount());
+	if (m_RealityMap.GetLineCount() == 0)
 	{
-		checkFlagsFromReality();
-		return;
+		// Not computed yet
+		nFirstLine = 0;
+		nEndLine = nLineCount;
 	}
-	if (GetLineFlags(i) & LF_GHOST)
+	else if (nFirstLine < 0 || nEndLine > nLineCount || nOldEndLine < nFirstLine)
 	{
-		++i;
-		goto passingGhosts;
+		// The mapping was not of these lines
+		ASSERT(false);
+		m_RealityMap.Clear();
+		nFirstLine = 0;
+		nEndLine = nLineCount;
 	}
-	// this is the first line of a reality block
-	block.nStartApparent = i;
-	block.nStartReal = reality + 1;
-	block.nCount = -1;
-	++reality;
-	++i;
-	// fall through to other state
-
-	// state 2, i - 1 is real line
-inReality:
-	ASSERT( i <= nLineCount );
-	if (i == nLineCount || (GetLineFlags(i) & LF_GHOST))
+	else
 	{
-		// i-1 is the last line of a reality block
-		ASSERT(reality >= 0);
-		block.nCount = i - block.nStartApparent;
-		ASSERT(block.nCount > 0);
-		ASSERT(reality + 1 - block.nStartReal == block.nCount);
-		
-		// Optimize memory allocation
-		if (m_RealityBlocks.capacity() == m_RealityBlocks.size())
-		{
-			if (m_RealityBlocks.size() == 0)
-				m_RealityBlocks.reserve(16);
-			else
-				// TODO: grow more slowly with really large RealityBlocks
-				m_RealityBlocks.reserve(m_RealityBlocks.size() * 2);
-		}
-		m_RealityBlocks.push_back(block);
-		if (i == nLineCount)
-		{
-			checkFlagsFromReality();
-			return;
-		}
-		++i;
-		goto passingGhosts;
+		m_RealityMap.Erase(nFirstLine, nOldEndLine);
 	}
-	++reality;
-	++i;
-	goto inReality;
+
+	// Add the runs of ghost and real lines
+	int nLine = nFirstLine;
+	while (nLine < nEndLine)
+	{
+		const bool bGhost = (GetLineFlags(nLine) & LF_GHOST) != 0;
+		int nRunEnd = nLine + 1;
+		while (nRunEnd < nEndLine && ((GetLineFlags(nRunEnd) & LF_GHOST) != 0) == bGhost)
+			++nRunEnd;
+		m_RealityMap.Insert(nLine, nRunEnd - nLine, bGhost);
+		nLine = nRunEnd;
+	}
+	checkFlagsFromReality();
 }
 
 /** 
@@ -794,19 +730,14 @@ This means that this only has effect in DEBUG build
 void CGhostTextBuffer::checkFlagsFromReality() const
 {
 #ifdef _DEBUG
-	const int size = static_cast<int>(m_RealityBlocks.size());
-	int i = 0;
-	for (int b = 0 ; b < size ; b ++)
+	ASSERT(m_RealityMap.GetLineCount() == GetLineCount());
+	int nRealLine = 0;
+	for (int i = 0; i < GetLineCount(); i++)
 	{
-		const RealityBlock & block = m_RealityBlocks[b];
-		for ( ; i < block.nStartApparent ; i++)
-			ASSERT ((GetLineFlags(i) & LF_GHOST) != 0);
-		for ( ; i < block.nStartApparent+block.nCount ; i++)
-			ASSERT ((GetLineFlags(i) & LF_GHOST) == 0);
+		if ((GetLineFlags(i) & LF_GHOST) == 0)
+			ASSERT(m_RealityMap.GetApparentLine(nRealLine++) == i);
 	}
-
-	for ( ; i < GetLineCount() ; i++)
-		ASSERT ((GetLineFlags(i) & LF_GHOST) != 0);
+	ASSERT(m_RealityMap.GetRealLineCount() == nRealLine);
 #endif 
 }
 
@@ -7,6 +7,7 @@
 
 #include <vector>
 #include "ccrystaltextbuffer.h"
+#include "RealityMap.h"
 
 
 /////////////////////////////////////////////////////////////////////////////
@@ -43,19 +44,7 @@ public:
 	DECLARE_DYNCREATE (CGhostTextBuffer)
 
 private:
-	/**
-	 * @brief A struct mapping real lines and apparent (screen) lines.
-	 * This struct maps lines between real lines and apparent (screen) lines.
-	 * The mapping records for each text block an apparent line and matching
-	 * real line.
-	 */
-	struct RealityBlock
-	{
-		int nStartReal; /**< Start line of real block. */
-		int nStartApparent; /**< Start line of apparent block. */
-		int nCount; /**< Lines in the block. */
-	};
-	std::vector<RealityBlock> m_RealityBlocks; /**< Mapping of real and apparent lines. */
+	RealityMap m_RealityMap; /**< Mapping of real and apparent lines. */
 
 	// Operations
 private:
@@ -125,6 +114,7 @@ public:
 
 private:
 	void RecomputeRealityMapping();
+	void UpdateRealityMapping(int nFirstLine, int nEndLine);
 	/** For debugging purpose */
 	void checkFlagsFromReality() const;
 
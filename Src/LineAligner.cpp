@@ -0,0 +1,329 @@
+/**
+ * @file  LineAligner.cpp
+ *
+ * @brief Lining up similar lines of diff blocks.
+ */
+
+#include "pch.h"
+#include "LineAligner.h"
+#include <algorithm>
+#define POCO_NO_UNWINDOWS 1
+#include <Poco/Environment.h>
+#include "ParallelDiff.h"
+#include "CompareOptions.h"
+
+namespace
+{
+
+/** @brief Rows of the band computed by one parallel job. */
+const int RowsPerJob = 256;
+/** @brief Bands smaller than this are computed on one thread. */
+const int64_t ParallelMinCells = 64 * 1024;
+/** @brief Lines the band reaches at least to both sides of the diagonal. */
+const int MinBand = 16;
+
+/** @brief Directions of the alignment, to trace it back. */
+enum Step : uint8_t
+{
+	STEP_UP, /**< Line of left side not matched */
+	STEP_LEFT, /**< Line of right side not matched */
+	STEP_DIAG, /**< Lines matched */
+};
+
+/** @brief Lines with more q-grams have them compared one by one, not by mask. */
+const int LongLineGrams = 128;
+/** @brief 64-bit words of the q-gram mask. */
+const int MaskWords = 8;
+
+inline int BitCount(uint64_t x)
+{
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return static_cast<int>((x * 0x0101010101010101ULL) >> 56);
+}
+
+inline bool IsWhitespace(TCHAR c)
+{
+	return c == ' ' || c == '\t';
+}
+
+/** @brief Q-grams of a line. */
+struct Signature
+{
+	uint64_t mask[MaskWords]; /**< Bits set by q-gram hashes */
+	int bits; /**< Number of bits set in mask */
+	int count; /**< Number of q-grams */
+	std::vector<uint32_t> grams; /**< Sorted q-gram hashes, of long lines only */
+};
+
+/** @brief Band of line pairs evaluated, with similarities of its pairs. */
+struct Band
+{
+	int lo(int i) const { return static_cast<int>((std::max<int64_t>)(0, Center(i) - width)); }
+	int hi(int i) const { return static_cast<int>((std::min<int64_t>)(n1 - 1, Center(i) + width)); }
+	int64_t Center(int i) const { return n0 > 1 ? static_cast<int64_t>(i) * (n1 - 1) / (n0 - 1) : 0; }
+
+	int n0, n1;
+	int width; /**< Lines to both sides of the diagonal */
+	std::vector<int64_t> rowStart; /**< Index of first cell of each row */
+	std::vector<uint16_t> scores; /**< Similarities of cells */
+};
+
+/** @brief Arguments of ScoreRows(). */
+struct ScoreJob
+{
+	Band *band;
+	const std::vector<Signature> *sigs[2];
+};
+
+/**
+ * @brief Compute signature of a line.
+ * The text is first normalized like the compare options make it compare.
+ * Lines shorter than a q-gram have their whole text as their only q-gram.
+ */
+void MakeSignature(const String &line, bool bIgnoreCase, int nIgnoreWhitespace, Signature &sig)
+{
+	String text;
+	text.reserve(line.length());
+	for (size_t i = 0; i < line.length(); ++i)
+	{
+		TCHAR c = line[i];
+		if (IsWhitespace(c) && nIgnoreWhitespace != WHITESPACE_COMPARE_ALL)
+		{
+			if (nIgnoreWhitespace == WHITESPACE_IGNORE_ALL)
+				continue;
+			// Runs of whitespace as one space, trailing whitespace not at all
+			while (i + 1 < line.length() && IsWhitespace(line[i + 1]))
+				++i;
+			if (i + 1 < line.length())
+				text += ' ';
+			continue;
+		}
+		text += bIgnoreCase ? static_cast<TCHAR>(_totlower(c)) : c;
+	}
+
+	std::fill(sig.mask, sig.mask + MaskWords, 0);
+	sig.grams.clear();
+	sig.count = 0;
+	if (!text.empty())
+	{
+		const size_t q = (std::min<size_t>)(LineAligner::QGram, text.length());
+		sig.count = static_cast<int>(text.length() - q + 1);
+		if (sig.count > LongLineGrams)
+			sig.grams.reserve(sig.count);
+		for (size_t i = 0; i + q <= text.length(); ++i)
+		{
+			// FNV-1a
+			uint32_t h = 2166136261u;
+			for (size_t k = i; k < i + q; ++k)
+				h = (h ^ static_cast<uint32_t>(text[k])) * 16777619u;
+			sig.mask[h >> 29] |= 1ULL << ((h >> 23) & 63);
+			if (sig.count > LongLineGrams)
+				sig.grams.push_back(h);
+		}
+		std::sort(sig.grams.begin(), sig.grams.end());
+	}
+	sig.bits = 0;
+	for (int i = 0; i < MaskWords; ++i)
+		sig.bits += BitCount(sig.mask[i]);
+}
+
+/**
+ * @brief Similarity of lines, from 0 to LineAligner::MaxScore.
+ * The share of common q-grams is counted from the masks, for long lines
+ * whose masks fill up from the q-grams themselves. Lines less similar than
+ * LineAligner::MinScore get 0. Empty lines are equal to each other.
+ */
+int Similarity(const Signature &sig0, const Signature &sig1)
+{
+	const int n0 = sig0.count, n1 = sig1.count;
+	if (n0 == 0 || n1 == 0)
+		return (n0 == 0 && n1 == 0) ? LineAligner::MaxScore : 0;
+
+	int common = 0;
+	for (int i = 0; i < MaskWords; ++i)
+		common += BitCount(sig0.mask[i] & sig1.mask[i]);
+	int score = 2 * common * LineAligner::MaxScore / (sig0.bits + sig1.bits);
+	if (sig0.grams.empty() || sig1.grams.empty())
+	{
+		// Lines of different lengths are not more similar than their lengths allow
+		score = (std::min)(score, static_cast<int>(2 * static_cast<int64_t>((std::min)(n0, n1)) * LineAligner::MaxScore / (n0 + n1)));
+	}
+	else if (score >= LineAligner::MinScore / 2)
+	{
+		// Masks of long lines tell the share of common q-grams only roughly
+		common = 0;
+		for (size_t i = 0, j = 0; i < sig0.grams.size() && j < sig1.grams.size(); )
+		{
+			if (sig0.grams[i] < sig1.grams[j])
+				++i;
+			else if (sig1.grams[j] < sig0.grams[i])
+				++j;
+			else
+			{
+				++common;
+				++i;
+				++j;
+			}
+		}
+		score = static_cast<int>(2 * static_cast<int64_t>(common) * LineAligner::MaxScore / (n0 + n1));
+	}
+	return score < LineAligner::MinScore ? 0 : score;
+}
+
+/**
+ * @brief Compute similarities of the band rows of one job.
+ * This is run by parallel_for().
+ */
+void ScoreRows(void *arg, int job)
+{
+	ScoreJob &scoreJob = *static_cast<ScoreJob *>(arg);
+	Band &band = *scoreJob.band;
+	const int end = (std::min)(band.n0, (job + 1) * RowsPerJob);
+	for (int i = job * RowsPerJob; i < end; ++i)
+	{
+		uint16_t *scores = &band.scores[band.rowStart[i]];
+		for (int j = band.lo(i), hi = band.hi(i); j <= hi; ++j)
+			*scores++ = static_cast<uint16_t>(Similarity((*scoreJob.sigs[0])[i], (*scoreJob.sigs[1])[j]));
+	}
+}
+
+}
+
+const int LineAligner::QGram;
+const int LineAligner::MaxScore;
+const int LineAligner::MinScore;
+const int64_t LineAligner::MaxCells = 16 * 1024 * 1024;
+
+/**
+ * @brief Constructor.
+ * @param [in] bIgnoreCase Lines differing only in case are equal.
+ * @param [in] nIgnoreWhitespace Whitespace option, one of WHITESPACE_*.
+ * @param [in] nThreads Threads computing similarities, 0 for all processors.
+ */
+LineAligner::LineAligner(bool bIgnoreCase, int nIgnoreWhitespace, int nThreads /*= 0*/)
+: m_bIgnoreCase(bIgnoreCase)
+, m_nIgnoreWhitespace(nIgnoreWhitespace)
+, m_nThreads(nThreads > 0 ? nThreads : static_cast<int>(Poco::Environment::processorCount()))
+{
+}
+
+/**
+ * @brief Similarity of two lines with the current options, from 0 to MaxScore.
+ */
+int LineAligner::Similarity(const String &line0, const String &line1) const
+{
+	Signature sig0, sig1;
+	MakeSignature(line0, m_bIgnoreCase, m_nIgnoreWhitespace, sig0);
+	MakeSignature(line1, m_bIgnoreCase, m_nIgnoreWhitespace, sig1);
+	return ::Similarity(sig0, sig1);
+}
+
+/**
+ * @brief Align lines of left side to lines of right side.
+ * @param [in] lines0 Lines of left side.
+ * @param [in] lines1 Lines of right side.
+ * @return Index of the matching right side line for every left side line,
+ * or NO_MATCH. Matched indexes are increasing.
+ */
+std::vector<int> LineAligner::Align(const std::vector<String> &lines0, const std::vector<String> &lines1) const
+{
+	const int n0 = static_cast<int>(lines0.size());
+	const int n1 = static_cast<int>(lines1.size());
+	std::vector<int> map(n0, NO_MATCH);
+	if (n0 == 0 || n1 == 0)
+		return map;
+
+	std::vector<Signature> sigs[2];
+	sigs[0].resize(n0);
+	sigs[1].resize(n1);
+	for (int i = 0; i < n0; ++i)
+		MakeSignature(lines0[i], m_bIgnoreCase, m_nIgnoreWhitespace, sigs[0][i]);
+	for (int j = 0; j < n1; ++j)
+		MakeSignature(lines1[j], m_bIgnoreCase, m_nIgnoreWhitespace, sigs[1][j]);
+
+	// Whole block if small enough, otherwise a band around its diagonal
+	Band band;
+	band.n0 = n0;
+	band.n1 = n1;
+	band.width = (static_cast<int64_t>(n0) * n1 <= MaxCells) ? n1 :
+		static_cast<int>((std::max<int64_t>)(MinBand, MaxCells / n0 / 2));
+	band.rowStart.resize(n0 + 1);
+	band.rowStart[0] = 0;
+	for (int i = 0; i < n0; ++i)
+		band.rowStart[i + 1] = band.rowStart[i] + band.hi(i) - band.lo(i) + 1;
+	band.scores.resize(static_cast<size_t>(band.rowStart[n0]));
+
+	ScoreJob scoreJob;
+	scoreJob.band = &band;
+	scoreJob.sigs[0] = &sigs[0];
+	scoreJob.sigs[1] = &sigs[1];
+	const int jobs = (n0 + RowsPerJob - 1) / RowsPerJob;
+	parallel_for(jobs, band.rowStart[n0] >= ParallelMinCells ? m_nThreads : 1, ScoreRows, &scoreJob);
+
+	// Best total similarity of lines [0;i] and [0;j] is in cur[j] when row i
+	// is done. Cells left of the band keep the value from the rows above,
+	// cells right of the band have the value of the last cell of the row.
+	// Unmatched pairs count 1, so pairs fill the space between matches.
+	std::vector<int> cur(n1, 0);
+	std::vector<uint8_t> steps(band.scores.size());
+	int prevHi = -1, prevRowMax = 0;
+	for (int i = 0; i < n0; ++i)
+	{
+		const int lo = band.lo(i), hi = band.hi(i);
+		const uint16_t *scores = &band.scores[band.rowStart[i]];
+		uint8_t *step = &steps[band.rowStart[i]];
+		int diagPrev = lo == 0 ? 0 : lo - 1 <= prevHi ? cur[lo - 1] : prevRowMax;
+		int left = diagPrev;
+		for (int j = lo; j <= hi; ++j)
+		{
+			const int up = j <= prevHi ? cur[j] : prevRowMax;
+			const int diag = diagPrev + *scores++ + 1;
+			// Prefer leaving lines unmatched on ties, so lines are paired
+			// from the top of the gaps between matches
+			int best = up;
+			Step s = STEP_UP;
+			if (left > best)
+			{
+				best = left;
+				s = STEP_LEFT;
+			}
+			if (diag > best)
+			{
+				best = diag;
+				s = STEP_DIAG;
+			}
+			*step++ = s;
+			diagPrev = up;
+			cur[j] = left = best;
+		}
+		prevHi = hi;
+		prevRowMax = cur[hi];
+	}
+
+	for (int i = n0 - 1, j = n1 - 1; i >= 0 && j >= 0; )
+	{
+		const int lo = band.lo(i), hi = band.hi(i);
+		if (j > hi)
+			j = hi;
+		else if (j < lo)
+			--i;
+		else
+		{
+			switch (steps[band.rowStart[i] + j - lo])
+			{
+			case STEP_UP:
+				--i;
+				break;
+			case STEP_LEFT:
+				--j;
+				break;
+			default:
+				map[i--] = j--;
+				break;
+			}
+		}
+	}
+	return map;
+}
@@ -0,0 +1,47 @@
+/**
+ * @file  LineAligner.h
+ *
+ * @brief Declaration of LineAligner class.
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "UnicodeString.h"
+
+/**
+ * @brief Lines up similar lines of the two sides of a diff block.
+ *
+ * Every line gets a signature of the q-grams (substrings of QGram
+ * characters) of its text, as the text compares with the current options.
+ * The similarity of two lines is the Dice coefficient of their q-grams,
+ * counted from bitmasks of the q-grams. Only long lines, whose masks fill
+ * up, have their q-grams compared one by one, when the masks show they
+ * may be similar.
+ *
+ * Lines are then aligned by dynamic programming, maximizing the total
+ * similarity of the matched pairs so that matches do not cross. Pairs not
+ * similar at all still count a little, so the remaining lines are paired
+ * side by side as far as they fit. For big blocks only a band around the
+ * diagonal of the block is evaluated, so the work is linear in the block
+ * size. Similarities of the band are computed on several threads.
+ */
+class LineAligner
+{
+public:
+	enum { NO_MATCH = -1 };
+
+	static const int QGram = 3; /**< Characters per q-gram */
+	static const int MaxScore = 1000; /**< Similarity of equal lines */
+	static const int MinScore = 300; /**< Lines less similar are not similar at all */
+	static const int64_t MaxCells; /**< Most line pairs evaluated per block */
+
+	LineAligner(bool bIgnoreCase, int nIgnoreWhitespace, int nThreads = 0);
+	std::vector<int> Align(const std::vector<String> &lines0, const std::vector<String> &lines1) const;
+	int Similarity(const String &line0, const String &line1) const;
+
+private:
+	bool m_bIgnoreCase;
+	int m_nIgnoreWhitespace;
+	int m_nThreads; /**< Threads computing similarities */
+};
@@ -28,6 +28,7 @@
 #include "StdAfx.h"
 #include "MergeDoc.h"
 #include <io.h>
+#include <exception>
 #include <Poco/Timestamp.h>
 #include "UnicodeString.h"
 #include "Merge.h"
@@ -65,6 +66,7 @@
 #include "charsets.h"
 #include "markdown.h"
 #include "stringdiffs.h"
+#include "ParallelDiff.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -75,6 +77,9 @@ using std::swap;
 /** @brief Max len of path in caption. */
 static const UINT CAPTION_PATH_MAX = 50;
 
+/** @brief Unchanged lines diffed around edited lines in incremental rescan. */
+static const int RESCAN_CONTEXT_LINES = 100;
+
 int CMergeDoc::m_nBuffersTemp = 2;
 
 /** @brief EOL types */
@@ -288,8 +293,10 @@ static void SaveBuffForDiff(CDiffTextBuffer & buf, const String& filepath, int n
  * error happened
  * If this code is OK, Rescan has detached the views temporarily
  * (positions of cursors have been lost)
- * @note Rescan() ALWAYS compares temp files. Actual user files are not
- * touched by Rescan().
+ * @note Rescan() ALWAYS compares buffer contents, given to diff-engine
+ * from memory or, with prediffer plugins, as temp files. Actual user files
+ * are not touched by Rescan(). When only buffer contents changed since the
+ * last rescan, just the edited lines are diffed (RescanEditedLines()).
  * @sa CDiffWrapper::RunFileDiff()
  */
 int CMergeDoc::Rescan(bool &bBinary, IDENTLEVEL &identical,
@@ -384,17 +391,36 @@ int CMergeDoc::Rescan(bool &bBinary, IDENTLEVEL &identical,
 
 	DIFFSTATUS status;
 
-	if (!HasSyncPoints())
+	// Without prediffer plugin, diff-engine reads buffer texts from memory
+	// instead of temp files
+	std::string texts[3];
+
+	// If only buffer contents changed after last rescan, diff just the edited lines
+	String sRescanKey = bBinary ? _T("") : GetRescanKey();
+	const bool bIncremental = !sRescanKey.empty() && sRescanKey == m_sRescanKey;
+	m_sRescanKey.clear();
+
+	if (bIncremental && RescanEditedLines(status))
+	{
+		diffSuccess = true;
+	}
+	else if (!HasSyncPoints())
 	{
-		// Save text buffer to file
+		// Get text buffer for diff-engine
+		const bool bUseTexts = !m_diffWrapper.HasPrediffer();
 		for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
 		{
 			m_ptBuf[nBuffer]->SetTempPath(tempPath);
-			SaveBuffForDiff(*m_ptBuf[nBuffer], m_tempFiles[nBuffer].GetPath());
+			if (bUseTexts)
+				m_ptBuf[nBuffer]->GetTextForDiff(texts[nBuffer]);
+			else
+				SaveBuffForDiff(*m_ptBuf[nBuffer], m_tempFiles[nBuffer].GetPath());
 		}
 
 		m_diffWrapper.SetCreateDiffList(&m_diffList);
+		m_diffWrapper.SetTexts(bUseTexts ? texts : nullptr);
 		diffSuccess = m_diffWrapper.RunFileDiff();
+		m_diffWrapper.SetTexts(nullptr);
 
 		// Read diff-status
 		m_diffWrapper.GetDiffStatus(&status);
@@ -408,18 +434,24 @@ int CMergeDoc::Rescan(bool &bBinary, IDENTLEVEL &identical,
 		int nLines[3], nRealLine[3];
 		for (size_t i = 0; i <= syncpoints.size(); ++i)
 		{
-			// Save text buffer to file
+			// Get text buffer for diff-engine
+			const bool bUseTexts = !m_diffWrapper.HasPrediffer();
 			for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
 			{
 				nLines[nBuffer] = (i >= syncpoints.size()) ? -1 : syncpoints[i][nBuffer] - nStartLine[nBuffer];
 				m_ptBuf[nBuffer]->SetTempPath(tempPath);
-				SaveBuffForDiff(*m_ptBuf[nBuffer], m_tempFiles[nBuffer].GetPath(), 
-					nStartLine[nBuffer], nLines[nBuffer]);
+				if (bUseTexts)
+					m_ptBuf[nBuffer]->GetTextForDiff(texts[nBuffer], nStartLine[nBuffer], nLines[nBuffer]);
+				else
+					SaveBuffForDiff(*m_ptBuf[nBuffer], m_tempFiles[nBuffer].GetPath(), 
+						nStartLine[nBuffer], nLines[nBuffer]);
 			}
 			DiffList templist;
 			templist.Clear();
 			m_diffWrapper.SetCreateDiffList(&templist);
+			m_diffWrapper.SetTexts(bUseTexts ? texts : nullptr);
 			diffSuccess = m_diffWrapper.RunFileDiff();
+			m_diffWrapper.SetTexts(nullptr);
 			for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
 				nRealLine[nBuffer] = m_ptBuf[nBuffer]->ComputeRealLine(nStartLine[nBuffer]);
 			m_diffList.AppendDiffList(templist, nRealLine);
@@ -436,6 +468,9 @@ int CMergeDoc::Rescan(bool &bBinary, IDENTLEVEL &identical,
 		m_diffWrapper.SetCreateDiffList(&m_diffList);
 	}
 
+	// Keep diffs for next incremental rescan
+	m_diffListRescan = m_diffList;
+
 	// If one file has EOL before EOF and other not...
 	if (std::count(status.bMissingNL, status.bMissingNL + m_nBuffers, status.bMissingNL[0]) < m_nBuffers)
 	{
@@ -509,7 +544,9 @@ int CMergeDoc::Rescan(bool &bBinary, IDENTLEVEL &identical,
 		for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
 		{
 			m_bEditAfterRescan[nBuffer] = false;
+			m_ptBuf[nBuffer]->ResetEditedLines();
 		}
+		m_sRescanKey = sRescanKey;
 	}
 
 	if (!GetOptionsMgr()->GetBool(OPT_CMP_IGNORE_CODEPAGE) &&
@@ -523,6 +560,209 @@ int CMergeDoc::Rescan(bool &bBinary, IDENTLEVEL &identical,
 	return nResult;
 }
 
+/**
+ * @brief Get options affecting diffs of last rescan.
+ * Incremental rescan is possible only if these didn't change.
+ * @return Options as string, or empty string if diffs must be always
+ * computed for whole files (sync points, moved blocks, prediffer plugin,
+ * comment filtering).
+ */
+String CMergeDoc::GetRescanKey() const
+{
+	if (HasSyncPoints() || m_diffWrapper.GetDetectMovedBlocks() || m_diffWrapper.HasPrediffer())
+		return _T("");
+
+	DIFFOPTIONS options = {0};
+	m_diffWrapper.GetOptions(&options);
+	// Comment filtering looks back to the start of the file for an open
+	// block comment, which a diff of the edited lines only does not see
+	if (options.bFilterCommentsLines)
+		return _T("");
+	String key = strutils::format(_T("%d|%d|%d|%d|%d|%d|%d|"),
+		m_nBuffers,
+		options.nIgnoreWhitespace,
+		options.bIgnoreCase,
+		options.bIgnoreBlankLines,
+		options.bIgnoreEol,
+		options.nDiffAlgorithm,
+		GetOptionsMgr()->GetBool(OPT_ALLOW_MIXED_EOL));
+	for (int nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
+		key += strutils::format(_T("%d|%s|"), m_ptBuf[nBuffer]->GetCRLFMode(),
+			m_filePaths[nBuffer].c_str());
+	if (GetOptionsMgr()->GetBool(OPT_LINEFILTER_ENABLED))
+		key += theApp.m_pLineFilters->GetAsString();
+	return key;
+}
+
+/**
+ * @brief Diff only lines edited after last rescan.
+ * The edited lines of all buffers are extended to a common window, which
+ * starts and ends in lines that were matched in last rescan and have not
+ * been edited since. Only the window is diffed again; diffs of last rescan
+ * before and after it are reused.
+ * @param [out] status Diff status for whole files.
+ * @return false if the window would cover whole files or diffing failed,
+ * then whole files must be diffed.
+ */
+bool CMergeDoc::RescanEditedLines(DIFFSTATUS &status)
+{
+	const int nDiffs = m_diffListRescan.GetSize();
+	std::vector<DIFFRANGE> diffs(nDiffs);
+	for (int nDiff = 0; nDiff < nDiffs; nDiff++)
+		m_diffListRescan.GetDiff(nDiff, diffs[nDiff]);
+
+	// Edited lines in line numbers of last rescan
+	int nOldLines[3], nNewLines[3], nEditBegin[3], nEditEnd[3];
+	bool bEdited[3] = { false, false, false };
+	int nBuffer;
+	for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
+	{
+		const CDiffTextBuffer &buf = *m_ptBuf[nBuffer];
+		nOldLines[nBuffer] = buf.GetRescanLineCount();
+		nNewLines[nBuffer] = buf.GetRealLineCount();
+		if (!buf.HasEditedLines())
+			continue;
+		bEdited[nBuffer] = true;
+		int nMinLines = min(nOldLines[nBuffer], nNewLines[nBuffer]);
+		nEditBegin[nBuffer] = min(buf.GetFirstEditedLine(), nMinLines);
+		nEditEnd[nBuffer] = nOldLines[nBuffer] -
+			min(buf.GetUneditedTailLines(), nMinLines - nEditBegin[nBuffer]);
+	}
+	if (std::count(bEdited, bEdited + m_nBuffers, true) == 0)
+		return false;
+
+	// Lines between diffs: gap g is before diff g, last gap after last diff
+	auto gapBegin = [&](int g, int file) { return g == 0 ? 0 : diffs[g - 1].end[file] + 1; };
+	auto gapEnd = [&](int g, int file) { return g == nDiffs ? nOldLines[file] : diffs[g].begin[file]; };
+	auto gapLength = [&](int g) {
+		int nLength = INT_MAX;
+		for (int file = 0; file < m_nBuffers; file++)
+			nLength = min(nLength, gapEnd(g, file) - gapBegin(g, file));
+		return max(nLength, 0);
+	};
+	auto gapBefore = [&](int g, const int nLine[]) {
+		for (int file = 0; file < m_nBuffers; file++)
+			if (bEdited[file] && gapBegin(g, file) > nLine[file])
+				return false;
+		return true;
+	};
+	auto gapAfter = [&](int g, const int nLine[]) {
+		for (int file = 0; file < m_nBuffers; file++)
+			if (bEdited[file] && gapEnd(g, file) < nLine[file])
+				return false;
+		return true;
+	};
+
+	// Window starts in last gap beginning before edited lines
+	int nGapFirst = 0;
+	while (nGapFirst < nDiffs && gapBefore(nGapFirst + 1, nEditBegin))
+		nGapFirst++;
+	int nOffset = INT_MAX;
+	for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
+		if (bEdited[nBuffer])
+			nOffset = min(nOffset, nEditBegin[nBuffer] - gapBegin(nGapFirst, nBuffer));
+	nOffset = max(min(nOffset, gapLength(nGapFirst)) - RESCAN_CONTEXT_LINES, 0);
+	int nWindowBegin[3] = { 0, 0, 0 };
+	for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
+		nWindowBegin[nBuffer] = gapBegin(nGapFirst, nBuffer) + nOffset;
+
+	// Window ends in first gap ending after edited lines
+	int nGapLast = nGapFirst;
+	while (nGapLast < nDiffs && !gapAfter(nGapLast, nEditEnd))
+		nGapLast++;
+	nOffset = 0;
+	for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
+		if (bEdited[nBuffer])
+			nOffset = max(nOffset, nEditEnd[nBuffer] - gapBegin(nGapLast, nBuffer));
+	nOffset += RESCAN_CONTEXT_LINES;
+	int nWindowEnd[3] = { 0, 0, 0 };
+	bool bWindowAtEnd = (nGapLast == nDiffs && nOffset >= gapLength(nGapLast));
+	for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
+	{
+		if (bWindowAtEnd)
+			nWindowEnd[nBuffer] = nOldLines[nBuffer];
+		else
+			nWindowEnd[nBuffer] = gapBegin(nGapLast, nBuffer) + min(nOffset, gapLength(nGapLast));
+	}
+
+	bool bWhole = bWindowAtEnd;
+	for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
+		if (nWindowBegin[nBuffer] != 0)
+			bWhole = false;
+	if (bWhole)
+		return false;
+
+	// Diff the window, lines after it have moved by the change of line count
+	std::string texts[3];
+	int nShift[3] = { 0, 0, 0 };
+	for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
+	{
+		CDiffTextBuffer &buf = *m_ptBuf[nBuffer];
+		nShift[nBuffer] = nNewLines[nBuffer] - nOldLines[nBuffer];
+		int nStartLine = buf.ComputeApparentLine(nWindowBegin[nBuffer]);
+		int nEndLine = buf.ComputeApparentLine(nWindowEnd[nBuffer] + nShift[nBuffer]);
+		buf.GetTextForDiff(texts[nBuffer], nStartLine, nEndLine - nStartLine);
+	}
+	DiffList templist;
+	m_diffWrapper.SetCreateDiffList(&templist);
+	m_diffWrapper.SetTexts(texts);
+	bool bSuccess = m_diffWrapper.RunFileDiff();
+	m_diffWrapper.SetTexts(nullptr);
+	m_diffWrapper.SetCreateDiffList(&m_diffList);
+	DIFFSTATUS status_part;
+	m_diffWrapper.GetDiffStatus(&status_part);
+	if (!bSuccess || status_part.bBinaries)
+		return false;
+
+	// Splice diffs of window between kept diffs
+	m_diffList.Clear();
+	for (int nDiff = 0; nDiff < nGapFirst; nDiff++)
+		m_diffList.AddDiff(diffs[nDiff]);
+	m_diffList.AppendDiffList(templist, nWindowBegin);
+	for (int nDiff = nGapLast; nDiff < nDiffs; nDiff++)
+	{
+		DIFFRANGE dr = diffs[nDiff];
+		for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
+		{
+			dr.begin[nBuffer] += nShift[nBuffer];
+			dr.end[nBuffer] += nShift[nBuffer];
+		}
+		m_diffList.AddDiff(dr);
+	}
+
+	// Status for whole files
+	status = DIFFSTATUS();
+	for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
+	{
+		const CDiffTextBuffer &buf = *m_ptBuf[nBuffer];
+		int nLastLine = buf.ApparentLastRealLine();
+		status.bMissingNL[nBuffer] = nLastLine >= 0 &&
+			buf.GetLineLength(nLastLine) > 0 && buf.GetLineEol(nLastLine)[0] == 0;
+	}
+	if (m_diffList.GetSize() == 0)
+		status.Identical = IDENTLEVEL_ALL;
+	else if (m_nBuffers < 3)
+		status.Identical = IDENTLEVEL_NONE;
+	else
+	{
+		// Two files are identical if all diffs are in the third one
+		const OP_TYPE op = m_diffList.DiffRangeAt(0)->op;
+		bool bSameOp = true;
+		for (int nDiff = 1; nDiff < m_diffList.GetSize(); nDiff++)
+			if (m_diffList.DiffRangeAt(nDiff)->op != op)
+				bSameOp = false;
+		if (bSameOp && op == OP_1STONLY)
+			status.Identical = IDENTLEVEL_EXCEPTLEFT;
+		else if (bSameOp && op == OP_2NDONLY)
+			status.Identical = IDENTLEVEL_EXCEPTMIDDLE;
+		else if (bSameOp && op == OP_3RDONLY)
+			status.Identical = IDENTLEVEL_EXCEPTRIGHT;
+		else
+			status.Identical = IDENTLEVEL_NONE;
+	}
+	return true;
+}
+
 void CMergeDoc::CheckFileChanged(void)
 {
 	int nBuffer;
@@ -591,79 +831,34 @@ void CMergeDoc::FlagTrivialLines(void)
 /** @brief Adjust all different lines that were detected as actually matching moved lines */
 void CMergeDoc::FlagMovedLines(void)
 {
-	int i;
-	MovedLines *pMovedLines;
-
-	pMovedLines = m_diffWrapper.GetMovedLines(0);
-	for (i = 0; i < m_ptBuf[0]->GetLineCount(); ++i)
+	// Only the lines of the moved blocks are visited, not every line of the files
+	auto flagMovedBlocks = [this](int nBuffer, MovedLines::ML_SIDE side)
 	{
-		int j = pMovedLines->LineInBlock(i, MovedLines::SIDE_RIGHT);
-		if (j != -1)
+		const MovedLines *pMovedLines = m_diffWrapper.GetMovedLines(nBuffer);
+		const int nLineCount = m_ptBuf[nBuffer]->GetLineCount();
+		for (const MovedLines::MovedBlock& block : pMovedLines->GetBlocks(side))
 		{
-			TRACE(_T("%d->%d\n"), i, j);
-			ASSERT(j>=0);
-			// We only flag lines that are already marked as being different
-			int apparent = m_ptBuf[0]->ComputeApparentLine(i);
-			if (m_ptBuf[0]->FlagIsSet(apparent, LF_DIFF))
+			ASSERT(block.target >= 0);
+			for (int i = block.begin; i < block.end && i < nLineCount; ++i)
 			{
-				m_ptBuf[0]->SetLineFlag(apparent, LF_MOVED, true, false, false);
+				// We only flag lines that are already marked as being different
+				int apparent = m_ptBuf[nBuffer]->ComputeApparentLine(i);
+				if (m_ptBuf[nBuffer]->FlagIsSet(apparent, LF_DIFF))
+				{
+					m_ptBuf[nBuffer]->SetLineFlag(apparent, LF_MOVED, true, false, false);
+				}
 			}
 		}
-	}
+	};
 
-	pMovedLines = m_diffWrapper.GetMovedLines(1);
-	for (i=0; i<m_ptBuf[1]->GetLineCount(); ++i)
-	{
-		int j = pMovedLines->LineInBlock(i, MovedLines::SIDE_LEFT);
-		if (j != -1)
-		{
-			TRACE(_T("%d->%d\n"), i, j);
-			ASSERT(j>=0);
-			// We only flag lines that are already marked as being different
-			int apparent = m_ptBuf[1]->ComputeApparentLine(i);
-			if (m_ptBuf[1]->FlagIsSet(apparent, LF_DIFF))
-			{
-				m_ptBuf[1]->SetLineFlag(apparent, LF_MOVED, true, false, false);
-			}
-		}
-	}
+	flagMovedBlocks(0, MovedLines::SIDE_RIGHT);
+	flagMovedBlocks(1, MovedLines::SIDE_LEFT);
 
 	if (m_nBuffers < 3)
 		return;
 
-	pMovedLines = m_diffWrapper.GetMovedLines(1);
-	for (i=0; i<m_ptBuf[1]->GetLineCount(); ++i)
-	{
-		int j = pMovedLines->LineInBlock(i, MovedLines::SIDE_RIGHT);
-		if (j != -1)
-		{
-			TRACE(_T("%d->%d\n"), i, j);
-			ASSERT(j>=0);
-			// We only flag lines that are already marked as being different
-			int apparent = m_ptBuf[1]->ComputeApparentLine(i);
-			if (m_ptBuf[1]->FlagIsSet(apparent, LF_DIFF))
-			{
-				m_ptBuf[1]->SetLineFlag(apparent, LF_MOVED, true, false, false);
-			}
-		}
-	}
-
-	pMovedLines = m_diffWrapper.GetMovedLines(2);
-	for (i=0; i<m_ptBuf[2]->GetLineCount(); ++i)
-	{
-		int j = pMovedLines->LineInBlock(i, MovedLines::SIDE_LEFT);
-		if (j != -1)
-		{
-			TRACE(_T("%d->%d\n"), i, j);
-			ASSERT(j>=0);
-			// We only flag lines that are already marked as being different
-			int apparent = m_ptBuf[2]->ComputeApparentLine(i);
-			if (m_ptBuf[2]->FlagIsSet(apparent, LF_DIFF))
-			{
-				m_ptBuf[2]->SetLineFlag(apparent, LF_MOVED, true, false, false);
-			}
-		}
-	}
+	flagMovedBlocks(1, MovedLines::SIDE_RIGHT);
+	flagMovedBlocks(2, MovedLines::SIDE_LEFT);
 
 	// todo: Need to record actual moved information
 }
@@ -2444,24 +2639,26 @@ bool CMergeDoc::CloseNow()
 }
 
 /**
- * @brief Loads file to buffer and shows load-errors
+ * @brief Loads file to buffer
  * @param [in] sFileName File to open
  * @param [in] nBuffer Index (0-based) of buffer to load
  * @param [out] readOnly whether file is read-only
  * @param [in] encoding encoding used
+ * @param [out] sOpenError Error message when the file could not be opened
  * @return Tells if files were loaded successfully
+ * @note This runs on a worker thread when panes are loaded concurrently,
+ * errors are shown afterwards by ShowLoadError().
  * @sa CMergeDoc::OpenDocs()
  **/
-int CMergeDoc::LoadFile(CString sFileName, int nBuffer, bool & readOnly, const FileTextEncoding & encoding)
+int CMergeDoc::LoadFile(CString sFileName, int nBuffer, bool & readOnly, const FileTextEncoding & encoding, CString & sOpenError)
 {
-	String sError;
 	DWORD retVal = FileLoadResult::FRESULT_ERROR;
 
 	CDiffTextBuffer *pBuf = m_ptBuf[nBuffer].get();
 	m_filePaths[nBuffer] = sFileName;
 
 	CRLFSTYLE nCrlfStyle = CRLF_STYLE_AUTOMATIC;
-	CString sOpenError;
+	sOpenError.Empty();
 	retVal = pBuf->LoadFromFile(sFileName, m_pInfoUnpacker.get(),
 		m_strBothFilenames.c_str(), readOnly, nCrlfStyle, encoding, sOpenError);
 
@@ -2479,22 +2676,33 @@ int CMergeDoc::LoadFile(CString sFileName, int nBuffer, bool & readOnly, const F
 			pBuf->SetMixedEOL(true);
 		}
 	}
+	return retVal;
+}
 
+/**
+ * @brief Shows the error of loading a file into a buffer, if any.
+ * @param [in] nBuffer Index (0-based) of buffer loaded
+ * @param [in] retVal Result of LoadFile()
+ * @param [in] sOpenError Error message returned by LoadFile()
+ */
+void CMergeDoc::ShowLoadError(int nBuffer, DWORD retVal, const CString & sOpenError)
+{
+	String sError;
+	const String sFileName = m_filePaths[nBuffer];
 	if (FileLoadResult::IsError(retVal))
 	{
 		// Error from Unifile/system
 		if (!sOpenError.IsEmpty())
-			sError = strutils::format_string2(_("Cannot open file\n%1\n\n%2"), (LPCTSTR)sFileName, (LPCTSTR)sOpenError);
+			sError = strutils::format_string2(_("Cannot open file\n%1\n\n%2"), sFileName, (LPCTSTR)sOpenError);
 		else
-			sError = strutils::format_string1(_("File not found: %1"), (LPCTSTR)sFileName);
+			sError = strutils::format_string1(_("File not found: %1"), sFileName);
 		ShowMessageBox(sError, MB_OK | MB_ICONSTOP | MB_MODELESS);
 	}
 	else if (FileLoadResult::IsErrorUnpack(retVal))
 	{
-		sError = strutils::format_string1(_("File not unpacked: %1"), (LPCTSTR)sFileName);
+		sError = strutils::format_string1(_("File not unpacked: %1"), sFileName);
 		ShowMessageBox(sError, MB_OK | MB_ICONSTOP | MB_MODELESS);
 	}
-	return retVal;
 }
 
 /**
@@ -2533,10 +2741,11 @@ void CMergeDoc::SanityCheckCodepage(FileLocation & fileinfo)
  * @param [in] filename File's name.
  * @param [in] readOnly Is file read-only?
  * @param [in] encoding File's encoding.
+ * @param [out] sOpenError Error message when the file could not be opened.
  * @return One of FileLoadResult values.
  */
 DWORD CMergeDoc::LoadOneFile(int index, String filename, bool readOnly, const String& strDesc, 
-		const FileTextEncoding & encoding)
+		const FileTextEncoding & encoding, CString & sOpenError)
 {
 	DWORD loadSuccess = FileLoadResult::FRESULT_ERROR;;
 	
@@ -2550,12 +2759,12 @@ DWORD CMergeDoc::LoadOneFile(int index, String filename, bool readOnly, const St
 		m_pSaveFileInfo[index]->Update(filename);
 		m_pRescanFileInfo[index]->Update(filename);
 
-		loadSuccess = LoadFile(filename.c_str(), index, readOnly, encoding);
+		loadSuccess = LoadFile(filename.c_str(), index, readOnly, encoding, sOpenError);
 		if (FileLoadResult::IsLossy(loadSuccess))
 		{
 			m_ptBuf[index]->FreeAll();
 			loadSuccess = LoadFile(filename.c_str(), index, readOnly,
-				GuessCodepageEncoding(filename, GetOptionsMgr()->GetInt(OPT_CP_DETECT), -1));
+				GuessCodepageEncoding(filename, GetOptionsMgr()->GetInt(OPT_CP_DETECT), -1), sOpenError);
 		}
 	}
 	else
@@ -2569,6 +2778,18 @@ DWORD CMergeDoc::LoadOneFile(int index, String filename, bool readOnly, const St
 	return loadSuccess;
 }
 
+/**
+ * @brief Can the files be loaded on several threads at once?
+ * Unpacker plugins are scripts run one at a time, and the unpacker is
+ * shared by all files, so files are loaded concurrently only when no
+ * unpacker has to be found or run.
+ */
+bool CMergeDoc::CanLoadConcurrently() const
+{
+	return m_pInfoUnpacker->m_PluginOrPredifferMode == PLUGIN_MANUAL &&
+		m_pInfoUnpacker->m_PluginName.empty() && m_pInfoUnpacker->m_pufile == nullptr;
+}
+
 /**
  * @brief Loads files and does initial rescan.
  * @param fileloc [in] File to open to left/middle/right side (path & encoding info)
@@ -2614,13 +2835,42 @@ bool CMergeDoc::OpenDocs(int nFiles, const FileLocation ifileloc[],
 	}
 	m_strBothFilenames.erase(m_strBothFilenames.length() - 1);
 
-	// Load files
+	// Load files, all panes at once when possible: the views are
+	// detached, so each load only touches its own buffer
 	DWORD nSuccess[3];
+	CString sOpenError[3];
+	std::exception_ptr loadException[3];
+	std::vector<std::function<void()>> loads;
 	for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
 	{
-		nSuccess[nBuffer] = LoadOneFile(nBuffer, fileloc[nBuffer].filepath, bRO[nBuffer], strDesc ? strDesc[nBuffer] : _T(""),
-			fileloc[nBuffer].encoding);
+		nSuccess[nBuffer] = FileLoadResult::FRESULT_ERROR;
+		loads.push_back([&, nBuffer]()
+		{
+			try
+			{
+				nSuccess[nBuffer] = LoadOneFile(nBuffer, fileloc[nBuffer].filepath, bRO[nBuffer], strDesc ? strDesc[nBuffer] : _T(""),
+					fileloc[nBuffer].encoding, sOpenError[nBuffer]);
+			}
+			catch (...)
+			{
+				loadException[nBuffer] = std::current_exception();
+			}
+		});
 	}
+	if (CanLoadConcurrently())
+		RunConcurrently(loads);
+	else
+	{
+		for (const auto& load : loads)
+			load();
+	}
+	for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
+	{
+		if (loadException[nBuffer])
+			std::rethrow_exception(loadException[nBuffer]);
+	}
+	for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
+		ShowLoadError(nBuffer, nSuccess[nBuffer], sOpenError[nBuffer]);
 	const bool bFiltersEnabled = GetOptionsMgr()->GetBool(OPT_PLUGINS_ENABLED);
 
 	// scratchpad : we don't call LoadFile, so
@@ -3049,6 +3299,7 @@ void CMergeDoc::SwapFiles()
 
 	m_filePaths.Swap();
 	m_diffList.Swap(0, m_nBuffers - 1);
+	m_sRescanKey.clear();
 	for (int nGroup = 0; nGroup < m_nGroups; nGroup++)
 		swap(m_pView[nGroup][0]->m_piMergeEditStatus, m_pView[nGroup][m_nBuffers - 1]->m_piMergeEditStatus);
 
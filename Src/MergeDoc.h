@@ -134,6 +134,7 @@ class CChildFrame;
 class CDirDoc;
 class CEncodingErrorBar;
 class CLocationView;
+class LineAligner;
 
 /**
  * @brief Document class for merging two files
@@ -180,7 +181,8 @@ public:
 	void UpdateResources();
 	bool OpenDocs(int nFiles, const FileLocation fileloc[],
 		const bool bRO[], const String strDesc[]);
-	int LoadFile(CString sFileName, int nBuffer, bool & readOnly, const FileTextEncoding & encoding);
+	int LoadFile(CString sFileName, int nBuffer, bool & readOnly, const FileTextEncoding & encoding, CString & sOpenError);
+	void ShowLoadError(int nBuffer, DWORD retVal, const CString & sOpenError);
 	void MoveOnLoad(int nPane = -1, int nLinIndex = -1);
 	void ChangeFile(int nBuffer, const String& path);
 	void RescanIfNeeded(float timeOutInSecond);
@@ -328,7 +330,8 @@ private:
 	bool GetByteColoringOption() const;
 	bool IsValidCodepageForMergeEditor(unsigned cp) const;
 	void SanityCheckCodepage(FileLocation & fileinfo);
-	DWORD LoadOneFile(int index, String filename, bool readOnly, const String& strDesc, const FileTextEncoding & encoding);
+	DWORD LoadOneFile(int index, String filename, bool readOnly, const String& strDesc, const FileTextEncoding & encoding, CString & sOpenError);
+	bool CanLoadConcurrently() const;
 
 // Implementation data
 protected:
@@ -350,6 +353,8 @@ protected:
 	std::unique_ptr<CEncodingErrorBar> m_pEncodingErrorBar;
 	bool m_bHasSyncPoints;
 	bool m_bAutoMerged;
+	DiffList m_diffListRescan; /**< Diffs of last rescan as diffutils gave them, for incremental rescan */
+	String m_sRescanKey; /**< Options of last rescan, empty if next rescan must diff whole files */
 // friend access
 	friend class RescanSuppress;
 
@@ -383,11 +388,12 @@ protected:
 	//}}AFX_MSG
 	DECLARE_MESSAGE_MAP()
 private:
+	String GetRescanKey() const;
+	bool RescanEditedLines(DIFFSTATUS &status);
 	void PrimeTextBuffers();
 	void HideLines();
 	void AdjustDiffBlocks();
-	void AdjustDiffBlock(DiffMap & diffmap, const DIFFRANGE & diffrange, int lo0, int hi0, int lo1, int hi1);
-	int GetMatchCost(const String &Line0, const String &Line1);
+	void AdjustDiffBlock(DiffMap & diffmap, const DIFFRANGE & diffrange, const LineAligner & aligner);
 	void FlagTrivialLines();
 	void FlagMovedLines();
 	String GetFileExt(LPCTSTR sFileName, LPCTSTR sDescription) const;
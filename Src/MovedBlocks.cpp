@@ -21,70 +21,89 @@
  */
 
 #include "pch.h"
-#include <map>
+#include <vector>
+#include <cstdint>
 #include <cassert>
 #include "diff.h"
 
-class IntSet
-{
-public:
-	void Add(int val) { m_map[val] = 1; }
-	void Remove(int val) { m_map.erase(val); }
-	size_t count() const { return m_map.size(); }
-	bool isPresent(int val) const { return m_map.find(val) != m_map.end(); }
-	int getSingle() const { return m_map.begin()->first; }
-private:
-	std::map<int, int> m_map;
-};
-
 /** 
- * @brief  Set of equivalent lines
+ * @brief  Equivalency groups of the altered lines
+ * Open addressing hash table keyed by equivalency code, sized from the
+ * number of altered lines. A group only counts its lines on each side and
+ * keeps the first of them, which is all a perfect match needs.
  * This uses diffutils line numbers, which are counted from the prefix
  */
-struct EqGroup
+class EqGroupTable
 {
-	IntSet m_lines0; // equivalent lines on side#0
-	IntSet m_lines1; // equivalent lines on side#1
+public:
+	struct EqGroup
+	{
+		int eqcode;
+		int count0; // number of equivalent lines on side#0
+		int count1; // number of equivalent lines on side#1
+		int line0; // first equivalent line on side#0
+		int line1; // first equivalent line on side#1
 
-	bool isPerfectMatch() const { return m_lines0.count()==1 && m_lines1.count()==1; }
-};
+		bool isPerfectMatch() const { return count0==1 && count1==1; }
+	};
 
+	explicit EqGroupTable(int lines)
+	{
+		m_bits = 4;
+		while ((1 << m_bits) < 2 * lines)
+			++m_bits;
+		EqGroup empty = { EmptyCode, 0, 0, -1, -1 };
+		m_groups.assign(static_cast<size_t>(1) << m_bits, empty);
+	}
 
-/** @brief  Maps equivalency code to equivalency group */
-class CodeToGroupMap
-{
-public:
-	std::map<int, EqGroup *> m_map;
 	/** @brief Add a line to the appropriate equivalency group */
 	void Add(int lineno, int eqcode, int nside)
 	{
-		EqGroup *pgroup = find(eqcode);
-		if (pgroup == nullptr)
+		EqGroup &group = m_groups[index(eqcode)];
+		group.eqcode = eqcode;
+		if (nside)
 		{
-			pgroup = new EqGroup;
-			m_map[eqcode] = pgroup;
+			if (group.count1++ == 0 || lineno < group.line1)
+				group.line1 = lineno;
 		}
-		if (nside)
-			pgroup->m_lines1.Add(lineno);
 		else
-			pgroup->m_lines0.Add(lineno);
+		{
+			if (group.count0++ == 0 || lineno < group.line0)
+				group.line0 = lineno;
+		}
 	}
 
 	/** @brief Return the appropriate equivalency group */
-	EqGroup * find(int eqcode)
+	const EqGroup * find(int eqcode) const
 	{
-		std::map<int, EqGroup *>::const_iterator it = m_map.find(eqcode);
-		return it != m_map.end() ? it->second : nullptr;
+		const EqGroup &group = m_groups[index(eqcode)];
+		return group.eqcode == eqcode ? &group : nullptr;
 	}
 
-	~CodeToGroupMap()
+private:
+	enum { EmptyCode = -1 };
+
+	/** @brief Slot of the group of @p eqcode, or the empty slot to put it in */
+	size_t index(int eqcode) const
 	{
-		std::map<int, EqGroup *>::const_iterator pos = m_map.begin();
-		while (pos != m_map.end())
-			delete pos++->second;
+		const size_t mask = m_groups.size() - 1;
+		size_t i = (static_cast<uint32_t>(eqcode) * 2654435769u) >> (32 - m_bits);
+		while (m_groups[i].eqcode != eqcode && m_groups[i].eqcode != EmptyCode)
+			i = (i + 1) & mask;
+		return i;
 	}
+
+	std::vector<EqGroup> m_groups;
+	int m_bits; /**< log2 of the table size, kept at most half full */
 };
 
+/** @brief Are line @p i of side#0 and line @p j of side#1 equivalent? */
+static inline bool isSameLine(const struct file_data fd[], int i, int j)
+{
+	return i >= 0 && j >= 0 && i < fd[0].buffered_lines && j < fd[1].buffered_lines
+		&& fd[0].equivs[i] == fd[1].equivs[j];
+}
+
 /*
  WinMerge moved block code
  This is called by diffutils code, by diff_2_files routine (in ANALYZE.C)
@@ -97,11 +116,15 @@ public:
 */
 extern "C" void moved_block_analysis(struct change ** pscript, struct file_data fd[])
 {
-	// Hash all altered lines
-	CodeToGroupMap map;
-
 	struct change * script = *pscript;
 	struct change *p,*e;
+
+	// Hash all altered lines
+	int altered = 0;
+	for (e = script; e; e = e->link)
+		altered += e->deleted + e->inserted;
+	EqGroupTable map(altered);
+
 	for (e = script; e; e = p)
 	{
 		p = e->link;
@@ -120,11 +143,11 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 	{
 		// scan down block for a match
 		p = e->link;
-		EqGroup * pgroup = nullptr;
+		const EqGroupTable::EqGroup * pgroup = nullptr;
 		int i=0;
 		for (i=e->line0; i-(e->line0) < (e->deleted); ++i)
 		{
-			EqGroup * tempgroup = map.find(fd[0].equivs[i]);
+			const EqGroupTable::EqGroup * tempgroup = map.find(fd[0].equivs[i]);
 			if (tempgroup->isPerfectMatch())
 			{
 				pgroup = tempgroup;
@@ -137,7 +160,7 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 			continue;
 
 		// found a match
-		int j = pgroup->m_lines1.getSingle();
+		int j = pgroup->line1;
 		// Ok, now our moved block is the single line i,j
 
 		// extend moved block upward as far as possible
@@ -145,12 +168,8 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 		int j1 = j-1;
 		for ( ; i1>=e->line0; --i1, --j1)
 		{
-			EqGroup * pgroup0 = map.find(fd[0].equivs[i1]);
-			EqGroup * pgroup1 = map.find(fd[1].equivs[j1]);
-			if (pgroup0 != pgroup1)
+			if (!isSameLine(fd, i1, j1))
 				break;
-//			pgroup0->m_lines0.Remove(i1); // commented out this line although I'm not sure what this line means because this line causes the bug sf.net#2174
-//			pgroup1->m_lines1.Remove(j1);
 		}
 		++i1;
 		++j1;
@@ -161,12 +180,8 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 		int j2 = j+1;
 		for ( ; i2-(e->line0) < (e->deleted); ++i2,++j2)
 		{
-			EqGroup * pgroup0 = map.find(fd[0].equivs[i2]);
-			EqGroup * pgroup1 = map.find(fd[1].equivs[j2]);
-			if (pgroup0 != pgroup1)
+			if (!isSameLine(fd, i2, j2))
 				break;
-//			pgroup0->m_lines0.Remove(i2); // commented out this line although I'm not sure what this line means because this line causes the bug sf.net#2174
-//			pgroup1->m_lines1.Remove(j2);
 		}
 		--i2;
 		--j2;
@@ -238,11 +253,11 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 	{
 		// scan down block for a match
 		p = e->link;
-		EqGroup * pgroup = nullptr;
+		const EqGroupTable::EqGroup * pgroup = nullptr;
 		int j=0;
 		for (j=e->line1; j-(e->line1) < (e->inserted); ++j)
 		{
-			EqGroup * tempgroup = map.find(fd[1].equivs[j]);
+			const EqGroupTable::EqGroup * tempgroup = map.find(fd[1].equivs[j]);
 			if (tempgroup->isPerfectMatch())
 			{
 				pgroup = tempgroup;
@@ -255,7 +270,7 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 			continue;
 
 		// found a match
-		int i = pgroup->m_lines0.getSingle();
+		int i = pgroup->line0;
 		// Ok, now our moved block is the single line i,j
 
 		// extend moved block upward as far as possible
@@ -263,12 +278,8 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 		int j1 = j-1;
 		for ( ; j1>=e->line1; --i1, --j1)
 		{
-			EqGroup * pgroup0 = map.find(fd[0].equivs[i1]);
-			EqGroup * pgroup1 = map.find(fd[1].equivs[j1]);
-			if (pgroup0 != pgroup1)
+			if (!isSameLine(fd, i1, j1))
 				break;
-//			pgroup0->m_lines0.Remove(i1); // commented out this line although I'm not sure what this line means because this line causes the bug sf.net#2174
-//			pgroup1->m_lines1.Remove(j1);
 		}
 		++i1;
 		++j1;
@@ -279,12 +290,8 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 		int j2 = j+1;
 		for ( ; j2-(e->line1) < (e->inserted); ++i2,++j2)
 		{
-			EqGroup * pgroup0 = map.find(fd[0].equivs[i2]);
-			EqGroup * pgroup1 = map.find(fd[1].equivs[j2]);
-			if (pgroup0 != pgroup1)
+			if (!isSameLine(fd, i2, j2))
 				break;
-//			pgroup0->m_lines0.Remove(i2); // commented out this line although I'm not sure what this line means because this line causes the bug sf.net#2174
-//			pgroup1->m_lines1.Remove(j2);
 		}
 		--i2;
 		--j2;
@@ -6,6 +6,7 @@
 
 #include "pch.h"
 #include "MovedLines.h"
+#include <algorithm>
 
 /**
  * @brief clear the lists of moved blocks.
@@ -18,56 +19,78 @@ void MovedLines::Clear()
 
 /**
  * @brief Add moved block to the list.
+ * Lines are usually added in increasing order, extending the last block
+ * or starting a new one. A line added out of order is inserted at its
+ * place, replacing any earlier mapping of the same line.
  * @param [in] side1 First side we are mapping.
  * @param [in] line1 Linenumber in side first side.
  * @param [in] line2 Linenumber in second side.
  */
 void MovedLines::Add(ML_SIDE side1, unsigned line1,	unsigned line2)
 {
-	MovedLinesMap *list;
-	if (side1 == SIDE_LEFT)
-		list = &m_moved0;
-	else
-		list = &m_moved1;
+	MovedBlocks& list = side1 == SIDE_LEFT ? m_moved0 : m_moved1;
+	const int line = static_cast<int>(line1);
+	const int target = static_cast<int>(line2);
 
-	(*list)[line1] = line2;
+	if (!list.empty() && list.back().end == line &&
+		list.back().target + (line - list.back().begin) == target)
+	{
+		++list.back().end;
+		return;
+	}
+	if (list.empty() || list.back().end <= line)
+	{
+		list.push_back({ line, line + 1, target });
+		return;
+	}
+
+	// Out of order: split the block holding the line, if any
+	auto it = std::upper_bound(list.begin(), list.end(), line,
+		[](int l, const MovedBlock& block) { return l < block.begin; });
+	if (it != list.begin() && (it - 1)->end > line)
+	{
+		MovedBlock before = *(it - 1);
+		MovedBlock after = { line + 1, before.end, before.target + (line + 1 - before.begin) };
+		before.end = line;
+		it = list.erase(it - 1);
+		if (after.begin < after.end)
+			it = list.insert(it, after);
+		if (before.begin < before.end)
+			it = list.insert(it, before) + 1;
+	}
+	list.insert(it, { line, line + 1, target });
 }
 
 /**
  * @brief Check if line is in moved block.
  * @param [in] line Linenumber to check.
  * @param [in] side Side of the linenumber.
+ * @return Linenumber on the other side, -1 if line is not moved.
  */
 int MovedLines::LineInBlock(unsigned line, ML_SIDE side) const
 {
-	if (side == SIDE_LEFT)
-		return SecondSideInMovedBlock(line);
-	else
-		return FirstSideInMovedBlock(line);
+	return FindLine(GetBlocks(side), static_cast<int>(line));
 }
 
 /**
- * @brief Get right->left info for a moved line (real line number)
+ * @brief Get the moved blocks LineInBlock() looks up for a side.
+ * @param [in] side Side of the linenumbers.
+ * @return Moved blocks sorted by first line.
  */
-int MovedLines::FirstSideInMovedBlock(unsigned secondSideLine) const
+const MovedLines::MovedBlocks& MovedLines::GetBlocks(ML_SIDE side) const
 {
-	MovedLinesMap::const_iterator iter;
-	iter = m_moved1.find(secondSideLine);
-	if (iter != m_moved1.end())
-		return iter->second;
-	else
-		return -1;
+	return side == SIDE_LEFT ? m_moved0 : m_moved1;
 }
 
 /**
- * @brief Get left->right info for a moved line (real line number)
+ * @brief Get the line a line is moved to, by binary search of the blocks.
  */
-int MovedLines::SecondSideInMovedBlock(unsigned firstSideLine) const
+int MovedLines::FindLine(const MovedBlocks& blocks, int line)
 {
-	MovedLinesMap::const_iterator iter;
-	iter = m_moved0.find(firstSideLine);
-	if (iter != m_moved0.end())
-		return iter->second;
-	else
+	auto it = std::upper_bound(blocks.begin(), blocks.end(), line,
+		[](int l, const MovedBlock& block) { return l < block.begin; });
+	if (it == blocks.begin() || (it - 1)->end <= line)
 		return -1;
+	--it;
+	return it->target + (line - it->begin);
 }
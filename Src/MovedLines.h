@@ -5,12 +5,16 @@
  */
 #pragma once
 
-#include <map>
+#include <vector>
 
 /**
  * @brief Container class for moved lines/blocks.
  * This class contains list of moved blocs/lines we detect
  * when comparing files.
+ *
+ * Moved lines are kept as runs of consecutive lines moved to consecutive
+ * lines of the other side, sorted by line number, so a line is looked up
+ * by binary search among the moved blocks rather than among all lines.
  */
 class MovedLines
 {
@@ -22,16 +26,23 @@ public:
 		SIDE_RIGHT,
 	};
 
+	/** @brief Run of lines [begin, end) moved to lines starting at target. */
+	struct MovedBlock
+	{
+		int begin;
+		int end;
+		int target;
+	};
+	typedef std::vector<MovedBlock> MovedBlocks;
+
 	void Clear();
 	void Add(ML_SIDE side1, unsigned line1, unsigned line2);
 	int LineInBlock(unsigned line, ML_SIDE side) const;
-
-protected:
-	int FirstSideInMovedBlock(unsigned secondSideLine) const;
-	int SecondSideInMovedBlock(unsigned firstSideLine) const;
+	const MovedBlocks& GetBlocks(ML_SIDE side) const;
 
 private:
-	typedef std::map<int, int> MovedLinesMap;
-	MovedLinesMap m_moved0; /**< Moved lines map for first side */
-	MovedLinesMap m_moved1; /**< Moved lines map for second side */
+	static int FindLine(const MovedBlocks& blocks, int line);
+
+	MovedBlocks m_moved0; /**< Moved blocks for first side */
+	MovedBlocks m_moved1; /**< Moved blocks for second side */
 };
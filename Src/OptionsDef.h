@@ -163,6 +163,7 @@ extern const String OPT_CMP_IGNORE_BLANKLINES OP("Settings/IgnoreBlankLines");
 extern const String OPT_CMP_FILTER_COMMENTLINES OP("Settings/FilterCommentsLines");
 extern const String OPT_CMP_IGNORE_CASE OP("Settings/IgnoreCase");
 extern const String OPT_CMP_IGNORE_EOL OP("Settings/IgnoreEol");
+extern const String OPT_CMP_DIFF_ALGORITHM OP("Settings/DiffAlgorithm");
 extern const String OPT_CMP_IGNORE_CODEPAGE OP("Settings/IgnoreCodepage");
 extern const String OPT_CMP_METHOD OP("Settings/CompMethod2");
 extern const String OPT_CMP_MOVED_BLOCKS OP("Settings/MovedBlocks");
@@ -170,6 +171,9 @@ extern const String OPT_CMP_MATCH_SIMILAR_LINES OP("Settings/MatchSimilarLines")
 extern const String OPT_CMP_STOP_AFTER_FIRST OP("Settings/StopAfterFirst");
 extern const String OPT_CMP_QUICK_LIMIT OP("Settings/QuickMethodLimit");
 extern const String OPT_CMP_COMPARE_THREADS OP("Settings/CompareThreads");
+extern const String OPT_CMP_COLLECT_THREADS OP("Settings/CollectThreads");
+extern const String OPT_CMP_RESULT_CACHE OP("Settings/CompareResultCache");
+extern const String OPT_CMP_PREFILTER OP("Settings/ComparePrefilter");
 extern const String OPT_CMP_WALK_UNIQUE_DIRS OP("Settings/ScanUnpairedDir");
 extern const String OPT_CMP_IGNORE_REPARSE_POINTS OP("Settings/IgnoreReparsePoints");
 extern const String OPT_CMP_INCLUDE_SUBDIRS OP("Settings/Recurse");
@@ -21,6 +21,7 @@ void SetDefaults(COptionsMgr *pOptionsMgr)
 	pOptionsMgr->InitOption(OPT_CMP_FILTER_COMMENTLINES, false);
 	pOptionsMgr->InitOption(OPT_CMP_IGNORE_CASE, false);
 	pOptionsMgr->InitOption(OPT_CMP_IGNORE_EOL, false);
+	pOptionsMgr->InitOption(OPT_CMP_DIFF_ALGORITHM, (int)DIFF_ALGORITHM_DEFAULT);
 }
 
 void Load(const COptionsMgr *pOptionsMgr, DIFFOPTIONS& options)
@@ -30,6 +31,7 @@ void Load(const COptionsMgr *pOptionsMgr, DIFFOPTIONS& options)
 	options.bFilterCommentsLines = pOptionsMgr->GetBool(OPT_CMP_FILTER_COMMENTLINES);
 	options.bIgnoreCase = pOptionsMgr->GetBool(OPT_CMP_IGNORE_CASE);
 	options.bIgnoreEol = pOptionsMgr->GetBool(OPT_CMP_IGNORE_EOL);
+	options.nDiffAlgorithm = pOptionsMgr->GetInt(OPT_CMP_DIFF_ALGORITHM);
 }
 
 void Save(COptionsMgr *pOptionsMgr, const DIFFOPTIONS& options)
@@ -39,6 +41,7 @@ void Save(COptionsMgr *pOptionsMgr, const DIFFOPTIONS& options)
 	pOptionsMgr->SaveOption(OPT_CMP_FILTER_COMMENTLINES, options.bFilterCommentsLines);
 	pOptionsMgr->SaveOption(OPT_CMP_IGNORE_CASE, options.bIgnoreCase);
 	pOptionsMgr->SaveOption(OPT_CMP_IGNORE_EOL, options.bIgnoreEol);
+	pOptionsMgr->SaveOption(OPT_CMP_DIFF_ALGORITHM, options.nDiffAlgorithm);
 }
 
 }
@@ -0,0 +1,188 @@
+/**
+ * @file  ParallelDiff.cpp
+ *
+ * @brief Running parts of a compare on several threads.
+ */
+
+#include "pch.h"
+#include "ParallelDiff.h"
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <vector>
+#define POCO_NO_UNWINDOWS 1
+#include <Poco/ThreadPool.h>
+#include <Poco/Runnable.h>
+#include <Poco/AtomicCounter.h>
+#include "diff.h"
+
+using Poco::ThreadPool;
+using Poco::Runnable;
+using Poco::AtomicCounter;
+
+namespace
+{
+
+/**
+ * @brief Runnable keeping the exception its job threw.
+ * Poco's ErrorHandler would swallow it on a pool thread, so it is kept for
+ * the calling thread to rethrow once all threads have been joined.
+ */
+class ThreadJob : public Runnable
+{
+public:
+	void run()
+	{
+		try
+		{
+			work();
+		}
+		catch (...)
+		{
+			m_exception = std::current_exception();
+			stop();
+		}
+	}
+	/** @brief Rethrow the exception thrown by the job, if any. */
+	void rethrow() const
+	{
+		if (m_exception)
+			std::rethrow_exception(m_exception);
+	}
+	/** @brief Do the work on the calling thread, letting exceptions through. */
+	virtual void work() = 0;
+protected:
+	/** @brief Called after the job threw, to end the other jobs early. */
+	virtual void stop() {}
+private:
+	std::exception_ptr m_exception;
+};
+
+/**
+ * @brief Runs jobs until all have been taken.
+ * Workers take the next job index from a shared counter, so a worker
+ * finishing a small segment early goes on with the next one.
+ */
+class SegmentWorker : public ThreadJob
+{
+public:
+	SegmentWorker(AtomicCounter &next, int count, void (*job)(void *, int), void *arg)
+		: m_next(next), m_count(count), m_job(job), m_arg(arg) {}
+	void work()
+	{
+		for (int i = ++m_next - 1; i < m_count; i = ++m_next - 1)
+			m_job(m_arg, i);
+	}
+protected:
+	void stop() { m_next = m_count; }
+private:
+	AtomicCounter &m_next;
+	int m_count;
+	void (*m_job)(void *, int);
+	void *m_arg;
+};
+
+/** @brief Runs one job of RunConcurrently(). */
+class JobRunner : public ThreadJob
+{
+public:
+	explicit JobRunner(const std::function<void()> &job) : m_job(job) {}
+	void work() { m_job(); }
+private:
+	const std::function<void()> &m_job;
+};
+
+/**
+ * @brief Waits for all threads of a pool when leaving a scope.
+ * The jobs on the threads use objects of the scope, which must outlive
+ * them also when the job of the calling thread throws.
+ */
+class JoinAllGuard
+{
+public:
+	explicit JoinAllGuard(ThreadPool &threadPool) : m_threadPool(threadPool) {}
+	~JoinAllGuard() { m_threadPool.joinAll(); }
+private:
+	JoinAllGuard(const JoinAllGuard &) = delete;
+	JoinAllGuard & operator=(const JoinAllGuard &) = delete;
+	ThreadPool &m_threadPool;
+};
+
+/** @brief Rethrow the first exception thrown by a job on a pool thread. */
+template <class Job>
+void RethrowFirst(const std::vector<std::unique_ptr<Job>> &jobs)
+{
+	for (const auto &job : jobs)
+		job->rethrow();
+}
+
+}
+
+/**
+ * @brief Run @p job for indexes 0 to @p count - 1 on up to @p threads threads.
+ * This is called by diffutils code, by compareseq_segmented (in ANALYZE.C).
+ * The calling thread runs jobs too, and returns when all are done. An
+ * exception thrown by a job is rethrown on the calling thread.
+ */
+extern "C" void parallel_for(int count, int threads, void (*job)(void *, int), void *arg)
+{
+	AtomicCounter next(0);
+	const int nworkers = (std::min)(threads, count) - 1;
+	if (nworkers <= 0)
+	{
+		SegmentWorker(next, count, job, arg).work();
+		return;
+	}
+
+	std::vector<std::unique_ptr<SegmentWorker>> workers;
+	for (int i = 0; i < nworkers; ++i)
+		workers.emplace_back(new SegmentWorker(next, count, job, arg));
+	ThreadPool threadPool(nworkers, nworkers);
+	{
+		JoinAllGuard joinAll(threadPool);
+		for (auto &worker : workers)
+			threadPool.start(*worker);
+		SegmentWorker self(next, count, job, arg);
+		try
+		{
+			self.work();
+		}
+		catch (...)
+		{
+			next = count;
+			throw;
+		}
+	}
+	RethrowFirst(workers);
+}
+
+/**
+ * @brief Run @p jobs concurrently and wait for all of them.
+ * The last job runs on the calling thread, so thread-local state it
+ * leaves, like diffutils options and globals, is the same as if the
+ * jobs were run one after another. An exception thrown by a job is
+ * rethrown on the calling thread.
+ */
+void RunConcurrently(const std::vector<std::function<void()>> &jobs)
+{
+	if (jobs.empty())
+		return;
+	const int nworkers = static_cast<int>(jobs.size()) - 1;
+	if (nworkers == 0)
+	{
+		jobs[0]();
+		return;
+	}
+
+	std::vector<std::unique_ptr<JobRunner>> runners;
+	for (int i = 0; i < nworkers; ++i)
+		runners.emplace_back(new JobRunner(jobs[i]));
+	ThreadPool threadPool(nworkers, nworkers);
+	{
+		JoinAllGuard joinAll(threadPool);
+		for (auto &runner : runners)
+			threadPool.start(*runner);
+		jobs.back()();
+	}
+	RethrowFirst(runners);
+}
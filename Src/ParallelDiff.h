@@ -0,0 +1,12 @@
+/** 
+ * @file  ParallelDiff.h
+ *
+ * @brief Running parts of a compare on several threads.
+ */
+#pragma once
+
+#include <functional>
+#include <vector>
+
+extern "C" void parallel_for(int count, int threads, void (*job)(void *, int), void *arg);
+void RunConcurrently(const std::vector<std::function<void()>> &jobs);
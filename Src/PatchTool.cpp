@@ -28,6 +28,8 @@
 #include "PatchDlg.h"
 #include "paths.h"
 #include "Merge.h"
+#include "OptionsDef.h"
+#include "OptionsMgr.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -213,6 +215,7 @@ bool CPatchTool::ShowDialog(CPatchDlg *pDlgPatch)
 		diffOptions.bIgnoreEol = pDlgPatch->m_ignoreEOLDifference;
 		
 		diffOptions.bIgnoreCase = !pDlgPatch->m_caseSensitive;
+		diffOptions.nDiffAlgorithm = GetOptionsMgr()->GetInt(OPT_CMP_DIFF_ALGORITHM);
 		m_diffWrapper.SetOptions(&diffOptions);
 	}
 	else
@@ -28,6 +28,7 @@ PropCompare::PropCompare(COptionsMgr *optionsMgr)
  , m_bMovedBlocks(false)
  , m_bMatchSimilarLines(false)
  , m_bFilterCommentsLines(false)
+ , m_nDiffAlgorithm(0)
 {
 }
 
@@ -43,6 +44,7 @@ void PropCompare::DoDataExchange(CDataExchange* pDX)
 	DDX_Radio(pDX, IDC_WHITESPACE, m_nIgnoreWhite);
 	DDX_Check(pDX, IDC_MOVED_BLOCKS, m_bMovedBlocks);
 	DDX_Check(pDX, IDC_MATCH_SIMILAR_LINES, m_bMatchSimilarLines);
+	DDX_CBIndex(pDX, IDC_DIFF_ALGORITHM, m_nDiffAlgorithm);
 	//}}AFX_DATA_MAP
 }
 
@@ -68,6 +70,7 @@ void PropCompare::ReadOptions()
 	m_bIgnoreCodepage = GetOptionsMgr()->GetBool(OPT_CMP_IGNORE_CODEPAGE);
 	m_bMovedBlocks = GetOptionsMgr()->GetBool(OPT_CMP_MOVED_BLOCKS);
 	m_bMatchSimilarLines = GetOptionsMgr()->GetBool(OPT_CMP_MATCH_SIMILAR_LINES);
+	m_nDiffAlgorithm = GetOptionsMgr()->GetInt(OPT_CMP_DIFF_ALGORITHM);
 }
 
 /** 
@@ -85,6 +88,30 @@ void PropCompare::WriteOptions()
 	GetOptionsMgr()->SaveOption(OPT_CMP_IGNORE_CASE, m_bIgnoreCase);
 	GetOptionsMgr()->SaveOption(OPT_CMP_MOVED_BLOCKS, m_bMovedBlocks);
 	GetOptionsMgr()->SaveOption(OPT_CMP_MATCH_SIMILAR_LINES, m_bMatchSimilarLines);
+	GetOptionsMgr()->SaveOption(OPT_CMP_DIFF_ALGORITHM, m_nDiffAlgorithm);
+}
+
+/** 
+ * @brief Called before propertysheet is drawn.
+ */
+BOOL PropCompare::OnInitDialog()
+{
+	OptionsPanel::OnInitDialog();
+	CComboBox * combo = (CComboBox*) GetDlgItem(IDC_DIFF_ALGORITHM);
+
+	// Same order as enum DiffAlgorithm
+	String item = _("Default");
+	combo->AddString(item.c_str());
+	item = _("Minimal");
+	combo->AddString(item.c_str());
+	item = _("Patience");
+	combo->AddString(item.c_str());
+	item = _("Histogram");
+	combo->AddString(item.c_str());
+	combo->SetCurSel(m_nDiffAlgorithm);
+
+	return TRUE;  // return TRUE unless you set the focus to a control
+	              // EXCEPTION: OCX Property Pages should return FALSE
 }
 
 /** 
@@ -100,5 +127,6 @@ void PropCompare::OnDefaults()
 	m_bIgnoreCase = GetOptionsMgr()->GetDefault<bool>(OPT_CMP_IGNORE_CASE);
 	m_bMovedBlocks = GetOptionsMgr()->GetDefault<bool>(OPT_CMP_MOVED_BLOCKS);
 	m_bMatchSimilarLines = GetOptionsMgr()->GetDefault<bool>(OPT_CMP_MATCH_SIMILAR_LINES);
+	m_nDiffAlgorithm = GetOptionsMgr()->GetDefault<unsigned>(OPT_CMP_DIFF_ALGORITHM);
 	UpdateData(FALSE);
 }
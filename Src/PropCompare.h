@@ -16,6 +16,8 @@ class COptionsMgr;
  *  - Compare all whitespaces, recommended for merging!
  *  - Ignore changes in whitespaces (amount of spaces etc)
  *  - Ignore all whitespace characters
+ *
+ * Diff algorithm: how lines of the files are aligned, see DiffAlgorithm.
  */
 class PropCompare : public OptionsPanel
 {
@@ -38,6 +40,7 @@ public:
 	bool    m_bMovedBlocks;
 	bool    m_bMatchSimilarLines;
 	bool    m_bFilterCommentsLines;
+	int     m_nDiffAlgorithm;
 	//}}AFX_DATA
 
 
@@ -52,6 +55,7 @@ public:
 protected:
 	// Generated message map functions
 	//{{AFX_MSG(PropCompare)
+	afx_msg BOOL OnInitDialog();
 	afx_msg void OnDefaults();
 	//}}AFX_MSG
 	DECLARE_MESSAGE_MAP()
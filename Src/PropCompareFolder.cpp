@@ -119,6 +119,8 @@ BOOL PropCompareFolder::OnInitDialog()
 	combo->AddString(item.c_str());
 	item = _("Size");
 	combo->AddString(item.c_str());
+	item = _("Content Hash");
+	combo->AddString(item.c_str());
 	combo->SetCurSel(m_compareMethod);
 
 	return TRUE;  // return TRUE unless you set the focus to a control
@@ -161,5 +163,5 @@ void PropCompareFolder::UpdateControls()
 	CComboBox * pCombo = (CComboBox*)GetDlgItem(IDC_COMPAREMETHODCOMBO);
 	EnableDlgItem(IDC_COMPARE_STOPFIRST, pCombo->GetCurSel() == 1);
 	EnableDlgItem(IDC_EXPAND_SUBDIRS, IsDlgButtonChecked(IDC_RECURS_CHECK) == 1);
-	EnableDlgItem(IDC_COMPARE_THREAD_COUNT, pCombo->GetCurSel() <= 1 ? true : false); // true: fullcontent, quickcontent
+	EnableDlgItem(IDC_COMPARE_THREAD_COUNT, (pCombo->GetCurSel() <= 1 || pCombo->GetCurSel() == 6) ? true : false); // true: fullcontent, quickcontent, contenthash
 }
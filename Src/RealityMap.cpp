@@ -0,0 +1,337 @@
+/**
+ * @file  RealityMap.cpp
+ *
+ * @brief Implementation of RealityMap class.
+ */
+
+#include "pch.h"
+#include "RealityMap.h"
+#include <cassert>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+/**
+ * @brief A run of ghost or real lines, and the subtree it is the root of.
+ * Runs in the left subtree come before the run, the ones in the right
+ * subtree after it. Priorities are random, and not more than the priority
+ * of the parent, which keeps the tree balanced.
+ */
+struct RealityMap::Node
+{
+	int nLines; /**< Lines of the run. */
+	bool bGhost; /**< Are the lines ghost lines? */
+	unsigned nPriority; /**< Random priority. */
+	int nTotalLines; /**< Lines in the subtree. */
+	int nTotalReal; /**< Real lines in the subtree. */
+	std::unique_ptr<Node> pLeft; /**< Runs before this one. */
+	std::unique_ptr<Node> pRight; /**< Runs after this one. */
+
+	/** @brief Update the counts of the subtree after its children changed. */
+	void Update()
+	{
+		nTotalLines = nLines;
+		nTotalReal = bGhost ? 0 : nLines;
+		if (pLeft)
+		{
+			nTotalLines += pLeft->nTotalLines;
+			nTotalReal += pLeft->nTotalReal;
+		}
+		if (pRight)
+		{
+			nTotalLines += pRight->nTotalLines;
+			nTotalReal += pRight->nTotalReal;
+		}
+	}
+};
+
+RealityMap::RealityMap()
+: m_nSeed(1)
+{
+}
+
+RealityMap::~RealityMap()
+{
+}
+
+/**
+ * @brief Remove all lines.
+ */
+void RealityMap::Clear()
+{
+	m_pRoot.reset();
+}
+
+/**
+ * @brief Return number of lines, ghost or real.
+ */
+int RealityMap::GetLineCount() const
+{
+	return m_pRoot ? m_pRoot->nTotalLines : 0;
+}
+
+/**
+ * @brief Return number of real lines.
+ */
+int RealityMap::GetRealLineCount() const
+{
+	return m_pRoot ? m_pRoot->nTotalReal : 0;
+}
+
+/**
+ * @brief Create a node for a run of lines, with a new random priority.
+ */
+std::unique_ptr<RealityMap::Node> RealityMap::NewNode(int nLines, bool bGhost)
+{
+	m_nSeed = m_nSeed * 1103515245 + 12345;
+	std::unique_ptr<Node> pNode(new Node);
+	pNode->nLines = nLines;
+	pNode->bGhost = bGhost;
+	pNode->nPriority = m_nSeed;
+	pNode->Update();
+	return pNode;
+}
+
+/**
+ * @brief Split a subtree into its first @p nLine lines and the others.
+ * A run holding lines on both sides is cut in two.
+ */
+void RealityMap::Split(std::unique_ptr<Node> pNode, int nLine, std::unique_ptr<Node> &pLeft, std::unique_ptr<Node> &pRight)
+{
+	if (!pNode)
+	{
+		pLeft.reset();
+		pRight.reset();
+		return;
+	}
+	const int nBefore = pNode->pLeft ? pNode->pLeft->nTotalLines : 0;
+	if (nLine <= nBefore)
+	{
+		Split(std::move(pNode->pLeft), nLine, pLeft, pNode->pLeft);
+		pNode->Update();
+		pRight = std::move(pNode);
+	}
+	else if (nLine >= nBefore + pNode->nLines)
+	{
+		Split(std::move(pNode->pRight), nLine - nBefore - pNode->nLines, pNode->pRight, pRight);
+		pNode->Update();
+		pLeft = std::move(pNode);
+	}
+	else
+	{
+		// The rest of the run goes first in the right part: with the
+		// priority of the node, it becomes the root of this part
+		std::unique_ptr<Node> pRest(new Node);
+		pRest->nLines = nBefore + pNode->nLines - nLine;
+		pRest->bGhost = pNode->bGhost;
+		pRest->nPriority = pNode->nPriority;
+		pRest->Update();
+		pNode->nLines = nLine - nBefore;
+		pRight = Merge(std::move(pRest), std::move(pNode->pRight));
+		pNode->Update();
+		pLeft = std::move(pNode);
+	}
+}
+
+/**
+ * @brief Merge two subtrees, all runs of @p pLeft coming before the runs of @p pRight.
+ */
+std::unique_ptr<RealityMap::Node> RealityMap::Merge(std::unique_ptr<Node> pLeft, std::unique_ptr<Node> pRight)
+{
+	if (!pLeft)
+		return pRight;
+	if (!pRight)
+		return pLeft;
+	if (pLeft->nPriority >= pRight->nPriority)
+	{
+		pLeft->pRight = Merge(std::move(pLeft->pRight), std::move(pRight));
+		pLeft->Update();
+		return pLeft;
+	}
+	pRight->pLeft = Merge(std::move(pLeft), std::move(pRight->pLeft));
+	pRight->Update();
+	return pRight;
+}
+
+/**
+ * @brief Remove the first run of a subtree and return it.
+ */
+std::unique_ptr<RealityMap::Node> RealityMap::TakeFirst(std::unique_ptr<Node> &pNode)
+{
+	if (pNode->pLeft)
+	{
+		std::unique_ptr<Node> pFirst = TakeFirst(pNode->pLeft);
+		pNode->Update();
+		return pFirst;
+	}
+	std::unique_ptr<Node> pFirst = std::move(pNode);
+	pNode = std::move(pFirst->pRight);
+	pFirst->Update();
+	return pFirst;
+}
+
+/**
+ * @brief Remove the last run of a subtree and return it.
+ */
+std::unique_ptr<RealityMap::Node> RealityMap::TakeLast(std::unique_ptr<Node> &pNode)
+{
+	if (pNode->pRight)
+	{
+		std::unique_ptr<Node> pLast = TakeLast(pNode->pRight);
+		pNode->Update();
+		return pLast;
+	}
+	std::unique_ptr<Node> pLast = std::move(pNode);
+	pNode = std::move(pLast->pLeft);
+	pLast->Update();
+	return pLast;
+}
+
+/**
+ * @brief Merge two subtrees like Merge(), and make one run of the last run
+ * of @p pLeft and the first run of @p pRight if both are ghost or both are
+ * real lines. This keeps the tree from growing a node for each split.
+ */
+std::unique_ptr<RealityMap::Node> RealityMap::Join(std::unique_ptr<Node> pLeft, std::unique_ptr<Node> pRight)
+{
+	if (!pLeft || !pRight)
+		return Merge(std::move(pLeft), std::move(pRight));
+	std::unique_ptr<Node> pLast = TakeLast(pLeft);
+	std::unique_ptr<Node> pFirst = TakeFirst(pRight);
+	if (pLast->bGhost == pFirst->bGhost)
+	{
+		pLast->nLines += pFirst->nLines;
+		pLast->Update();
+		pFirst.reset();
+	}
+	return Merge(Merge(std::move(pLeft), std::move(pLast)), Merge(std::move(pFirst), std::move(pRight)));
+}
+
+/**
+ * @brief Insert lines.
+ * @param [in] nLine Index of the first inserted line.
+ * @param [in] nCount Number of lines to insert.
+ * @param [in] bGhost Are the lines ghost lines?
+ */
+void RealityMap::Insert(int nLine, int nCount, bool bGhost)
+{
+	assert(nLine >= 0 && nLine <= GetLineCount());
+	if (nCount <= 0)
+		return;
+	std::unique_ptr<Node> pLeft, pRight;
+	Split(std::move(m_pRoot), nLine, pLeft, pRight);
+	m_pRoot = Join(Join(std::move(pLeft), NewNode(nCount, bGhost)), std::move(pRight));
+}
+
+/**
+ * @brief Erase lines.
+ * @param [in] nFirst Index of the first line to erase.
+ * @param [in] nLast Index after the last line to erase.
+ */
+void RealityMap::Erase(int nFirst, int nLast)
+{
+	assert(nFirst >= 0 && nFirst <= nLast && nLast <= GetLineCount());
+	if (nFirst == nLast)
+		return;
+	std::unique_ptr<Node> pLeft, pMiddle, pRight;
+	Split(std::move(m_pRoot), nFirst, pLeft, pRight);
+	Split(std::move(pRight), nLast - nFirst, pMiddle, pRight);
+	m_pRoot = Join(std::move(pLeft), std::move(pRight));
+}
+
+/**
+ * @brief Return number of runs of ghost or real lines.
+ * Neighbouring runs are never both ghost or both real lines.
+ */
+int RealityMap::GetRunCount() const
+{
+	return CountRuns(m_pRoot.get());
+}
+
+/**
+ * @brief Return number of runs in a subtree.
+ */
+int RealityMap::CountRuns(const Node *pNode)
+{
+	return pNode ? 1 + CountRuns(pNode->pLeft.get()) + CountRuns(pNode->pRight.get()) : 0;
+}
+
+/**
+ * @brief Is a line a ghost line?
+ */
+bool RealityMap::IsGhost(int nLine) const
+{
+	assert(nLine >= 0 && nLine < GetLineCount());
+	const Node *pNode = m_pRoot.get();
+	for (;;)
+	{
+		const int nBefore = pNode->pLeft ? pNode->pLeft->nTotalLines : 0;
+		if (nLine < nBefore)
+			pNode = pNode->pLeft.get();
+		else if (nLine < nBefore + pNode->nLines)
+			return pNode->bGhost;
+		else
+		{
+			nLine -= nBefore + pNode->nLines;
+			pNode = pNode->pRight.get();
+		}
+	}
+}
+
+/**
+ * @brief Return number of real lines before a line.
+ * This is the real line of the line if it is real, or of the next real line.
+ */
+int RealityMap::GetRealLinesBefore(int nLine) const
+{
+	assert(nLine >= 0 && nLine <= GetLineCount());
+	int nReal = 0;
+	const Node *pNode = m_pRoot.get();
+	while (pNode != nullptr)
+	{
+		const int nBefore = pNode->pLeft ? pNode->pLeft->nTotalLines : 0;
+		if (nLine <= nBefore)
+			pNode = pNode->pLeft.get();
+		else
+		{
+			nReal += pNode->pLeft ? pNode->pLeft->nTotalReal : 0;
+			if (nLine <= nBefore + pNode->nLines)
+				return nReal + (pNode->bGhost ? 0 : nLine - nBefore);
+			if (!pNode->bGhost)
+				nReal += pNode->nLines;
+			nLine -= nBefore + pNode->nLines;
+			pNode = pNode->pRight.get();
+		}
+	}
+	return nReal;
+}
+
+/**
+ * @brief Return the line (apparent line) of a real line.
+ */
+int RealityMap::GetApparentLine(int nRealLine) const
+{
+	assert(nRealLine >= 0 && nRealLine < GetRealLineCount());
+	int nLine = 0;
+	const Node *pNode = m_pRoot.get();
+	for (;;)
+	{
+		const int nRealBefore = pNode->pLeft ? pNode->pLeft->nTotalReal : 0;
+		if (nRealLine < nRealBefore)
+		{
+			pNode = pNode->pLeft.get();
+			continue;
+		}
+		nLine += pNode->pLeft ? pNode->pLeft->nTotalLines : 0;
+		nRealLine -= nRealBefore;
+		if (!pNode->bGhost)
+		{
+			if (nRealLine < pNode->nLines)
+				return nLine + nRealLine;
+			nRealLine -= pNode->nLines;
+		}
+		nLine += pNode->nLines;
+		pNode = pNode->pRight.get();
+	}
+}
@@ -0,0 +1,54 @@
+/**
+ * @file  RealityMap.h
+ *
+ * @brief Declaration of RealityMap class.
+ */
+#pragma once
+
+#include <memory>
+
+/**
+ * @brief Ghost and real lines of a buffer, for mapping real and apparent lines.
+ *
+ * The lines are kept as runs of ghost lines and runs of real lines, in a
+ * balanced tree (a treap ordered by line) where each node knows how many
+ * lines and real lines its subtree holds. Finding the real lines before
+ * an apparent line, or the apparent line of a real line, and inserting or
+ * erasing lines, take O(log n) steps for n runs, instead of scanning all
+ * the lines or shifting all the runs after an edit.
+ */
+class RealityMap
+{
+public:
+	RealityMap();
+	~RealityMap();
+
+	void Clear();
+	int GetLineCount() const;
+	int GetRealLineCount() const;
+	int GetRunCount() const;
+
+	void Insert(int nLine, int nCount, bool bGhost);
+	void Erase(int nFirst, int nLast);
+
+	bool IsGhost(int nLine) const;
+	int GetRealLinesBefore(int nLine) const;
+	int GetApparentLine(int nRealLine) const;
+
+private:
+	struct Node;
+
+	RealityMap(const RealityMap &) = delete;
+	RealityMap & operator=(const RealityMap &) = delete;
+
+	std::unique_ptr<Node> NewNode(int nLines, bool bGhost);
+	static void Split(std::unique_ptr<Node> pNode, int nLine, std::unique_ptr<Node> &pLeft, std::unique_ptr<Node> &pRight);
+	static std::unique_ptr<Node> Merge(std::unique_ptr<Node> pLeft, std::unique_ptr<Node> pRight);
+	static std::unique_ptr<Node> TakeFirst(std::unique_ptr<Node> &pNode);
+	static std::unique_ptr<Node> TakeLast(std::unique_ptr<Node> &pNode);
+	static std::unique_ptr<Node> Join(std::unique_ptr<Node> pLeft, std::unique_ptr<Node> pRight);
+	static int CountRuns(const Node *pNode);
+
+	std::unique_ptr<Node> m_pRoot; /**< Root of the tree, null if there are no lines. */
+	unsigned m_nSeed; /**< Seed of the node priorities. */
+};
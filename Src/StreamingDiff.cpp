@@ -0,0 +1,498 @@
+/**
+ * @file  StreamingDiff.cpp
+ *
+ * @brief Implementation of StreamingDiff class.
+ */
+
+#include "pch.h"
+#include "StreamingDiff.h"
+#include <io.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
+#include "diff.h"
+#include "FileReader.h"
+#include "HashCompare.h"
+#include "Exceptions.h"
+
+using CompareEngines::FileReader;
+using CompareEngines::ContentHasher;
+
+const int64_t StreamingDiff::MinSize = 1024LL * 1024 * 1024;
+
+namespace
+{
+
+/** @brief Most lines in a file, diffutils counts lines and sizes of its tables with int. */
+const size_t MaxLines = (std::numeric_limits<int>::max)() / 4;
+
+/** @brief Line endings. */
+enum Eol
+{
+	EOL_NONE, /**< Last line without newline */
+	EOL_LF,
+	EOL_CRLF,
+	EOL_CR,
+};
+
+/**
+ * @brief Splits the blocks of a FileReader into lines.
+ * Lines end with CR, LF or CR-LF like in diffutils, and include their end.
+ * A line inside one block is returned in place, a line continuing in the
+ * next block is collected into a buffer.
+ */
+class LineReader
+{
+public:
+	explicit LineReader(FileReader &reader)
+		: m_reader(reader), m_p(nullptr), m_end(nullptr), m_bFailed(false) {}
+	bool Begin(const char *&data, size_t &len);
+	void Skip(size_t len) { m_p += len; }
+	bool Next(const char *&line, size_t &len);
+	bool Failed() const { return m_bFailed; }
+
+private:
+	bool TakeCarry(const char *&line, size_t &len);
+
+	FileReader &m_reader;
+	const char *m_p; /**< Start of next line in current block */
+	const char *m_end; /**< End of current block */
+	std::string m_carry; /**< Start of a line continuing in next block */
+	std::string m_line; /**< Last line returned from m_carry */
+	bool m_bFailed; /**< Reading failed */
+};
+
+/**
+ * @brief Read first block, to look at it before it is split into lines.
+ */
+bool LineReader::Begin(const char *&data, size_t &len)
+{
+	if (!m_reader.Read(data, len))
+	{
+		m_bFailed = true;
+		return false;
+	}
+	m_p = data;
+	m_end = data + len;
+	return true;
+}
+
+/**
+ * @brief Get next line, valid until the next call.
+ * @return false at end of file or if reading failed.
+ */
+bool LineReader::Next(const char *&line, size_t &len)
+{
+	for (;;)
+	{
+		if (m_p == m_end)
+		{
+			if (m_reader.IsEof())
+				return !m_carry.empty() && TakeCarry(line, len);
+			const char *data;
+			size_t n;
+			if (!m_reader.Read(data, n))
+			{
+				m_bFailed = true;
+				return false;
+			}
+			m_p = data;
+			m_end = data + n;
+			continue;
+		}
+		if (!m_carry.empty() && m_carry.back() == '\r')
+		{
+			// CR ended previous block, LF may still belong to the line
+			if (*m_p == '\n')
+			{
+				m_carry += '\n';
+				++m_p;
+			}
+			return TakeCarry(line, len);
+		}
+		const char *eol = m_p;
+		while (eol < m_end && *eol != '\n' && *eol != '\r')
+			++eol;
+		if (eol == m_end || (*eol == '\r' && eol + 1 == m_end))
+		{
+			m_carry.append(m_p, m_end - m_p);
+			m_p = m_end;
+			continue;
+		}
+		const char *next = eol + ((*eol == '\r' && eol[1] == '\n') ? 2 : 1);
+		if (m_carry.empty())
+		{
+			line = m_p;
+			len = next - m_p;
+			m_p = next;
+			return true;
+		}
+		m_carry.append(m_p, next - m_p);
+		m_p = next;
+		return TakeCarry(line, len);
+	}
+}
+
+bool LineReader::TakeCarry(const char *&line, size_t &len)
+{
+	m_line.swap(m_carry);
+	m_carry.clear();
+	line = m_line.data();
+	len = m_line.size();
+	return true;
+}
+
+/** @brief Get line ending of a line from LineReader. */
+Eol GetEol(const char *line, size_t len)
+{
+	if (line[len - 1] == '\n')
+		return (len >= 2 && line[len - 2] == '\r') ? EOL_CRLF : EOL_LF;
+	return line[len - 1] == '\r' ? EOL_CR : EOL_NONE;
+}
+
+/** @brief Length of line ending. */
+size_t EolLength(Eol eol)
+{
+	return eol == EOL_NONE ? 0 : eol == EOL_CRLF ? 2 : 1;
+}
+
+/**
+ * @brief Hash line as it compares with the current diffutils options.
+ * Like in diffutils, -b and -w ignore spaces and tabs only, -i folds case
+ * with tolower(), and a last line without newline differs from every line
+ * with newline in the robust output styles.
+ * @param [in] line Line, with line ending.
+ * @param [in] len Length of line.
+ * @param [in] eol Line ending of line.
+ * @param [in,out] buf Buffer for normalized text.
+ */
+uint64_t HashLine(const char *line, size_t len, Eol eol, std::string &buf)
+{
+	uint64_t seed;
+	if (eol == EOL_NONE && ROBUST_OUTPUT_STYLE(output_style))
+		seed = 4; // diffutils adds newline, but compares the line without it
+	else if (eol == EOL_NONE)
+		seed = EOL_LF; // the newline diffutils adds compares like any other
+	else if (ignore_eol_diff)
+		seed = EOL_LF;
+	else
+		seed = eol;
+
+	ContentHasher hasher(seed);
+	const size_t textLen = len - EolLength(eol);
+	if (!ignore_case_flag && !ignore_space_change_flag && !ignore_all_space_flag)
+	{
+		hasher.Update(line, textLen);
+		return hasher.Digest();
+	}
+
+	buf.clear();
+	for (size_t i = 0; i < textLen; ++i)
+	{
+		unsigned char c = static_cast<unsigned char>(line[i]);
+		if (c == ' ' || c == '\t')
+		{
+			if (ignore_all_space_flag)
+				continue;
+			if (ignore_space_change_flag)
+			{
+				// Runs of white space compare as one space, trailing ones not at all
+				while (i + 1 < textLen && (line[i + 1] == ' ' || line[i + 1] == '\t'))
+					++i;
+				if (i + 1 < textLen)
+					buf += ' ';
+				else if (eol == EOL_CR && !ignore_eol_diff)
+					buf += '\r'; // diffutils hashes CR after trailing white space
+				continue;
+			}
+		}
+		if (ignore_case_flag && isupper(c))
+			c = static_cast<unsigned char>(tolower(c));
+		buf += static_cast<char>(c);
+	}
+	hasher.Update(buf.data(), buf.size());
+	return hasher.Digest();
+}
+
+}
+
+/**
+ * @brief Constructor.
+ * @param [in,out] inf Files to compare, opened as for diff_2_files().
+ */
+StreamingDiff::StreamingDiff(file_data *inf)
+: m_inf(inf)
+{
+	m_lines[0] = m_lines[1] = 0;
+}
+
+/**
+ * @brief Check if files are big enough to be streamed.
+ * Only the patch output styles which print lines in order are supported.
+ */
+bool StreamingDiff::IsSuitable(const file_data *inf)
+{
+	if (output_style != OUTPUT_NORMAL && output_style != OUTPUT_CONTEXT &&
+			output_style != OUTPUT_UNIFIED)
+		return false;
+	for (int i = 0; i < 2; ++i)
+	{
+		if (inf[i].in_memory || inf[i].desc <= 0 ||
+				(inf[i].stat.st_mode & _S_IFMT) != _S_IFREG)
+			return false;
+	}
+	return inf[0].stat.st_size + inf[1].stat.st_size >= MinSize;
+}
+
+/**
+ * @brief Compare the files.
+ * Lines between the identical prefix and suffix get diffutils equivalence
+ * classes by the order of their hashes, which needs no hash table.
+ * @param [out] script Edit script, as diff_2_files() returns it.
+ * @return COMPARED when @p script is set.
+ */
+StreamingDiff::Result StreamingDiff::Diff(struct change **script)
+{
+	*script = nullptr;
+	std::vector<uint64_t> hashes[2];
+	SE_Handler seh;
+	try
+	{
+		const int nFiles = same_file_p(m_inf) ? 1 : 2;
+		for (int i = 0; i < nFiles; ++i)
+		{
+			Result result = HashLines(i, hashes[i]);
+			if (result != COMPARED)
+			{
+				// Leave the files for diff_2_files() as they were
+				for (int j = 0; j < 2; ++j)
+				{
+					m_inf[j].count_crlfs = m_inf[j].count_crs = 0;
+					m_inf[j].count_lfs = m_inf[j].count_zeros = 0;
+					m_inf[j].missing_newline = 0;
+				}
+				return result;
+			}
+		}
+		if (nFiles == 1)
+		{
+			m_lineOffsets[1] = m_lineOffsets[0];
+			m_lines[1] = m_lines[0];
+			m_inf[1].count_crlfs = m_inf[0].count_crlfs;
+			m_inf[1].count_crs = m_inf[0].count_crs;
+			m_inf[1].count_lfs = m_inf[0].count_lfs;
+			m_inf[1].count_zeros = m_inf[0].count_zeros;
+			m_inf[1].missing_newline = m_inf[0].missing_newline;
+		}
+		const std::vector<uint64_t> *lineHashes[2] = { &hashes[0], &hashes[nFiles - 1] };
+		const std::vector<uint64_t> &hashes0 = *lineHashes[0], &hashes1 = *lineHashes[1];
+
+		const int n0 = m_lines[0], n1 = m_lines[1];
+		int prefix = 0;
+		while (prefix < n0 && prefix < n1 && hashes0[prefix] == hashes1[prefix])
+			++prefix;
+		int suffix = 0;
+		while (suffix < n0 - prefix && suffix < n1 - prefix &&
+				hashes0[n0 - 1 - suffix] == hashes1[n1 - 1 - suffix])
+			++suffix;
+
+		std::vector<uint64_t> classes;
+		classes.reserve(static_cast<size_t>(n0 + n1 - 2 * (prefix + suffix)));
+		for (int i = 0; i < 2; ++i)
+			classes.insert(classes.end(), lineHashes[i]->begin() + prefix, lineHashes[i]->end() - suffix);
+		std::sort(classes.begin(), classes.end());
+		classes.erase(std::unique(classes.begin(), classes.end()), classes.end());
+
+		for (int i = 0; i < 2; ++i)
+		{
+			const int lines = m_lines[i] - prefix - suffix;
+			int *equivs = static_cast<int *>(malloc((lines + 1) * sizeof(int)));
+			if (equivs == nullptr)
+				return FAILED;
+			const uint64_t *hash = lineHashes[i]->data() + prefix;
+			for (int j = 0; j < lines; ++j)
+				equivs[j] = 1 + static_cast<int>(std::lower_bound(classes.begin(), classes.end(), hash[j]) - classes.begin());
+			m_inf[i].equivs = equivs;
+			m_inf[i].buffered_lines = lines;
+			m_inf[i].valid_lines = m_lines[i] - prefix;
+			m_inf[i].prefix_lines = prefix;
+			m_inf[i].equiv_max = static_cast<int>(classes.size()) + 1;
+		}
+		std::vector<uint64_t>().swap(classes);
+		for (int i = 0; i < 2; ++i)
+			std::vector<uint64_t>().swap(hashes[i]);
+
+		*script = diff_equivs(m_inf);
+	}
+	catch (SE_Exception&)
+	{
+		*script = nullptr;
+		return FAILED;
+	}
+	catch (std::bad_alloc&)
+	{
+		*script = nullptr;
+		return FAILED;
+	}
+	return COMPARED;
+}
+
+/**
+ * @brief Print edit script from Diff() in the current diffutils output style.
+ * Changes close enough to be printed in one hunk are read from the files
+ * with their context at a time, and diffutils prints them from the text.
+ * @param [in] script Edit script from Diff().
+ * @return false if reading the files failed.
+ */
+bool StreamingDiff::PrintScript(struct change *script) const
+{
+	// diffutils joins changes closer than this to one hunk, or
+	// with ignored blank lines even closer ones only
+	const int thresh = 2 * context + 1;
+	std::string text[2];
+	std::vector<size_t> starts[2];
+	std::vector<const char *> linbuf[2];
+	struct change *next = script;
+	while (next != nullptr)
+	{
+		struct change *first = next, *last = next;
+		while (last->link != nullptr && last->link->line0 < last->line0 + last->deleted + thresh)
+			last = last->link;
+		const int begin[2] = { first->line0, first->line1 };
+		const int end[2] = { last->line0 + last->deleted, last->line1 + last->inserted };
+
+		for (int i = 0; i < 2; ++i)
+		{
+			// Line numbers of script start after the identical prefix
+			const int from = (std::max)(begin[i] - context, -m_inf[i].prefix_lines);
+			const int to = (std::min)(end[i] + context, m_inf[i].valid_lines);
+			if (!LoadLines(i, from + m_inf[i].prefix_lines, (std::max)(to - from, 0), text[i], starts[i]))
+				return false;
+			linbuf[i].resize(starts[i].size());
+			for (size_t j = 0; j < starts[i].size(); ++j)
+				linbuf[i][j] = text[i].data() + starts[i][j];
+			files[i] = m_inf[i];
+			files[i].linbuf = linbuf[i].data() - from;
+		}
+
+		next = last->link;
+		last->link = nullptr;
+		if (output_style == OUTPUT_NORMAL)
+			print_normal_script(first);
+		else
+			print_context_script(first, output_style == OUTPUT_UNIFIED);
+		last->link = next;
+	}
+	return true;
+}
+
+/**
+ * @brief Hash lines of a file and index their offsets.
+ * @param [in] file File to read.
+ * @param [out] hashes Hashes of lines.
+ * @return COMPARED when file was read.
+ */
+StreamingDiff::Result StreamingDiff::HashLines(int file, std::vector<uint64_t> &hashes)
+{
+	file_data &inf = m_inf[file];
+	if (_lseeki64(inf.desc, 0, SEEK_SET) != 0)
+		return FAILED;
+	std::unique_ptr<FileReader> reader = FileReader::Create(inf.desc, FileReader::READ_AHEAD);
+	if (!reader)
+		return FAILED;
+
+	LineReader lines(*reader);
+	const char *data;
+	size_t len;
+	if (!lines.Begin(data, len))
+		return FAILED;
+	// diffutils converts UTF-16 and UTF-32 files to UTF-8 in memory,
+	// and files with zero bytes in their first block are binary
+	if (len >= 2 && ((data[0] == '\xFF' && data[1] == '\xFE') || (data[0] == '\xFE' && data[1] == '\xFF')))
+		return NOT_STREAMED;
+	if (memchr(data, 0, len) != nullptr)
+		return NOT_STREAMED;
+	uint64_t offset = 0;
+	if (len >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0)
+	{
+		lines.Skip(3);
+		offset = 3;
+	}
+
+	std::string buf;
+	const char *line;
+	while (lines.Next(line, len))
+	{
+		if (hashes.size() == MaxLines)
+			return FAILED;
+		if (hashes.size() % LineIndexStep == 0)
+			m_lineOffsets[file].push_back(offset);
+		const Eol eol = GetEol(line, len);
+		switch (eol)
+		{
+		case EOL_LF: ++inf.count_lfs; break;
+		case EOL_CRLF: ++inf.count_crlfs; break;
+		case EOL_CR: ++inf.count_crs; break;
+		}
+		inf.count_zeros += static_cast<int>(std::count(line, line + len, '\0'));
+		inf.missing_newline = (eol == EOL_NONE);
+		hashes.push_back(HashLine(line, len, eol, buf));
+		offset += len;
+	}
+	if (lines.Failed())
+		return FAILED;
+	m_lines[file] = static_cast<int>(hashes.size());
+	return COMPARED;
+}
+
+/**
+ * @brief Read text of lines again.
+ * Line endings are LFs if EOL differences are ignored, like in diffutils.
+ * @param [in] file File to read.
+ * @param [in] first First line to read, counted from start of file.
+ * @param [in] count Number of lines to read.
+ * @param [out] text Text of lines.
+ * @param [out] starts Offsets of lines in @p text, and the end of last line.
+ * @return false if reading failed.
+ */
+bool StreamingDiff::LoadLines(int file, int first, int count, std::string &text, std::vector<size_t> &starts) const
+{
+	text.clear();
+	starts.clear();
+	if (count > 0)
+	{
+		const int fd = m_inf[file].desc;
+		if (_lseeki64(fd, m_lineOffsets[file][first / LineIndexStep], SEEK_SET) < 0)
+			return false;
+		std::unique_ptr<FileReader> reader = FileReader::Create(fd, FileReader::BUFFERED);
+		if (!reader)
+			return false;
+		LineReader lines(*reader);
+		const char *line;
+		size_t len;
+		for (int skip = first % LineIndexStep; skip > 0; --skip)
+		{
+			if (!lines.Next(line, len))
+				return false;
+		}
+		for (int i = 0; i < count; ++i)
+		{
+			if (!lines.Next(line, len))
+				return false;
+			starts.push_back(text.size());
+			const Eol eol = GetEol(line, len);
+			if (ignore_eol_diff && eol != EOL_NONE)
+			{
+				text.append(line, len - EolLength(eol));
+				text += '\n';
+			}
+			else
+				text.append(line, len);
+		}
+	}
+	starts.push_back(text.size());
+	return true;
+}
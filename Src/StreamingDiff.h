@@ -0,0 +1,55 @@
+/**
+ * @file  StreamingDiff.h
+ *
+ * @brief Declaration of StreamingDiff class.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct file_data;
+struct change;
+
+/**
+ * @brief Diff of files too big to be read into memory.
+ *
+ * diffutils reads both files completely into memory and keeps a pointer
+ * to every line. Here the files are read block by block instead and every
+ * line is kept only as a 64-bit hash of its text, as the text compares
+ * with the current diffutils options. Lines with equal hashes are taken as
+ * equal lines. The offset of every LineIndexStep:th line is stored, so the
+ * text of the lines printed into a patch is read again when it is printed.
+ *
+ * The files are given as diffutils file_data, opened as for diff_2_files().
+ * After Diff() the file_data has the equivalence classes and the results
+ * diffutils puts there, except the text of the lines.
+ */
+class StreamingDiff
+{
+public:
+	/** @brief Result of Diff(). */
+	enum Result
+	{
+		NOT_STREAMED, /**< Files are not 8-bit text, compare them in memory */
+		FAILED, /**< Reading or comparing files failed */
+		COMPARED, /**< Files were compared */
+	};
+
+	static const int64_t MinSize; /**< Files together this big are streamed */
+	static const int LineIndexStep = 64; /**< Lines per stored line offset */
+
+	explicit StreamingDiff(file_data *inf);
+	static bool IsSuitable(const file_data *inf);
+	Result Diff(struct change **script);
+	bool PrintScript(struct change *script) const;
+
+private:
+	Result HashLines(int file, std::vector<uint64_t> &hashes);
+	bool LoadLines(int file, int first, int count, std::string &text, std::vector<size_t> &starts) const;
+
+	file_data *m_inf; /**< Files compared */
+	std::vector<uint64_t> m_lineOffsets[2]; /**< File offsets of every LineIndexStep:th line */
+	int m_lines[2]; /**< Number of lines in files */
+};
@@ -239,3 +239,11 @@ bool UniMarkdownFile::ReadString(String &line, String &eol, bool *lossy)
 		*lossy = nlosses != m_txtstats.nlosses;
 	return bDone;
 }
+
+/**
+ * @brief Lines of markup are made by ReadString(), not read at once.
+ */
+bool UniMarkdownFile::ReadAllLines(std::unique_ptr<TCHAR[]> & text, std::vector<size_t> & lineStarts)
+{
+	return false;
+}
@@ -18,6 +18,7 @@ class UniMarkdownFile : public UniMemFile
 public:
 	UniMarkdownFile();
 	virtual bool ReadString(String & line, String & eol, bool * lossy);
+	virtual bool ReadAllLines(std::unique_ptr<TCHAR[]> & text, std::vector<size_t> & lineStarts);
 	virtual void Close();
 
 protected:
@@ -399,6 +399,396 @@ compareseq (int xoff, int xlim, int yoff, int ylim, int minimal)
     }
 }
 
+/* WinMerge: patience and histogram diff.
+
+   Both algorithms split a region at lines chosen by how often they occur,
+   and align the parts between them separately.  Parts where no line
+   qualifies are left to compareseq.  Regions waiting to be compared are
+   kept on a stack, because the splits can be very unbalanced.  */
+
+#define HISTOGRAM_MAX_CHAIN 64	/* Lines more frequent than this in a region
+				   are not used for splitting it.  */
+
+struct region
+{
+  int xoff, xlim, yoff, ylim;
+};
+
+static DECL_TLS struct region *region_stack;
+static DECL_TLS int region_count, region_alloc;
+
+static DECL_TLS int *class_count[2];	/* Occurrences of each equivalence class
+				   in the current region, zero outside it.  */
+static DECL_TLS int *class_pos[2];	/* Position of a class in the region;
+				   for histogram diff its first one in file 0.  */
+static DECL_TLS int *chain;	/* Next position of the same class in file 0.  */
+static DECL_TLS int *lis_x, *lis_y, *lis_tails, *lis_prev; /* Patience sorting.  */
+
+static void
+push_region (int xoff, int xlim, int yoff, int ylim)
+{
+  if (region_count == region_alloc)
+    {
+      region_alloc = region_alloc ? 2 * region_alloc : 64;
+      region_stack = (struct region *)
+	xrealloc (region_stack, region_alloc * sizeof (*region_stack));
+    }
+  region_stack[region_count].xoff = xoff;
+  region_stack[region_count].xlim = xlim;
+  region_stack[region_count].yoff = yoff;
+  region_stack[region_count].ylim = ylim;
+  ++region_count;
+}
+
+/* Mark all lines of a region as changed.  */
+
+static void
+mark_region (int xoff, int xlim, int yoff, int ylim)
+{
+  while (xoff < xlim)
+    files[0].changed_flag[files[0].realindexes[xoff++]] = 1;
+  while (yoff < ylim)
+    files[1].changed_flag[files[1].realindexes[yoff++]] = 1;
+}
+
+/* Split a region at the longest increasing sequence of lines that occur
+   exactly once in both of its files.  Return zero if there are none.  */
+
+static int
+patience_split (int xoff, int xlim, int yoff, int ylim)
+{
+  int * const xv = xvec;
+  int * const yv = yvec;
+  int i, n = 0, len = 0, k;
+
+  for (i = xoff; i < xlim; i++)
+    {
+      ++class_count[0][xv[i]];
+      class_pos[0][xv[i]] = i;
+    }
+  for (i = yoff; i < ylim; i++)
+    ++class_count[1][yv[i]];
+
+  /* Pair up the unique lines in file 1 order, and find the longest run
+     of pairs increasing in file 0 order by patience sorting.  */
+  for (i = yoff; i < ylim; i++)
+    {
+      int c = yv[i];
+      if (class_count[0][c] == 1 && class_count[1][c] == 1)
+	{
+	  int x = class_pos[0][c];
+	  int lo = 0, hi = len;
+	  while (lo < hi)
+	    {
+	      int mid = (lo + hi) / 2;
+	      if (lis_x[lis_tails[mid]] < x)
+		lo = mid + 1;
+	      else
+		hi = mid;
+	    }
+	  lis_x[n] = x;
+	  lis_y[n] = i;
+	  lis_prev[n] = lo > 0 ? lis_tails[lo - 1] : -1;
+	  lis_tails[lo] = n;
+	  if (lo == len)
+	    ++len;
+	  ++n;
+	}
+    }
+
+  for (i = xoff; i < xlim; i++)
+    class_count[0][xv[i]] = 0;
+  for (i = yoff; i < ylim; i++)
+    class_count[1][yv[i]] = 0;
+
+  if (len == 0)
+    return 0;
+
+  /* Walk the sequence back from its end, pushing the gaps between
+     the anchors.  */
+  for (k = lis_tails[len - 1]; k >= 0; k = lis_prev[k])
+    {
+      push_region (lis_x[k] + 1, xlim, lis_y[k] + 1, ylim);
+      xlim = lis_x[k];
+      ylim = lis_y[k];
+    }
+  push_region (xoff, xlim, yoff, ylim);
+  return 1;
+}
+
+/* Split a region around the longest common run of lines that contains
+   the least frequent lines of file 0.  Return zero if no line occurs
+   in both files at most HISTOGRAM_MAX_CHAIN times, after marking the
+   region changed if no line occurs in both files at all.  */
+
+static int
+histogram_split (int xoff, int xlim, int yoff, int ylim)
+{
+  int * const xv = xvec;
+  int * const yv = yvec;
+  int * const count = class_count[0];
+  int * const first = class_pos[0];
+  int i, j;
+  int best_count = HISTOGRAM_MAX_CHAIN + 1;
+  int bx0 = 0, bx1 = 0, by0 = 0, by1 = 0;
+  int common = 0;
+
+  /* Chain the positions of each class in file 0, in ascending order.  */
+  for (i = xlim; --i >= xoff; )
+    {
+      int c = xv[i];
+      chain[i] = count[c] ? first[c] : -1;
+      first[c] = i;
+      ++count[c];
+    }
+
+  for (j = yoff; j < ylim; )
+    {
+      int c = yv[j];
+      int jnext = j + 1;
+
+      if (count[c])
+	common = 1;
+      if (count[c] && count[c] <= best_count)
+	for (i = first[c]; i >= 0; )
+	  {
+	    int x0 = i, x1 = i + 1, y0 = j, y1 = j + 1;
+	    int rc = count[c];
+
+	    /* Extend the match both ways, noting its least frequent line.  */
+	    while (x0 > xoff && y0 > yoff && xv[x0 - 1] == yv[y0 - 1])
+	      {
+		--x0, --y0;
+		if (rc > count[xv[x0]])
+		  rc = count[xv[x0]];
+	      }
+	    while (x1 < xlim && y1 < ylim && xv[x1] == yv[y1])
+	      {
+		if (rc > count[xv[x1]])
+		  rc = count[xv[x1]];
+		++x1, ++y1;
+	      }
+
+	    if (jnext < y1)
+	      jnext = y1;
+	    if (bx1 - bx0 < x1 - x0 || rc < best_count)
+	      {
+		bx0 = x0, bx1 = x1, by0 = y0, by1 = y1;
+		best_count = rc;
+	      }
+
+	    /* Skip the positions inside the match just tried.  */
+	    do
+	      i = chain[i];
+	    while (i >= 0 && i < x1);
+	  }
+      j = jnext;
+    }
+
+  for (i = xoff; i < xlim; i++)
+    count[xv[i]] = 0;
+
+  if (bx0 == bx1)
+    {
+      if (!common)
+	{
+	  mark_region (xoff, xlim, yoff, ylim);
+	  return 1;
+	}
+      return 0;
+    }
+
+  push_region (bx1, xlim, by1, ylim);
+  push_region (xoff, bx0, yoff, by0);
+  return 1;
+}
+
+/* Compare a region of the files with patience or histogram diff,
+   depending on DIFF_ALGORITHM.  The arguments are like compareseq's.  */
+
+static void
+compareseq_anchored (int xoff, int xlim, int yoff, int ylim)
+{
+  int * const xv = xvec;
+  int * const yv = yvec;
+
+  push_region (xoff, xlim, yoff, ylim);
+  while (region_count > 0)
+    {
+      struct region r = region_stack[--region_count];
+      int split;
+
+      while (r.xoff < r.xlim && r.yoff < r.ylim && xv[r.xoff] == yv[r.yoff])
+	++r.xoff, ++r.yoff;
+      while (r.xlim > r.xoff && r.ylim > r.yoff && xv[r.xlim - 1] == yv[r.ylim - 1])
+	--r.xlim, --r.ylim;
+
+      if (r.xoff == r.xlim || r.yoff == r.ylim)
+	{
+	  mark_region (r.xoff, r.xlim, r.yoff, r.ylim);
+	  continue;
+	}
+
+      if (diff_algorithm == DIFF_ALG_PATIENCE)
+	split = patience_split (r.xoff, r.xlim, r.yoff, r.ylim);
+      else
+	split = histogram_split (r.xoff, r.xlim, r.yoff, r.ylim);
+      if (!split)
+	compareseq (r.xoff, r.xlim, r.yoff, r.ylim, 0);
+    }
+}
+
+/* Allocate the tables of compareseq_anchored for the files in FILEVEC.  */
+
+static void
+alloc_anchored (struct file_data const filevec[])
+{
+  size_t classes = filevec[0].equiv_max;
+  size_t lines = filevec[0].nondiscarded_lines + 1;
+
+  class_count[0] = (int *) xmalloc (classes * 4 * sizeof (int));
+  bzero (class_count[0], classes * 2 * sizeof (int));
+  class_count[1] = class_count[0] + classes;
+  class_pos[0] = class_count[1] + classes;
+  class_pos[1] = class_pos[0] + classes;
+  chain = (int *) xmalloc (lines * 5 * sizeof (int));
+  lis_x = chain + lines;
+  lis_y = lis_x + lines;
+  lis_tails = lis_y + lines;
+  lis_prev = lis_tails + lines;
+}
+
+static void
+free_anchored (void)
+{
+  free (class_count[0]);
+  free (chain);
+  free (region_stack);
+  region_stack = NULL;
+  region_count = region_alloc = 0;
+}
+
+/* WinMerge: segmented compare of large files.
+
+   Lines occurring exactly once in both files split the files into segments
+   that are compared independently, on up to DIFF_THREADS threads.  The
+   segments depend only on the files, so the result does not depend on the
+   number of threads.  */
+
+#define SEGMENT_MIN_LINES 65536	/* Files with fewer lines together
+				   are compared in one piece.  */
+#define SEGMENT_LINES 16384	/* Consecutive gaps between unique lines are
+				   joined into segments of at least this many lines.  */
+
+struct segment
+{
+  struct region r;
+  int *fdiag, *bdiag;	/* Diagonal vectors for this segment only.  */
+};
+
+struct segment_job
+{
+  struct segment *segments;
+  int *xvec, *yvec;
+  struct file_data files[2];
+  int too_expensive, heuristic, minimal;
+};
+
+/* Compare segment I of the job ARG.  Runs on a worker thread, so copy
+   the state compareseq uses to this thread first.  */
+
+static void
+compare_segment (void *arg, int i)
+{
+  struct segment_job const *job = (struct segment_job const *) arg;
+  struct segment const *s = &job->segments[i];
+
+  xvec = job->xvec;
+  yvec = job->yvec;
+  files[0] = job->files[0];
+  files[1] = job->files[1];
+  too_expensive = job->too_expensive;
+  heuristic = job->heuristic;
+  fdiag = s->fdiag;
+  bdiag = s->bdiag;
+  compareseq (s->r.xoff, s->r.xlim, s->r.yoff, s->r.ylim, job->minimal);
+}
+
+/* Compare lines XOFF..XLIM-1 of file 0 with YOFF..YLIM-1 of file 1
+   segment by segment.  Return zero if the files have no unique common
+   lines to split them at, without changing anything.  */
+
+static int
+compareseq_segmented (int xoff, int xlim, int yoff, int ylim, int minimal)
+{
+  struct segment_job job;
+  struct segment *segments;
+  int *diags;
+  int *saved_fdiag = fdiag, *saved_bdiag = bdiag;
+  int count = 0, i;
+  size_t ndiags = 0;
+
+  alloc_anchored (&files[0]);
+  if (!patience_split (xoff, xlim, yoff, ylim))
+    {
+      free_anchored ();
+      return 0;
+    }
+
+  /* Join the gaps between unique lines, popped from the stack first gap
+     first, into segments.  */
+  segments = (struct segment *) xmalloc (region_count * sizeof (*segments));
+  while (region_count > 0)
+    {
+      struct region r = region_stack[--region_count];
+      if (count > 0
+	  && (segments[count - 1].r.xlim - segments[count - 1].r.xoff)
+	     + (segments[count - 1].r.ylim - segments[count - 1].r.yoff)
+	     < SEGMENT_LINES)
+	{
+	  segments[count - 1].r.xlim = r.xlim;
+	  segments[count - 1].r.ylim = r.ylim;
+	}
+      else
+	segments[count++].r = r;
+    }
+  free_anchored ();
+
+  for (i = 0; i < count; i++)
+    ndiags += (segments[i].r.xlim - segments[i].r.xoff)
+	      + (segments[i].r.ylim - segments[i].r.yoff) + 3;
+  diags = (int *) xmalloc (ndiags * (2 * sizeof (int)));
+  for (i = 0, ndiags = 0; i < count; i++)
+    {
+      struct region const *r = &segments[i].r;
+      int dmin = r->xoff - r->ylim;
+      segments[i].fdiag = diags + ndiags + 1 - dmin;
+      ndiags += (r->xlim - r->xoff) + (r->ylim - r->yoff) + 3;
+      segments[i].bdiag = diags + ndiags + 1 - dmin;
+      ndiags += (r->xlim - r->xoff) + (r->ylim - r->yoff) + 3;
+    }
+
+  job.segments = segments;
+  job.xvec = xvec;
+  job.yvec = yvec;
+  job.files[0] = files[0];
+  job.files[1] = files[1];
+  job.too_expensive = too_expensive;
+  job.heuristic = heuristic;
+  job.minimal = minimal;
+  if (diff_threads > 1)
+    parallel_for (count, diff_threads, compare_segment, &job);
+  else
+    for (i = 0; i < count; i++)
+      compare_segment (&job, i);
+
+  fdiag = saved_fdiag;
+  bdiag = saved_bdiag;
+  free (diags);
+  free (segments);
+  return 1;
+}
+
 /* Discard lines from one file that have no matches in the other file.
 
    A line which is discarded will not be considered by the actual
@@ -418,6 +808,8 @@ discard_confusing_lines (struct file_data filevec[])
   char *discarded[2];
   int *equiv_count[2];
   int *p;
+  /* Only the default algorithm leaves lines out of the comparison.  */
+  int keep_all = no_discards || diff_algorithm != DIFF_ALG_MYERS;
 
   /* Allocate our results.  */
   p = (int *) xmalloc ((filevec[0].buffered_lines + filevec[1].buffered_lines)
@@ -599,7 +991,7 @@ discard_confusing_lines (struct file_data filevec[])
       unsigned int end = filevec[f].buffered_lines;
       unsigned int j = 0;
       for (i = 0; i < end; ++i)
-	if (no_discards || discards[i] == 0)
+	if (keep_all || discards[i] == 0)
 	  {
 	    filevec[f].undiscarded[j] = filevec[f].equivs[i];
 	    filevec[f].realindexes[j++] = i;
@@ -830,6 +1222,94 @@ briefly_report (int changes, struct file_data const filevec[])
 	     filevec[0].name, filevec[1].name);
 }
 
+// WinMerge: compare two files by the equivalence classes of their lines.
+// FILEVEC[i].equivs, buffered_lines and equiv_max must be set; the text of
+// the lines is not looked at, so this also works for files whose lines are
+// only known by their hashes.  Return the edit script.
+struct change * diff_equivs (struct file_data filevec[])
+{
+	int diags;
+	int i;
+	struct change *script;
+
+	//  Allocate vectors for the results of comparison:
+	// a flag for each line of each file, saying whether that line
+	// is an insertion or deletion.
+	// Allocate an extra element, always zero, at each end of each vector.  
+	
+	size_t s = filevec[0].buffered_lines + filevec[1].buffered_lines + 4;
+	filevec[0].changed_flag = (char *)xmalloc (s);
+	bzero (filevec[0].changed_flag, s);
+	filevec[0].changed_flag++;
+	filevec[1].changed_flag = filevec[0].changed_flag
+		+ filevec[0].buffered_lines + 2;
+	
+	//  Some lines are obviously insertions or deletions
+	// because they don't match anything.  Detect them now, and
+	// avoid even thinking about them in the main comparison algorithm.  
+	
+	discard_confusing_lines (filevec);
+	
+	//  Now do the main comparison algorithm, considering just the
+	// undiscarded lines.  
+	
+	xvec = filevec[0].undiscarded;
+	yvec = filevec[1].undiscarded;
+	diags = filevec[0].nondiscarded_lines + filevec[1].nondiscarded_lines + 3;
+	fdiag = (int *) xmalloc (diags * (2 * sizeof (int)));
+	bdiag = fdiag + diags;
+	fdiag += filevec[1].nondiscarded_lines + 1;
+	bdiag += filevec[1].nondiscarded_lines + 1;
+	
+      /* Set TOO_EXPENSIVE to be approximate square root of input size,
+     bounded below by 4096.  4096 seems to be good for circa-2016 CPUs 
+  */
+        too_expensive = 1;
+        for (i = filevec[0].nondiscarded_lines + filevec[1].nondiscarded_lines;
+         i != 0; i >>= 2)
+	  too_expensive <<= 1;
+        too_expensive = max (4096, too_expensive);
+
+	files[0] = filevec[0];
+	files[1] = filevec[1];
+	
+	if (diff_algorithm == DIFF_ALG_PATIENCE || diff_algorithm == DIFF_ALG_HISTOGRAM)
+	{
+		alloc_anchored (filevec);
+		compareseq_anchored (0, filevec[0].nondiscarded_lines,
+		  0, filevec[1].nondiscarded_lines);
+		free_anchored ();
+	}
+	else
+	{
+		int minimal = no_discards || diff_algorithm == DIFF_ALG_MINIMAL;
+		if (filevec[0].nondiscarded_lines + filevec[1].nondiscarded_lines < SEGMENT_MIN_LINES
+		    || !compareseq_segmented (0, filevec[0].nondiscarded_lines,
+					      0, filevec[1].nondiscarded_lines, minimal))
+			compareseq (0, filevec[0].nondiscarded_lines,
+			  0, filevec[1].nondiscarded_lines, minimal);
+	}
+	
+	free (fdiag - (filevec[1].nondiscarded_lines + 1));
+	
+	//  Modify the results slightly to make them prettier
+	// in cases where that can validly be done.  
+	
+	shift_boundaries (filevec);
+	
+	//  Get the results of comparison in the form of a chain
+	// of `struct change's -- an edit script.  
+	
+#if 0
+	if (output_style == OUTPUT_ED)
+		script = build_reverse_script (filevec);
+	else
+#endif
+		script = build_script (filevec);
+
+	return script;
+}
+
 //  Report the differences of two files.  DEPTH is the current directory
 // depth. 
 // WinMerge: add bMoved_blocks_flag for detecting moved blocks and
@@ -838,7 +1318,6 @@ briefly_report (int changes, struct file_data const filevec[])
 struct change * diff_2_files (struct file_data filevec[], int depth, int * bin_status,
 	int bMoved_blocks_flag, int * bin_file)
 {
-	int diags;
 	int i;
 	struct change *script=NULL;
 	int changes;
@@ -863,8 +1342,13 @@ struct change * diff_2_files (struct file_data filevec[], int depth, int * bin_s
 			changes = 1;
 		else
 		//  Identical descriptor implies identical files
-		if (filevec[0].desc == filevec[1].desc)
+		if (same_file_p (filevec))
 			changes = 0;
+		else
+		//  Texts given in memory are buffered completely already
+		if (filevec[0].in_memory || filevec[1].in_memory)
+			changes = (filevec[0].buffered_chars != filevec[1].buffered_chars ||
+				memcmp (filevec[0].buffer, filevec[1].buffer, filevec[0].buffered_chars) != 0);
 		//  Scan both files, a buffer at a time, looking for a difference.  
 		else
 		{
@@ -923,66 +1407,7 @@ struct change * diff_2_files (struct file_data filevec[], int depth, int * bin_s
 	}
 	else
 	{
-		//  Allocate vectors for the results of comparison:
-		// a flag for each line of each file, saying whether that line
-		// is an insertion or deletion.
-		// Allocate an extra element, always zero, at each end of each vector.  
-		
-		size_t s = filevec[0].buffered_lines + filevec[1].buffered_lines + 4;
-		filevec[0].changed_flag = (char *)xmalloc (s);
-		bzero (filevec[0].changed_flag, s);
-		filevec[0].changed_flag++;
-		filevec[1].changed_flag = filevec[0].changed_flag
-			+ filevec[0].buffered_lines + 2;
-		
-		//  Some lines are obviously insertions or deletions
-		// because they don't match anything.  Detect them now, and
-		// avoid even thinking about them in the main comparison algorithm.  
-		
-		discard_confusing_lines (filevec);
-		
-		//  Now do the main comparison algorithm, considering just the
-		// undiscarded lines.  
-		
-		xvec = filevec[0].undiscarded;
-		yvec = filevec[1].undiscarded;
-		diags = filevec[0].nondiscarded_lines + filevec[1].nondiscarded_lines + 3;
-		fdiag = (int *) xmalloc (diags * (2 * sizeof (int)));
-		bdiag = fdiag + diags;
-		fdiag += filevec[1].nondiscarded_lines + 1;
-		bdiag += filevec[1].nondiscarded_lines + 1;
-		
-      /* Set TOO_EXPENSIVE to be approximate square root of input size,
-	     bounded below by 4096.  4096 seems to be good for circa-2016 CPUs 
-	  */
-        too_expensive = 1;
-        for (i = filevec[0].nondiscarded_lines + filevec[1].nondiscarded_lines;
-	         i != 0; i >>= 2)
-		  too_expensive <<= 1;
-        too_expensive = max (4096, too_expensive);
-
-		files[0] = filevec[0];
-		files[1] = filevec[1];
-		
-		compareseq (0, filevec[0].nondiscarded_lines,
-		  0, filevec[1].nondiscarded_lines, no_discards);
-		
-		free (fdiag - (filevec[1].nondiscarded_lines + 1));
-		
-		//  Modify the results slightly to make them prettier
-		// in cases where that can validly be done.  
-		
-		shift_boundaries (filevec);
-		
-		//  Get the results of comparison in the form of a chain
-		// of `struct change's -- an edit script.  
-		
-#if 0
-		if (output_style == OUTPUT_ED)
-			script = build_reverse_script (filevec);
-		else
-#endif
-			script = build_script (filevec);
+		script = diff_equivs (filevec);
 		
 		//  Set CHANGES if we had any diffs.
 		// If some changes are ignored, we must scan the script to decide.  
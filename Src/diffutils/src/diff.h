@@ -84,6 +84,27 @@ enum output_style {
 
 EXTERN int output_style;
 
+/* WinMerge: algorithms for aligning the lines of two files.  */
+enum diff_algorithm {
+
+  // NOTE: these values are stored in the user's Registry - don't change their value !!
+  //   (see enum DiffAlgorithm in Src/CompareOptions.h)
+  /* Myers' algorithm, with heuristics for big files.  */
+  DIFF_ALG_MYERS = 0,
+  /* Myers' algorithm, minimal edit script whatever it costs (-d).  */
+  DIFF_ALG_MINIMAL = 1,
+  /* Patience diff: align lines unique in both files first.  */
+  DIFF_ALG_PATIENCE = 2,
+  /* Histogram diff: align the least frequent common lines first.  */
+  DIFF_ALG_HISTOGRAM = 3
+};
+
+EXTERN int diff_algorithm;
+
+/* WinMerge: number of threads comparing segments of large files.
+   0 or 1 compares them one by one on the calling thread.  */
+EXTERN int diff_threads;
+
 /* Nonzero if output cannot be generated for identical files.  */
 EXTERN int no_diff_means_no_output;
 
@@ -297,8 +318,16 @@ struct file_data {
 
     /* text stats for WinMerge */
     int count_crlfs, count_crs, count_lfs, count_zeros;
+
+    /* WinMerge: nonzero if the whole text was put into buffer by the caller
+       and there is no file to read. */
+    int in_memory;
 };
 
+/* WinMerge: nonzero if both elements of a file_data vector read the same file. */
+#define same_file_p(filevec) \
+  ((filevec)[0].desc == (filevec)[1].desc && !(filevec)[0].in_memory && !(filevec)[1].in_memory)
+
 /* Describe the two files currently being compared.  */
 
 EXTERN struct file_data files[2];
@@ -312,7 +341,11 @@ EXTERN FILE *outfile;
 /* analyze.c */
 /* WinMerge: add last two params */
 struct change * diff_2_files (struct file_data[], int, int *, int, int*);
+/* WinMerge: compare files by the equivalence classes of their lines only */
+struct change * diff_equivs (struct file_data[]);
 void moved_block_analysis(struct change ** pscript, struct file_data fd[]);
+/* WinMerge: run JOB (ARG, I) for I = 0..COUNT-1 on up to THREADS threads.  */
+void parallel_for (int count, int threads, void (*job) (void *, int), void *arg);
 
 /* context.c */
 void print_context_header (struct file_data[], int);
@@ -28,6 +28,13 @@ the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
 /* Given a hash value and a new character, return a new hash value. */
 #define HASH(h, c) ((c) + ROL (h, 7))
 
+/* Mix the bits of a finished line hash, so that the bucket index
+   depends on all of them.  */
+#define HASH_FINISH(h) ((h) ^= (h) >> 16, (h) *= 0x85EBCA6B, (h) ^= (h) >> 13, \
+                        (h) *= 0xC2B2AE35, (h) ^= (h) >> 16)
+
+#define ROL64(v, n) ((v) << (n) | (v) >> (64 - (n)))
+
 /* Guess remaining number of lines from number N of lines so far,
    size S so far, and total size T.  */
 #define GUESS_LINES(n,s,t) (((t) - (s)) / ((n) < 10 ? 32 : (s) / ((n)-1)) + 5)
@@ -35,6 +42,15 @@ the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
 /* Type used for fast prefix comparison in find_identical_ends.  */
 typedef unsigned word;
 
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#define IO_SIMD
+#endif
+
+/* Multiplier and word type of the line hash.  */
+#define LINE_HASH_MUL 0x9E3779B97F4A7C15ULL
+typedef unsigned long long hash_word;
+
 /** @brief Known Unicode encodings. */
 enum UNICODESET
 {
@@ -76,6 +92,8 @@ static DECL_TLS int equivs_index;
 static DECL_TLS int equivs_alloc;
 
 static void find_and_hash_each_line (struct file_data *);
+static unsigned char const *find_eol_char (unsigned char const *, unsigned char const *);
+static unsigned hash_line (unsigned char const *, size_t, int);
 static void find_identical_ends (struct file_data[]);
 static char *prepare_text_end (struct file_data *, short);
 static enum UNICODESET get_unicode_signature(struct file_data *, int *pBomsize);
@@ -140,8 +158,15 @@ int
 sip (struct file_data *current, int skip_test)
 {
   int isbinary = 0;
+  /* WinMerge: text given in memory is already in the buffer, only test it.  */
+  if (current->in_memory)
+    {
+      if (!skip_test && !get_unicode_signature(current, NULL))
+        isbinary = binary_file_p(current->buffer,
+          min(current->buffered_chars, (FSIZE)STAT_BLOCKSIZE (current->stat)));
+    }
   /* If we have a nonexistent file (or NUL: device) at this stage, treat it as empty.  */
-  if (current->desc < 0 || !(S_ISREG (current->stat.st_mode)))
+  else if (current->desc < 0 || !(S_ISREG (current->stat.st_mode)))
     {
       /* Leave room for a sentinel.  */
       current->buffer = xmalloc (sizeof (word));
@@ -187,6 +212,9 @@ slurp (struct file_data *current)
   if (current->desc < 0)
     /* The file is nonexistent.  */
     ;
+  else if (current->in_memory)
+    /* The whole text is already in the buffer.  */
+    ;
   else if (always_text_flag || current->buffered_chars != 0)
     {
       enum UNICODESET sig = get_unicode_signature(current, NULL);
@@ -256,6 +284,111 @@ ISWSPACE (char ch)
   return ch==' ' || ch=='\t';
 }
 
+#ifdef IO_SIMD
+/* Return a mask of the bytes in V equal to CH.  */
+static unsigned
+byte_mask (__m128i v, char ch)
+{
+  return (unsigned) _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 (ch)));
+}
+
+/* Return a mask of the \n and \r bytes in the 16 bytes at P.  */
+static unsigned
+eol_mask (unsigned char const *p)
+{
+  __m128i v = _mm_loadu_si128 ((__m128i const *) p);
+  return byte_mask (v, '\n') | byte_mask (v, '\r');
+}
+
+/* Return the number of bits set in M.  */
+static int
+bit_count (unsigned m)
+{
+  int n = 0;
+  for (;  m;  m &= m - 1)
+    n++;
+  return n;
+}
+#endif /* IO_SIMD */
+
+/* Return the first \n or \r at or after P.  The text before END always
+   ends in a newline, so the scan stops within it.  */
+static unsigned char const *
+find_eol_char (unsigned char const *p, unsigned char const *end)
+{
+#ifdef IO_SIMD
+  for (;  end - p >= 16;  p += 16)
+    {
+      unsigned mask = eol_mask (p);
+      if (mask)
+        {
+          unsigned long index;
+          _BitScanForward (&index, mask);
+          return p + index;
+        }
+    }
+#endif
+  while (*p != '\n' && *p != '\r')
+    p++;
+  return p;
+}
+
+/* Fold the ASCII upper case letters of W to lower case, and other bytes
+   like HASH did in find_and_hash_each_line.  */
+static hash_word
+fold_word (hash_word w)
+{
+  const hash_word ones = ~(hash_word) 0 / 255;
+  const hash_word high = ones * 0x80;
+
+  if (w & high)
+    {
+      unsigned char b[sizeof (w)];
+      unsigned i;
+
+      memcpy (b, &w, sizeof (w));
+      for (i = 0;  i < sizeof (w);  i++)
+        if (isupper (b[i]))
+          b[i] = (unsigned char) tolower (b[i]);
+      memcpy (&w, b, sizeof (w));
+      return w;
+    }
+  /* Bit 7 of a byte turns on in GE when the byte is >= 'A'
+     and in GT when it is > 'Z'.  */
+  {
+    hash_word ge = w + ones * (0x80 - 'A');
+    hash_word gt = w + ones * (0x80 - 'Z' - 1);
+    return w | (((ge ^ gt) & high) >> 2);
+  }
+}
+
+/* Hash the N bytes of a line at P a word at a time, folding case if FOLD.
+   Lines that line_cmp calls equal must get equal hashes, which is
+   all the hashes of the byte-wise HASH paths need to agree on.  */
+static unsigned
+hash_line (unsigned char const *p, size_t n, int fold)
+{
+  hash_word h = 0;
+  hash_word w;
+
+  for (;  n >= sizeof (w);  n -= sizeof (w), p += sizeof (w))
+    {
+      memcpy (&w, p, sizeof (w));
+      if (fold)
+        w = fold_word (w);
+      h = (ROL64 (h, 5) ^ w) * LINE_HASH_MUL;
+    }
+  if (n)
+    {
+      w = 0;
+      memcpy (&w, p, n);
+      if (fold)
+        w = fold_word (w);
+      h = (ROL64 (h, 5) ^ w) * LINE_HASH_MUL;
+    }
+  return (unsigned) (h ^ (h >> 32));
+}
+
 /* Split the file into lines, simultaneously computing the equivalence class for
    each line. */
 static void
@@ -299,7 +432,17 @@ find_and_hash_each_line (struct file_data *current)
          respecting UNIX (\r), MS-DOS/Windows (\r\n), and MAC (\r) eols */
 
       /* Hash this line until we find a newline. */
-      if (ignore_case_flag)
+      if (!ignore_all_space_flag && !ignore_space_change_flag)
+        {
+          /* Nothing to skip: find the end of line first,
+             then hash the whole line at once.  */
+          unsigned char const HUGE *e = find_eol_char (p, (unsigned char const HUGE *) bufend);
+          if (*e == '\r' && e[1] == '\n')
+            e++;
+          h = hash_line (p, e - p, ignore_case_flag);
+          p = e + 1;
+        }
+      else if (ignore_case_flag)
         {
           if (ignore_all_space_flag)
             while ((c = *p++) != '\n' && (c != '\r' || *p == '\n'))
@@ -332,11 +475,6 @@ find_and_hash_each_line (struct file_data *current)
                 if (c == '\r' && *p != '\n')
                   goto hashing_done;
               }
-          else
-            while ((c = *p++) != '\n' && (c != '\r' || *p == '\n'))
-              {
-                h = HASH (h, isupper (c) ? tolower (c) : c);
-              }
         }
       else
         {
@@ -371,13 +509,9 @@ find_and_hash_each_line (struct file_data *current)
                 if (c == '\r' && *p != '\n')
                   goto hashing_done;
               }
-          else
-            while ((c = *p++) != '\n' && (c != '\r' || *p == '\n'))
-              {
-                h = HASH (h, c);
-              }
         }
 hashing_done:;
+      HASH_FINISH (h);
 
       bucket = &buckets[h % nbuckets];
       length = (char const HUGE *) p - ip - ((char const HUGE *) p == incomplete_tail);
@@ -453,8 +587,9 @@ hashing_done:;
 
       line++;
 
-      while (p[0] != '\n' && (p[0] != '\r' || p[1] == '\n'))
-         p++;
+      p = find_eol_char (p, (unsigned char const HUGE *) bufend);
+      if (p[0] == '\r' && p[1] == '\n')
+        p++;
       p++;
     }
 
@@ -671,6 +806,32 @@ prepare_text_end (struct file_data *current, short side)
 	t = q0 = p + buffered_chars;
 	while (q0 > r)
 	{
+#ifdef IO_SIMD
+		/* Count 16 bytes at a time when none of them needs mapping.
+		   An LF ends a CRLF if the byte before it, maybe below the
+		   block, is a CR; count_crs is compensated as below. */
+		if (q0 - r >= 16)
+		{
+			__m128i v = _mm_loadu_si128 ((__m128i const *)(q0 - 16));
+			unsigned crs = byte_mask (v, '\r');
+			unsigned lfs = byte_mask (v, '\n');
+			unsigned crlfs = (crs << 1) & lfs;
+			if ((lfs & 1) && q0 - 16 > r && q0[-17] == '\r')
+				crlfs |= 1;
+			if (!ignore_eol_diff || !(crs | crlfs))
+			{
+				if (t != q0)
+					_mm_storeu_si128 ((__m128i *)(t - 16), v);
+				t -= 16;
+				q0 -= 16;
+				current->count_crs += bit_count (crs) - bit_count (crlfs);
+				current->count_lfs += bit_count (lfs & ~crlfs);
+				current->count_crlfs += bit_count (crlfs);
+				current->count_zeros += bit_count (byte_mask (v, '\0'));
+				continue;
+			}
+		}
+#endif
 		switch (*--t = *--q0)
 		{
 		case '\r':
@@ -720,7 +881,7 @@ find_identical_ends (struct file_data filevec[])
   int buffered_prefix, prefix_count, prefix_mask;
   int ttt;
 
-  if (filevec[0].desc != filevec[1].desc)
+  if (!same_file_p (filevec))
     {
       slurp (&filevec[0]);
       buffer0 = prepare_text_end (&filevec[0], 0);
@@ -760,6 +921,18 @@ find_identical_ends (struct file_data filevec[])
 
       /* Loop until first mismatch, or to the sentinel characters.  */
 
+#ifdef IO_SIMD
+      /* Compare 16 bytes at a time while both buffers have them.  */
+      {
+        char HUGE *lim0 = p0 + ((n0 < n1 ? n0 : n1) & ~(FSIZE) 15);
+        while (p0 != lim0
+               && _mm_movemask_epi8 (_mm_cmpeq_epi8 (
+                    _mm_loadu_si128 ((__m128i const *) p0),
+                    _mm_loadu_si128 ((__m128i const *) p1))) == 0xFFFF)
+          p0 += 16, p1 += 16;
+      }
+#endif
+
       /* Compare a word at a time for speed.  */
       w0 = (word *) p0;
       w1 = (word *) p1;
@@ -823,6 +996,13 @@ find_identical_ends (struct file_data filevec[])
       beg0 = filevec[0].prefix_end + (n0 < n1 ? 0 : n0 - n1);
 
       /* Scan back until chars don't match or we reach that point.  */
+#ifdef IO_SIMD
+      while (p0 - beg0 >= 16
+             && _mm_movemask_epi8 (_mm_cmpeq_epi8 (
+                  _mm_loadu_si128 ((__m128i const *) (p0 - 16)),
+                  _mm_loadu_si128 ((__m128i const *) (p1 - 16)))) == 0xFFFF)
+        p0 -= 16, p1 -= 16;
+#endif
       while (p0 != beg0)
         if (*--p0 != *--p1)
           {
@@ -900,13 +1080,12 @@ find_identical_ends (struct file_data filevec[])
                * sizeof(*linbuf0));
           linbuf0[l] = p0;
           /* Perry/WinMerge (2004-01-05) altered original diffutils loop "while (*p0++ != '\n') ;" for other EOLs */
-          while (1)
-            {
-              char ch = *p0++;
-              /* stop at any eol, \n or \r or \r\n */
-              if (ch == '\n') break;
-              if (ch == '\r' && (p0==end0 || *p0!='\n')) break;
-            }
+          /* stop at any eol, \n or \r or \r\n */
+          p0 = (char HUGE *) find_eol_char ((unsigned char const *) p0,
+                                            (unsigned char const *) end0);
+          if (*p0 == '\r' && p0 + 1 != end0 && p0[1] == '\n')
+            p0++;
+          p0++;
         }
     }
   buffered_prefix = prefix_count && context < lines ? context : lines;
@@ -1000,7 +1179,7 @@ read_files (struct file_data filevec[], int pretend_binary, int *bin_file)
       *bin_file = 1;
     }
 
-  if (filevec[0].desc != filevec[1].desc)
+  if (!same_file_p (filevec))
     {
       if (bin_file!=NULL)
         {
@@ -1045,14 +1224,14 @@ read_files (struct file_data filevec[], int pretend_binary, int *bin_file)
 			filevec[0].buffer = xrealloc (filevec[0].buffer, tmax_bufsize);
 			filevec[0].bufsize = tmax_bufsize;
 		  }
-		if (filevec[0].desc != filevec[1].desc && tmax_bufsize > filevec[1].bufsize)
+		if (!same_file_p (filevec) && tmax_bufsize > filevec[1].bufsize)
 		  {
 			filevec[1].buffer = xrealloc (filevec[1].buffer, tmax_bufsize);
 			filevec[1].bufsize = tmax_bufsize;
 		  }
 	}
 	  
-  if (filevec[0].desc == filevec[1].desc)
+  if (same_file_p (filevec))
 	{
 		// The files may be exactly the same file.  Give them the same buffer, etc.
 		assert( filevec[1].buffer == NULL );
@@ -1072,7 +1251,7 @@ read_files (struct file_data filevec[], int pretend_binary, int *bin_file)
   find_identical_ends (filevec);
 
   /* Don't slurp rest of file when comparing file to itself. */
-  if (filevec[0].desc == filevec[1].desc)
+  if (same_file_p (filevec))
     {
 	  filevec[1].count_crs = filevec[0].count_crs;
 	  filevec[1].count_lfs = filevec[0].count_lfs;
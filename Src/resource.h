@@ -515,6 +515,7 @@
 #define IDC_SWAP01_STATIC               8825
 #define IDC_SWAP12_STATIC               8826
 #define IDC_SWAP02_STATIC               8827
+#define IDC_DIFF_ALGORITHM              8828
 #define IDS_SPLASH_DEVELOPERS           8976
 #define IDS_SPLASH_GPLTEXT              8977
 #define IDS_MESSAGEBOX_OK               9001
@@ -574,6 +575,7 @@
 #define ID_COMPMETHOD_MODDATE           16435
 #define ID_COMPMETHOD_DATESIZE          16436
 #define ID_COMPMETHOD_SIZE              16437
+#define ID_COMPMETHOD_HASH_CONTENTS     16438
 #define IDS_FILTERFILE_NAMETITLE        16448
 #define IDS_FILTERFILE_PATHTITLE        16449
 #define IDS_FILTER_TITLE                16450
@@ -771,6 +773,9 @@
 #define IDS_COLHDR_NIDIFFS              17814
 #define IDS_COLHDR_NSDIFFS              17815
 #define IDS_COLHDR_BINARY               17816
+#define IDS_COLHDR_LHASH                17817
+#define IDS_COLHDR_RHASH                17818
+#define IDS_COLHDR_MHASH                17819
 #define IDS_CANT_COMPARE_FILES          17831
 #define IDS_ABORTED_ITEM                17832
 #define IDS_FILE_SKIPPED                17833
@@ -833,6 +838,9 @@
 #define IDS_COLDESC_NIDIFFS             17944
 #define IDS_COLDESC_NSDIFFS             17945
 #define IDS_COLDESC_BINARY              17946
+#define IDS_COLDESC_LHASH               17947
+#define IDS_COLDESC_RHASH               17948
+#define IDS_COLDESC_MHASH               17949
 #define IDS_DIRECTORY_REPORT_TITLE      17962
 #define IDS_REPORT_COMMALIST            17963
 #define IDS_REPORT_TABLIST              17964
@@ -1210,6 +1218,7 @@
 #define IDS_COMPMETHOD_MODDATE          33401
 #define IDS_COMPMETHOD_DATESIZE         33402
 #define IDS_COMPMETHOD_SIZE             33403
+#define IDS_COMPMETHOD_HASH_CONTENTS    33404
 #define IDS_UNPACK_AUTO                 33494
 #define IDS_NO_PREDIFFER                33495
 #define IDS_SUGGESTED_PLUGINS           33496
@@ -1239,7 +1248,7 @@
 #define _APS_3D_CONTROLS                     1
 #define _APS_NEXT_RESOURCE_VALUE        248
 #define _APS_NEXT_COMMAND_VALUE         33647
-#define _APS_NEXT_CONTROL_VALUE         8828
+#define _APS_NEXT_CONTROL_VALUE         8829
 #define _APS_NEXT_SYMED_VALUE           116
 #endif
 #endif
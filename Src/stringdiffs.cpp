@@ -11,9 +11,11 @@
 #include <windows.h>
 #include <tchar.h>
 #include <cassert>
+#include <unordered_map>
 #include <mbctype.h>	// MBCS (multibyte MBCS character stuff)
 #include "CompareOptions.h"
 #include "stringdiffsi.h"
+#include "BitParallelLcs.h"
 #include "Diff3.h"
 
 using std::vector;
@@ -25,6 +27,10 @@ static bool Initialized;
 static bool CustomChars;
 static TCHAR *BreakChars;
 static TCHAR BreakCharDefaults[] = _T(",.;:");
+/** @brief Most edit script elements onp() may copy for a pair of lines */
+static const int64_t MaxOnpWork = 1 << 22;
+/** @brief Byte level differences this long are compared character by character */
+static const int MinByteLcsLength = 1024;
 
 static bool isSafeWhitespace(TCHAR ch);
 static bool isWordBreak(int breakType, const TCHAR *str, int index);
@@ -261,7 +267,7 @@ stringdiffs::BuildWordDiffList_DP()
 
 	//if (dp(edscript) <= 0)
 	//	return false;
-	onp(edscript);
+	lcs(edscript);
 
 	int i = 1, j = 1;
 	for (size_t k = 0; k < edscript.size(); k++)
@@ -341,11 +347,9 @@ stringdiffs::BuildWordDiffList()
 	BuildWordsArray(m_str1, m_words1);
 	BuildWordsArray(m_str2, m_words2);
 
-#ifdef _WIN64
-	if (m_words1.size() > 20480 || m_words2.size() > 20480)
-#else
-	if (m_words1.size() > 2048 || m_words2.size() > 2048)
-#endif
+	// Lines with too many words to compare them in reasonable time
+	// are different as a whole
+	if (!BitParallelLcs::CanCompare(m_words1.size() - 1, m_words2.size() - 1))
 	{
 		int s1 = m_words1[0].start;
 		int e1 = m_words1[m_words1.size() - 1].end;
@@ -496,7 +500,7 @@ stringdiffs::Hash(const String & str, int begin, int end, unsigned h) const
  * @brief Compare two words (by reference to original strings)
  */
 bool
-stringdiffs::AreWordsSame(const word & word1, const word & word2) const
+stringdiffs::AreWordsSame(const String & str1, const word & word1, const String & str2, const word & word2) const
 {
 	if (this->m_whitespace != WHITESPACE_COMPARE_ALL)
 	{
@@ -509,12 +513,56 @@ stringdiffs::AreWordsSame(const word & word1, const word & word2) const
 		return false;
 	for (int i=0; i<word1.length(); ++i)
 	{
-		if (!caseMatch(m_str1[word1.start+i], m_str2[word2.start+i]))
+		if (!caseMatch(str1[word1.start+i], str2[word2.start+i]))
 			return false;
 	}
 	return true;
 }
 
+/**
+ * @brief Number the words of both lines, the same words getting the same number
+ * @return Number of different words
+ */
+unsigned
+stringdiffs::WordSymbols(std::vector<unsigned> & seq1, std::vector<unsigned> & seq2) const
+{
+	struct Symbol
+	{
+		const String *str;
+		const word *pword;
+		unsigned symbol;
+	};
+	std::unordered_multimap<int, Symbol> symbols;
+	unsigned nSymbols = 0;
+	unsigned spaceSymbol = UINT_MAX;
+	auto number = [&](const String & str, const std::vector<word> & words, std::vector<unsigned> & seq)
+	{
+		seq.resize(words.size() - 1);
+		for (size_t i = 1; i < words.size(); ++i)
+		{
+			const word & w = words[i];
+			if (m_whitespace != WHITESPACE_COMPARE_ALL && IsSpace(w))
+			{
+				// All whitespace is the same
+				if (spaceSymbol == UINT_MAX)
+					spaceSymbol = nSymbols++;
+				seq[i - 1] = spaceSymbol;
+				continue;
+			}
+			auto range = symbols.equal_range(w.hash);
+			auto it = range.first;
+			while (it != range.second && !AreWordsSame(*it->second.str, *it->second.pword, str, w))
+				++it;
+			if (it == range.second)
+				it = symbols.insert({ w.hash, { &str, &w, nSymbols++ } });
+			seq[i - 1] = it->second.symbol;
+		}
+	};
+	number(m_str1, m_words1, seq1);
+	number(m_str2, m_words2, seq2);
+	return nSymbols;
+}
+
 /**
  * @brief Return true if characters match
  */
@@ -628,12 +676,65 @@ stringdiffs::snake(int k, int y, bool exchanged)
 	int M = static_cast<int>(exchanged ? m_words2.size() - 1 : m_words1.size() - 1);
 	int N = static_cast<int>(exchanged ? m_words1.size() - 1 : m_words2.size() - 1);
 	int x = y - k;
-	while (x < M && y < N && (exchanged ? AreWordsSame(m_words1[y + 1], m_words2[x + 1]) : AreWordsSame(m_words1[x + 1], m_words2[y + 1]))) {
+	while (x < M && y < N && (exchanged ? AreWordsSame(m_str1, m_words1[y + 1], m_str2, m_words2[x + 1]) : AreWordsSame(m_str1, m_words1[x + 1], m_str2, m_words2[y + 1]))) {
 		x = x + 1; y = y + 1;
 	}
 	return y;
 }
 
+/**
+ * @brief Edit script of the words of the lines.
+ * onp() is used as long as its work, which grows with the square of the
+ * number of differences, stays small. Lines with more differences get the
+ * edit script of a longest common subsequence computed on bit vectors (see
+ * BitParallelLcs), in a time that only depends on their lengths.
+ * @return Number of edits
+ */
+int
+stringdiffs::lcs(std::vector<char> &edscript)
+{
+	const int64_t M = static_cast<int64_t>(m_words1.size() - 1);
+	const int64_t N = static_cast<int64_t>(m_words2.size() - 1);
+	const int64_t DELTA = M > N ? M - N : N - M;
+	auto onpWork = [&](int64_t P) { return P * (P + DELTA + 1) * (M + N); };
+	if (onpWork((std::min)(M, N)) <= MaxOnpWork)
+		return onp(edscript);
+
+	std::vector<unsigned> seq1, seq2;
+	const unsigned nSymbols = WordSymbols(seq1, seq2);
+	if (onpWork((std::min)(M, N) - BitParallelLcs::Length(seq1, seq2, nSymbols)) <= MaxOnpWork)
+		return onp(edscript);
+
+	std::vector<char> ses;
+	BitParallelLcs::EditScript(seq1, seq2, nSymbols, ses);
+
+	// A word deleted next to a word inserted is a changed word
+	edscript.clear();
+	int D = 0;
+	for (size_t i = 0; i < ses.size(); i++)
+	{
+		switch (ses[i])
+		{
+		case '+':
+		case '-':
+			if (i + 1 < ses.size() && ses[i + 1] != '=' && ses[i + 1] != ses[i])
+			{
+				edscript.push_back('!');
+				i++;
+			}
+			else
+			{
+				edscript.push_back(ses[i]);
+			}
+			D++;
+			break;
+		default:
+			edscript.push_back('=');
+		}
+	}
+	return D;
+}
+
 /**
  * @brief Return true if chars match
  *
@@ -1009,6 +1110,7 @@ ComputeByteDiff(String & str1, String & str2,
  */
 void stringdiffs::wordLevelToByteLevel()
 {
+	std::vector<wdiff> wdiffs;
 	for (size_t i = 0; i < m_wdiffs.size(); i++)
 	{
 		int begin[3], end[3];
@@ -1037,6 +1139,114 @@ void stringdiffs::wordLevelToByteLevel()
 			diff.end[1] = diff.begin[1] + end[1];
 			diff.begin[1] += begin[1];
 		}
+
+		// Long differences, as in lines of minified files, are compared
+		// character by character. Shorter ones only have their ends trimmed.
+		const int len1 = diff.end[0] - diff.begin[0] + 1;
+		const int len2 = diff.end[1] - diff.begin[1] + 1;
+		if (len1 > 0 && len2 > 0 && (std::max)(len1, len2) >= MinByteLcsLength
+			&& BitParallelLcs::CanCompare(len1, len2))
+			ByteDiffsOfRange(diff, wdiffs);
+		else
+			wdiffs.push_back(diff);
+	}
+	m_wdiffs.swap(wdiffs);
+}
+
+/**
+ * @brief Add the differences of the characters of a byte level difference.
+ * The characters are compared as ComputeByteDiff() compares them: case is
+ * ignored unless case sensitive, and whitespace either compares, or any
+ * run of it is the same as another, or it is skipped.
+ * @param [in] diff Difference to split.
+ * @param [in,out] diffs Differences the ones of @p diff are added to.
+ */
+void stringdiffs::ByteDiffsOfRange(const wdiff & diff, std::vector<wdiff> & diffs) const
+{
+	struct Token
+	{
+		int begin;
+		int end;
+	};
+	std::vector<Token> tokens[2];
+	std::vector<unsigned> seqs[2];
+	std::unordered_map<unsigned, unsigned> symbols;
+	const unsigned spaceSymbol = 0;
+	unsigned nSymbols = 1;
+	const String *strs[2] = { &m_str1, &m_str2 };
+	for (int side = 0; side < 2; ++side)
+	{
+		const String & str = *strs[side];
+		for (int i = diff.begin[side]; i <= diff.end[side]; ++i)
+		{
+			const TCHAR ch = str[i];
+			if (m_whitespace != WHITESPACE_COMPARE_ALL && isSafeWhitespace(ch))
+			{
+				if (m_whitespace == WHITESPACE_IGNORE_CHANGE)
+				{
+					if (!seqs[side].empty() && seqs[side].back() == spaceSymbol && tokens[side].back().end == i - 1)
+						tokens[side].back().end = i;
+					else
+					{
+						tokens[side].push_back({ i, i });
+						seqs[side].push_back(spaceSymbol);
+					}
+				}
+				continue;
+			}
+			unsigned code = static_cast<_TUCHAR>(ch);
+			int end = i;
+			if (IsLeadByte(ch) && i < diff.end[side])
+			{
+				// DBCS (we assume if a lead byte, then character is 2-byte)
+				code = (code << 8) | static_cast<_TUCHAR>(str[i + 1]);
+				end = i + 1;
+			}
+			else if (!m_case_sensitive)
+			{
+				code = static_cast<unsigned>(_totupper(ch));
+			}
+			auto it = symbols.emplace(code, nSymbols).first;
+			if (it->second == nSymbols)
+				++nSymbols;
+			tokens[side].push_back({ i, end });
+			seqs[side].push_back(it->second);
+			i = end;
+		}
+	}
+
+	std::vector<char> edscript;
+	BitParallelLcs::EditScript(seqs[0], seqs[1], nSymbols, edscript);
+
+	size_t t[2] = { 0, 0 };
+	for (size_t k = 0; k < edscript.size(); )
+	{
+		if (edscript[k] == '=')
+		{
+			++t[0];
+			++t[1];
+			++k;
+			continue;
+		}
+		const size_t first[2] = { t[0], t[1] };
+		for (; k < edscript.size() && edscript[k] != '='; ++k)
+			++t[edscript[k] == '-' ? 0 : 1];
+		int begin[2], end[2];
+		for (int side = 0; side < 2; ++side)
+		{
+			if (first[side] < t[side])
+			{
+				begin[side] = tokens[side][first[side]].begin;
+				end[side] = tokens[side][t[side] - 1].end;
+			}
+			else
+			{
+				// nothing on this side, the difference is before the next character
+				begin[side] = first[side] > 0 ? tokens[side][first[side] - 1].end + 1 : diff.begin[side];
+				end[side] = begin[side] - 1;
+			}
+		}
+		diffs.push_back(wdiff(begin[0], end[0], begin[1], end[1]));
 	}
 }
 
@@ -70,7 +70,9 @@ private:
 
 	void BuildWordsArray(const String & str, std::vector<word>& words);
 	unsigned Hash(const String & str, int begin, int end, unsigned h ) const;
-	bool AreWordsSame(const word & word1, const word & word2) const;
+	bool AreWordsSame(const String & str1, const word & word1, const String & str2, const word & word2) const;
+	unsigned WordSymbols(std::vector<unsigned> & seq1, std::vector<unsigned> & seq2) const;
+	void ByteDiffsOfRange(const wdiff & diff, std::vector<wdiff> & diffs) const;
 	bool IsWord(const word & word1) const;
 	/**
 	 * @brief Is this block an space or whitespace one?
@@ -98,6 +100,7 @@ private:
 	int dp(std::vector<char> & edscript);
 	int onp(std::vector<char> & edscript);
 	int snake(int k, int y, bool exchanged);
+	int lcs(std::vector<char> & edscript);
 #ifdef STRINGDIFF_LOGGING
 	void debugoutput();
 #endif
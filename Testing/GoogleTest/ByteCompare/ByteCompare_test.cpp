@@ -2,6 +2,8 @@
 #include <gtest/gtest.h>
 #include "diff.h"
 #include "CompareEngines/ByteCompare.h"
+#include "CompareEngines/ByteComparator.h"
+#include "FileTextStats.h"
 #include "CompareOptions.h"
 #include "FileLocation.h"
 #include "DiffItem.h"
@@ -139,6 +141,52 @@ namespace
 	}
 
 
+	TEST_F(ByteCompareTest, WideBuffers)
+	{
+		// Long buffers go through the vectorized loops, put EOLs, 0-bytes
+		// and differences on and around every vector boundary
+		QuickCompareOptions option;
+		for (size_t pos = 0; pos < 100; ++pos)
+		{
+			std::string data(200, 'A');
+			data[pos] = '\r';
+			data[pos + 1] = '\n';
+			data[pos + 2] = '\0';
+			data[pos + 3] = '\r';
+			data[pos + 5] = '\n';
+
+			CompareEngines::ByteComparator comparator(&option);
+			FileTextStats stats[2];
+			const char *ptr0 = data.data(), *ptr1 = data.data();
+			EXPECT_EQ(CompareEngines::ByteComparator::RESULT_SAME, comparator.CompareBuffers(stats[0], stats[1],
+				ptr0, ptr1, ptr0 + data.size(), ptr1 + data.size(), true, true, 0, 0));
+			EXPECT_EQ(1, stats[0].ncrlfs);
+			EXPECT_EQ(1, stats[0].ncrs);
+			EXPECT_EQ(1, stats[0].nlfs);
+			EXPECT_EQ(1, stats[0].nzeros);
+
+			std::string other(data);
+			other[pos + 4] = 'B';
+			CompareEngines::ByteComparator comparator2(&option);
+			ptr0 = data.data();
+			ptr1 = other.data();
+			EXPECT_EQ(CompareEngines::ByteComparator::RESULT_DIFF, comparator2.CompareBuffers(stats[0], stats[1],
+				ptr0, ptr1, ptr0 + data.size(), ptr1 + other.size(), true, true, 0, 0));
+			EXPECT_EQ(pos + 4, static_cast<size_t>(ptr0 - data.data()));
+		}
+
+		// Case differences far into equal runs
+		option.m_bIgnoreCase = true;
+		std::string lower(300, 'a'), upper(lower);
+		for (size_t pos = 0; pos < upper.size(); pos += 37)
+			upper[pos] = 'A';
+		CompareEngines::ByteComparator comparator(&option);
+		FileTextStats stats[2];
+		const char *ptr0 = lower.data(), *ptr1 = upper.data();
+		EXPECT_EQ(CompareEngines::ByteComparator::RESULT_SAME, comparator.CompareBuffers(stats[0], stats[1],
+			ptr0, ptr1, ptr0 + lower.size(), ptr1 + upper.size(), true, true, 0, 0));
+	}
+
 	TEST_F(ByteCompareTest, IgnoreAllSpace)
 	{
 		CompareEngines::ByteCompare bc;
@@ -0,0 +1,215 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <Poco/Timestamp.h>
+#include "CompareResultCache.h"
+#include "DiffItem.h"
+#include "Environment.h"
+#include "paths.h"
+#include "TFile.h"
+
+namespace
+{
+	// The fixture for testing CompareResultCache.
+	class CompareResultCacheTest : public testing::Test
+	{
+	protected:
+		CompareResultCacheTest()
+			: m_sCachePath(paths::ConcatPath(env::GetTemporaryPath(), _T("CompareResultCache_test.cache")))
+		{
+		}
+
+		virtual ~CompareResultCacheTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+			Remove();
+		}
+
+		virtual void TearDown()
+		{
+			Remove();
+		}
+
+		void Remove()
+		{
+			TFile file(m_sCachePath);
+			if (file.exists())
+				file.remove();
+		}
+
+		String m_sCachePath;
+	};
+
+	/** @brief Set @p di to a two-way file item as collected, before comparing. */
+	void SetItem(DIFFITEM& di, const String& name, Poco::File::FileSize size, const Poco::Timestamp& mtime)
+	{
+		di.diffcode.diffcode = DIFFCODE::FILE | DIFFCODE::BOTH;
+		di.nsdiffs = -1;
+		di.nidiffs = -1;
+		for (int i = 0; i < 2; ++i)
+		{
+			di.diffFileInfo[i].path = String(i == 0 ? _T("C:\\left") : _T("C:\\right"));
+			di.diffFileInfo[i].filename = name;
+			di.diffFileInfo[i].size = size;
+			di.diffFileInfo[i].mtime = mtime;
+			di.diffFileInfo[i].m_textStats.clear();
+			di.diffFileInfo[i].m_contentHash = 0;
+			di.diffFileInfo[i].m_bContentHashValid = false;
+		}
+	}
+
+	/** @brief Set @p di to the item of SetItem() compared: different text files. */
+	void SetCompared(DIFFITEM& di, const String& name, Poco::File::FileSize size, const Poco::Timestamp& mtime)
+	{
+		SetItem(di, name, size, mtime);
+		di.diffcode.diffcode |= DIFFCODE::TEXT | DIFFCODE::DIFF;
+		di.nsdiffs = 3;
+		di.nidiffs = 1;
+		di.diffFileInfo[0].m_textStats.ncrlfs = 10;
+		di.diffFileInfo[1].m_textStats.nlfs = 12;
+		di.diffFileInfo[1].m_contentHash = 0x1234567890ABCDEFULL;
+		di.diffFileInfo[1].m_bContentHashValid = true;
+	}
+
+	TEST_F(CompareResultCacheTest, Hit)
+	{
+		const Poco::Timestamp mtime;
+		DIFFITEM di;
+		{
+			CompareResultCache cache(m_sCachePath, 1);
+			EXPECT_FALSE(cache.Load());
+			SetCompared(di, _T("a.txt"), 100, mtime);
+			cache.Store(di, 2);
+
+			SetItem(di, _T("a.txt"), 100, mtime);
+			EXPECT_TRUE(cache.Lookup(di, 2));
+			EXPECT_TRUE(di.diffcode.isText());
+			EXPECT_TRUE(di.diffcode.isResultDiff());
+			EXPECT_TRUE(cache.Save(false));
+		}
+
+		// Results read back from the cache file
+		CompareResultCache cache(m_sCachePath, 1);
+		EXPECT_TRUE(cache.Load());
+		SetItem(di, _T("a.txt"), 100, mtime);
+		EXPECT_TRUE(cache.Lookup(di, 2));
+		EXPECT_TRUE(di.diffcode.isText());
+		EXPECT_TRUE(di.diffcode.isResultDiff());
+		EXPECT_EQ(3, di.nsdiffs);
+		EXPECT_EQ(1, di.nidiffs);
+		EXPECT_EQ(10, di.diffFileInfo[0].m_textStats.ncrlfs);
+		EXPECT_EQ(12, di.diffFileInfo[1].m_textStats.nlfs);
+		EXPECT_FALSE(di.diffFileInfo[0].m_bContentHashValid);
+		EXPECT_TRUE(di.diffFileInfo[1].m_bContentHashValid);
+		EXPECT_EQ(0x1234567890ABCDEFULL, di.diffFileInfo[1].m_contentHash);
+	}
+
+	TEST_F(CompareResultCacheTest, FileChanged)
+	{
+		const Poco::Timestamp mtime;
+		DIFFITEM di;
+		CompareResultCache cache(m_sCachePath, 1);
+		SetCompared(di, _T("a.txt"), 100, mtime);
+		cache.Store(di, 2);
+
+		SetItem(di, _T("a.txt"), 100, mtime + 1000000);
+		EXPECT_FALSE(cache.Lookup(di, 2));
+		SetItem(di, _T("a.txt"), 101, mtime);
+		EXPECT_FALSE(cache.Lookup(di, 2));
+		SetItem(di, _T("a.txt"), 100, mtime);
+		di.diffFileInfo[1].size = 101;
+		EXPECT_FALSE(cache.Lookup(di, 2));
+		SetItem(di, _T("b.txt"), 100, mtime);
+		EXPECT_FALSE(cache.Lookup(di, 2));
+		EXPECT_EQ(DIFFCODE::FILE | DIFFCODE::BOTH, di.diffcode.diffcode);
+
+		SetItem(di, _T("a.txt"), 100, mtime);
+		EXPECT_TRUE(cache.Lookup(di, 2));
+	}
+
+	TEST_F(CompareResultCacheTest, OptionsChanged)
+	{
+		const Poco::Timestamp mtime;
+		DIFFITEM di;
+		{
+			CompareResultCache cache(m_sCachePath, 1);
+			SetCompared(di, _T("a.txt"), 100, mtime);
+			cache.Store(di, 2);
+			EXPECT_TRUE(cache.Save(false));
+		}
+
+		// A cache written with other options is ignored
+		CompareResultCache cache(m_sCachePath, 2);
+		EXPECT_FALSE(cache.Load());
+		SetItem(di, _T("a.txt"), 100, mtime);
+		EXPECT_FALSE(cache.Lookup(di, 2));
+	}
+
+	TEST_F(CompareResultCacheTest, NotStored)
+	{
+		const Poco::Timestamp mtime;
+		DIFFITEM di;
+		CompareResultCache cache(m_sCachePath, 1);
+		SetCompared(di, _T("a.txt"), 100, mtime);
+		di.diffcode.diffcode = (di.diffcode.diffcode & ~DIFFCODE::COMPAREFLAGS) | DIFFCODE::CMPERR;
+		cache.Store(di, 2);
+		SetCompared(di, _T("b.txt"), 100, mtime);
+		di.diffcode.diffcode = (di.diffcode.diffcode & ~DIFFCODE::COMPAREFLAGS) | DIFFCODE::CMPABORT;
+		cache.Store(di, 2);
+
+		SetItem(di, _T("a.txt"), 100, mtime);
+		EXPECT_FALSE(cache.Lookup(di, 2));
+		SetItem(di, _T("b.txt"), 100, mtime);
+		EXPECT_FALSE(cache.Lookup(di, 2));
+	}
+
+	TEST_F(CompareResultCacheTest, Prune)
+	{
+		const Poco::Timestamp mtime;
+		DIFFITEM di;
+		{
+			CompareResultCache cache(m_sCachePath, 1);
+			SetCompared(di, _T("a.txt"), 100, mtime);
+			cache.Store(di, 2);
+			SetCompared(di, _T("b.txt"), 100, mtime);
+			cache.Store(di, 2);
+			SetCompared(di, _T("c.txt"), 100, mtime);
+			cache.Store(di, 2);
+			EXPECT_TRUE(cache.Save(false));
+		}
+		{
+			// Partial compare: results not used are kept
+			CompareResultCache cache(m_sCachePath, 1);
+			EXPECT_TRUE(cache.Load());
+			SetItem(di, _T("a.txt"), 100, mtime);
+			EXPECT_TRUE(cache.Lookup(di, 2));
+			EXPECT_TRUE(cache.Save(false));
+		}
+		{
+			// Full compare: a.txt used, b.txt changed, c.txt gone
+			CompareResultCache cache(m_sCachePath, 1);
+			EXPECT_TRUE(cache.Load());
+			SetItem(di, _T("a.txt"), 100, mtime);
+			EXPECT_TRUE(cache.Lookup(di, 2));
+			SetItem(di, _T("b.txt"), 200, mtime);
+			EXPECT_FALSE(cache.Lookup(di, 2));
+			SetCompared(di, _T("b.txt"), 200, mtime);
+			cache.Store(di, 2);
+			EXPECT_TRUE(cache.Save(true));
+		}
+
+		CompareResultCache cache(m_sCachePath, 1);
+		EXPECT_TRUE(cache.Load());
+		SetItem(di, _T("a.txt"), 100, mtime);
+		EXPECT_TRUE(cache.Lookup(di, 2));
+		SetItem(di, _T("b.txt"), 200, mtime);
+		EXPECT_TRUE(cache.Lookup(di, 2));
+		SetItem(di, _T("b.txt"), 100, mtime);
+		EXPECT_FALSE(cache.Lookup(di, 2));
+		SetItem(di, _T("c.txt"), 100, mtime);
+		EXPECT_FALSE(cache.Lookup(di, 2));
+	}
+
+}  // namespace
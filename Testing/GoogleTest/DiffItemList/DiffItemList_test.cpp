@@ -0,0 +1,163 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <windows.h>
+#include <psapi.h>
+#include <chrono>
+#include <iostream>
+#include "DiffItemList.h"
+
+#pragma comment(lib, "psapi.lib")
+
+namespace
+{
+	// The fixture for testing DiffItemList.
+	class DiffItemListTest : public testing::Test
+	{
+	protected:
+		DiffItemListTest()
+		{
+		}
+
+		virtual ~DiffItemListTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+			m_list.InitDiffItemList();
+		}
+
+		virtual void TearDown()
+		{
+			m_list.RemoveAll();
+		}
+
+		int CountItems() const
+		{
+			int count = 0;
+			DIFFITEM *pos = m_list.GetFirstDiffPosition();
+			while (pos != nullptr)
+			{
+				m_list.GetNextDiffPosition(pos);
+				++count;
+			}
+			return count;
+		}
+
+		DiffItemList m_list;
+	};
+
+	TEST_F(DiffItemListTest, AddAndWalk)
+	{
+		DIFFITEM *dir = m_list.AddNewDiff(nullptr);
+		DIFFITEM *file1 = m_list.AddNewDiff(dir);
+		DIFFITEM *file2 = m_list.AddNewDiff(dir);
+		DIFFITEM *file3 = m_list.AddNewDiff(nullptr);
+		EXPECT_EQ(4, CountItems());
+
+		DIFFITEM *pos = m_list.GetFirstDiffPosition();
+		EXPECT_EQ(dir, &m_list.GetNextDiffRefPosition(pos));
+		EXPECT_EQ(file1, &m_list.GetNextDiffRefPosition(pos));
+		EXPECT_EQ(file2, &m_list.GetNextDiffRefPosition(pos));
+		EXPECT_EQ(file3, &m_list.GetNextDiffRefPosition(pos));
+		EXPECT_EQ(nullptr, pos);
+		EXPECT_EQ(1, file1->GetDepth());
+		EXPECT_TRUE(file1->IsAncestor(dir));
+	}
+
+	TEST_F(DiffItemListTest, Remove)
+	{
+		DIFFITEM *dir1 = m_list.AddNewDiff(nullptr);
+		DIFFITEM *dir2 = m_list.AddNewDiff(nullptr);
+		DIFFITEM *sub = m_list.AddNewDiff(dir1);
+		m_list.AddNewDiff(sub);
+		m_list.AddNewDiff(sub);
+		m_list.AddNewDiff(dir2);
+		EXPECT_EQ(6, CountItems());
+
+		m_list.RemoveChildren(dir2);
+		EXPECT_FALSE(dir2->HasChildren());
+		EXPECT_EQ(5, CountItems());
+
+		m_list.RemoveDiff(sub);
+		EXPECT_FALSE(dir1->HasChildren());
+		EXPECT_EQ(2, CountItems());
+
+		m_list.RemoveDiff(dir1);
+		EXPECT_EQ(dir2, m_list.GetFirstDiffPosition());
+		EXPECT_EQ(1, CountItems());
+
+		// Storage of removed items is reused
+		DIFFITEM *item = m_list.AddNewDiff(dir2);
+		EXPECT_EQ(-1, item->nsdiffs);
+		EXPECT_FALSE(item->HasChildren());
+		EXPECT_EQ(dir2, item->GetParentLink());
+		EXPECT_EQ(2, CountItems());
+	}
+
+	TEST_F(DiffItemListTest, ManyChunks)
+	{
+		const int nItems = static_cast<int>(DiffItemPool::ChunkItems) * 3 + 1;
+		DIFFITEM *dir = m_list.AddNewDiff(nullptr);
+		for (int i = 0; i < nItems; ++i)
+			m_list.AddNewDiff(dir)->nsdiffs = i;
+		EXPECT_EQ(nItems + 1, CountItems());
+
+		int i = 0;
+		for (DIFFITEM *pos = m_list.GetFirstChildDiffPosition(dir); pos != nullptr; ++i)
+			EXPECT_EQ(i, m_list.GetNextSiblingDiffPosition(pos).nsdiffs);
+		EXPECT_EQ(nItems, i);
+
+		m_list.RemoveAll();
+		m_list.InitDiffItemList();
+		EXPECT_EQ(nullptr, m_list.GetFirstDiffPosition());
+	}
+
+	size_t GetPrivateBytes()
+	{
+		PROCESS_MEMORY_COUNTERS_EX pmc = { sizeof(pmc) };
+		GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS *>(&pmc), sizeof(pmc));
+		return pmc.PrivateUsage;
+	}
+
+	// Memory benchmark, run with --gtest_also_run_disabled_tests
+	TEST_F(DiffItemListTest, DISABLED_Memory5M)
+	{
+		const int nFolders = 5000;
+		const int nFilesPerFolder = 999;
+		const String path = _T("folder\\subfolder");
+		const String filename = _T("file.txt");
+
+		size_t before = GetPrivateBytes();
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < nFolders; ++i)
+		{
+			DIFFITEM *dir = m_list.AddNewDiff(nullptr);
+			dir->diffcode.diffcode = DIFFCODE::DIR | DIFFCODE::BOTH;
+			for (int j = 0; j < nFilesPerFolder; ++j)
+			{
+				DIFFITEM *file = m_list.AddNewDiff(dir);
+				file->diffcode.diffcode = DIFFCODE::FILE | DIFFCODE::BOTH;
+				for (int k = 0; k < 2; ++k)
+				{
+					file->diffFileInfo[k].path = path;
+					file->diffFileInfo[k].filename = filename;
+				}
+			}
+		}
+		auto built = std::chrono::steady_clock::now();
+		size_t used = GetPrivateBytes() - before;
+		EXPECT_EQ(nFolders * (nFilesPerFolder + 1), CountItems());
+		m_list.RemoveAll();
+		auto removed = std::chrono::steady_clock::now();
+
+		std::cout << "items: " << nFolders * (nFilesPerFolder + 1)
+			<< ", DIFFITEM: " << sizeof(DIFFITEM) << " bytes"
+			<< ", memory: " << used / (1024 * 1024) << " MB"
+			<< ", build: " << std::chrono::duration_cast<std::chrono::milliseconds>(built - start).count() << " ms"
+			<< ", remove: " << std::chrono::duration_cast<std::chrono::milliseconds>(removed - built).count() << " ms"
+			<< std::endl;
+		m_list.InitDiffItemList();
+	}
+
+}  // namespace
@@ -0,0 +1,143 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <windows.h>
+#include <tchar.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include "UnicodeString.h"
+#include "unicoder.h"
+#include "DirTravel.h"
+#include "../UnitTests/Random.h"
+
+namespace
+{
+	// The fixture for testing DirTravel functions.
+	class DirTravelTest : public testing::Test
+	{
+	protected:
+		DirTravelTest()
+		{
+		}
+
+		virtual ~DirTravelTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+	};
+
+	int sign(int n)
+	{
+		return (n > 0) - (n < 0);
+	}
+
+	DirEntry MakeEntry(const String &name, bool casesensitive)
+	{
+		DirEntry ent;
+		ent.filename = name;
+		ent.collkey = MakeCollationKey(name, casesensitive);
+		return ent;
+	}
+
+	TEST_F(DirTravelTest, KeysOrderLikeCollstr)
+	{
+		const TCHAR *names[] = {
+			_T(""), _T("a"), _T("A"), _T("ab"), _T("aB"), _T("Ab"), _T("b"), _T("B"),
+			_T("a.txt"), _T("a_txt"), _T("a-txt"), _T("a txt"), _T("file10"), _T("file9"),
+			_T("FILE9"), _T("~tmp"), _T("[x]"), _T("Z"), _T("zz"), _T("1"), _T("01"),
+		};
+		for (bool casesensitive : { true, false })
+		{
+			for (const TCHAR *name1 : names)
+			{
+				for (const TCHAR *name2 : names)
+				{
+					DirEntry e1 = MakeEntry(name1, casesensitive);
+					DirEntry e2 = MakeEntry(name2, casesensitive);
+					EXPECT_EQ(sign(collstr(name1, name2, casesensitive)), sign(collitem(e1, e2)))
+						<< ucr::toUTF8(name1) << " " << ucr::toUTF8(name2) << " " << casesensitive;
+				}
+			}
+		}
+	}
+
+	TEST_F(DirTravelTest, IgnoreCase)
+	{
+		EXPECT_EQ(0, collitem(MakeEntry(_T("ReadMe.TXT"), false), MakeEntry(_T("readme.txt"), false)));
+		EXPECT_NE(0, collitem(MakeEntry(_T("ReadMe.TXT"), true), MakeEntry(_T("readme.txt"), true)));
+	}
+
+	std::vector<String> MakeNames(size_t count, unsigned seed)
+	{
+		std::vector<String> names;
+		Random random(seed);
+		for (size_t i = 0; i < count; ++i)
+			names.push_back(strutils::format(_T("Source_File_%08u_%zu.cpp"), random(), i));
+		return names;
+	}
+
+	// Benchmark of sorting and matching two listings of 100k entries,
+	// run with --gtest_also_run_disabled_tests
+	TEST_F(DirTravelTest, DISABLED_SortAndMatch100k)
+	{
+		const size_t count = 100000;
+		std::vector<String> names1 = MakeNames(count, 1);
+		std::vector<String> names2 = names1;
+		std::rotate(names2.begin(), names2.begin() + count / 3, names2.end());
+		names2.resize(count - count / 10);
+
+		// Compare names with collstr() in sort and match
+		auto start = std::chrono::steady_clock::now();
+		{
+			std::vector<String> sorted1 = names1, sorted2 = names2;
+			auto less = [](const String &s1, const String &s2) { return collstr(s1, s2, false) < 0; };
+			std::sort(sorted1.begin(), sorted1.end(), less);
+			std::sort(sorted2.begin(), sorted2.end(), less);
+			size_t i = 0, j = 0, matched = 0;
+			while (i < sorted1.size() && j < sorted2.size())
+			{
+				int cmp = collstr(sorted1[i], sorted2[j], false);
+				if (cmp == 0) { ++matched; ++i; ++j; }
+				else if (cmp < 0) ++i;
+				else ++j;
+			}
+			EXPECT_EQ(names2.size(), matched);
+		}
+		auto collstrDone = std::chrono::steady_clock::now();
+
+		// Compute keys once, compare keys in sort and match
+		{
+			DirItemArray items1, items2;
+			for (const String &name : names1)
+				items1.push_back(MakeEntry(name, false));
+			for (const String &name : names2)
+				items2.push_back(MakeEntry(name, false));
+			auto less = [](const DirEntry &e1, const DirEntry &e2) { return collitem(e1, e2) < 0; };
+			std::sort(items1.begin(), items1.end(), less);
+			std::sort(items2.begin(), items2.end(), less);
+			size_t i = 0, j = 0, matched = 0;
+			while (i < items1.size() && j < items2.size())
+			{
+				int cmp = collitem(items1[i], items2[j]);
+				if (cmp == 0) { ++matched; ++i; ++j; }
+				else if (cmp < 0) ++i;
+				else ++j;
+			}
+			EXPECT_EQ(names2.size(), matched);
+		}
+		auto keysDone = std::chrono::steady_clock::now();
+
+		std::cout << "entries: " << count
+			<< ", collstr: " << std::chrono::duration_cast<std::chrono::milliseconds>(collstrDone - start).count() << " ms"
+			<< ", keys: " << std::chrono::duration_cast<std::chrono::milliseconds>(keysDone - collstrDone).count() << " ms"
+			<< std::endl;
+	}
+
+}  // namespace
@@ -0,0 +1,130 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include "CompareEngines/FileReader.h"
+#include <io.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <fstream>
+#include <string>
+
+using CompareEngines::FileReader;
+
+namespace
+{
+	struct TempFile
+	{
+		TempFile(const std::string& filename, const std::string& data) : m_filename(filename)
+		{
+			std::ofstream ostr(filename.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
+			ostr.write(data.data(), data.size());
+		}
+		~TempFile()
+		{
+			remove(m_filename.c_str());
+		}
+		std::string m_filename;
+	};
+
+	// The fixture for testing FileReader.
+	class FileReaderTest : public testing::Test
+	{
+	protected:
+		FileReaderTest()
+		{
+		}
+
+		virtual ~FileReaderTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+	};
+
+	const FileReader::Strategy Strategies[] =
+		{ FileReader::MAPPED, FileReader::BUFFERED, FileReader::READ_AHEAD };
+
+	std::string MakeData(size_t size)
+	{
+		std::string data(size, '\0');
+		for (size_t i = 0; i < size; ++i)
+			data[i] = static_cast<char>(i * 7 + (i >> 12));
+		return data;
+	}
+
+	bool ReadAll(FileReader &reader, std::string &contents)
+	{
+		contents.clear();
+		while (!reader.IsEof())
+		{
+			const char *data;
+			size_t len;
+			if (!reader.Read(data, len))
+				return false;
+			contents.append(data, len);
+		}
+		return true;
+	}
+
+	TEST_F(FileReaderTest, ReadWhole)
+	{
+		const size_t sizes[] = { 0, 1, 4095, 4096, 1024 * 1024, 1024 * 1024 + 1, 17 * 1024 * 1024 + 3 };
+		for (size_t size : sizes)
+		{
+			std::string data = MakeData(size);
+			TempFile file("_tmp_.bin", data);
+			for (FileReader::Strategy strategy : Strategies)
+			{
+				std::unique_ptr<FileReader> reader = FileReader::Open(_T("_tmp_.bin"), strategy);
+				ASSERT_TRUE(reader != nullptr);
+				std::string contents;
+				EXPECT_TRUE(ReadAll(*reader, contents));
+				EXPECT_TRUE(contents == data) << "size " << size << " strategy " << strategy;
+			}
+		}
+	}
+
+	TEST_F(FileReaderTest, FromDescriptor)
+	{
+		std::string data = MakeData(2 * 1024 * 1024);
+		TempFile file("_tmp_.bin", data);
+		int fd = -1;
+		_sopen_s(&fd, "_tmp_.bin", O_RDONLY | O_BINARY, _SH_DENYWR, _S_IREAD);
+		ASSERT_NE(-1, fd);
+		_lseeki64(fd, 100, SEEK_SET);
+		for (FileReader::Strategy strategy : Strategies)
+		{
+			// Two readers share the descriptor, reading starts from its position
+			std::unique_ptr<FileReader> reader1 = FileReader::Create(fd, strategy);
+			std::unique_ptr<FileReader> reader2 = FileReader::Create(fd, strategy);
+			ASSERT_TRUE(reader1 != nullptr);
+			ASSERT_TRUE(reader2 != nullptr);
+			std::string contents1, contents2;
+			EXPECT_TRUE(ReadAll(*reader1, contents1));
+			EXPECT_TRUE(ReadAll(*reader2, contents2));
+			EXPECT_TRUE(contents1 == data.substr(100));
+			EXPECT_TRUE(contents2 == data.substr(100));
+			EXPECT_EQ(100, _lseeki64(fd, 0, SEEK_CUR));
+		}
+		_close(fd);
+	}
+
+	TEST_F(FileReaderTest, ChooseStrategy)
+	{
+		EXPECT_EQ(FileReader::BUFFERED, FileReader::ChooseStrategy(0));
+		EXPECT_EQ(FileReader::BUFFERED, FileReader::ChooseStrategy(64 * 1024));
+		EXPECT_EQ(FileReader::MAPPED, FileReader::ChooseStrategy(16 * 1024 * 1024));
+		EXPECT_EQ(FileReader::READ_AHEAD, FileReader::ChooseStrategy(1024LL * 1024 * 1024));
+	}
+
+	TEST_F(FileReaderTest, Missing)
+	{
+		EXPECT_TRUE(FileReader::Open(_T("_tmp_nonexistent_.bin")) == nullptr);
+	}
+
+}  // namespace
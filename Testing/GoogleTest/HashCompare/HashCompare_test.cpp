@@ -0,0 +1,196 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include "DiffContext.h"
+#include "PathContext.h"
+#include "CompareEngines/HashCompare.h"
+#include "IAbortable.h"
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	struct TempFile
+	{
+		TempFile(const std::string& filename, const char *data, size_t len) : m_filename(filename)
+		{
+			std::ofstream ostr(filename.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
+			ostr.write(data, len);
+		}
+		~TempFile()
+		{
+			remove(m_filename.c_str());
+		}
+		std::string m_filename;
+	};
+
+	// The fixture for testing HashCompare.
+	class HashCompareTest : public testing::Test
+	{
+	protected:
+		HashCompareTest()
+		{
+		}
+
+		virtual ~HashCompareTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+	};
+
+	/** @brief Abortable which always asks to abort. */
+	struct Aborted : public IAbortable
+	{
+		virtual bool ShouldAbort() const { return true; }
+	};
+
+	uint64_t Digest(const char *data, size_t len)
+	{
+		CompareEngines::ContentHasher hasher;
+		hasher.Update(data, len);
+		return hasher.Digest();
+	}
+
+	TEST_F(HashCompareTest, KnownDigests)
+	{
+		// Reference XXH64 values, seed 0
+		EXPECT_EQ(0xEF46DB3751D8E999ULL, Digest("", 0));
+		EXPECT_EQ(0xD24EC4F1A98C6E5BULL, Digest("a", 1));
+		EXPECT_EQ(0x44BC2CF5AD770999ULL, Digest("abc", 3));
+		const char *text = "Nobody inspects the spammish repetition";
+		EXPECT_EQ(0xFBCEA83C8A378BF1ULL, Digest(text, strlen(text)));
+	}
+
+	TEST_F(HashCompareTest, Chunked)
+	{
+		char data[1280];
+		for (int i = 0; i < sizeof(data); ++i)
+			data[i] = static_cast<char>(i);
+		EXPECT_EQ(0xAFC184AD7938A354ULL, Digest(data, sizeof(data)));
+
+		for (size_t chunk = 1; chunk < 70; chunk += 3)
+		{
+			CompareEngines::ContentHasher hasher;
+			for (size_t pos = 0; pos < sizeof(data); pos += chunk)
+				hasher.Update(data + pos, (std::min)(chunk, sizeof(data) - pos));
+			EXPECT_EQ(0xAFC184AD7938A354ULL, hasher.Digest());
+		}
+	}
+
+	TEST_F(HashCompareTest, TwoWay)
+	{
+		CompareEngines::HashCompare hc;
+		DIFFITEM di;
+		PathContext files;
+		di.diffcode.diffcode = DIFFCODE::FILE | DIFFCODE::BOTH;
+
+		{
+			TempFile l1("A", "1", 1);
+			TempFile r1("B", "1", 1);
+			files.SetLeft(_T("A"));
+			files.SetRight(_T("B"));
+			di.diffFileInfo[0].size = 1;
+			di.diffFileInfo[1].size = 1;
+			EXPECT_EQ(DIFFCODE::SAME, hc.CompareFiles(files, di));
+			EXPECT_TRUE(di.diffFileInfo[0].m_bContentHashValid);
+			EXPECT_TRUE(di.diffFileInfo[1].m_bContentHashValid);
+			EXPECT_EQ(Digest("1", 1), di.diffFileInfo[0].m_contentHash);
+		}
+
+		{
+			TempFile l1("A", "1", 1);
+			TempFile r1("B", "2", 1);
+			files.SetLeft(_T("A"));
+			files.SetRight(_T("B"));
+			EXPECT_EQ(DIFFCODE::DIFF, hc.CompareFiles(files, di));
+			EXPECT_NE(di.diffFileInfo[0].m_contentHash, di.diffFileInfo[1].m_contentHash);
+		}
+
+		{
+			TempFile l1("A", "", 0);
+			TempFile r1("B", "", 0);
+			files.SetLeft(_T("A"));
+			files.SetRight(_T("B"));
+			di.diffFileInfo[0].size = 0;
+			di.diffFileInfo[1].size = 0;
+			EXPECT_EQ(DIFFCODE::SAME, hc.CompareFiles(files, di));
+		}
+
+		{
+			TempFile l1("A", "1", 1);
+			files.SetLeft(_T("A"));
+			files.SetRight(_T("B"));
+			di.diffFileInfo[0].size = 1;
+			di.diffFileInfo[1].size = 1;
+			EXPECT_EQ(DIFFCODE::CMPERR, hc.CompareFiles(files, di));
+		}
+
+		{
+			// Abort is not reported as an error
+			TempFile l1("A", "1", 1);
+			TempFile r1("B", "1", 1);
+			files.SetLeft(_T("A"));
+			files.SetRight(_T("B"));
+			Aborted aborted;
+			hc.SetAbortable(&aborted);
+			EXPECT_EQ(DIFFCODE::CMPABORT, hc.CompareFiles(files, di));
+			hc.SetAbortable(nullptr);
+		}
+	}
+
+	TEST_F(HashCompareTest, ThreeWay)
+	{
+		CompareEngines::HashCompare hc;
+		DIFFITEM di;
+		PathContext files;
+		di.diffcode.diffcode = DIFFCODE::FILE | DIFFCODE::ALL;
+		di.diffFileInfo[0].size = 1;
+		di.diffFileInfo[1].size = 1;
+		di.diffFileInfo[2].size = 1;
+		files.SetLeft(_T("A"));
+		files.SetMiddle(_T("B"));
+		files.SetRight(_T("C"));
+
+		{
+			TempFile l1("A", "1", 1);
+			TempFile m1("B", "1", 1);
+			TempFile r1("C", "1", 1);
+			EXPECT_EQ(DIFFCODE::SAME, hc.CompareFiles(files, di));
+		}
+
+		{
+			TempFile l1("A", "1", 1);
+			TempFile m1("B", "1", 1);
+			TempFile r1("C", "2", 1);
+			EXPECT_EQ(DIFFCODE::DIFF | DIFFCODE::DIFF3RDONLY, hc.CompareFiles(files, di));
+		}
+
+		{
+			TempFile l1("A", "1", 1);
+			TempFile m1("B", "2", 1);
+			TempFile r1("C", "1", 1);
+			EXPECT_EQ(DIFFCODE::DIFF | DIFFCODE::DIFF2NDONLY, hc.CompareFiles(files, di));
+		}
+
+		{
+			TempFile l1("A", "2", 1);
+			TempFile m1("B", "1", 1);
+			TempFile r1("C", "1", 1);
+			EXPECT_EQ(DIFFCODE::DIFF | DIFFCODE::DIFF1STONLY, hc.CompareFiles(files, di));
+		}
+
+		{
+			TempFile l1("A", "1", 1);
+			TempFile m1("B", "2", 1);
+			TempFile r1("C", "3", 1);
+			EXPECT_EQ(DIFFCODE::DIFF, hc.CompareFiles(files, di));
+		}
+	}
+
+}  // namespace
@@ -0,0 +1,105 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "LineAligner.h"
+#include "CompareOptions.h"
+#include "../UnitTests/Random.h"
+
+namespace
+{
+	TEST(LineAligner, Similarity)
+	{
+		LineAligner aligner(false, WHITESPACE_COMPARE_ALL);
+		EXPECT_EQ(LineAligner::MaxScore, aligner.Similarity(_T("int i = 0;"), _T("int i = 0;")));
+		EXPECT_EQ(LineAligner::MaxScore, aligner.Similarity(_T(""), _T("")));
+		EXPECT_EQ(0, aligner.Similarity(_T(""), _T("int i = 0;")));
+		EXPECT_EQ(0, aligner.Similarity(_T("int i = 0;"), _T("return false;")));
+		EXPECT_LT(0, aligner.Similarity(_T("int i = 0;"), _T("int j = 0;")));
+		EXPECT_GT(LineAligner::MaxScore, aligner.Similarity(_T("int i = 0;"), _T("INT I = 0;")));
+
+		LineAligner alignerIgnore(true, WHITESPACE_IGNORE_CHANGE);
+		EXPECT_EQ(LineAligner::MaxScore, alignerIgnore.Similarity(_T("int i = 0;"), _T("INT  I = 0;\t")));
+		EXPECT_GT(LineAligner::MaxScore, alignerIgnore.Similarity(_T("int i = 0;"), _T("int i=0;")));
+		LineAligner alignerIgnoreAll(false, WHITESPACE_IGNORE_ALL);
+		EXPECT_EQ(LineAligner::MaxScore, alignerIgnoreAll.Similarity(_T("int i = 0;"), _T("\tint i=0;")));
+		EXPECT_EQ(LineAligner::MaxScore, alignerIgnoreAll.Similarity(_T("  "), _T("")));
+	}
+
+	TEST(LineAligner, Align)
+	{
+		LineAligner aligner(false, WHITESPACE_COMPARE_ALL);
+		const int N = LineAligner::NO_MATCH;
+
+		// Similar lines are matched, the others paired where they fit
+		std::vector<String> left = { _T("// first"), _T("int i = 0;"), _T("int j = 1;") };
+		std::vector<String> right = { _T("for (;;)"), _T("int i = 10;"), _T("int j = 11;") };
+		EXPECT_EQ(std::vector<int>({ 0, 1, 2 }), aligner.Align(left, right));
+
+		// Inserted line
+		right = { _T("int i = 0;"), _T("return false;"), _T("int j = 1;") };
+		left = { _T("int i = 1;"), _T("int j = 2;") };
+		EXPECT_EQ(std::vector<int>({ 0, 2 }), aligner.Align(left, right));
+
+		// Lines not matching are paired from the top
+		left = { _T("abc"), _T("def"), _T("ghi") };
+		right = { _T("xyz") };
+		EXPECT_EQ(std::vector<int>({ 0, N, N }), aligner.Align(left, right));
+
+		// Similar line far below
+		left = { _T("class CMergeDoc") };
+		right = { _T("abc"), _T("def"), _T("ghi"), _T("class CMergeDoc2") };
+		EXPECT_EQ(std::vector<int>({ 3 }), aligner.Align(left, right));
+
+		EXPECT_EQ(std::vector<int>({ N }), aligner.Align(left, {}));
+		EXPECT_EQ(std::vector<int>(), aligner.Align({}, right));
+	}
+
+	/**
+	 * @brief Lines of a big changed block, and the same lines edited.
+	 * @return Number of lines kept.
+	 */
+	int MakeBlock(int lines, std::vector<String> &left, std::vector<String> &right)
+	{
+		int kept = 0;
+		Random random(1);
+		for (int i = 0; i < lines; ++i)
+		{
+			const String line = _T("\tvalue") + std::to_wstring(i) + _T(" = compute(") + std::to_wstring(random() % 1000) + _T(");");
+			left.push_back(line);
+			switch (random() % 20)
+			{
+			case 0: break;
+			case 1: right.push_back(_T("// ") + std::to_wstring(random())); right.push_back(line + _T(" // x")); ++kept; break;
+			default: right.push_back(line + _T(" // x")); ++kept; break;
+			}
+		}
+		return kept;
+	}
+
+	TEST(LineAligner, BigBlock)
+	{
+		// Too big to evaluate all pairs, only a band is
+		std::vector<String> left, right;
+		const int kept = MakeBlock(20000, left, right);
+		ASSERT_LT(LineAligner::MaxCells, static_cast<int64_t>(left.size()) * right.size());
+
+		std::vector<int> map1 = LineAligner(false, WHITESPACE_COMPARE_ALL, 1).Align(left, right);
+		std::vector<int> map4 = LineAligner(false, WHITESPACE_COMPARE_ALL, 4).Align(left, right);
+		EXPECT_TRUE(map1 == map4);
+
+		int matched = 0, prev = -1;
+		for (size_t i = 0; i < map1.size(); ++i)
+		{
+			if (map1[i] == LineAligner::NO_MATCH)
+				continue;
+			EXPECT_LT(prev, map1[i]);
+			prev = map1[i];
+			if (right[map1[i]] == left[i] + _T(" // x"))
+				++matched;
+		}
+		// Lines kept are matched with their edited lines
+		EXPECT_EQ(kept, matched);
+	}
+
+}  // namespace
@@ -0,0 +1,237 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include "../editlib/stdafx.h"
+#include "../../../Externals/crystaledit/editlib/LineTree.h"
+#include <vector>
+#include "../UnitTests/Random.h"
+
+namespace
+{
+	// The fixture for testing LineTree.
+	class LineTreeTest : public testing::Test
+	{
+	protected:
+		LineTreeTest()
+		{
+		}
+
+		virtual ~LineTreeTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+	};
+
+	/** @brief A line told apart from the others by its flags. */
+	LineInfo Line(DWORD dwTag)
+	{
+		LineInfo li;
+		li.m_dwFlags = dwTag;
+		return li;
+	}
+
+	/** @brief Check the lines of the tree against their tags. */
+	void CheckLines(const LineTree& lines, const std::vector<DWORD>& tags)
+	{
+		ASSERT_EQ(tags.size(), lines.size());
+		EXPECT_EQ(tags.empty(), lines.empty());
+		for (size_t i = 0; i < tags.size(); ++i)
+			ASSERT_EQ(tags[i], lines[i].m_dwFlags) << i;
+		// Backwards, and jumping around, not from the leaves last found
+		for (size_t i = tags.size(); i-- > 0; )
+			ASSERT_EQ(tags[i], lines[i].m_dwFlags) << i;
+		for (size_t i = 0; i < tags.size(); i += 997)
+			ASSERT_EQ(tags[tags.size() - 1 - i], lines[tags.size() - 1 - i].m_dwFlags) << i;
+	}
+
+	/** @brief Insert lines tagged from @p dwTag on, one by one. */
+	void InsertLines(LineTree& lines, std::vector<DWORD>& tags, size_t nPosition, size_t nCount, DWORD dwTag)
+	{
+		for (size_t i = 0; i < nCount; ++i)
+		{
+			lines.insert(nPosition + i, 1, Line(dwTag + static_cast<DWORD>(i)));
+			tags.insert(tags.begin() + nPosition + i, dwTag + static_cast<DWORD>(i));
+		}
+	}
+
+	TEST_F(LineTreeTest, Empty)
+	{
+		LineTree lines;
+		EXPECT_TRUE(lines.empty());
+		EXPECT_EQ(0u, lines.size());
+		lines.insert(0, 0, Line(1));
+		lines.erase(0, 0);
+		EXPECT_TRUE(lines.empty());
+	}
+
+	// Lines are found by index after inserts at the start, middle and end
+	TEST_F(LineTreeTest, Insert)
+	{
+		LineTree lines;
+		std::vector<DWORD> tags;
+		InsertLines(lines, tags, 0, 10, 100);
+		InsertLines(lines, tags, 0, 3, 200);
+		InsertLines(lines, tags, 5, 4, 300);
+		InsertLines(lines, tags, tags.size(), 2, 400);
+		CheckLines(lines, tags);
+
+		lines.insert(7, 20, Line(500));
+		tags.insert(tags.begin() + 7, 20, 500);
+		CheckLines(lines, tags);
+	}
+
+	// Leaves and nodes split when they get too many lines or children
+	TEST_F(LineTreeTest, Split)
+	{
+		LineTree lines;
+		std::vector<DWORD> tags;
+
+		// More lines than a leaf holds, inserted one by one in the middle
+		InsertLines(lines, tags, 0, 2, 1);
+		InsertLines(lines, tags, 1, 3 * LineTree::MaxLeafLines, 10);
+		CheckLines(lines, tags);
+
+		// More leaves than a node holds, in one insert
+		const size_t nCount = 3 * LineTree::MaxLeafLines * LineTree::MaxChildren;
+		lines.insert(100, nCount, Line(2));
+		tags.insert(tags.begin() + 100, nCount, 2);
+		CheckLines(lines, tags);
+
+		// Insert at the edges of the leaves
+		for (size_t i = 0; i < 2 * LineTree::MaxChildren; ++i)
+		{
+			const size_t nPosition = i * LineTree::MaxLeafLines;
+			lines.insert(nPosition, 1, Line(3));
+			tags.insert(tags.begin() + nPosition, 3);
+		}
+		CheckLines(lines, tags);
+	}
+
+	// Nodes merge with their neighbours when they get too few lines
+	TEST_F(LineTreeTest, Merge)
+	{
+		LineTree lines;
+		std::vector<DWORD> tags;
+		InsertLines(lines, tags, 0, 4 * LineTree::MaxLeafLines * LineTree::MaxChildren, 0);
+
+		// Erase most lines of every leaf
+		for (size_t nPosition = 0; nPosition + 10 < tags.size(); nPosition += 10)
+		{
+			const size_t nLast = nPosition + (std::min)(static_cast<size_t>(LineTree::MaxLeafLines), tags.size() - nPosition - 10);
+			lines.erase(nPosition + 10, nLast);
+			tags.erase(tags.begin() + nPosition + 10, tags.begin() + nLast);
+		}
+		CheckLines(lines, tags);
+
+		// Erase ranges spanning many leaves, then down to one line
+		lines.erase(5, tags.size() / 2);
+		tags.erase(tags.begin() + 5, tags.begin() + tags.size() / 2);
+		CheckLines(lines, tags);
+		lines.erase(1, tags.size());
+		tags.erase(tags.begin() + 1, tags.end());
+		CheckLines(lines, tags);
+		lines.erase(0, 1);
+		EXPECT_TRUE(lines.empty());
+
+		// The tree is still usable
+		tags.clear();
+		InsertLines(lines, tags, 0, 3 * LineTree::MaxLeafLines, 7);
+		CheckLines(lines, tags);
+	}
+
+	TEST_F(LineTreeTest, ResizeAndClear)
+	{
+		LineTree lines;
+		std::vector<DWORD> tags;
+		InsertLines(lines, tags, 0, 100, 1);
+		lines.resize(5000);
+		tags.resize(5000, Line(0).m_dwFlags);
+		CheckLines(lines, tags);
+		lines.resize(40);
+		tags.resize(40);
+		CheckLines(lines, tags);
+		lines.clear();
+		EXPECT_TRUE(lines.empty());
+		lines.resize(3);
+		EXPECT_EQ(3u, lines.size());
+	}
+
+	// Lines changed through an index are changed in the tree
+	TEST_F(LineTreeTest, Index)
+	{
+		LineTree lines;
+		std::vector<DWORD> tags;
+		lines.insert(0, 5 * LineTree::MaxLeafLines, Line(0));
+		tags.insert(tags.begin(), 5 * LineTree::MaxLeafLines, 0);
+		for (size_t i = 0; i < tags.size(); i += 3)
+		{
+			lines[i].m_dwFlags = static_cast<DWORD>(i);
+			tags[i] = static_cast<DWORD>(i);
+		}
+		// Copying lines down, as when compacting them
+		size_t nKept = 0;
+		for (size_t i = 0; i < tags.size(); ++i)
+		{
+			if (i % 3 != 1)
+			{
+				lines[nKept] = lines[i];
+				tags[nKept++] = tags[i];
+			}
+		}
+		lines.resize(nKept);
+		tags.resize(nKept);
+		CheckLines(lines, tags);
+	}
+
+	// Same lines as a vector after random inserts, erases and resizes
+	TEST_F(LineTreeTest, SameAsVector)
+	{
+		Random random(1);
+		for (int round = 0; round < 20; ++round)
+		{
+			LineTree lines;
+			std::vector<DWORD> tags;
+			DWORD dwTag = 1;
+			for (int step = 0; step < 500; ++step)
+			{
+				const unsigned kind = random(10);
+				if (kind < 4)
+				{
+					const size_t nPosition = random(static_cast<unsigned>(tags.size()) + 1);
+					const size_t nCount = random(3) == 0 ? random(3000) : random(5);
+					lines.insert(nPosition, nCount, Line(dwTag));
+					tags.insert(tags.begin() + nPosition, nCount, dwTag++);
+				}
+				else if (kind < 7 && !tags.empty())
+				{
+					const size_t nFirst = random(static_cast<unsigned>(tags.size()));
+					const size_t nMax = random(3) == 0 ? tags.size() - nFirst : (std::min)(static_cast<size_t>(10), tags.size() - nFirst);
+					const size_t nLast = nFirst + random(static_cast<unsigned>(nMax) + 1);
+					lines.erase(nFirst, nLast);
+					tags.erase(tags.begin() + nFirst, tags.begin() + nLast);
+				}
+				else if (kind == 7)
+				{
+					const size_t nSize = random(5000);
+					lines.resize(nSize);
+					tags.resize(nSize, Line(0).m_dwFlags);
+				}
+				else if (!tags.empty())
+				{
+					const size_t nLine = random(static_cast<unsigned>(tags.size()));
+					lines[nLine].m_dwFlags = dwTag;
+					tags[nLine] = dwTag++;
+				}
+				ASSERT_EQ(tags.size(), lines.size());
+			}
+			CheckLines(lines, tags);
+		}
+	}
+
+}  // namespace
@@ -0,0 +1,374 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "MovedLines.h"
+#include "diff.h"
+#include "../UnitTests/DiffBuffers.h"
+#include "../UnitTests/Random.h"
+
+namespace
+{
+	/** @brief Result of diff_2_files() with moved block detection for in-memory texts. */
+	struct Diff
+	{
+		Diff(const std::string& text0, const std::string& text1, bool movedBlocks = true)
+		{
+			OpenBuffers(inf, text0, text1);
+			always_text_flag = 1;
+			output_style = OUTPUT_NORMAL;
+			ignore_case_flag = 0;
+			ignore_space_change_flag = 0;
+			ignore_all_space_flag = 0;
+			ignore_eol_diff = 0;
+			ignore_blank_lines_flag = 0;
+			ignore_some_changes = 0;
+			length_varies = 0;
+			int bin_status = 0;
+			script = diff_2_files(inf, 0, &bin_status, movedBlocks, nullptr);
+			always_text_flag = 0;
+		}
+		~Diff()
+		{
+			for (change *e = script, *next; e != nullptr; e = next)
+			{
+				next = e->link;
+				free(e);
+			}
+			cleanup_file_buffers(inf);
+		}
+		/** @brief Number of lines in moved blocks, checking they match the lines they are moved to. */
+		int Moved() const
+		{
+			int moved = 0;
+			for (const change *e = script; e != nullptr; e = e->link)
+			{
+				if (e->match1 >= 0)
+				{
+					for (int k = 0; k < e->deleted; ++k)
+						EXPECT_EQ(inf[0].equivs[e->line0 + k], inf[1].equivs[e->match1 + k]);
+					moved += e->deleted;
+				}
+				if (e->match0 >= 0)
+				{
+					for (int k = 0; k < e->inserted; ++k)
+						EXPECT_EQ(inf[0].equivs[e->match0 + k], inf[1].equivs[e->line1 + k]);
+					moved += e->inserted;
+				}
+			}
+			return moved;
+		}
+		file_data inf[2];
+		change *script;
+	};
+
+	/** @brief Lines of a function with unique lines. */
+	std::string Function(int n, int lines = 5)
+	{
+		std::string text = "void f" + std::to_string(n) + "()\n{\n";
+		for (int i = 0; i < lines; ++i)
+			text += "\tcall(" + std::to_string(n) + ", " + std::to_string(i) + ");\n";
+		return text + "}\n";
+	}
+
+	/**
+	 * @brief Source of @p functions functions, and a copy with every 10th
+	 * function moved elsewhere and some functions edited.
+	 */
+	void MakeSource(int functions, std::string &text0, std::string &text1)
+	{
+		Random random(1);
+		std::vector<int> order;
+		std::vector<int> moved;
+		for (int i = 0; i < functions; ++i)
+		{
+			text0 += Function(i);
+			if (i % 10 == 5)
+				moved.push_back(i);
+			else
+				order.push_back(i);
+		}
+		for (int n : moved)
+			order.insert(order.begin() + random() % order.size(), n);
+		for (int n : order)
+			text1 += random() % 20 == 0 ? Function(n, 6) : Function(n);
+	}
+
+	TEST(MovedBlocks, MovedFunction)
+	{
+		const std::string text0 = Function(0) + Function(1) + Function(2) + Function(3);
+		const std::string text1 = Function(0) + Function(2) + Function(3) + Function(1);
+		Diff diff(text0, text1);
+		// Both sides of the function, braces too: blocks extend over lines not unique
+		EXPECT_EQ(2 * 8, diff.Moved());
+
+		Diff noMoved(text0, text1, false);
+		for (const change *e = noMoved.script; e != nullptr; e = e->link)
+		{
+			EXPECT_EQ(-1, e->match0);
+			EXPECT_EQ(-1, e->match1);
+		}
+	}
+
+	TEST(MovedBlocks, NotMoved)
+	{
+		// Changed lines not found on the other side, or only in unchanged lines
+		Diff diff("a\nb\nc\nd\n", "a\nx\nc\ny\n");
+		EXPECT_EQ(0, diff.Moved());
+		Diff diff2("a\nb\n", "b\na\nb\n");
+		EXPECT_EQ(0, diff2.Moved());
+		Diff diff3("", "a\n");
+		EXPECT_EQ(0, diff3.Moved());
+	}
+
+	TEST(MovedBlocks, MovedAtEnds)
+	{
+		// Moved blocks reaching the first and last lines of the files
+		Diff diff("a\nb\nc\nd\ne\n", "d\ne\nc\na\nb\n");
+		EXPECT_LT(0, diff.Moved());
+		Diff diff2("a\nb\nc\n", "c\nb\na\n");
+		EXPECT_LT(0, diff2.Moved());
+	}
+
+	TEST(MovedBlocks, ManyMovedFunctions)
+	{
+		std::string text0, text1;
+		MakeSource(1000, text0, text1);
+		Diff diff(text0, text1);
+		// At least the lines of the functions moved and not edited, but their braces
+		EXPECT_LT(90 * 6, diff.Moved());
+	}
+
+	/** @brief Altered lines of one equivalency class, counted the way moved block detection needs them. */
+	struct Group
+	{
+		int count[2]; /**< Altered lines on each side */
+		int line[2]; /**< An altered line on each side */
+	};
+
+	/**
+	 * @brief Random texts of few distinct lines, the second with blocks moved,
+	 * replaced, deleted or inserted.
+	 */
+	void MakeMoves(Random& random, std::string &text0, std::string &text1)
+	{
+		const unsigned range = 1 + random(random(2) ? 10 : 200);
+		std::vector<std::string> lines0, lines1;
+		for (int n = random(60); n > 0; --n)
+			lines0.push_back(std::to_string(random(range)) + "\n");
+		lines1 = lines0;
+		for (int edits = random(6); edits > 0 && !lines1.empty(); --edits)
+		{
+			const size_t first = random(static_cast<unsigned>(lines1.size()));
+			const size_t last = first + random(static_cast<unsigned>((std::min)(lines1.size() - first, size_t(6)))) + 1;
+			std::vector<std::string> block(lines1.begin() + first, lines1.begin() + last);
+			lines1.erase(lines1.begin() + first, lines1.begin() + last);
+			switch (random(4))
+			{
+			case 0: // moved
+				lines1.insert(lines1.begin() + random(static_cast<unsigned>(lines1.size()) + 1), block.begin(), block.end());
+				break;
+			case 1: // replaced
+				lines1.insert(lines1.begin() + first, std::to_string(random(range)) + "\n");
+				break;
+			case 2: // inserted
+				block.insert(block.begin(), std::to_string(random(range)) + "\n");
+				lines1.insert(lines1.begin() + first, block.begin(), block.end());
+				break;
+			default: // deleted
+				break;
+			}
+		}
+		for (const auto& line : lines0)
+			text0 += line;
+		for (const auto& line : lines1)
+			text1 += line;
+	}
+
+	// Every altered line found once among the altered lines of each side is
+	// in a moved block, and every moved block has such a line moved to the
+	// other one. Groups of the altered lines are collected here into a
+	// std::map, for reference.
+	TEST(MovedBlocks, SameAsReferenceGroups)
+	{
+		Random random(2);
+		for (int iter = 0; iter < 3000; ++iter)
+		{
+			std::string text0, text1;
+			MakeMoves(random, text0, text1);
+			Diff diff(text0, text1);
+			diff.Moved();
+
+			std::map<int, Group> groups;
+			for (const change *e = diff.script; e != nullptr; e = e->link)
+			{
+				const int first[2] = { e->line0, e->line1 };
+				const int count[2] = { e->deleted, e->inserted };
+				for (int side = 0; side < 2; ++side)
+				{
+					for (int line = first[side]; line < first[side] + count[side]; ++line)
+					{
+						Group& group = groups.insert({ diff.inf[side].equivs[line], Group() }).first->second;
+						group.line[side] = line;
+						++group.count[side];
+					}
+				}
+			}
+			auto isPerfect = [&](int side, int line) -> const Group *
+			{
+				const Group& group = groups[diff.inf[side].equivs[line]];
+				return (group.count[0] == 1 && group.count[1] == 1) ? &group : nullptr;
+			};
+
+			for (const change *e = diff.script; e != nullptr; e = e->link)
+			{
+				bool bSeed = false;
+				for (int k = 0; k < e->deleted; ++k)
+				{
+					if (const Group *group = isPerfect(0, e->line0 + k))
+					{
+						ASSERT_LE(0, e->match1) << "iteration " << iter;
+						if (group->line[1] == e->match1 + k)
+							bSeed = true;
+					}
+				}
+				if (e->match1 >= 0)
+				{
+					EXPECT_TRUE(bSeed) << "iteration " << iter;
+				}
+				bSeed = false;
+				for (int k = 0; k < e->inserted; ++k)
+				{
+					if (const Group *group = isPerfect(1, e->line1 + k))
+					{
+						ASSERT_LE(0, e->match0) << "iteration " << iter;
+						if (group->line[0] == e->match0 + k)
+							bSeed = true;
+					}
+				}
+				if (e->match0 >= 0)
+				{
+					EXPECT_TRUE(bSeed) << "iteration " << iter;
+				}
+			}
+		}
+	}
+
+	TEST(MovedLines, LineInBlock)
+	{
+		MovedLines moved;
+		for (unsigned i = 10; i < 20; ++i)
+			moved.Add(MovedLines::SIDE_LEFT, i, i + 100);
+		for (unsigned i = 30; i < 35; ++i)
+			moved.Add(MovedLines::SIDE_LEFT, i, 5 - (i - 30));
+		moved.Add(MovedLines::SIDE_RIGHT, 7, 3);
+
+		EXPECT_EQ(-1, moved.LineInBlock(9, MovedLines::SIDE_LEFT));
+		EXPECT_EQ(110, moved.LineInBlock(10, MovedLines::SIDE_LEFT));
+		EXPECT_EQ(119, moved.LineInBlock(19, MovedLines::SIDE_LEFT));
+		EXPECT_EQ(-1, moved.LineInBlock(20, MovedLines::SIDE_LEFT));
+		EXPECT_EQ(5, moved.LineInBlock(30, MovedLines::SIDE_LEFT));
+		EXPECT_EQ(1, moved.LineInBlock(34, MovedLines::SIDE_LEFT));
+		EXPECT_EQ(-1, moved.LineInBlock(35, MovedLines::SIDE_LEFT));
+		EXPECT_EQ(-1, moved.LineInBlock(7, MovedLines::SIDE_LEFT));
+		EXPECT_EQ(3, moved.LineInBlock(7, MovedLines::SIDE_RIGHT));
+		EXPECT_EQ(-1, moved.LineInBlock(10, MovedLines::SIDE_RIGHT));
+
+		// Consecutive lines moved to consecutive lines make one block
+		EXPECT_EQ(6u, moved.GetBlocks(MovedLines::SIDE_LEFT).size());
+		EXPECT_EQ(1u, moved.GetBlocks(MovedLines::SIDE_RIGHT).size());
+
+		moved.Clear();
+		EXPECT_EQ(-1, moved.LineInBlock(10, MovedLines::SIDE_LEFT));
+		EXPECT_EQ(-1, moved.LineInBlock(7, MovedLines::SIDE_RIGHT));
+	}
+
+	TEST(MovedLines, OutOfOrder)
+	{
+		MovedLines moved;
+		for (unsigned i = 10; i < 20; ++i)
+			moved.Add(MovedLines::SIDE_RIGHT, i, i + 100);
+		moved.Add(MovedLines::SIDE_RIGHT, 5, 50);
+		moved.Add(MovedLines::SIDE_RIGHT, 15, 0);
+		moved.Add(MovedLines::SIDE_RIGHT, 10, 1);
+		moved.Add(MovedLines::SIDE_RIGHT, 19, 2);
+
+		const int expected[] = { 50, -1, -1, -1, -1, 1, 111, 112, 113, 114, 0, 116, 117, 118, 2, -1 };
+		for (unsigned i = 5; i < 21; ++i)
+			EXPECT_EQ(expected[i - 5], moved.LineInBlock(i, MovedLines::SIDE_RIGHT)) << i;
+
+		const MovedLines::MovedBlocks& blocks = moved.GetBlocks(MovedLines::SIDE_RIGHT);
+		for (size_t i = 1; i < blocks.size(); ++i)
+			EXPECT_LE(blocks[i - 1].end, blocks[i].begin);
+	}
+
+	// Same lines moved as in a map of lines, whatever the order lines are added in
+	TEST(MovedLines, SameAsMap)
+	{
+		Random random(3);
+		for (int iter = 0; iter < 200; ++iter)
+		{
+			MovedLines moved;
+			std::map<int, int> reference;
+			for (int n = random(100); n > 0; --n)
+			{
+				// Mostly runs of lines in order, some lines out of order
+				int line = reference.empty() ? random(50) : reference.rbegin()->first + 1;
+				if (random(4) == 0)
+					line = random(200);
+				const int target = random(3) == 0 ? random(200) : (reference.count(line - 1) ? reference[line - 1] + 1 : random(200));
+				moved.Add(MovedLines::SIDE_LEFT, line, target);
+				reference[line] = target;
+			}
+			for (int line = 0; line < 210; ++line)
+			{
+				auto it = reference.find(line);
+				EXPECT_EQ(it != reference.end() ? it->second : -1, moved.LineInBlock(line, MovedLines::SIDE_LEFT))
+					<< "iteration " << iter << " line " << line;
+			}
+			const MovedLines::MovedBlocks& blocks = moved.GetBlocks(MovedLines::SIDE_LEFT);
+			for (size_t i = 1; i < blocks.size(); ++i)
+				EXPECT_LE(blocks[i - 1].end, blocks[i].begin);
+		}
+	}
+
+	TEST(MovedBlocks, DISABLED_moved_blocks_100K)
+	{
+		std::string text0, text1;
+		MakeSource(100000, text0, text1);
+		for (bool movedBlocks : { false, true })
+		{
+			auto start = std::chrono::steady_clock::now();
+			int moved = 0;
+			{
+				Diff diff(text0, text1, movedBlocks);
+				moved = diff.Moved();
+			}
+			auto end = std::chrono::steady_clock::now();
+			printf("diff_2_files moved blocks %d: %d moved lines %lld ms\n", movedBlocks, moved,
+				static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()));
+		}
+
+		MovedLines movedLines;
+		for (unsigned i = 0; i < 1000000; ++i)
+		{
+			if (i % 100 < 20)
+				movedLines.Add(MovedLines::SIDE_LEFT, i, 2000000 - i);
+		}
+		auto start = std::chrono::steady_clock::now();
+		int found = 0;
+		for (unsigned i = 0; i < 1000000; ++i)
+			found += movedLines.LineInBlock(i, MovedLines::SIDE_LEFT) != -1;
+		auto end = std::chrono::steady_clock::now();
+		EXPECT_EQ(200000, found);
+		printf("MovedLines::LineInBlock 1M lines %lld ms\n",
+			static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()));
+	}
+
+}  // namespace
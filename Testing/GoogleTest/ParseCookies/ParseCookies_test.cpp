@@ -0,0 +1,214 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include "../editlib/stdafx.h"
+#include "../../../Externals/crystaledit/editlib/ParseCookies.h"
+#include <vector>
+#include "../UnitTests/Random.h"
+
+namespace
+{
+	// The fixture for testing ParseCookies.
+	class ParseCookiesTest : public testing::Test
+	{
+	protected:
+		ParseCookiesTest()
+		{
+		}
+
+		virtual ~ParseCookiesTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+	};
+
+	/**
+	 * @brief Lines parsed like a text view parses them.
+	 * A line below 100 keeps the state of the line before, like a line
+	 * without comment marks; another line sets the state to its value
+	 * minus 100.
+	 */
+	struct View
+	{
+		View() : nParsed(0) {}
+
+		DWORD Parse(DWORD dwCookie, unsigned nLine)
+		{
+			++nParsed;
+			return lines[nLine] < 100 ? dwCookie : lines[nLine] - 100;
+		}
+
+		/** @brief Parse the first line whose cookie is not known, like ParseNextLine(). */
+		void ParseNextLine()
+		{
+			const size_t L = cookies.GetValidLines();
+			cookies.SetNext(Parse(L > 0 ? cookies[L - 1] : 0, static_cast<unsigned>(L)));
+		}
+
+		/** @brief Return cookie of a line, or 0 before the first, like GetParseCookie(). */
+		DWORD GetParseCookie(ptrdiff_t nLine)
+		{
+			if (cookies.empty())
+				cookies.Reset(lines.size());
+			if (nLine < 0)
+				return 0;
+			while (cookies.GetValidLines() <= static_cast<size_t>(nLine))
+				ParseNextLine();
+			return cookies[nLine];
+		}
+
+		/** @brief Parse a line for drawing it, like GetTextBlocks(). */
+		DWORD DrawLine(size_t nLine)
+		{
+			const DWORD dwCookie = Parse(GetParseCookie(static_cast<ptrdiff_t>(nLine) - 1), static_cast<unsigned>(nLine));
+			if (cookies.GetValidLines() == nLine)
+				cookies.SetNext(dwCookie);
+			EXPECT_EQ(dwCookie, cookies[nLine]);
+			return dwCookie;
+		}
+
+		/** @brief Cookies of all lines, parsed from the first. */
+		std::vector<DWORD> FullReparse()
+		{
+			std::vector<DWORD> result;
+			DWORD dwCookie = 0;
+			for (size_t i = 0; i < lines.size(); ++i)
+				result.push_back(dwCookie = lines[i] < 100 ? dwCookie : lines[i] - 100);
+			return result;
+		}
+
+		std::vector<unsigned> lines;
+		ParseCookies cookies;
+		int nParsed;
+	};
+
+	// Cookies are computed when asked for, from the last known one
+	TEST_F(ParseCookiesTest, Parse)
+	{
+		View view;
+		view.lines = { 1, 102, 3, 4, 100, 5 };
+		EXPECT_EQ(2u, view.GetParseCookie(3));
+		EXPECT_EQ(4u, view.cookies.GetValidLines());
+		EXPECT_EQ(4, view.nParsed);
+		EXPECT_EQ(0u, view.GetParseCookie(5));
+		EXPECT_EQ(6, view.nParsed);
+		EXPECT_EQ(view.FullReparse()[2], view.GetParseCookie(2));
+		EXPECT_EQ(6, view.nParsed);
+	}
+
+	// Lines below a changed line are not parsed again when its cookie is the same
+	TEST_F(ParseCookiesTest, SameCookie)
+	{
+		View view;
+		view.lines.assign(1000, 1);
+		view.lines[500] = 103;
+		view.GetParseCookie(999);
+		EXPECT_EQ(1000, view.nParsed);
+
+		// The changed line and the next one, which has the cookie it had
+		view.lines[10] = 2;
+		view.cookies.LineChanged(10);
+		view.nParsed = 0;
+		EXPECT_EQ(3u, view.GetParseCookie(999));
+		EXPECT_EQ(2, view.nParsed);
+
+		// Changed cookie: parsing goes on to the next line setting the state
+		view.lines[10] = 105;
+		view.cookies.LineChanged(10);
+		view.nParsed = 0;
+		EXPECT_EQ(3u, view.GetParseCookie(999));
+		EXPECT_EQ(491, view.nParsed);
+		EXPECT_EQ(5u, view.GetParseCookie(499));
+
+		// Lines inserted and deleted
+		view.lines.insert(view.lines.begin() + 21, 5, 1);
+		view.cookies.LinesChanged(20, 5);
+		view.nParsed = 0;
+		EXPECT_EQ(3u, view.GetParseCookie(1004));
+		EXPECT_EQ(7, view.nParsed);
+		view.lines.erase(view.lines.begin() + 31, view.lines.begin() + 36);
+		view.cookies.LinesChanged(30, -5);
+		view.nParsed = 0;
+		EXPECT_EQ(3u, view.GetParseCookie(999));
+		EXPECT_EQ(2, view.nParsed);
+		for (size_t i = 0; i < view.lines.size(); ++i)
+			EXPECT_EQ(view.FullReparse()[i], view.GetParseCookie(i)) << i;
+	}
+
+	// Same cookies as a full reparse after random edits
+	TEST_F(ParseCookiesTest, SameAsFullReparse)
+	{
+		Random random(1);
+		for (int round = 0; round < 50; ++round)
+		{
+			View view;
+			view.lines.resize(1 + random(200));
+			for (auto& line : view.lines)
+				line = random(5) == 0 ? 100 + random(4) : random(100);
+			for (int step = 0; step < 300; ++step)
+			{
+				const size_t nLineCount = view.lines.size();
+				const size_t nLine = random(static_cast<unsigned>(nLineCount));
+				const unsigned nValue = random(5) == 0 ? 100 + random(4) : random(100);
+				const unsigned kind = random(10);
+				if (kind < 3)
+				{
+					view.lines[nLine] = nValue;
+					if (!view.cookies.empty())
+						view.cookies.LineChanged(nLine);
+				}
+				else if (kind < 5)
+				{
+					const size_t nCount = random(10);
+					view.lines[nLine] = nValue;
+					view.lines.insert(view.lines.begin() + nLine + 1, nCount, random(2) ? nValue : 1);
+					if (!view.cookies.empty())
+						view.cookies.LinesChanged(nLine, static_cast<ptrdiff_t>(nCount));
+				}
+				else if (kind < 7)
+				{
+					const size_t nCount = random(static_cast<unsigned>((std::min)(nLineCount - nLine - 1, static_cast<size_t>(10))) + 1);
+					view.lines[nLine] = nValue;
+					view.lines.erase(view.lines.begin() + nLine + 1, view.lines.begin() + nLine + 1 + nCount);
+					if (!view.cookies.empty())
+						view.cookies.LinesChanged(nLine, -static_cast<ptrdiff_t>(nCount));
+				}
+				else if (kind == 7)
+				{
+					for (size_t i = nLine; i < nLineCount; ++i)
+					{
+						if (random(3) == 0)
+							view.lines[i] = random(2) ? nValue : random(100);
+					}
+					if (!view.cookies.empty())
+						view.cookies.TextChanged(nLine);
+				}
+				else if (kind == 8 && random(10) == 0)
+				{
+					view.cookies.clear();
+				}
+
+				// Draw a few lines, and read cookies of others
+				const std::vector<DWORD> expected = view.FullReparse();
+				const size_t nTop = random(static_cast<unsigned>(view.lines.size()));
+				for (size_t i = nTop; i < (std::min)(nTop + 5, view.lines.size()); ++i)
+					ASSERT_EQ(expected[i], view.DrawLine(i)) << i;
+				const size_t nOther = random(static_cast<unsigned>(view.lines.size()));
+				ASSERT_EQ(expected[nOther], view.GetParseCookie(nOther)) << nOther;
+				if (step % 20 == 0)
+				{
+					for (size_t i = 0; i < view.lines.size(); ++i)
+						ASSERT_EQ(expected[i], view.GetParseCookie(i)) << i;
+				}
+				ASSERT_EQ(view.lines.size(), view.cookies.size());
+			}
+		}
+	}
+
+}  // namespace
@@ -0,0 +1,149 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include "DiffContext.h"
+#include "PathContext.h"
+#include "CompareEngines/PrefilterCompare.h"
+#include <fstream>
+#include <string>
+
+using CompareEngines::PrefilterCompare;
+
+namespace
+{
+	struct TempFile
+	{
+		TempFile(const std::string& filename, const std::string& data) : m_filename(filename)
+		{
+			std::ofstream ostr(filename.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
+			ostr.write(data.data(), data.size());
+		}
+		~TempFile()
+		{
+			remove(m_filename.c_str());
+		}
+		std::string m_filename;
+	};
+
+	// The fixture for testing PrefilterCompare.
+	class PrefilterCompareTest : public testing::Test
+	{
+	protected:
+		PrefilterCompareTest()
+		{
+		}
+
+		virtual ~PrefilterCompareTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+	};
+
+	int CompareTwo(const std::string& data1, const std::string& data2, bool bSignatures = false)
+	{
+		TempFile l1("A", data1);
+		TempFile r1("B", data2);
+		PrefilterCompare pc;
+		DIFFITEM di;
+		PathContext files;
+		di.diffcode.diffcode = DIFFCODE::FILE | DIFFCODE::BOTH;
+		di.diffFileInfo[0].size = data1.size();
+		di.diffFileInfo[1].size = data2.size();
+		files.SetLeft(_T("A"));
+		files.SetRight(_T("B"));
+		return pc.CompareFiles(files, di, bSignatures);
+	}
+
+	int CompareThree(const std::string& data1, const std::string& data2, const std::string& data3)
+	{
+		TempFile l1("A", data1);
+		TempFile m1("B", data2);
+		TempFile r1("C", data3);
+		PrefilterCompare pc;
+		DIFFITEM di;
+		PathContext files;
+		di.diffcode.diffcode = DIFFCODE::FILE | DIFFCODE::ALL;
+		di.diffFileInfo[0].size = data1.size();
+		di.diffFileInfo[1].size = data2.size();
+		di.diffFileInfo[2].size = data3.size();
+		files.SetLeft(_T("A"));
+		files.SetMiddle(_T("B"));
+		files.SetRight(_T("C"));
+		return pc.CompareFiles(files, di);
+	}
+
+	TEST_F(PrefilterCompareTest, SizeDiffers)
+	{
+		// Only sizes are compared, no text/binary status
+		EXPECT_EQ(DIFFCODE::FILE | DIFFCODE::DIFF, CompareTwo("abc", "abcd"));
+	}
+
+	TEST_F(PrefilterCompareTest, SmallFiles)
+	{
+		EXPECT_EQ(DIFFCODE::FILE | DIFFCODE::TEXT | DIFFCODE::SAME, CompareTwo("abc", "abc"));
+		EXPECT_EQ(DIFFCODE::FILE | DIFFCODE::TEXT | DIFFCODE::DIFF, CompareTwo("abc", "abd"));
+		EXPECT_EQ(DIFFCODE::FILE | DIFFCODE::TEXT | DIFFCODE::SAME, CompareTwo("", ""));
+		EXPECT_EQ(DIFFCODE::FILE | DIFFCODE::BIN | DIFFCODE::BINSIDE1 | DIFFCODE::DIFF,
+			CompareTwo(std::string("a\0c", 3), "abc"));
+
+		// Samples from beginning and end cover the whole file
+		std::string data(PrefilterCompare::SampleSize + 100, 'x');
+		std::string data2 = data;
+		data2[PrefilterCompare::SampleSize + 50] = 'y';
+		EXPECT_EQ(DIFFCODE::FILE | DIFFCODE::TEXT | DIFFCODE::DIFF, CompareTwo(data, data2));
+	}
+
+	TEST_F(PrefilterCompareTest, LargeFiles)
+	{
+		std::string data(3 * PrefilterCompare::SampleSize, 'x');
+		std::string data2 = data;
+
+		// Difference in the middle is left for full compare
+		data2[data.size() / 2] = 'y';
+		EXPECT_EQ(0, CompareTwo(data, data2));
+		EXPECT_EQ(0, CompareTwo(data, data));
+
+		// Differences in samples
+		data2 = data;
+		data2[5] = 'y';
+		EXPECT_EQ(DIFFCODE::FILE | DIFFCODE::DIFF, CompareTwo(data, data2));
+		data2 = data;
+		data2[data.size() - 1] = 'y';
+		EXPECT_EQ(DIFFCODE::FILE | DIFFCODE::DIFF, CompareTwo(data, data2));
+	}
+
+	TEST_F(PrefilterCompareTest, Signatures)
+	{
+		// Diffutils compare skips a UTF-8 BOM, so these may compare same
+		const std::string bom = "\xEF\xBB\xBF";
+		EXPECT_EQ(0, CompareTwo(bom + "abc", "abc", true));
+		EXPECT_EQ(0, CompareTwo("abc", bom + "abc", true));
+		EXPECT_EQ(0, CompareTwo(std::string("\xFF\xFE" "a\0", 4), "a", true));
+		EXPECT_EQ(DIFFCODE::FILE | DIFFCODE::DIFF, CompareTwo("abc", "abcd", true));
+		EXPECT_EQ(DIFFCODE::FILE | DIFFCODE::TEXT | DIFFCODE::SAME, CompareTwo("ab", "ab", true));
+
+		// Byte compare doesn't skip it
+		EXPECT_EQ(DIFFCODE::FILE | DIFFCODE::DIFF, CompareTwo(bom + "abc", "abc"));
+	}
+
+	TEST_F(PrefilterCompareTest, ThreeWay)
+	{
+		const unsigned text = DIFFCODE::FILE | DIFFCODE::TEXT;
+		EXPECT_EQ(text | DIFFCODE::SAME, CompareThree("1", "1", "1"));
+		EXPECT_EQ(text | DIFFCODE::DIFF | DIFFCODE::DIFF3RDONLY, CompareThree("1", "1", "2"));
+		EXPECT_EQ(text | DIFFCODE::DIFF | DIFFCODE::DIFF2NDONLY, CompareThree("1", "2", "1"));
+		EXPECT_EQ(text | DIFFCODE::DIFF | DIFFCODE::DIFF1STONLY, CompareThree("2", "1", "1"));
+		EXPECT_EQ(text | DIFFCODE::DIFF, CompareThree("1", "2", "3"));
+		EXPECT_EQ(DIFFCODE::FILE | DIFFCODE::DIFF | DIFFCODE::DIFF2NDONLY, CompareThree("1", "12", "1"));
+
+		std::string data(3 * PrefilterCompare::SampleSize, 'x');
+		EXPECT_EQ(0, CompareThree(data, data, data));
+	}
+
+}  // namespace
@@ -0,0 +1,148 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "RealityMap.h"
+#include "../UnitTests/Random.h"
+
+namespace
+{
+	// The fixture for testing RealityMap.
+	class RealityMapTest : public testing::Test
+	{
+	protected:
+		RealityMapTest()
+		{
+		}
+
+		virtual ~RealityMapTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+	};
+
+	/** @brief Check the map against the ghost flags of the lines. */
+	void CheckMap(const RealityMap& map, const std::vector<bool>& ghosts)
+	{
+		ASSERT_EQ(static_cast<int>(ghosts.size()), map.GetLineCount());
+		int nReal = 0;
+		int nRuns = 0;
+		for (int i = 0; i < static_cast<int>(ghosts.size()); ++i)
+		{
+			EXPECT_EQ(nReal, map.GetRealLinesBefore(i)) << i;
+			EXPECT_EQ(ghosts[i], map.IsGhost(i)) << i;
+			if (!ghosts[i])
+			{
+				EXPECT_EQ(i, map.GetApparentLine(nReal++)) << i;
+			}
+			if (i == 0 || ghosts[i] != ghosts[i - 1])
+				++nRuns;
+		}
+		EXPECT_EQ(nReal, map.GetRealLinesBefore(static_cast<int>(ghosts.size())));
+		EXPECT_EQ(nReal, map.GetRealLineCount());
+		EXPECT_EQ(nRuns, map.GetRunCount());
+	}
+
+	// An empty map has no lines
+	TEST_F(RealityMapTest, Empty)
+	{
+		RealityMap map;
+		EXPECT_EQ(0, map.GetLineCount());
+		EXPECT_EQ(0, map.GetRealLineCount());
+		EXPECT_EQ(0, map.GetRealLinesBefore(0));
+		map.Insert(0, 3, false);
+		map.Clear();
+		EXPECT_EQ(0, map.GetLineCount());
+	}
+
+	// Ghost lines between real lines
+	TEST_F(RealityMapTest, GhostLines)
+	{
+		RealityMap map;
+		map.Insert(0, 5, false);
+		map.Insert(2, 3, true);
+		map.Insert(8, 1, true);
+		// real, real, ghost x3, real x3, ghost,
+		CheckMap(map, { false, false, true, true, true, false, false, false, true });
+		EXPECT_EQ(2, map.GetRealLinesBefore(3));
+		EXPECT_EQ(5, map.GetApparentLine(2));
+		map.Erase(1, 6);
+		CheckMap(map, { false, false, false, true });
+	}
+
+	// Neighbouring runs of the same kind become one run
+	TEST_F(RealityMapTest, JoinRuns)
+	{
+		RealityMap map;
+		map.Insert(0, 5, false);
+		map.Insert(2, 3, false);
+		EXPECT_EQ(1, map.GetRunCount());
+		map.Insert(4, 2, true);
+		EXPECT_EQ(3, map.GetRunCount());
+		map.Erase(3, 7);
+		CheckMap(map, { false, false, false, false, false, false });
+		map.Insert(6, 1, true);
+		map.Insert(7, 2, true);
+		CheckMap(map, { false, false, false, false, false, false, true, true, true });
+	}
+
+	// Same lines as a vector of flags after random inserts and erases
+	TEST_F(RealityMapTest, SameAsFlags)
+	{
+		Random random(1);
+		for (int round = 0; round < 20; ++round)
+		{
+			RealityMap map;
+			std::vector<bool> ghosts;
+			for (int step = 0; step < 300; ++step)
+			{
+				const int nLines = static_cast<int>(ghosts.size());
+				if (random(3) != 0 || nLines == 0)
+				{
+					const int nLine = random(nLines + 1);
+					const int nCount = random(6);
+					const bool bGhost = random(2) != 0;
+					map.Insert(nLine, nCount, bGhost);
+					ghosts.insert(ghosts.begin() + nLine, nCount, bGhost);
+				}
+				else
+				{
+					const int nFirst = random(nLines + 1);
+					const int nLast = nFirst + random(nLines - nFirst + 1);
+					map.Erase(nFirst, nLast);
+					ghosts.erase(ghosts.begin() + nFirst, ghosts.begin() + nLast);
+				}
+			}
+			CheckMap(map, ghosts);
+		}
+	}
+
+	TEST_F(RealityMapTest, DISABLED_ManyRuns)
+	{
+		Random random(2);
+		RealityMap map;
+		for (int i = 0; i < 200000; ++i)
+			map.Insert(map.GetLineCount(), 1 + random(20), i % 2 != 0);
+		const int nLines = map.GetLineCount();
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < 100000; ++i)
+		{
+			const int nLine = random(nLines);
+			map.Insert(nLine, 3, true);
+			map.Erase(nLine, nLine + 3);
+			map.GetApparentLine(map.GetRealLinesBefore(nLine) % map.GetRealLineCount());
+		}
+		auto end = std::chrono::steady_clock::now();
+		printf("%d lines, 100000 edits: %lld ms\n", nLines,
+			static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()));
+	}
+
+}  // namespace
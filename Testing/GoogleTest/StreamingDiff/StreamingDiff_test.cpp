@@ -0,0 +1,233 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <io.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include "diff.h"
+#include "../UnitTests/DiffBuffers.h"
+#include "StreamingDiff.h"
+#include "../UnitTests/Random.h"
+
+namespace
+{
+	struct TempFile
+	{
+		TempFile(const std::string& filename, const std::string& data) : m_filename(filename)
+		{
+			std::ofstream ostr(filename.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
+			ostr.write(data.data(), data.size());
+		}
+		~TempFile()
+		{
+			remove(m_filename.c_str());
+		}
+		std::string m_filename;
+	};
+
+	void SetFlags(int style, bool ignoreCase, int whitespace, bool ignoreEol)
+	{
+		output_style = style;
+		context = 3;
+		no_diff_means_no_output = 1;
+		always_text_flag = 0;
+		ignore_blank_lines_flag = 0;
+		ignore_case_flag = ignoreCase;
+		ignore_space_change_flag = whitespace == 1;
+		ignore_all_space_flag = whitespace == 2;
+		ignore_eol_diff = ignoreEol;
+		ignore_some_changes = ignoreCase || whitespace != 0 || ignoreEol;
+		length_varies = whitespace != 0;
+	}
+
+	/** @brief Print edit script the way @p print does into a string. */
+	template<class Print>
+	std::string Output(Print print)
+	{
+		EXPECT_EQ(0, fopen_s(&outfile, "_tmp_out_.txt", "w+b"));
+		print();
+		std::string text;
+		rewind(outfile);
+		char buf[4096];
+		for (size_t n; (n = fread(buf, 1, sizeof(buf), outfile)) > 0; )
+			text.append(buf, n);
+		fclose(outfile);
+		outfile = nullptr;
+		remove("_tmp_out_.txt");
+		return text;
+	}
+
+	/** @brief Output of diffutils comparing the texts in memory. */
+	std::string DiffInMemory(const std::string& text0, const std::string& text1)
+	{
+		file_data inf[2];
+		OpenBuffers(inf, text0, text1);
+		int bin_status = 0;
+		change *script = diff_2_files(inf, 0, &bin_status, 0, nullptr);
+		std::string output = Output([script]()
+			{
+				if (output_style == OUTPUT_NORMAL)
+					print_normal_script(script);
+				else
+					print_context_script(script, output_style == OUTPUT_UNIFIED);
+			});
+		for (change *e = script, *next; e != nullptr; e = next)
+		{
+			next = e->link;
+			free(e);
+		}
+		cleanup_file_buffers(inf);
+		return output;
+	}
+
+	/** @brief Files opened as for diff_2_files(). */
+	struct Files
+	{
+		Files(const std::string& text0, const std::string& text1)
+			: m_file0("_tmp0_.txt", text0), m_file1("_tmp1_.txt", text1)
+		{
+			memset(inf, 0, sizeof(inf));
+			const char *names[2] = { "_tmp0_.txt", "_tmp1_.txt" };
+			for (int i = 0; i < 2; ++i)
+			{
+				inf[i].name = "";
+				_sopen_s(&inf[i].desc, names[i], O_RDONLY | O_BINARY, _SH_DENYWR, _S_IREAD);
+				_fstat64(inf[i].desc, &inf[i].stat);
+			}
+		}
+		~Files()
+		{
+			cleanup_file_buffers(inf);
+			for (int i = 0; i < 2; ++i)
+				_close(inf[i].desc);
+		}
+		TempFile m_file0, m_file1;
+		file_data inf[2];
+	};
+
+	/** @brief Output of StreamingDiff comparing the texts in files. */
+	std::string DiffStreaming(const std::string& text0, const std::string& text1)
+	{
+		Files files(text0, text1);
+		StreamingDiff diff(files.inf);
+		change *script = nullptr;
+		EXPECT_EQ(StreamingDiff::COMPARED, diff.Diff(&script));
+		std::string output = Output([&diff, script]()
+			{
+				EXPECT_TRUE(diff.PrintScript(script));
+			});
+		for (change *e = script, *next; e != nullptr; e = next)
+		{
+			next = e->link;
+			free(e);
+		}
+		return output;
+	}
+
+	/** @brief Text of @p lines lines, and a copy with edits every 50 lines. */
+	void MakeTexts(int lines, unsigned seed, std::string &text0, std::string &text1)
+	{
+		Random random(seed);
+		const char *eols[] = { "\n", "\r\n", "\r" };
+		for (int i = 0; i < lines; ++i)
+		{
+			const unsigned r = random() % 10;
+			// Some long lines, for files of several blocks
+			std::string line = r < 2 ? "}" : r < 3 ? "" : r < 4 ? std::string(random() % 20000, 'x') :
+				"line " + std::to_string(random() % (lines * 2));
+			line += eols[random() % 3];
+			text0 += line;
+			switch (random() % 50)
+			{
+			case 0: break;
+			case 1: text1 += "new " + std::to_string(random()) + "\n" + line; break;
+			case 2: text1 += "changed " + line; break;
+			default: text1 += line; break;
+			}
+		}
+	}
+
+	TEST(StreamingDiff, SameAsDiffutils)
+	{
+		for (int style : { OUTPUT_NORMAL, OUTPUT_CONTEXT, OUTPUT_UNIFIED })
+		{
+			SetFlags(style, false, 0, false);
+			for (unsigned seed = 1; seed <= 4; ++seed)
+			{
+				std::string text0, text1;
+				MakeTexts(2000, seed, text0, text1);
+				EXPECT_TRUE(DiffInMemory(text0, text1) == DiffStreaming(text0, text1)) << "style " << style << " seed " << seed;
+			}
+		}
+		SetFlags(OUTPUT_NORMAL, false, 0, false);
+	}
+
+	TEST(StreamingDiff, FileEnds)
+	{
+		const char *texts[] = { "", "a", "a\n", "a\r", "a \r", "A\t\r\n", "b\na", "b\na\n",
+			"\xEF\xBB\xBF" "a\nb\n", "a\nb\nc\nd\ne\nf\ng\nh", "\xC4" "a\n", "\xE4" "A" };
+		for (int style : { OUTPUT_NORMAL, OUTPUT_CONTEXT, OUTPUT_UNIFIED })
+		{
+			for (int whitespace : { 0, 1, 2 })
+			{
+				for (bool ignore : { false, true })
+				{
+					SetFlags(style, ignore, whitespace, ignore);
+					for (const char *text0 : texts)
+					{
+						for (const char *text1 : texts)
+							EXPECT_EQ(DiffInMemory(text0, text1), DiffStreaming(text0, text1))
+								<< "'" << text0 << "' '" << text1 << "' style " << style
+								<< " whitespace " << whitespace << " ignore " << ignore;
+					}
+				}
+			}
+		}
+		SetFlags(OUTPUT_NORMAL, false, 0, false);
+	}
+
+	TEST(StreamingDiff, IgnoreOptions)
+	{
+		const std::string text0 = "Abc def\r\nabc  def\n\tabc def \nend";
+		const std::string text1 = "abc def\nabc def\r\nabc def\nEND";
+		for (const std::string& text : { text1, text1 + "\n" })
+		{
+			for (int whitespace : { 0, 1, 2 })
+			{
+				for (bool ignoreCase : { false, true })
+				{
+					for (bool ignoreEol : { false, true })
+					{
+						SetFlags(OUTPUT_UNIFIED, ignoreCase, whitespace, ignoreEol);
+						EXPECT_EQ(DiffInMemory(text0, text), DiffStreaming(text0, text))
+							<< "whitespace " << whitespace << " case " << ignoreCase << " eol " << ignoreEol;
+					}
+				}
+			}
+		}
+		SetFlags(OUTPUT_UNIFIED, true, 2, true);
+		EXPECT_EQ("", DiffStreaming(text0, text1));
+		SetFlags(OUTPUT_NORMAL, false, 0, false);
+	}
+
+	TEST(StreamingDiff, NotText)
+	{
+		SetFlags(OUTPUT_UNIFIED, false, 0, false);
+		const std::string binary("abc\n\0def\n", 9);
+		const std::string utf16("\xFF\xFE" "a\0\n\0", 6);
+		for (const std::string *text : { &binary, &utf16 })
+		{
+			Files files("abc\n", *text);
+			StreamingDiff diff(files.inf);
+			change *script = nullptr;
+			EXPECT_EQ(StreamingDiff::NOT_STREAMED, diff.Diff(&script));
+			EXPECT_EQ(nullptr, script);
+		}
+		SetFlags(OUTPUT_NORMAL, false, 0, false);
+	}
+
+}  // namespace
@@ -0,0 +1,252 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <windows.h>
+#include <tchar.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "stringdiffs.h"
+#include "BitParallelLcs.h"
+#include "../UnitTests/Random.h"
+
+using std::vector;
+
+namespace
+{
+	// The fixture for testing the bit-parallel LCS and the long lines it compares.
+	class StringDiffsBitParallelTest : public testing::Test
+	{
+	protected:
+		StringDiffsBitParallelTest()
+		{
+			strdiff::Init();
+		}
+
+		virtual ~StringDiffsBitParallelTest()
+		{
+			strdiff::Close();
+		}
+	};
+
+	/** @brief LCS length by dynamic programming, cell by cell. */
+	int LcsLength(const vector<unsigned>& seq1, const vector<unsigned>& seq2)
+	{
+		vector<int> row(seq2.size() + 1, 0);
+		for (size_t i = 0; i < seq1.size(); ++i)
+		{
+			int diag = 0;
+			for (size_t j = 0; j < seq2.size(); ++j)
+			{
+				const int up = row[j + 1];
+				row[j + 1] = seq1[i] == seq2[j] ? diag + 1 : (std::max)(up, row[j]);
+				diag = up;
+			}
+		}
+		return row[seq2.size()];
+	}
+
+	/** @brief Check the edit script turns @p seq1 into @p seq2. */
+	void CheckScript(const vector<unsigned>& seq1, const vector<unsigned>& seq2, const vector<char>& edscript)
+	{
+		size_t i = 0, j = 0;
+		for (char op : edscript)
+		{
+			if (op == '=')
+			{
+				ASSERT_LT(i, seq1.size());
+				ASSERT_LT(j, seq2.size());
+				ASSERT_EQ(seq1[i++], seq2[j++]);
+			}
+			else if (op == '-')
+				++i;
+			else
+			{
+				ASSERT_EQ('+', op);
+				++j;
+			}
+		}
+		EXPECT_EQ(seq1.size(), i);
+		EXPECT_EQ(seq2.size(), j);
+	}
+
+	/** @brief A sequence, and a copy with some elements changed, deleted and inserted. */
+	void MakeSequences(Random& random, int length, unsigned nSymbols, vector<unsigned>& seq1, vector<unsigned>& seq2)
+	{
+		seq1.clear();
+		seq2.clear();
+		for (int i = 0; i < length; ++i)
+			seq1.push_back(random(nSymbols));
+		const unsigned edits = 1 + random(10);
+		for (unsigned s : seq1)
+		{
+			switch (random(edits + 3))
+			{
+			case 0: break;
+			case 1: seq2.push_back(random(nSymbols)); break;
+			case 2: seq2.push_back(random(nSymbols)); seq2.push_back(s); break;
+			default: seq2.push_back(s); break;
+			}
+		}
+	}
+
+	/** @brief Text of a string outside the differences of its side. */
+	String Unchanged(const String& str, const std::vector<strdiff::wdiff>& diffs, int side)
+	{
+		String text;
+		int pos = 0;
+		for (const strdiff::wdiff& diff : diffs)
+		{
+			EXPECT_LE(pos, diff.begin[side]);
+			text += str.substr(pos, diff.begin[side] - pos);
+			pos = diff.end[side] + 1;
+		}
+		return text + str.substr(pos);
+	}
+
+	/** @brief A line of minified code, and a copy with some edits. */
+	void MakeMinified(Random& random, int length, String& str1, String& str2)
+	{
+		const TCHAR *tokens[] = { _T("a"), _T("b"), _T("var"), _T("="), _T("("), _T(")"), _T(";"), _T(","),
+			_T("function"), _T("{"), _T("}"), _T("return"), _T("+"), _T("1"), _T("0"), _T("."), _T("x") };
+		const unsigned nTokens = sizeof(tokens) / sizeof(tokens[0]);
+		while (static_cast<int>(str1.length()) < length)
+		{
+			const String token = tokens[random(nTokens)];
+			str1 += token;
+			switch (random(40))
+			{
+			case 0: break;
+			case 1: str2 += tokens[random(nTokens)]; break;
+			case 2: str2 += token + tokens[random(nTokens)]; break;
+			default: str2 += token; break;
+			}
+		}
+	}
+
+	// Same LCS length as the dynamic programming, and valid edit scripts
+	TEST_F(StringDiffsBitParallelTest, SameAsDynamicProgramming)
+	{
+		Random random(1);
+		for (int length : { 0, 1, 2, 63, 64, 65, 127, 128, 129, 200, 500 })
+		{
+			for (unsigned nSymbols : { 1u, 2u, 4u, 26u, 1000u })
+			{
+				vector<unsigned> seq1, seq2;
+				MakeSequences(random, length, nSymbols, seq1, seq2);
+				const int lcs = LcsLength(seq1, seq2);
+				EXPECT_EQ(lcs, strdiff::BitParallelLcs::Length(seq1, seq2, nSymbols)) << length << " " << nSymbols;
+				EXPECT_EQ(lcs, strdiff::BitParallelLcs::Length(seq2, seq1, nSymbols)) << length << " " << nSymbols;
+				vector<char> edscript;
+				EXPECT_EQ(lcs, strdiff::BitParallelLcs::EditScript(seq1, seq2, nSymbols, edscript)) << length << " " << nSymbols;
+				CheckScript(seq1, seq2, edscript);
+			}
+		}
+	}
+
+	// Runs of the same symbol, where many alignments are longest
+	TEST_F(StringDiffsBitParallelTest, RepeatedSymbols)
+	{
+		for (int length : { 3, 100, 1000, 3000 })
+		{
+			vector<unsigned> seq1(1, 1), seq2(1, 2);
+			seq1.insert(seq1.end(), length, 0);
+			seq2.insert(seq2.end(), length, 0);
+			seq1.insert(seq1.end(), { 3, 4, 3 });
+			seq2.push_back(3);
+			seq1.insert(seq1.end(), length, 0);
+			seq2.insert(seq2.end(), length, 0);
+			seq1.push_back(1);
+			seq2.push_back(2);
+			vector<char> edscript;
+			EXPECT_EQ(2 * length + 1, strdiff::BitParallelLcs::EditScript(seq1, seq2, 5, edscript));
+			CheckScript(seq1, seq2, edscript);
+			EXPECT_EQ(2 * length + 1, strdiff::BitParallelLcs::Length(seq1, seq2, 5));
+		}
+	}
+
+	// Edit scripts too big to trace back at once are split and still optimal
+	TEST_F(StringDiffsBitParallelTest, SplitScript)
+	{
+		Random random(2);
+		vector<unsigned> seq1, seq2;
+		MakeSequences(random, 20000, 50, seq1, seq2);
+		ASSERT_LT(strdiff::BitParallelLcs::MaxTraceWords, static_cast<int64_t>(seq2.size()) * (seq1.size() / 64));
+		vector<char> edscript;
+		const int lcs = strdiff::BitParallelLcs::EditScript(seq1, seq2, 50, edscript);
+		EXPECT_EQ(strdiff::BitParallelLcs::Length(seq1, seq2, 50), lcs);
+		CheckScript(seq1, seq2, edscript);
+	}
+
+	// Word diffs of long lines with many differences leave the same text unchanged
+	TEST_F(StringDiffsBitParallelTest, LongLineWords)
+	{
+		strdiff::SetBreakChars(_T(".,;:()[]{}=+"));
+		Random random(3);
+		for (int length : { 1000, 20000 })
+		{
+			String str1, str2;
+			MakeMinified(random, length, str1, str2);
+			std::vector<strdiff::wdiff> diffs;
+			strdiff::ComputeWordDiffs(str1, str2, true, 0, 1, false, &diffs);
+			EXPECT_LT(1u, diffs.size());
+			EXPECT_EQ(Unchanged(str1, diffs, 0), Unchanged(str2, diffs, 1));
+		}
+	}
+
+	// Long differences at byte level are split into the differences of their characters
+	TEST_F(StringDiffsBitParallelTest, LongLineBytes)
+	{
+		Random random(4);
+		String str1, str2;
+		MakeMinified(random, 5000, str1, str2);
+		for (bool case_sensitive : { true, false })
+		{
+			std::vector<strdiff::wdiff> diffs;
+			// No spaces or break characters, the line is a single word
+			strdiff::ComputeWordDiffs(str1, str2, case_sensitive, 0, 0, true, &diffs);
+			EXPECT_LT(1u, diffs.size());
+			EXPECT_EQ(Unchanged(str1, diffs, 0), Unchanged(str2, diffs, 1));
+		}
+
+		// Whitespace runs ignored as it is for shorter differences
+		String spaced1 = _T("x") + str1 + _T(" \t ") + str1 + _T("x");
+		String spaced2 = _T("y") + str1 + _T(" ") + str1 + _T("y");
+		std::vector<strdiff::wdiff> diffs;
+		strdiff::ComputeWordDiffs(spaced1, spaced2, true, 1, 0, true, &diffs);
+		ASSERT_EQ(2u, diffs.size());
+		EXPECT_EQ(0, diffs[0].begin[0]);
+		EXPECT_EQ(0, diffs[0].end[0]);
+		EXPECT_EQ(static_cast<int>(spaced1.length()) - 1, diffs[1].begin[0]);
+		diffs.clear();
+		strdiff::ComputeWordDiffs(spaced1, spaced2, true, 0, 0, true, &diffs);
+		EXPECT_EQ(Unchanged(spaced1, diffs, 0), Unchanged(spaced2, diffs, 1));
+	}
+
+	/** @brief Time word and byte level diffs of long minified lines. */
+	void TimeLongLines(int length, int breakType, bool byte_level)
+	{
+		strdiff::SetBreakChars(_T(".,;:()[]{}=+"));
+		Random random(5);
+		String str1, str2;
+		MakeMinified(random, length, str1, str2);
+		std::vector<strdiff::wdiff> diffs;
+		auto start = std::chrono::steady_clock::now();
+		strdiff::ComputeWordDiffs(str1, str2, true, 0, breakType, byte_level, &diffs);
+		auto end = std::chrono::steady_clock::now();
+		printf("%d chars, break type %d, byte level %d: %d diffs %lld ms\n", length, breakType, byte_level,
+			static_cast<int>(diffs.size()),
+			static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()));
+	}
+
+	TEST_F(StringDiffsBitParallelTest, DISABLED_LongLines)
+	{
+		for (int length : { 10000, 100000, 300000 })
+		{
+			TimeLongLines(length, 1, false);
+			TimeLongLines(length, 1, true);
+			TimeLongLines(length, 0, true);
+		}
+	}
+
+}  // namespace
@@ -0,0 +1,221 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include "UniFile.h"
+#include "unicoder.h"
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../UnitTests/Random.h"
+
+namespace
+{
+	struct TempFile
+	{
+		TempFile(const std::string& filename, const std::string& data) : m_filename(filename)
+		{
+			std::ofstream ostr(filename.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
+			ostr.write(data.data(), data.size());
+		}
+		~TempFile()
+		{
+			remove(m_filename.c_str());
+		}
+		std::string m_filename;
+	};
+
+	// The fixture for testing UniFile.
+	class UniFileTest : public testing::Test
+	{
+	protected:
+		UniFileTest()
+		{
+		}
+
+		virtual ~UniFileTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+	};
+
+	/** @brief Lines of a file, with their EOLs, and its statistics. */
+	struct Lines
+	{
+		std::vector<String> lines;
+		UniFile::txtstats stats;
+		int lineno;
+	};
+
+	bool Open(UniMemFile& file, const std::string& filename, int codepage)
+	{
+		if (!file.OpenReadOnly(String(filename.begin(), filename.end())))
+			return false;
+		file.SetCodepage(codepage);
+		return true;
+	}
+
+	/** @brief Read lines one by one, as documents were loaded before. */
+	Lines ReadByLine(const std::string& filename, int codepage)
+	{
+		Lines result;
+		UniMemFile file;
+		EXPECT_TRUE(Open(file, filename, codepage));
+		String line, eol, preveol = _T("\n");
+		bool done = false;
+		do
+		{
+			bool lossy = false;
+			done = !file.ReadString(line, eol, &lossy);
+			if (done && preveol.empty())
+				break;
+			result.lines.push_back(line + eol);
+			preveol = eol;
+		} while (!done);
+		result.stats = file.GetTxtStats();
+		result.lineno = file.GetLineNumber();
+		return result;
+	}
+
+	/** @brief Read all lines at once. */
+	Lines ReadAll(const std::string& filename, int codepage)
+	{
+		Lines result;
+		UniMemFile file;
+		EXPECT_TRUE(Open(file, filename, codepage));
+		std::unique_ptr<TCHAR[]> text;
+		std::vector<size_t> lineStarts;
+		EXPECT_TRUE(file.ReadAllLines(text, lineStarts));
+		for (size_t i = 0; i + 1 < lineStarts.size(); ++i)
+		{
+			const size_t length = lineStarts[i + 1] - lineStarts[i] - 1;
+			EXPECT_EQ(0, text[lineStarts[i] + length]);
+			result.lines.push_back(String(&text[lineStarts[i]], length));
+		}
+		result.stats = file.GetTxtStats();
+		result.lineno = file.GetLineNumber();
+		return result;
+	}
+
+	/** @brief Text of random characters, EOLs and zeros in an encoding. */
+	std::string MakeText(Random& random, int length, int codepage)
+	{
+		std::string data;
+		for (int i = 0; i < length; ++i)
+		{
+			unsigned ch;
+			const unsigned kind = random(20);
+			if (kind < 8)
+				ch = 'a' + random(26);
+			else if (kind < 10)
+				ch = '\r';
+			else if (kind < 12)
+				ch = '\n';
+			else if (kind == 12)
+				ch = 0;
+			else if (kind < 16)
+				ch = 0x80 + random(0x780);
+			else if (kind < 18)
+				ch = 0x800 + random(0xD000);
+			else
+				ch = 0x10000 + random(0x10000);
+			if (codepage == ucr::CP_UTF_8)
+			{
+				unsigned char buf[8], *p = buf;
+				ucr::to_utf8_advance(ch, p);
+				data.append(reinterpret_cast<char *>(buf), p - buf);
+			}
+			else if (codepage == ucr::CP_UCS2LE || codepage == ucr::CP_UCS2BE)
+			{
+				if (ch >= 0x10000)
+					ch = 0x4E00;
+				const char hi = static_cast<char>(ch >> 8), lo = static_cast<char>(ch & 0xFF);
+				data += codepage == ucr::CP_UCS2LE ? lo : hi;
+				data += codepage == ucr::CP_UCS2LE ? hi : lo;
+			}
+			else
+			{
+				data += static_cast<char>(ch & 0xFF);
+			}
+		}
+		return data;
+	}
+
+	void ExpectSame(const Lines& expected, const Lines& actual)
+	{
+		EXPECT_EQ(expected.lines, actual.lines);
+		EXPECT_EQ(expected.stats.ncrs, actual.stats.ncrs);
+		EXPECT_EQ(expected.stats.nlfs, actual.stats.nlfs);
+		EXPECT_EQ(expected.stats.ncrlfs, actual.stats.ncrlfs);
+		EXPECT_EQ(expected.stats.nzeros, actual.stats.nzeros);
+		EXPECT_EQ(expected.stats.nlosses, actual.stats.nlosses);
+		EXPECT_EQ(expected.lineno, actual.lineno);
+	}
+
+	// Reading all lines at once gives the lines read one by one
+	TEST_F(UniFileTest, ReadAllLines)
+	{
+		const int codepages[] = { ucr::CP_UTF_8, ucr::CP_UCS2LE, ucr::CP_UCS2BE, 1252 };
+		Random random(1);
+		for (int codepage : codepages)
+		{
+			for (int length : { 1, 2, 15, 16, 17, 100, 3000 })
+			{
+				for (int i = 0; i < 10; ++i)
+				{
+					TempFile file("_tmp_test.txt", MakeText(random, length, codepage));
+					ExpectSame(ReadByLine(file.m_filename, codepage), ReadAll(file.m_filename, codepage));
+				}
+			}
+		}
+	}
+
+	// Bad UTF-8 is read as ReadString() reads it, EOL bytes in bad
+	// sequences included
+	TEST_F(UniFileTest, ReadAllLinesInvalidUtf8)
+	{
+		const std::string cases[] = {
+			"abc\xE2\x82",     // sequence cut by the end of the file
+			"a\xE2\n\nb",      // LF taken as trail byte
+			"a\xC3\r\nb",      // CR taken as trail byte, then LF
+			"a\xC0\x8D\nb",    // overlong CR
+			"a\xC0\x80z",      // overlong zero
+			"\xF8\x88\x80\x80\x80", // five byte sequence
+			"\xF4\x90\x80\x80\xF7\xBF\xBF\xBF", // outside of UTF-16
+			"\x80\xBF\xFE\xFF\r",
+		};
+		for (const auto& data : cases)
+		{
+			TempFile file("_tmp_test.txt", data);
+			ExpectSame(ReadByLine(file.m_filename, ucr::CP_UTF_8), ReadAll(file.m_filename, ucr::CP_UTF_8));
+		}
+
+		Random random(2);
+		for (int i = 0; i < 200; ++i)
+		{
+			std::string data;
+			const int length = 1 + random(300);
+			for (int j = 0; j < length; ++j)
+			{
+				const unsigned kind = random(8);
+				if (kind < 3)
+					data += static_cast<char>('a' + random(26));
+				else if (kind == 3)
+					data += random(2) ? '\r' : '\n';
+				else if (kind == 4)
+					data += static_cast<char>(0xC0 + random(2));
+				else
+					data += static_cast<char>(random(256));
+			}
+			TempFile file("_tmp_test.txt", data);
+			ExpectSame(ReadByLine(file.m_filename, ucr::CP_UTF_8), ReadAll(file.m_filename, ucr::CP_UTF_8));
+		}
+	}
+
+}  // namespace
@@ -0,0 +1,37 @@
+/**
+ * @file  DiffBuffers.h
+ *
+ * @brief Texts in memory for tests of diffutils.
+ */
+#pragma once
+
+#include <sys/stat.h>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "diff.h"
+
+/**
+ * @brief Set up @p inf for diffutils to read two texts from memory.
+ * The buffers are allocated like DiffFileData::OpenBuffers() does, with room
+ * for the newline and sentinel diffutils appends, and are freed by
+ * cleanup_file_buffers().
+ */
+inline void OpenBuffers(file_data inf[2], const std::string& text0, const std::string& text1)
+{
+	memset(inf, 0, 2 * sizeof(file_data));
+	const std::string *texts[2] = { &text0, &text1 };
+	for (int i = 0; i < 2; ++i)
+	{
+		size_t len = texts[i]->length();
+		inf[i].name = "";
+		inf[i].desc = i;
+		inf[i].bufsize = len + sizeof(unsigned) + 1;
+		inf[i].buffer = static_cast<char *>(malloc(inf[i].bufsize));
+		memcpy(inf[i].buffer, texts[i]->data(), len);
+		inf[i].buffered_chars = len;
+		inf[i].stat.st_mode = _S_IFREG;
+		inf[i].stat.st_size = len;
+		inf[i].in_memory = 1;
+	}
+}
@@ -0,0 +1,17 @@
+/**
+ * @file  Random.h
+ *
+ * @brief Pseudo-random numbers for tests.
+ */
+#pragma once
+
+/** @brief Pseudo-random numbers, the same on every run. */
+struct Random
+{
+	explicit Random(unsigned seed) : m_seed(seed) {}
+	/** @brief Next number, below 2^24. */
+	unsigned operator()() { m_seed = m_seed * 1103515245 + 12345; return m_seed >> 8; }
+	/** @brief Next number below @p n. */
+	unsigned operator()(unsigned n) { return (*this)() % n; }
+	unsigned m_seed;
+};
@@ -0,0 +1,207 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include "diff.h"
+#include "../UnitTests/DiffBuffers.h"
+#include "../UnitTests/Random.h"
+
+namespace
+{
+	/** @brief Result of diff_2_files() for a pair of in-memory texts. */
+	struct Diff
+	{
+		Diff(const std::string& text0, const std::string& text1, int algorithm, int threads = 0)
+		{
+			OpenBuffers(inf, text0, text1);
+			always_text_flag = 1;
+			output_style = OUTPUT_NORMAL;
+			ignore_case_flag = 0;
+			ignore_space_change_flag = 0;
+			ignore_all_space_flag = 0;
+			ignore_eol_diff = 0;
+			ignore_blank_lines_flag = 0;
+			ignore_some_changes = 0;
+			length_varies = 0;
+			diff_algorithm = algorithm;
+			diff_threads = threads;
+			int bin_status = 0;
+			script = diff_2_files(inf, 0, &bin_status, 0, nullptr);
+			diff_algorithm = DIFF_ALG_MYERS;
+			diff_threads = 0;
+			always_text_flag = 0;
+		}
+		~Diff()
+		{
+			for (change *e = script, *next; e != nullptr; e = next)
+			{
+				next = e->link;
+				free(e);
+			}
+			cleanup_file_buffers(inf);
+		}
+		/** @brief Number of hunks in the edit script. */
+		int Hunks() const
+		{
+			int n = 0;
+			for (const change *e = script; e != nullptr; e = e->link)
+				++n;
+			return n;
+		}
+		/** @brief Check the lines left unchanged pair up with equal lines. */
+		bool IsValid() const
+		{
+			int i = 0, j = 0;
+			const int n0 = inf[0].buffered_lines, n1 = inf[1].buffered_lines;
+			for (;;)
+			{
+				while (i < n0 && inf[0].changed_flag[i])
+					++i;
+				while (j < n1 && inf[1].changed_flag[j])
+					++j;
+				if (i == n0 || j == n1)
+					return i == n0 && j == n1;
+				if (inf[0].equivs[i++] != inf[1].equivs[j++])
+					return false;
+			}
+		}
+		/** @brief Changed flags of both files. */
+		std::string Changes() const
+		{
+			return std::string(inf[0].changed_flag, inf[0].buffered_lines) +
+				std::string(inf[1].changed_flag, inf[1].buffered_lines);
+		}
+		file_data inf[2];
+		change *script;
+	};
+
+	const int Algorithms[] = { DIFF_ALG_MYERS, DIFF_ALG_MINIMAL, DIFF_ALG_PATIENCE, DIFF_ALG_HISTOGRAM };
+
+	const char Frobnitz0[] =
+		"#include <stdio.h>\n\n"
+		"// Frobs foo heartily\nint frobnitz(int foo)\n{\n    int i;\n    for(i = 0; i < 10; i++)\n    {\n"
+		"        printf(\"Your answer is: \");\n        printf(\"%d\\n\", foo);\n    }\n}\n\n"
+		"int fact(int n)\n{\n    if(n > 1)\n    {\n        return fact(n-1) * n;\n    }\n    return 1;\n}\n\n"
+		"int main(int argc, char **argv)\n{\n    frobnitz(fact(10));\n}\n";
+	const char Frobnitz1[] =
+		"#include <stdio.h>\n\n"
+		"int fib(int n)\n{\n    if(n > 2)\n    {\n        return fib(n-1) + fib(n-2);\n    }\n    return 1;\n}\n\n"
+		"// Frobs foo heartily\nint frobnitz(int foo)\n{\n    int i;\n    for(i = 0; i < 10; i++)\n    {\n"
+		"        printf(\"%d\\n\", foo);\n    }\n}\n\n"
+		"int main(int argc, char **argv)\n{\n    frobnitz(fib(10));\n}\n";
+
+	TEST(diffutils, diff_algorithm_moved_function)
+	{
+		// Myers' algorithm matches braces and blank lines of the two functions
+		for (int algorithm : { DIFF_ALG_MYERS, DIFF_ALG_MINIMAL })
+		{
+			Diff diff(Frobnitz0, Frobnitz1, algorithm);
+			EXPECT_TRUE(diff.IsValid());
+			EXPECT_EQ(9, diff.Hunks());
+		}
+		// Unique lines keep function frobnitz() together
+		for (int algorithm : { DIFF_ALG_PATIENCE, DIFF_ALG_HISTOGRAM })
+		{
+			Diff diff(Frobnitz0, Frobnitz1, algorithm);
+			EXPECT_TRUE(diff.IsValid());
+			ASSERT_EQ(4, diff.Hunks());
+			EXPECT_EQ(0, diff.script->deleted);
+			EXPECT_EQ(9, diff.script->inserted);
+		}
+	}
+
+	TEST(diffutils, diff_algorithm_random)
+	{
+		Random random(1);
+		for (int iter = 0; iter < 500; ++iter)
+		{
+			// Few distinct lines to get many repeated ones
+			const unsigned range = 1 + random() % (iter % 2 ? 10 : 200);
+			std::string text0, text1;
+			for (int n = random() % 200; n > 0; --n)
+			{
+				std::string line = std::to_string(random() % range) + "\n";
+				text0 += line;
+				switch (random() % 8)
+				{
+				case 0: break;
+				case 1: text1 += std::to_string(random() % range) + "\n"; break;
+				default: text1 += line; break;
+				}
+			}
+			int changes[4];
+			for (int algorithm : Algorithms)
+			{
+				Diff diff(text0, text1, algorithm);
+				EXPECT_TRUE(diff.IsValid()) << "algorithm " << algorithm << " iteration " << iter;
+				changes[algorithm] = 0;
+				for (const change *e = diff.script; e != nullptr; e = e->link)
+					changes[algorithm] += e->deleted + e->inserted;
+			}
+			EXPECT_LE(changes[DIFF_ALG_MINIMAL], changes[DIFF_ALG_MYERS]);
+			EXPECT_LE(changes[DIFF_ALG_MINIMAL], changes[DIFF_ALG_PATIENCE]);
+			EXPECT_LE(changes[DIFF_ALG_MINIMAL], changes[DIFF_ALG_HISTOGRAM]);
+		}
+	}
+
+	/** @brief Source-like text of @p lines lines, and a copy with edits every 100 lines. */
+	void MakeSource(int lines, std::string &text0, std::string &text1)
+	{
+		Random random(1);
+		for (int i = 0; i < lines; ++i)
+		{
+			const unsigned r = random() % 10;
+			std::string line = r < 3 ? "}\n" : r < 5 ? "\n" : "line " + std::to_string(random() % (lines * 4)) + "\n";
+			text0 += line;
+			switch (random() % 100)
+			{
+			case 0: break;
+			case 1: text1 += "new " + std::to_string(random()) + "\n" + line; break;
+			default: text1 += line; break;
+			}
+		}
+	}
+
+	TEST(diffutils, diff_segments)
+	{
+		// Large enough to be compared in segments
+		std::string text0, text1;
+		MakeSource(100000, text0, text1);
+		Diff diff1(text0, text1, DIFF_ALG_MYERS, 1);
+		EXPECT_TRUE(diff1.IsValid());
+		for (int threads : { 2, 3, 8 })
+		{
+			Diff diff(text0, text1, DIFF_ALG_MYERS, threads);
+			EXPECT_TRUE(diff.IsValid());
+			EXPECT_TRUE(diff.Changes() == diff1.Changes()) << "threads " << threads;
+		}
+	}
+
+	// Benchmark of comparing files of 2M lines on 1 to all cores,
+	// run with --gtest_also_run_disabled_tests
+	TEST(diffutils, DISABLED_diff_segments_2M)
+	{
+		std::string text0, text1;
+		MakeSource(2000000, text0, text1);
+		const int maxThreads = (std::max)(1, static_cast<int>(std::thread::hardware_concurrency()));
+		for (int threads = 1; ; threads = (std::min)(threads * 2, maxThreads))
+		{
+			auto start = std::chrono::steady_clock::now();
+			{
+				Diff diff(text0, text1, DIFF_ALG_MYERS, threads);
+				EXPECT_NE(nullptr, diff.script);
+			}
+			auto end = std::chrono::steady_clock::now();
+			printf("diff_2_files %2d threads %lld ms\n", threads,
+				static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()));
+			if (threads == maxThreads)
+				break;
+		}
+	}
+
+}  // namespace
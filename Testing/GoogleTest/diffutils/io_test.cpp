@@ -0,0 +1,173 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "diff.h"
+#include "../UnitTests/DiffBuffers.h"
+
+namespace
+{
+	/** @brief Pair of in-memory texts split into lines by read_files(). */
+	struct Texts
+	{
+		Texts(const std::string& text0, const std::string& text1)
+		{
+			OpenBuffers(inf, text0, text1);
+			int bin_file = 0;
+			read_files(inf, 0, &bin_file);
+		}
+		~Texts()
+		{
+			for (int i = 0; i < 2; ++i)
+			{
+				free(inf[i].equivs);
+				free((void *)(inf[i].linbuf + inf[i].linbuf_base));
+				free(inf[i].buffer);
+			}
+		}
+		/** @brief Equivalence class of line @p line of text @p i, counted from first differing line. */
+		int Class(int i, int line) const { return inf[i].equivs[line]; }
+		file_data inf[2];
+	};
+
+	void SetFlags(bool ignoreCase, int whitespace, bool ignoreEol)
+	{
+		always_text_flag = 0;
+		output_style = OUTPUT_NORMAL;
+		no_diff_means_no_output = 1;
+		context = 0;
+		horizon_lines = 0;
+		ignore_case_flag = ignoreCase;
+		ignore_space_change_flag = whitespace == 1;
+		ignore_all_space_flag = whitespace == 2;
+		ignore_eol_diff = ignoreEol;
+		length_varies = whitespace != 0;
+	}
+
+	TEST(diffutils, read_files_lines)
+	{
+		SetFlags(false, 0, false);
+		// Lines of all lengths, so that words and vector blocks end everywhere in them
+		std::string body;
+		for (int len = 1; len <= 70; ++len)
+		{
+			std::string line(len, 'x');
+			body += line + "\r\n" + line + "\r" + line + "\n";
+		}
+		Texts texts("first\n" + body + "last\n", "FIRST\n" + body + "LAST\n");
+		for (int i = 0; i < 2; ++i)
+		{
+			EXPECT_EQ(0, texts.inf[i].prefix_lines);
+			EXPECT_EQ(212, texts.inf[i].buffered_lines);
+			EXPECT_EQ(70, texts.inf[i].count_crlfs);
+			EXPECT_EQ(70, texts.inf[i].count_crs);
+			EXPECT_EQ(72, texts.inf[i].count_lfs);
+			for (int len = 1; len <= 70; ++len)
+			{
+				const int line = 3 * len - 2;
+				EXPECT_EQ(len + 2, texts.inf[i].linbuf[line + 1] - texts.inf[i].linbuf[line]);
+				EXPECT_EQ(len + 1, texts.inf[i].linbuf[line + 2] - texts.inf[i].linbuf[line + 1]);
+				EXPECT_EQ(len + 1, texts.inf[i].linbuf[line + 3] - texts.inf[i].linbuf[line + 2]);
+				EXPECT_NE(texts.Class(i, line), texts.Class(i, line + 1));
+				EXPECT_NE(texts.Class(i, line + 1), texts.Class(i, line + 2));
+			}
+		}
+		for (int line = 1; line < 211; ++line)
+			EXPECT_EQ(texts.Class(0, line), texts.Class(1, line));
+		EXPECT_NE(texts.Class(0, 0), texts.Class(1, 0));
+		EXPECT_NE(texts.Class(0, 211), texts.Class(1, 211));
+	}
+
+	TEST(diffutils, read_files_classes)
+	{
+		const std::string text0 = "Abc def\r\nabc def\nabc  def\nabcdef\nline with a few more words in it\r\nend\n";
+		const std::string text1 = "abc def\nLINE WITH A FEW MORE WORDS IN IT\r\nline with a few more words in it\r\nEND\n";
+
+		SetFlags(false, 0, false);
+		{
+			Texts texts(text0, text1);
+			EXPECT_EQ(6, texts.inf[0].buffered_lines);
+			EXPECT_EQ(4, texts.inf[1].buffered_lines);
+			EXPECT_NE(texts.Class(0, 0), texts.Class(0, 1));
+			EXPECT_EQ(texts.Class(0, 1), texts.Class(1, 0));
+			EXPECT_NE(texts.Class(0, 4), texts.Class(1, 1));
+		}
+
+		SetFlags(true, 0, false);
+		{
+			Texts texts(text0, text1);
+			EXPECT_NE(texts.Class(0, 0), texts.Class(0, 1));
+			EXPECT_EQ(texts.Class(0, 4), texts.Class(1, 1));
+		}
+
+		SetFlags(true, 0, true);
+		{
+			Texts texts(text0, text1);
+			EXPECT_EQ(texts.Class(0, 0), texts.Class(0, 1));
+			EXPECT_EQ(texts.Class(0, 0), texts.Class(1, 0));
+		}
+
+		SetFlags(false, 1, false);
+		{
+			Texts texts(text0, text1);
+			EXPECT_EQ(texts.Class(0, 1), texts.Class(0, 2));
+			EXPECT_NE(texts.Class(0, 1), texts.Class(0, 3));
+		}
+
+		SetFlags(false, 2, false);
+		{
+			Texts texts(text0, text1);
+			EXPECT_EQ(texts.Class(0, 1), texts.Class(0, 3));
+		}
+		SetFlags(false, 0, false);
+	}
+
+	std::string MakeLog(int lines, int changeEvery)
+	{
+		std::string text;
+		char line[256];
+		for (int i = 0; i < lines; ++i)
+		{
+			int n = sprintf_s(line, "2020-01-%02d 12:%02d:%02d.%03d [Thread-%d] %s  com.example.Service - Request %d handled in %d ms\r\n",
+				i / 100000 % 28 + 1, i / 3600 % 60, i / 60 % 60, i % 1000, i % 17,
+				(i % 5) ? "INFO" : "Debug", (changeEvery && i % changeEvery == 0) ? i + 1 : i, i * 7 % 300);
+			text.append(line, n);
+		}
+		return text;
+	}
+
+	// Benchmark of splitting and hashing two logs of 500k lines with each
+	// ignore option, run with --gtest_also_run_disabled_tests
+	TEST(diffutils, DISABLED_read_files_500k)
+	{
+		const std::string text0 = MakeLog(500000, 0);
+		const std::string text1 = MakeLog(500000, 1000);
+		const struct { const char *name; bool ignoreCase; int whitespace; bool ignoreEol; } variants[] =
+		{
+			{ "", false, 0, false },
+			{ "-i", true, 0, false },
+			{ "-b", false, 1, false },
+			{ "-i -b", true, 1, false },
+			{ "-w", false, 2, false },
+			{ "-i -w", true, 2, false },
+			{ "--strip-trailing-cr", false, 0, true },
+		};
+		for (const auto& variant : variants)
+		{
+			SetFlags(variant.ignoreCase, variant.whitespace, variant.ignoreEol);
+			auto start = std::chrono::steady_clock::now();
+			{
+				Texts texts(text0, text1);
+				EXPECT_NE(0, texts.inf[0].buffered_lines);
+			}
+			auto end = std::chrono::steady_clock::now();
+			printf("read_files %-20s %lld ms\n", variant.name,
+				static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()));
+		}
+		SetFlags(false, 0, false);
+	}
+
+}  // namespace
@@ -0,0 +1,19 @@
+/**
+ * @file  stdafx.h
+ *
+ * @brief Stands in for the MFC precompiled header of editlib, for testing
+ * editlib classes which don't use MFC.
+ */
+#pragma once
+
+#include "pch.h"
+#include <windows.h>
+#include <cassert>
+
+#ifndef ASSERT
+#define ASSERT(f) assert(f)
+#endif
+
+#ifndef DEBUG_NEW
+#define DEBUG_NEW new
+#endif